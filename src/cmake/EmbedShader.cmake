@@ -0,0 +1,74 @@
+# Compiles a GLSL shader to SPIR-V and writes it to a header as a constexpr array, together with
+# the hash GpuShaderCache uses for it. Run by lxd_embed_shader() in CMakeLists.txt with:
+#   GLSLC, SPIRV_OPT  paths to the tools from the Vulkan SDK
+#   SOURCE, HEADER    the GLSL shader and the header to write
+#   NAME              name of the array, the hash is NAME followed by Hash
+#   STRIP_DEBUG       1 to optimize and strip the debug info, 0 for debug builds
+
+cmake_minimum_required( VERSION 3.13 )
+
+get_filename_component( SOURCE_NAME ${SOURCE} NAME )
+get_filename_component( SOURCE_EXT ${SOURCE} EXT )
+get_filename_component( HEADER_DIR ${HEADER} DIRECTORY )
+set( SPIRV ${HEADER}.spv )
+file( MAKE_DIRECTORY ${HEADER_DIR} )
+
+# VkShaderStageFlagBits, the stage is part of the hash.
+if ( SOURCE_EXT STREQUAL ".vert" )
+	set( STAGE 1 )
+elseif ( SOURCE_EXT STREQUAL ".frag" )
+	set( STAGE 16 )
+elseif ( SOURCE_EXT STREQUAL ".comp" )
+	set( STAGE 32 )
+else()
+	message( FATAL_ERROR "Unknown shader stage: ${SOURCE}" )
+endif()
+
+if ( STRIP_DEBUG )
+	set( GLSLC_FLAGS -O )
+else()
+	set( GLSLC_FLAGS -O0 -g )
+endif()
+
+execute_process( COMMAND ${GLSLC} --target-env=vulkan1.0 ${GLSLC_FLAGS} -o ${SPIRV} ${SOURCE}
+	RESULT_VARIABLE RESULT )
+if ( NOT RESULT EQUAL 0 )
+	message( FATAL_ERROR "Failed to compile ${SOURCE}" )
+endif()
+
+# glslc keeps the names and source info even when optimizing.
+if ( STRIP_DEBUG )
+	execute_process( COMMAND ${SPIRV_OPT} --strip-debug -o ${SPIRV} ${SPIRV}
+		RESULT_VARIABLE RESULT )
+	if ( NOT RESULT EQUAL 0 )
+		message( FATAL_ERROR "Failed to strip ${SPIRV}" )
+	endif()
+endif()
+
+file( READ ${SPIRV} SPIRV_HEX HEX )
+string( REGEX MATCHALL ".." SPIRV_BYTES "${SPIRV_HEX}" )
+
+# djb2 over the stage and the bytes, as in GpuShaderCache::Hash().
+set( HASH 5381 )
+math( EXPR HASH "( ${HASH} * 33 + ${STAGE} ) & 0xFFFFFFFF" )
+foreach( BYTE ${SPIRV_BYTES} )
+	math( EXPR HASH "( ${HASH} * 33 + 0x${BYTE} ) & 0xFFFFFFFF" )
+endforeach()
+
+# SPIR-V words are little-endian in the file, eight words per line.
+string( REGEX REPLACE "(..)(..)(..)(..)" "0x\\4\\3\\2\\1, " WORDS "${SPIRV_HEX}" )
+set( WORD "0x........, " )
+set( LINE "${WORD}${WORD}${WORD}${WORD}${WORD}${WORD}${WORD}0x........," )
+string( REGEX REPLACE "(${LINE}) " "\\1\n    " WORDS "${WORDS}" )
+string( STRIP "${WORDS}" WORDS )
+string( REGEX REPLACE ",$" "" WORDS "${WORDS}" )
+
+file( WRITE ${HEADER}
+	"// Generated from ${SOURCE_NAME} by EmbedShader.cmake, do not edit.\n"
+	"#pragma once\n"
+	"\n"
+	"#include <stdint.h>\n"
+	"\n"
+	"static constexpr uint32_t ${NAME}[] = {\n"
+	"    ${WORDS} };\n"
+	"static constexpr unsigned int ${NAME}Hash = ${HASH}u;\n" )
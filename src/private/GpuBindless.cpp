@@ -0,0 +1,258 @@
+#include "GpuBindless.hpp"
+#include "GpuBuffer.hpp"
+#include "GpuContext.hpp"
+#include "GpuDevice.hpp"
+#include "GpuGraphicsProgram.hpp"
+#include "GpuTexture.hpp"
+#include <algorithm>
+#include <climits>
+#include <iterator>
+
+namespace lxd
+{
+
+// What is left of a limit after the descriptors that set 0 of a program may use, including the
+// buffer of the spilled push constants.
+static int BindlessLimit( const uint32_t limit )
+{
+    const uint32_t reserved = MAX_PROGRAM_PARMS + 1;
+    return ( limit > reserved ) ? (int)std::min( limit - reserved, (uint32_t)INT_MAX ) : 0;
+}
+
+GpuBindlessTable::GpuBindlessTable( GpuContext* context ) : context( *context )
+{
+    GpuDevice* device = context->device;
+    assert( device->supportsBindless );
+
+    // The update-after-bind limits apply to the whole pipeline layout, so some room is left for
+    // the descriptors of the program itself. Samplers are not resources, but the textures and
+    // buffers share the per stage resource limit.
+    const VkPhysicalDeviceDescriptorIndexingPropertiesEXT& limits =
+        device->descriptorIndexingProperties;
+    this->maxTextures =
+        std::min( { GPU_BINDLESS_MAX_TEXTURES,
+                    BindlessLimit( limits.maxDescriptorSetUpdateAfterBindSampledImages ),
+                    BindlessLimit( limits.maxPerStageDescriptorUpdateAfterBindSampledImages ),
+                    BindlessLimit( limits.maxDescriptorSetUpdateAfterBindSamplers ),
+                    BindlessLimit( limits.maxPerStageDescriptorUpdateAfterBindSamplers ) } );
+    this->maxBuffers =
+        std::min( { GPU_BINDLESS_MAX_BUFFERS,
+                    BindlessLimit( limits.maxDescriptorSetUpdateAfterBindStorageBuffers ),
+                    BindlessLimit( limits.maxPerStageDescriptorUpdateAfterBindStorageBuffers ) } );
+    const int maxResources = BindlessLimit( limits.maxPerStageUpdateAfterBindResources );
+    if ( this->maxTextures + this->maxBuffers > maxResources )
+    {
+        this->maxTextures = std::min( this->maxTextures, maxResources / 2 );
+        this->maxBuffers  = std::min( this->maxBuffers, maxResources - this->maxTextures );
+    }
+    assert( this->maxTextures > 0 && this->maxBuffers > 0 );
+
+    const VkShaderStageFlags stageFlags =
+        VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkDescriptorSetLayoutBinding bindings[3];
+    bindings[GPU_BINDLESS_BINDING_TEXTURES].binding            = GPU_BINDLESS_BINDING_TEXTURES;
+    bindings[GPU_BINDLESS_BINDING_TEXTURES].descriptorType     = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+    bindings[GPU_BINDLESS_BINDING_TEXTURES].descriptorCount    = this->maxTextures;
+    bindings[GPU_BINDLESS_BINDING_TEXTURES].stageFlags         = stageFlags;
+    bindings[GPU_BINDLESS_BINDING_TEXTURES].pImmutableSamplers = nullptr;
+    bindings[GPU_BINDLESS_BINDING_SAMPLERS].binding            = GPU_BINDLESS_BINDING_SAMPLERS;
+    bindings[GPU_BINDLESS_BINDING_SAMPLERS].descriptorType     = VK_DESCRIPTOR_TYPE_SAMPLER;
+    bindings[GPU_BINDLESS_BINDING_SAMPLERS].descriptorCount    = this->maxTextures;
+    bindings[GPU_BINDLESS_BINDING_SAMPLERS].stageFlags         = stageFlags;
+    bindings[GPU_BINDLESS_BINDING_SAMPLERS].pImmutableSamplers = nullptr;
+    bindings[GPU_BINDLESS_BINDING_BUFFERS].binding             = GPU_BINDLESS_BINDING_BUFFERS;
+    bindings[GPU_BINDLESS_BINDING_BUFFERS].descriptorType      = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[GPU_BINDLESS_BINDING_BUFFERS].descriptorCount     = this->maxBuffers;
+    bindings[GPU_BINDLESS_BINDING_BUFFERS].stageFlags          = stageFlags;
+    bindings[GPU_BINDLESS_BINDING_BUFFERS].pImmutableSamplers  = nullptr;
+
+    // Unused entries may stay unwritten, and entries that are not used by pending command
+    // buffers may be written while the set is bound.
+    const VkDescriptorBindingFlagsEXT bindingFlags[3] = {
+        VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT |
+            VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT |
+            VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT,
+        VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT |
+            VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT |
+            VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT,
+        VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT |
+            VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT |
+            VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT,
+    };
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsCreateInfo;
+    bindingFlagsCreateInfo.sType =
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+    bindingFlagsCreateInfo.pNext         = nullptr;
+    bindingFlagsCreateInfo.bindingCount  = static_cast<uint32_t>( std::size( bindingFlags ) );
+    bindingFlagsCreateInfo.pBindingFlags = bindingFlags;
+
+    VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo;
+    descriptorSetLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    descriptorSetLayoutCreateInfo.pNext = &bindingFlagsCreateInfo;
+    descriptorSetLayoutCreateInfo.flags =
+        VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+    descriptorSetLayoutCreateInfo.bindingCount = static_cast<uint32_t>( std::size( bindings ) );
+    descriptorSetLayoutCreateInfo.pBindings    = bindings;
+
+    VK( device->vkCreateDescriptorSetLayout( device->device, &descriptorSetLayoutCreateInfo,
+                                             VK_ALLOCATOR, &this->descriptorSetLayout ) );
+
+    VkDescriptorPoolSize typeCounts[3];
+    typeCounts[0].type            = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+    typeCounts[0].descriptorCount = this->maxTextures;
+    typeCounts[1].type            = VK_DESCRIPTOR_TYPE_SAMPLER;
+    typeCounts[1].descriptorCount = this->maxTextures;
+    typeCounts[2].type            = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    typeCounts[2].descriptorCount = this->maxBuffers;
+
+    VkDescriptorPoolCreateInfo descriptorPoolCreateInfo;
+    descriptorPoolCreateInfo.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    descriptorPoolCreateInfo.pNext         = nullptr;
+    descriptorPoolCreateInfo.flags         = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+    descriptorPoolCreateInfo.maxSets       = 1;
+    descriptorPoolCreateInfo.poolSizeCount = static_cast<uint32_t>( std::size( typeCounts ) );
+    descriptorPoolCreateInfo.pPoolSizes    = typeCounts;
+
+    VK( device->vkCreateDescriptorPool( device->device, &descriptorPoolCreateInfo, VK_ALLOCATOR,
+                                        &this->descriptorPool ) );
+
+    VkDescriptorSetAllocateInfo descriptorSetAllocateInfo;
+    descriptorSetAllocateInfo.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    descriptorSetAllocateInfo.pNext              = nullptr;
+    descriptorSetAllocateInfo.descriptorPool     = this->descriptorPool;
+    descriptorSetAllocateInfo.descriptorSetCount = 1;
+    descriptorSetAllocateInfo.pSetLayouts        = &this->descriptorSetLayout;
+
+    VK( device->vkAllocateDescriptorSets( device->device, &descriptorSetAllocateInfo,
+                                          &this->descriptorSet ) );
+
+    ksMutex_Create( &this->mutex );
+}
+
+GpuBindlessTable::~GpuBindlessTable()
+{
+    ksMutex_Destroy( &this->mutex );
+
+    VC( context.device->vkDestroyDescriptorPool( context.device->device, this->descriptorPool,
+                                                 VK_ALLOCATOR ) );
+    VC( context.device->vkDestroyDescriptorSetLayout( context.device->device,
+                                                      this->descriptorSetLayout, VK_ALLOCATOR ) );
+}
+
+uint32_t GpuBindlessTable::AllocateIndex( uint32_t* freeIndices, int* numFreeIndices,
+                                          int* nextIndex, const int maxIndices )
+{
+    // Released indices are reused first to keep the used range of the arrays compact.
+    if ( *numFreeIndices > 0 )
+    {
+        return freeIndices[--( *numFreeIndices )];
+    }
+    if ( *nextIndex < maxIndices )
+    {
+        return ( *nextIndex )++;
+    }
+    Error( "Out of bindless indices (%d).", maxIndices );
+    return GPU_BINDLESS_INVALID_INDEX;
+}
+
+uint32_t GpuBindlessTable::RegisterTexture( const GpuTexture* texture )
+{
+    ksMutex_Lock( &this->mutex, true );
+    const uint32_t index = AllocateIndex( this->freeTextures, &this->numFreeTextures,
+                                          &this->nextTexture, this->maxTextures );
+    ksMutex_Unlock( &this->mutex );
+
+    if ( index != GPU_BINDLESS_INVALID_INDEX )
+    {
+        UpdateTexture( index, texture );
+    }
+    return index;
+}
+
+void GpuBindlessTable::UpdateTexture( const uint32_t index, const GpuTexture* texture )
+{
+    assert( index < (uint32_t)this->maxTextures );
+
+    VkDescriptorImageInfo imageInfo[2];
+    imageInfo[0].sampler     = VK_NULL_HANDLE;
+    imageInfo[0].imageView   = texture->view;
+    imageInfo[0].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    imageInfo[1].sampler     = texture->sampler;
+    imageInfo[1].imageView   = VK_NULL_HANDLE;
+    imageInfo[1].imageLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    VkWriteDescriptorSet writes[2];
+    for ( int i = 0; i < 2; i++ )
+    {
+        writes[i].sType            = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].pNext            = nullptr;
+        writes[i].dstSet           = this->descriptorSet;
+        writes[i].dstBinding       = ( i == 0 ) ? GPU_BINDLESS_BINDING_TEXTURES
+                                                : GPU_BINDLESS_BINDING_SAMPLERS;
+        writes[i].dstArrayElement  = index;
+        writes[i].descriptorCount  = 1;
+        writes[i].descriptorType   = ( i == 0 ) ? VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE
+                                                : VK_DESCRIPTOR_TYPE_SAMPLER;
+        writes[i].pImageInfo       = &imageInfo[i];
+        writes[i].pBufferInfo      = nullptr;
+        writes[i].pTexelBufferView = nullptr;
+    }
+
+    VC( context.device->vkUpdateDescriptorSets( context.device->device, 2, writes, 0, nullptr ) );
+}
+
+void GpuBindlessTable::ReleaseTexture( const uint32_t index )
+{
+    assert( index < (uint32_t)this->maxTextures );
+
+    ksMutex_Lock( &this->mutex, true );
+    this->freeTextures[this->numFreeTextures++] = index;
+    ksMutex_Unlock( &this->mutex );
+}
+
+uint32_t GpuBindlessTable::RegisterBuffer( const GpuBuffer* buffer )
+{
+    ksMutex_Lock( &this->mutex, true );
+    const uint32_t index = AllocateIndex( this->freeBuffers, &this->numFreeBuffers,
+                                          &this->nextBuffer, this->maxBuffers );
+    ksMutex_Unlock( &this->mutex );
+
+    if ( index == GPU_BINDLESS_INVALID_INDEX )
+    {
+        return index;
+    }
+
+    VkDescriptorBufferInfo bufferInfo;
+    bufferInfo.buffer = buffer->buffer;
+    bufferInfo.offset = 0;
+    bufferInfo.range  = buffer->size;
+
+    VkWriteDescriptorSet write;
+    write.sType            = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.pNext            = nullptr;
+    write.dstSet           = this->descriptorSet;
+    write.dstBinding       = GPU_BINDLESS_BINDING_BUFFERS;
+    write.dstArrayElement  = index;
+    write.descriptorCount  = 1;
+    write.descriptorType   = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    write.pImageInfo       = nullptr;
+    write.pBufferInfo      = &bufferInfo;
+    write.pTexelBufferView = nullptr;
+
+    VC( context.device->vkUpdateDescriptorSets( context.device->device, 1, &write, 0, nullptr ) );
+
+    return index;
+}
+
+void GpuBindlessTable::ReleaseBuffer( const uint32_t index )
+{
+    assert( index < (uint32_t)this->maxBuffers );
+
+    ksMutex_Lock( &this->mutex, true );
+    this->freeBuffers[this->numFreeBuffers++] = index;
+    ksMutex_Unlock( &this->mutex );
+}
+
+} // namespace lxd
@@ -1,6 +1,8 @@
 #include "GpuBuffer.hpp"
 #include "GpuDevice.hpp"
 #include "GpuContext.hpp"
+#include "GpuDeletionQueue.hpp"
+#include "GpuStateTracker.hpp"
 namespace lxd
 {
 
@@ -14,7 +16,10 @@ VkBufferUsageFlags GpuBuffer::GetBufferUsage( const GpuBufferType type )
                                  ? VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT
                                  : ( ( type == GPU_BUFFER_TYPE_STORAGE )
                                          ? VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
-                                         : 0 ) ) ) );
+                                         : ( ( type == GPU_BUFFER_TYPE_INDIRECT )
+                                                 ? ( VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                                                     VK_BUFFER_USAGE_STORAGE_BUFFER_BIT )
+                                                 : 0 ) ) ) ) );
 }
 
 VkAccessFlags GpuBuffer::GetBufferAccess( const GpuBufferType type )
@@ -28,17 +33,32 @@ VkAccessFlags GpuBuffer::GetBufferAccess( const GpuBufferType type )
                             ? VK_ACCESS_UNIFORM_READ_BIT
                             : ( ( type == GPU_BUFFER_TYPE_STORAGE )
                                     ? ( VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT )
-                                    : 0 ) ) ) );
+                                    : ( ( type == GPU_BUFFER_TYPE_INDIRECT )
+                                            ? VK_ACCESS_INDIRECT_COMMAND_READ_BIT
+                                            : 0 ) ) ) ) );
 }
+
+VkPipelineStageFlags GpuBuffer::GetBufferStages( const GpuBufferType type )
+{
+    const VkPipelineStageFlags shaderStages = VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+                                              VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+                                              VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    return ( ( type == GPU_BUFFER_TYPE_INDEX || type == GPU_BUFFER_TYPE_VERTEX )
+                 ? VK_PIPELINE_STAGE_VERTEX_INPUT_BIT
+                 : ( ( type == GPU_BUFFER_TYPE_INDIRECT ) ? VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT
+                                                          : shaderStages ) );
+}
+
 GpuBuffer::GpuBuffer( GpuContext* context, const GpuBufferType type, const size_t dataSize,
                       const void* data, const bool hostVisible, const bool dynamic )
     : context( *context )
 {
     assert( dataSize <= context->device->physicalDeviceProperties.limits.maxStorageBufferRange );
 
-    this->type  = type;
-    this->size  = dataSize;
-    this->owner = true;
+    this->type       = type;
+    this->size       = dataSize;
+    this->owner      = true;
+    this->resourceId = ++context->device->resourceSerial;
 
     VkBufferCreateInfo bufferCreateInfo;
     bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -158,19 +178,33 @@ GpuBuffer::GpuBuffer( GpuContext* context, const GpuBufferType type, const size_
             VC( context->device->vkFreeMemory( context->device->device, srcMemory, VK_ALLOCATOR ) );
         }
     }
+
+    if ( context->bindless != nullptr &&
+         ( GpuBuffer::GetBufferUsage( type ) & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT ) != 0 )
+    {
+        this->bindlessIndex = context->bindless->RegisterBuffer( this );
+    }
 }
 
 GpuBuffer::~GpuBuffer()
 {
+    context.InvalidateCommandBundles( this );
+    // The GPU may still read the buffer, so the index and the buffer are only released once the
+    // submits that are in flight or being recorded completed.
+    if ( this->bindlessIndex != GPU_BINDLESS_INVALID_INDEX )
+    {
+        context.deletionQueue->Destroy( GPU_DELETION_TYPE_BINDLESS_BUFFER, this->bindlessIndex );
+    }
     if ( this->mapped != nullptr )
     {
         VC( context.device->vkUnmapMemory( context.device->device, this->memory ) );
     }
     if ( this->owner )
     {
-        VC( context.device->vkDestroyBuffer( context.device->device, this->buffer, VK_ALLOCATOR ) );
-        VC( context.device->vkFreeMemory( context.device->device, this->memory, VK_ALLOCATOR ) );
+        context.deletionQueue->Destroy( GPU_DELETION_TYPE_BUFFER, (uint64_t)this->buffer );
+        context.deletionQueue->Destroy( GPU_DELETION_TYPE_MEMORY, (uint64_t)this->memory );
     }
+    free( this->rangeStates );
 }
 //
 //
@@ -274,30 +308,33 @@ GpuDepthBuffer::GpuDepthBuffer( GpuContext* context, const GpuSurfaceDepthFormat
     {
         context->CreateSetupCmdBuffer();
 
-        VkImageMemoryBarrier imageMemoryBarrier;
-        imageMemoryBarrier.sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-        imageMemoryBarrier.pNext               = nullptr;
-        imageMemoryBarrier.srcAccessMask       = 0;
-        imageMemoryBarrier.dstAccessMask       = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-        imageMemoryBarrier.oldLayout           = VK_IMAGE_LAYOUT_UNDEFINED;
-        imageMemoryBarrier.newLayout           = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-        imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        imageMemoryBarrier.image               = this->image;
-        imageMemoryBarrier.subresourceRange.aspectMask =
-            VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
-        imageMemoryBarrier.subresourceRange.baseMipLevel   = 0;
-        imageMemoryBarrier.subresourceRange.levelCount     = 1;
-        imageMemoryBarrier.subresourceRange.baseArrayLayer = 0;
-        imageMemoryBarrier.subresourceRange.layerCount     = numLayers;
-
-        const VkPipelineStageFlags src_stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-        const VkPipelineStageFlags dst_stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-        const VkDependencyFlags    flags      = 0;
+        // The depth buffer is only used as an attachment afterwards, so its states do not
+        // have to be kept around.
+        GpuSubresourceState* states =
+            static_cast<GpuSubresourceState*>( malloc( numLayers * sizeof( GpuSubresourceState ) ) );
+        for ( int layerIndex = 0; layerIndex < numLayers; layerIndex++ )
+        {
+            states[layerIndex] = GpuSubresourceState::Undefined();
+        }
 
-        VC( context->device->vkCmdPipelineBarrier( context->setupCommandBuffer, src_stages,
-                                                   dst_stages, flags, 0, nullptr, 0, nullptr, 1,
-                                                   &imageMemoryBarrier ) );
+        VkImageSubresourceRange range;
+        range.aspectMask     = VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+        range.baseMipLevel   = 0;
+        range.levelCount     = 1;
+        range.baseArrayLayer = 0;
+        range.layerCount     = numLayers;
+
+        GpuStateTracker stateTracker( context );
+        stateTracker.Begin( context->setupCommandBuffer );
+        stateTracker.ImageAccess( this->image, states, 1, numLayers, &range,
+                                  VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                                      VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                                  VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                                      VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                                  VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL );
+        stateTracker.Flush();
+
+        free( states );
 
         context->FlushSetupCmdBuffer();
     }
@@ -315,11 +352,11 @@ GpuDepthBuffer::~GpuDepthBuffer()
 
     for ( int viewIndex = 0; viewIndex < this->numViews; viewIndex++ )
     {
-        VC( context.device->vkDestroyImageView( context.device->device, this->views[viewIndex],
-                                                VK_ALLOCATOR ) );
+        context.deletionQueue->Destroy( GPU_DELETION_TYPE_IMAGE_VIEW,
+                                        (uint64_t)this->views[viewIndex] );
     }
-    VC( context.device->vkDestroyImage( context.device->device, this->image, VK_ALLOCATOR ) );
-    VC( context.device->vkFreeMemory( context.device->device, this->memory, VK_ALLOCATOR ) );
+    context.deletionQueue->Destroy( GPU_DELETION_TYPE_IMAGE, (uint64_t)this->image );
+    context.deletionQueue->Destroy( GPU_DELETION_TYPE_MEMORY, (uint64_t)this->memory );
 
     free( this->views );
 }
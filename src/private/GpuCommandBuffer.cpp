@@ -1,19 +1,34 @@
 #include "GpuCommandBuffer.hpp"
+#include "GpuBindless.hpp"
+#include "GpuBuffer.hpp"
+#include "GpuCommandBundle.hpp"
+#include "GpuComputePipeline.hpp"
+#include "GpuComputeProgram.hpp"
+#include "GpuDeletionQueue.hpp"
+#include "GpuDescriptorSetCache.hpp"
+#include "GpuGraphicsPipeline.hpp"
+#include "GpuStateTracker.hpp"
+#include "GpuSubmitBatch.hpp"
+#include "GpuTimeline.hpp"
+#include "GpuTimer.hpp"
 
 namespace lxd
 {
-GpuCommandBuffer::GpuCommandBuffer()
+GpuCommandBuffer::GpuCommandBuffer( GpuContext* context, const GpuCommandBufferType type,
+                                    const int numBuffers )
 {
     this->type          = type;
     this->numBuffers    = numBuffers;
     this->currentBuffer = 0;
     this->context       = context;
     this->cmdBuffers = (VkCommandBuffer*)malloc( numBuffers * sizeof( VkCommandBuffer ) );
-    this->fences     = (GpuFence*)malloc( numBuffers * sizeof( GpuFence ) );
+    this->submitValues = (uint64_t*)malloc( numBuffers * sizeof( uint64_t ) );
     this->mappedBuffers    = (GpuBuffer**)malloc( numBuffers * sizeof( GpuBuffer* ) );
     this->oldMappedBuffers = (GpuBuffer**)malloc( numBuffers * sizeof( GpuBuffer* ) );
-    this->pipelineResources =
-        (GpuPipelineResources**)malloc( numBuffers * sizeof( GpuPipelineResources* ) );
+    this->descriptorSetCaches =
+        (GpuDescriptorSetCache**)malloc( numBuffers * sizeof( GpuDescriptorSetCache* ) );
+    this->uniformRings = (GpuBuffer**)malloc( numBuffers * sizeof( GpuBuffer* ) );
+    this->eventPools   = (GpuEventPool**)malloc( numBuffers * sizeof( GpuEventPool* ) );
 
     for ( int i = 0; i < numBuffers; i++ )
     {
@@ -29,25 +44,37 @@ GpuCommandBuffer::GpuCommandBuffer()
         VK( context->device->vkAllocateCommandBuffers(
             context->device->device, &commandBufferAllocateInfo, &this->cmdBuffers[i] ) );
 
-        GpuFence_Create( context, &this->fences[i] );
+        this->submitValues[i] = 0;
 
         this->mappedBuffers[i]     = NULL;
         this->oldMappedBuffers[i]  = NULL;
-        this->pipelineResources[i] = NULL;
+        this->descriptorSetCaches[i] = new GpuDescriptorSetCache( context );
+        this->eventPools[i]          = new GpuEventPool( context );
+
+        // Persistently mapped, the GpuBuffer destructor unmaps it.
+        this->uniformRings[i] = new GpuBuffer( context, GPU_BUFFER_TYPE_UNIFORM,
+                                               GPU_UNIFORM_RING_SIZE, NULL, true );
+        VK( context->device->vkMapMemory( context->device->device, this->uniformRings[i]->memory,
+                                          0, VK_WHOLE_SIZE, 0, &this->uniformRings[i]->mapped ) );
     }
+    this->uniformRingOffset = 0;
+    this->stateTracker      = new GpuStateTracker( context );
 }
 
 GpuCommandBuffer::~GpuCommandBuffer()
 {
-    assert( context == this->context );
+    GpuContext* context = this->context;
+
+    if ( this->recordingTicket != 0 )
+    {
+        context->timeline->EndRecording( this->recordingTicket, 0 );
+    }
 
     for ( int i = 0; i < this->numBuffers; i++ )
     {
         VC( context->device->vkFreeCommandBuffers( context->device->device, context->commandPool, 1,
                                                    &this->cmdBuffers[i] ) );
 
-        GpuFence_Destroy( context, &this->fences[i] );
-
         for ( GpuBuffer *b = this->mappedBuffers[i], *next = NULL; b != NULL; b = next )
         {
             next = b->next;
@@ -65,20 +92,25 @@ GpuCommandBuffer::~GpuCommandBuffer()
         }
         this->oldMappedBuffers[i] = NULL;
 
-        for ( GpuPipelineResources *r = this->pipelineResources[i], *next = NULL;
-              r != NULL; r = next )
-        {
-            next = r->next;
-            GpuPipelineResources_Destroy( context, r );
-            free( r );
-        }
-        this->pipelineResources[i] = NULL;
+        delete this->descriptorSetCaches[i];
+        this->descriptorSetCaches[i] = NULL;
+
+        delete this->uniformRings[i];
+        this->uniformRings[i] = NULL;
+
+        delete this->eventPools[i];
+        this->eventPools[i] = NULL;
     }
 
-    free( this->pipelineResources );
+    delete this->stateTracker;
+    this->stateTracker = NULL;
+
+    free( this->eventPools );
+    free( this->uniformRings );
+    free( this->descriptorSetCaches );
     free( this->oldMappedBuffers );
     free( this->mappedBuffers );
-    free( this->fences );
+    free( this->submitValues );
     free( this->cmdBuffers );
 }
 
@@ -91,19 +123,29 @@ void      GpuCommandBuffer::BeginPrimary() {
 
 	this->currentBuffer = (this->currentBuffer + 1) % this->numBuffers;
 
-	GpuFence* fence = &this->fences[this->currentBuffer];
-	if (fence->submitted)
+	// Everything below reuses memory of the previous use of this buffer in the ring, which may
+	// still wait in the submit batch when the ring wrapped around within one batch.
+	if (this->submitValues[this->currentBuffer] >= this->context->timeline->PendingValue())
 	{
-		VK(device->vkWaitForFences(device->device, 1, &fence->fence, VK_TRUE,
-			1ULL * 1000 * 1000 * 1000));
-		VK(device->vkResetFences(device->device, 1, &fence->fence));
-		fence->submitted = false;
+		this->context->submitBatch->Flush();
 	}
+	this->context->timeline->Wait(this->submitValues[this->currentBuffer]);
+
+	// Cheap when nothing was released, and never waits for the GPU.
+	this->context->deletionQueue->Collect();
+
+	// Objects released from here on wait for the submit of this recording.
+	assert(this->recordingTicket == 0);
+	this->recordingTicket = this->context->timeline->BeginRecording();
 
 	GpuCommandBuffer_ManageBuffers(commandBuffer);
 
+	this->descriptorSetCaches[this->currentBuffer]->BeginFrame();
+	this->eventPools[this->currentBuffer]->BeginFrame();
+	this->uniformRingOffset = 0;
+
 	GpuGraphicsCommand_Init(&this->currentGraphicsState);
-	GpuComputeCommand_Init(&this->currentComputeState);
+	this->currentComputeState = GpuComputeCommand();
 
 	VK(device->vkResetCommandBuffer(this->cmdBuffers[this->currentBuffer],
 		0));
@@ -117,6 +159,8 @@ void      GpuCommandBuffer::BeginPrimary() {
 	VK(device->vkBeginCommandBuffer(this->cmdBuffers[this->currentBuffer],
 		&commandBufferBeginInfo));
 
+	this->stateTracker->Begin(this->cmdBuffers[this->currentBuffer], this->recordingTicket);
+
 	// Make sure any CPU writes are flushed.
 	{
 		VkMemoryBarrier memoryBarrier;
@@ -140,18 +184,22 @@ void      GpuCommandBuffer::EndPrimary() {
 	assert(this->currentFramebuffer == NULL);
 	assert(this->currentRenderPass == NULL);
 
-	GpuCommandBuffer_ManageTimers(commandBuffer);
+	ManageTimers();
 
 	GpuDevice* device = this->context->device;
+
+	// Barriers for accesses after the last command, e.g. the final texture usages.
+	this->stateTracker->Flush();
+
+	FlushUniformRing();
+
 	VK(device->vkEndCommandBuffer(this->cmdBuffers[this->currentBuffer]));
 }
-GpuFence* GpuCommandBuffer::SubmitPrimary() {
+uint64_t  GpuCommandBuffer::SubmitPrimary() {
 	assert(this->type == GPU_COMMAND_BUFFER_TYPE_PRIMARY);
 	assert(this->currentFramebuffer == NULL);
 	assert(this->currentRenderPass == NULL);
 
-	GpuDevice* device = this->context->device;
-
 	const VkPipelineStageFlags stageFlags[1] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
 
 	VkSubmitInfo submitInfo;
@@ -169,17 +217,56 @@ GpuFence* GpuCommandBuffer::SubmitPrimary() {
 		? &this->swapchainBuffer->renderingCompleteSemaphore
 		: NULL;
 
-	GpuFence* fence = &this->fences[this->currentBuffer];
-	VK(device->vkQueueSubmit(this->context->queue, 1, &submitInfo, fence->fence));
-	GpuFence_Submit(this->context, fence);
+	const uint64_t value = this->context->submitBatch->Submit(&submitInfo);
+	this->submitValues[this->currentBuffer] = value;
+	this->context->timeline->EndRecording(this->recordingTicket, value);
+	this->recordingTicket = 0;
 
 	this->swapchainBuffer = NULL;
 
-	return fence;
+	return value;
 }
 
 void GpuCommandBuffer::ChangeTextureUsage( GpuTexture* texture, const GpuTextureUsage usage ) {
+	assert(this->currentRenderPass == NULL);
 
+	// Only queues the barrier, it is recorded together with any other barriers right before the
+	// next command that needs it.
+	this->stateTracker->TextureAccess(texture, PipelineStagesForTextureUsage(usage, false),
+		AccessForTextureUsage(usage), LayoutForTextureUsage(usage));
+	texture->usage = usage;
+}
+
+void GpuCommandBuffer::ReleaseTexture( GpuTexture* texture, const GpuContext* dstContext,
+                                       const GpuTextureUsage usage ) {
+	assert(this->currentRenderPass == NULL);
+
+	// The release and the acquire have to use the same layouts.
+	this->stateTracker->ReleaseTexture(texture, dstContext->queueFamilyIndex,
+		LayoutForTextureUsage(usage));
+}
+
+void GpuCommandBuffer::AcquireTexture( GpuTexture* texture, const GpuContext* srcContext,
+                                       const GpuTextureUsage usage ) {
+	assert(this->currentRenderPass == NULL);
+
+	this->stateTracker->AcquireTexture(texture, srcContext->queueFamilyIndex,
+		PipelineStagesForTextureUsage(usage, false), AccessForTextureUsage(usage),
+		LayoutForTextureUsage(usage));
+	texture->usage = usage;
+}
+
+void GpuCommandBuffer::ReleaseBuffer( GpuBuffer* buffer, const GpuContext* dstContext ) {
+	assert(this->currentRenderPass == NULL);
+
+	this->stateTracker->ReleaseBuffer(buffer, dstContext->queueFamilyIndex);
+}
+
+void GpuCommandBuffer::AcquireBuffer( GpuBuffer* buffer, const GpuContext* srcContext ) {
+	assert(this->currentRenderPass == NULL);
+
+	this->stateTracker->AcquireBuffer(buffer, srcContext->queueFamilyIndex,
+		GpuBuffer::GetBufferStages(buffer->type), GpuBuffer::GetBufferAccess(buffer->type));
 }
 
 void GpuCommandBuffer::BeginFramebuffer( GpuFramebuffer* framebuffer, const int arrayLayer,
@@ -224,8 +311,7 @@ void GpuCommandBuffer::BeginFramebuffer( GpuFramebuffer* framebuffer, const int
 		framebuffer->depthBuffer.imageLayout ==
 		VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
 
-	GpuCommandBuffer_ChangeTextureUsage(
-		commandBuffer, &framebuffer->colorTextures[framebuffer->currentBuffer], usage);
+	ChangeTextureUsage(&framebuffer->colorTextures[framebuffer->currentBuffer], usage);
 
 	this->currentFramebuffer = framebuffer;
 }
@@ -242,11 +328,10 @@ void GpuCommandBuffer::EndFramebuffer( GpuFramebuffer* framebuffer, const int ar
 #if EXPLICIT_RESOLVE != 0
 	if (framebuffer->renderTexture.image != VK_NULL_HANDLE)
 	{
-		GpuCommandBuffer_ChangeTextureUsage(commandBuffer, &framebuffer->renderTexture,
-			GPU_TEXTURE_USAGE_TRANSFER_SRC);
-		GpuCommandBuffer_ChangeTextureUsage(
-			commandBuffer, &framebuffer->colorTextures[framebuffer->currentBuffer],
+		ChangeTextureUsage(&framebuffer->renderTexture, GPU_TEXTURE_USAGE_TRANSFER_SRC);
+		ChangeTextureUsage(&framebuffer->colorTextures[framebuffer->currentBuffer],
 			GPU_TEXTURE_USAGE_TRANSFER_DST);
+		this->stateTracker->Flush();
 
 		VkImageResolve region;
 		region.srcOffset.x = 0;
@@ -273,13 +358,11 @@ void GpuCommandBuffer::EndFramebuffer( GpuFramebuffer* framebuffer, const int ar
 			framebuffer->colorTextures[framebuffer->currentBuffer].image,
 			framebuffer->colorTextures[framebuffer->currentBuffer].imageLayout, 1, &region);
 
-		GpuCommandBuffer_ChangeTextureUsage(commandBuffer, &framebuffer->renderTexture,
-			GPU_TEXTURE_USAGE_COLOR_ATTACHMENT);
+		ChangeTextureUsage(&framebuffer->renderTexture, GPU_TEXTURE_USAGE_COLOR_ATTACHMENT);
 	}
 #endif
 
-	GpuCommandBuffer_ChangeTextureUsage(
-		commandBuffer, &framebuffer->colorTextures[framebuffer->currentBuffer], usage);
+	ChangeTextureUsage(&framebuffer->colorTextures[framebuffer->currentBuffer], usage);
 
 	this->currentFramebuffer = NULL;
 }
@@ -318,6 +401,75 @@ void GpuCommandBuffer::EndTimer( GpuTimer* timer ) {
 	this->currentTimers[this->currentTimerCount++] = timer;
 }
 
+void GpuCommandBuffer::ManageTimers() {
+	GpuDevice* device = this->context->device;
+
+	for (int i = 0; i < this->currentTimerCount; i++)
+	{
+		GpuTimer* timer = this->currentTimers[i];
+		const uint32_t nextIndex = (timer->index + 1) % (timer->framesDelayed + 1);
+
+		// The oldest query pair was written 'framesDelayed' uses ago. This does not stall as long
+		// as no more frames are in flight than the timer delays its results.
+		if (timer->init >= (uint32_t)timer->framesDelayed)
+		{
+			VK(device->vkGetQueryPoolResults(device->device, timer->pool, nextIndex * 2, 2,
+				2 * sizeof(uint64_t), timer->data, sizeof(uint64_t),
+				VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+		}
+		else
+		{
+			timer->init++;
+		}
+
+		// Reset the oldest pair for the next use of the timer.
+		VC(device->vkCmdResetQueryPool(this->cmdBuffers[this->currentBuffer], timer->pool,
+			nextIndex * 2, 2));
+		timer->index = nextIndex;
+	}
+	this->currentTimerCount = 0;
+}
+
+GpuSplitBarrier GpuCommandBuffer::SignalSplitBarrier( const VkPipelineStageFlags srcStages ) {
+	assert(this->currentRenderPass == NULL);
+	assert(srcStages != 0);
+
+	GpuDevice* device = this->context->device;
+
+	GpuSplitBarrier barrier;
+	barrier.event = this->eventPools[this->currentBuffer]->Allocate();
+	barrier.srcStages = srcStages;
+
+	VC(device->vkCmdSetEvent(this->cmdBuffers[this->currentBuffer], barrier.event, srcStages));
+
+	return barrier;
+}
+void GpuCommandBuffer::WaitSplitBarriers( const GpuSplitBarrier* barriers, const int numBarriers,
+                                          const VkPipelineStageFlags dstStages,
+                                          const int numBufferBarriers,
+                                          const VkBufferMemoryBarrier* bufferBarriers,
+                                          const int numImageBarriers,
+                                          const VkImageMemoryBarrier* imageBarriers )
+{
+	assert(this->currentRenderPass == NULL);
+	assert(numBarriers > 0 && numBarriers <= MAX_COMMAND_BUFFER_SPLIT_WAITS);
+
+	GpuDevice* device = this->context->device;
+
+	// The source stages have to be exactly the union of the stages the events were set with.
+	VkEvent              events[MAX_COMMAND_BUFFER_SPLIT_WAITS];
+	VkPipelineStageFlags srcStages = 0;
+	for (int i = 0; i < numBarriers; i++)
+	{
+		events[i] = barriers[i].event;
+		srcStages |= barriers[i].srcStages;
+	}
+
+	VC(device->vkCmdWaitEvents(this->cmdBuffers[this->currentBuffer], numBarriers, events,
+		srcStages, dstStages, 0, NULL, numBufferBarriers, bufferBarriers,
+		numImageBarriers, imageBarriers));
+}
+
 void GpuCommandBuffer::BeginRenderPass( GpuRenderPass* renderPass, GpuFramebuffer* framebuffer,
                                         const ScreenRect* rect )
 {
@@ -374,6 +526,9 @@ void GpuCommandBuffer::BeginRenderPass( GpuRenderPass* renderPass, GpuFramebuffe
 		? VK_SUBPASS_CONTENTS_INLINE
 		: VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS;
 
+	// Barriers can not be recorded inside the render pass.
+	this->stateTracker->Flush();
+
 	VC(device->vkCmdBeginRenderPass(cmdBuffer, &renderPassBeginInfo, contents));
 
 	this->currentRenderPass = renderPass;
@@ -420,7 +575,114 @@ void GpuCommandBuffer::SetScissor( const ScreenRect* rect ) {
 	VC(device->vkCmdSetScissor(cmdBuffer, 0, 1, &scissor));
 }
 
-void GpuCommandBuffer::SubmitGraphicsCommand( const GpuGraphicsCommand* command ) {
+void GpuCommandBuffer::UpdateProgramParms( const GpuProgramParmLayout* newLayout,
+	const GpuProgramParmLayout* oldLayout, const GpuProgramParmState* newParmState,
+	const GpuProgramParmState* oldParmState, const VkPipelineBindPoint bindPoint ) {
+	GpuDevice* device = this->context->device;
+
+	VkCommandBuffer cmdBuffer = this->cmdBuffers[this->currentBuffer];
+
+	// Descriptor sets are looked up by layout and bound resources, so alternating between
+	// materials hits the cache instead of allocating and writing a new set.
+	// Spilled push constants are copied to the uniform ring and only change the dynamic offset.
+	const bool descriptorsMatch = GpuProgramParmState::DescriptorsMatch(newLayout, newParmState,
+		oldLayout, oldParmState);
+	const bool spillDataMatch = GpuProgramParmState::SpillDataMatch(newLayout, newParmState,
+		oldLayout, oldParmState);
+	if ((!descriptorsMatch || !spillDataMatch) &&
+		(newLayout->numBindings > 0 || newLayout->packing.spillSize > 0))
+	{
+		// Uploaded first, the ring is replaced when it runs out of space.
+		uint32_t dynamicOffset = 0;
+		uint32_t dynamicOffsetCount = 0;
+		if (newLayout->packing.spillSize > 0)
+		{
+			dynamicOffset = UploadUniformData(&newParmState->data[newLayout->spillDataOffset],
+				newLayout->packing.spillSize);
+			dynamicOffsetCount = 1;
+		}
+
+		GpuBuffer*            uniformRing = this->uniformRings[this->currentBuffer];
+		const VkDescriptorSet descriptorSet =
+			this->descriptorSetCaches[this->currentBuffer]->GetDescriptorSet(newLayout, newParmState,
+				uniformRing);
+
+		VC(device->vkCmdBindDescriptorSets(cmdBuffer, bindPoint, newLayout->pipelineLayout, 0, 1,
+			&descriptorSet, dynamicOffsetCount, &dynamicOffset));
+	}
+
+	// The bindless table only needs to be bound again when the pipeline layout changes.
+	// Materials that only differ in bindless indices are switched with push constants.
+	if (this->context->bindless != NULL &&
+		(oldLayout == NULL || oldLayout->pipelineLayout != newLayout->pipelineLayout))
+	{
+		VC(device->vkCmdBindDescriptorSets(cmdBuffer, bindPoint, newLayout->pipelineLayout,
+			GPU_BINDLESS_DESCRIPTOR_SET, 1, &this->context->bindless->descriptorSet, 0, NULL));
+	}
+
+	// The push constants are stored in the parm state exactly as laid out in the push
+	// constant block, so only the bytes that changed need to be uploaded.
+	VkPushConstantRange ranges[MAX_PUSH_CONSTANT_RANGES];
+	const int numRanges = GpuProgramParmState::NewPushConstantRanges(newLayout, newParmState,
+		oldLayout, oldParmState, ranges);
+	for (int i = 0; i < numRanges; i++)
+	{
+		VC(device->vkCmdPushConstants(cmdBuffer, newLayout->pipelineLayout, ranges[i].stageFlags,
+			ranges[i].offset, ranges[i].size, &newParmState->data[ranges[i].offset]));
+	}
+}
+uint32_t GpuCommandBuffer::UploadUniformData( const void* data, const int size ) {
+	const int alignment =
+		(int)this->context->device->physicalDeviceProperties.limits.minUniformBufferOffsetAlignment;
+	int offset = (this->uniformRingOffset + alignment - 1) & ~(alignment - 1);
+	if ((size_t)(offset + size) > this->uniformRings[this->currentBuffer]->size)
+	{
+		GrowUniformRing(size);
+		offset = 0;
+	}
+
+	GpuBuffer* uniformRing = this->uniformRings[this->currentBuffer];
+	memcpy((unsigned char*)uniformRing->mapped + offset, data, size);
+	this->uniformRingOffset = offset + size;
+
+	return (uint32_t)offset;
+}
+void GpuCommandBuffer::GrowUniformRing( const int size ) {
+	GpuDevice* device = this->context->device;
+
+	// The full ring is only released once this recording completed, see GpuDeletionQueue, and
+	// the rest of the recording continues in a larger one. Descriptor sets are cached by buffer,
+	// so new ones are written for it. Later recordings keep using the larger ring.
+	FlushUniformRing();
+	GpuBuffer* oldRing = this->uniformRings[this->currentBuffer];
+	size_t ringSize = 2 * oldRing->size;
+	while (ringSize < (size_t)size)
+	{
+		ringSize *= 2;
+	}
+	delete oldRing;
+
+	GpuBuffer* newRing = new GpuBuffer(this->context, GPU_BUFFER_TYPE_UNIFORM, ringSize, NULL, true);
+	VK(device->vkMapMemory(device->device, newRing->memory, 0, VK_WHOLE_SIZE, 0, &newRing->mapped));
+	this->uniformRings[this->currentBuffer] = newRing;
+	this->uniformRingOffset = 0;
+}
+void GpuCommandBuffer::FlushUniformRing() {
+	GpuDevice* device = this->context->device;
+
+	// The uniform ring may not be host coherent.
+	if (this->uniformRingOffset > 0)
+	{
+		VkMappedMemoryRange mappedMemoryRange;
+		mappedMemoryRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+		mappedMemoryRange.pNext = NULL;
+		mappedMemoryRange.memory = this->uniformRings[this->currentBuffer]->memory;
+		mappedMemoryRange.offset = 0;
+		mappedMemoryRange.size = VK_WHOLE_SIZE;
+		VC(device->vkFlushMappedMemoryRanges(device->device, 1, &mappedMemoryRange));
+	}
+}
+void GpuCommandBuffer::BindGraphicsCommand( const GpuGraphicsCommand* command ) {
 
 	assert(this->currentRenderPass != NULL);
 
@@ -429,19 +691,25 @@ void GpuCommandBuffer::SubmitGraphicsCommand( const GpuGraphicsCommand* command
 	VkCommandBuffer             cmdBuffer = this->cmdBuffers[this->currentBuffer];
 	const GpuGraphicsCommand* state = &this->currentGraphicsState;
 
-	// If the pipeline has changed.
-	if (command->pipeline != state->pipeline)
+	// If the pipeline has changed. Pipelines that only differ in dynamic state share one.
+	if (state->pipeline == NULL || command->pipeline->pipeline != state->pipeline->pipeline)
 	{
 		VC(device->vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
 			command->pipeline->pipeline));
 	}
 
+	// Dynamic state is kept across pipeline binds, so only what changed is set.
+	if (this->context->dynamicRasterState != 0)
+	{
+		command->pipeline->CmdSetDynamicState(cmdBuffer, command->GetRasterOperations(),
+			(state->pipeline != NULL) ? state->GetRasterOperations() : NULL);
+	}
+
 	const GpuProgramParmLayout* commandLayout = &command->pipeline->program->parmLayout;
 	const GpuProgramParmLayout* stateLayout =
 		(state->pipeline != NULL) ? &state->pipeline->program->parmLayout : NULL;
 
-	GpuCommandBuffer_UpdateProgramParms(commandBuffer, commandLayout, stateLayout,
-		&command->parmState, &state->parmState,
+	UpdateProgramParms(commandLayout, stateLayout, &command->parmState, &state->parmState,
 		VK_PIPELINE_BIND_POINT_GRAPHICS);
 
 	const GpuGeometry* geometry = command->pipeline->geometry;
@@ -451,22 +719,22 @@ void GpuCommandBuffer::SubmitGraphicsCommand( const GpuGraphicsCommand* command
 		command->vertexBuffer != state->vertexBuffer ||
 		command->instanceBuffer != state->instanceBuffer)
 	{
-		const VkBuffer vertexBuffer = (command->vertexBuffer != NULL)
-			? command->vertexBuffer->buffer
-			: geometry->vertexBuffer.buffer;
+		const GpuBuffer* vertexBuffer = (command->vertexBuffer != NULL)
+			? command->vertexBuffer
+			: &geometry->vertexBuffer;
+		const GpuBuffer* instanceBuffer = (command->instanceBuffer != NULL)
+			? command->instanceBuffer
+			: &geometry->instanceBuffer;
+
 		for (int i = 0; i < command->pipeline->firstInstanceBinding; i++)
 		{
-			VC(device->vkCmdBindVertexBuffers(cmdBuffer, i, 1, &vertexBuffer,
+			VC(device->vkCmdBindVertexBuffers(cmdBuffer, i, 1, &vertexBuffer->buffer,
 				&command->pipeline->vertexBindingOffsets[i]));
 		}
-
-		const VkBuffer instanceBuffer = (command->instanceBuffer != NULL)
-			? command->instanceBuffer->buffer
-			: geometry->instanceBuffer.buffer;
 		for (int i = command->pipeline->firstInstanceBinding;
 			i < command->pipeline->vertexBindingCount; i++)
 		{
-			VC(device->vkCmdBindVertexBuffers(cmdBuffer, i, 1, &instanceBuffer,
+			VC(device->vkCmdBindVertexBuffers(cmdBuffer, i, 1, &instanceBuffer->buffer,
 				&command->pipeline->vertexBindingOffsets[i]));
 		}
 
@@ -475,13 +743,64 @@ void GpuCommandBuffer::SubmitGraphicsCommand( const GpuGraphicsCommand* command
 			: VK_INDEX_TYPE_UINT16;
 		VC(device->vkCmdBindIndexBuffer(cmdBuffer, geometry->indexBuffer.buffer, 0, indexType));
 	}
+}
+void GpuCommandBuffer::SubmitGraphicsCommand( const GpuGraphicsCommand* command ) {
+	// A pipeline that is still compiling draws with its fallback, or not at all.
+	const GpuGraphicsPipeline* pipeline = command->pipeline->Resolve();
+	if (pipeline == NULL)
+	{
+		return;
+	}
+	GpuGraphicsCommand resolvedCommand;
+	if (pipeline != command->pipeline)
+	{
+		resolvedCommand = *command;
+		resolvedCommand.pipeline = pipeline;
+		command = &resolvedCommand;
+	}
 
-	VC(device->vkCmdDrawIndexed(cmdBuffer, geometry->indexCount, command->numInstances, 0, 0,
-		0));
+	GpuDevice* device = this->context->device;
+
+	VkCommandBuffer cmdBuffer = this->cmdBuffers[this->currentBuffer];
+
+	BindGraphicsCommand(command);
+
+	VC(device->vkCmdDrawIndexed(cmdBuffer, command->pipeline->geometry->indexCount,
+		command->numInstances, 0, 0, 0));
 
 	this->currentGraphicsState = *command;
 }
-void GpuCommandBuffer::SubmitComputeCommand( const GpuComputeCommand* command ) {
+void GpuCommandBuffer::SubmitIndirectGraphicsCommand( const GpuGraphicsCommand* command,
+	const GpuBuffer* indirectBuffer ) {
+	assert(indirectBuffer->type == GPU_BUFFER_TYPE_INDIRECT);
+
+	const GpuGraphicsPipeline* pipeline = command->pipeline->Resolve();
+	if (pipeline == NULL)
+	{
+		return;
+	}
+	GpuGraphicsCommand resolvedCommand;
+	if (pipeline != command->pipeline)
+	{
+		resolvedCommand = *command;
+		resolvedCommand.pipeline = pipeline;
+		command = &resolvedCommand;
+	}
+
+	GpuDevice* device = this->context->device;
+
+	VkCommandBuffer cmdBuffer = this->cmdBuffers[this->currentBuffer];
+
+	BindGraphicsCommand(command);
+
+	// The index and instance counts are sourced from a VkDrawIndexedIndirectCommand,
+	// typically written by a compute shader such as GpuCullingPass.
+	VC(device->vkCmdDrawIndexedIndirect(cmdBuffer, indirectBuffer->buffer, 0, 1,
+		sizeof(VkDrawIndexedIndirectCommand)));
+
+	this->currentGraphicsState = *command;
+}
+void GpuCommandBuffer::BindComputeCommand( const GpuComputeCommand* command ) {
 	assert(this->currentRenderPass == NULL);
 
 	GpuDevice* device = this->context->device;
@@ -500,14 +819,126 @@ void GpuCommandBuffer::SubmitComputeCommand( const GpuComputeCommand* command )
 	const GpuProgramParmLayout* stateLayout =
 		(state->pipeline != NULL) ? &state->pipeline->program->parmLayout : NULL;
 
-	GpuCommandBuffer_UpdateProgramParms(commandBuffer, commandLayout, stateLayout,
-		&command->parmState, &state->parmState,
+	UpdateProgramParms(commandLayout, stateLayout, &command->parmState, &state->parmState,
 		VK_PIPELINE_BIND_POINT_COMPUTE);
 
+	// Wait for earlier writes to everything the shader accesses, and for earlier reads of
+	// everything it writes. Only the synchronization state of the resources changes.
+	for (int i = 0; i < commandLayout->numBindings; i++)
+	{
+		const GpuProgramParm* binding = commandLayout->bindings[i];
+		const void*           parm = command->parmState.parms[binding->index];
+		const bool            reads = (binding->access != GPU_PROGRAM_PARM_ACCESS_WRITE_ONLY);
+		const bool            writes = (binding->access != GPU_PROGRAM_PARM_ACCESS_READ_ONLY);
+		const VkAccessFlags   shaderAccess = (reads ? VK_ACCESS_SHADER_READ_BIT : 0) |
+			(writes ? VK_ACCESS_SHADER_WRITE_BIT : 0);
+		switch (binding->type)
+		{
+			case GPU_PROGRAM_PARM_TYPE_TEXTURE_SAMPLED:
+			case GPU_PROGRAM_PARM_TYPE_TEXTURE_STORAGE:
+			{
+				const GpuTextureUsage usage =
+					(binding->type == GPU_PROGRAM_PARM_TYPE_TEXTURE_SAMPLED)
+						? GPU_TEXTURE_USAGE_SAMPLED
+						: GPU_TEXTURE_USAGE_STORAGE;
+				GpuTexture* texture =
+					const_cast<GpuTexture*>(static_cast<const GpuTexture*>(parm));
+				this->stateTracker->TextureAccess(texture, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+					(usage == GPU_TEXTURE_USAGE_SAMPLED) ? VK_ACCESS_SHADER_READ_BIT : shaderAccess,
+					LayoutForTextureUsage(usage));
+				texture->usage = usage;
+				break;
+			}
+			case GPU_PROGRAM_PARM_TYPE_BUFFER_UNIFORM:
+			case GPU_PROGRAM_PARM_TYPE_BUFFER_STORAGE:
+			{
+				GpuBuffer* buffer = const_cast<GpuBuffer*>(static_cast<const GpuBuffer*>(parm));
+				this->stateTracker->BufferAccess(buffer, 0, buffer->size,
+					VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+					(binding->type == GPU_PROGRAM_PARM_TYPE_BUFFER_UNIFORM)
+						? VK_ACCESS_UNIFORM_READ_BIT
+						: shaderAccess);
+				break;
+			}
+			default:
+				break;
+		}
+	}
+}
+void GpuCommandBuffer::MakeComputeWritesAvailable( const GpuComputeCommand* command ) {
+	// Queue the barrier from the dispatch to the regular use of every buffer it wrote, e.g. the
+	// indirect arguments and vertex fetches of a draw. It is recorded before the next command,
+	// so it does not end up inside the render pass of the draw that consumes the results.
+	// Textures are moved to their next usage with ChangeTextureUsage() as usual.
+	const GpuProgramParmLayout* layout = &command->pipeline->program->parmLayout;
+	for (int i = 0; i < layout->numBindings; i++)
+	{
+		const GpuProgramParm* binding = layout->bindings[i];
+		if (binding->type != GPU_PROGRAM_PARM_TYPE_BUFFER_STORAGE ||
+			binding->access == GPU_PROGRAM_PARM_ACCESS_READ_ONLY)
+		{
+			continue;
+		}
+		GpuBuffer* buffer = const_cast<GpuBuffer*>(
+			static_cast<const GpuBuffer*>(command->parmState.parms[binding->index]));
+		this->stateTracker->BufferAccess(buffer, 0, buffer->size,
+			GpuBuffer::GetBufferStages(buffer->type),
+			GpuBuffer::GetBufferAccess(buffer->type) & ~GPU_WRITE_ACCESS_MASK);
+	}
+}
+void GpuCommandBuffer::SubmitComputeCommand( const GpuComputeCommand* command ) {
+	GpuDevice* device = this->context->device;
+
+	VkCommandBuffer cmdBuffer = this->cmdBuffers[this->currentBuffer];
+
+	BindComputeCommand(command);
+
+	this->stateTracker->Flush();
+
 	VC(device->vkCmdDispatch(cmdBuffer, command->x, command->y, command->z));
 
+	MakeComputeWritesAvailable(command);
+
 	this->currentComputeState = *command;
 }
+void GpuCommandBuffer::SubmitIndirectComputeCommand( const GpuComputeCommand* command,
+	const GpuBuffer* indirectBuffer ) {
+	assert(indirectBuffer->type == GPU_BUFFER_TYPE_INDIRECT);
+
+	GpuDevice* device = this->context->device;
+
+	VkCommandBuffer cmdBuffer = this->cmdBuffers[this->currentBuffer];
+
+	BindComputeCommand(command);
+
+	// The work group counts are sourced from a VkDispatchIndirectCommand, typically written by
+	// an earlier dispatch.
+	this->stateTracker->BufferAccess(const_cast<GpuBuffer*>(indirectBuffer), 0,
+		sizeof(VkDispatchIndirectCommand), VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+		VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+	this->stateTracker->Flush();
+
+	VC(device->vkCmdDispatchIndirect(cmdBuffer, indirectBuffer->buffer, 0));
+
+	MakeComputeWritesAvailable(command);
+
+	this->currentComputeState = *command;
+}
+void GpuCommandBuffer::ExecuteCommandBundle( const GpuCommandBundle* bundle ) {
+	assert(this->currentRenderPass == bundle->renderPass);
+	assert(this->currentRenderPass->type == GPU_RENDERPASS_TYPE_SECONDARY_COMMAND_BUFFERS);
+	// An invalid bundle references a destroyed resource and has to be recorded again.
+	assert(bundle->IsValid() && !bundle->recording);
+
+	GpuDevice* device = this->context->device;
+
+	VkCommandBuffer cmdBuffer = this->cmdBuffers[this->currentBuffer];
+
+	VC(device->vkCmdExecuteCommands(cmdBuffer, 1, &bundle->cmdBuffer));
+
+	// The state bound by the bundle does not carry over to the primary command buffer.
+	this->currentGraphicsState = GpuGraphicsCommand();
+}
 
 GpuBuffer* GpuCommandBuffer::MapBuffer( GpuBuffer* buffer, void** data ) {
 	assert(this->currentRenderPass == NULL);
@@ -561,27 +992,11 @@ void       GpuCommandBuffer::UnmapBuffer( GpuBuffer* buffer, GpuBuffer* mappedBu
 	{
 		assert(buffer->size == mappedBuffer->size);
 
-		{
-			// Add a memory barrier for the mapped buffer from host write to DMA read.
-			VkBufferMemoryBarrier bufferMemoryBarrier;
-			bufferMemoryBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
-			bufferMemoryBarrier.pNext = NULL;
-			bufferMemoryBarrier.srcAccessMask = VK_ACCESS_HOST_WRITE_BIT;
-			bufferMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-			bufferMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-			bufferMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-			bufferMemoryBarrier.buffer = mappedBuffer->buffer;
-			bufferMemoryBarrier.offset = 0;
-			bufferMemoryBarrier.size = mappedBuffer->size;
-
-			const VkPipelineStageFlags src_stages = VK_PIPELINE_STAGE_HOST_BIT;
-			const VkPipelineStageFlags dst_stages = VK_PIPELINE_STAGE_TRANSFER_BIT;
-			const VkDependencyFlags    flags = 0;
-
-			VC(device->vkCmdPipelineBarrier(
-				this->cmdBuffers[this->currentBuffer], src_stages, dst_stages,
-				flags, 0, NULL, 1, &bufferMemoryBarrier, 0, NULL));
-		}
+		// The host writes to the mapped buffer are made visible to the copy by the queue submit.
+		// The original buffer waits for any earlier commands that still read it.
+		this->stateTracker->BufferAccess(buffer, 0, buffer->size, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_ACCESS_TRANSFER_WRITE_BIT);
+		this->stateTracker->Flush();
 
 		{
 			// Copy back to the original buffer.
@@ -594,28 +1009,10 @@ void       GpuCommandBuffer::UnmapBuffer( GpuBuffer* buffer, GpuBuffer* mappedBu
 				mappedBuffer->buffer, buffer->buffer, 1, &bufferCopy));
 		}
 
-		{
-			// Add a memory barrier for the original buffer from DMA write to the buffer access.
-			VkBufferMemoryBarrier bufferMemoryBarrier;
-			bufferMemoryBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
-			bufferMemoryBarrier.pNext = NULL;
-			bufferMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-			bufferMemoryBarrier.dstAccessMask = GpuBuffer_GetBufferAccess(buffer->type);
-			bufferMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-			bufferMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-			bufferMemoryBarrier.buffer = buffer->buffer;
-			bufferMemoryBarrier.offset = 0;
-			bufferMemoryBarrier.size = buffer->size;
-
-			const VkPipelineStageFlags src_stages = VK_PIPELINE_STAGE_TRANSFER_BIT;
-			const VkPipelineStageFlags dst_stages =
-				VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT; // fixme: optimise
-			const VkDependencyFlags flags = 0;
-
-			VC(device->vkCmdPipelineBarrier(
-				this->cmdBuffers[this->currentBuffer], src_stages, dst_stages,
-				flags, 0, NULL, 1, &bufferMemoryBarrier, 0, NULL));
-		}
+		// The barrier from the copy to the stages that consume the buffer is recorded right
+		// before the next command, batched with any other pending barriers.
+		this->stateTracker->BufferAccess(buffer, 0, buffer->size,
+			GpuBuffer::GetBufferStages(buffer->type), GpuBuffer::GetBufferAccess(buffer->type));
 	}
 	else
 	{
@@ -0,0 +1,372 @@
+#include "GpuCommandBundle.hpp"
+#include "GpuBindless.hpp"
+#include "GpuBuffer.hpp"
+#include "GpuCommandBuffer.hpp"
+#include "GpuDescriptorSetCache.hpp"
+#include "GpuDevice.hpp"
+#include "GpuGeometry.hpp"
+#include "GpuGraphicsPipeline.hpp"
+#include "GpuRenderPass.hpp"
+
+namespace lxd
+{
+
+GpuCommandBundle::GpuCommandBundle( GpuContext* context, GpuRenderPass* renderPass )
+    : context( *context )
+{
+    assert( renderPass->type == GPU_RENDERPASS_TYPE_SECONDARY_COMMAND_BUFFERS );
+
+    this->renderPass = renderPass;
+
+    VkCommandBufferAllocateInfo commandBufferAllocateInfo;
+    commandBufferAllocateInfo.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    commandBufferAllocateInfo.pNext              = nullptr;
+    commandBufferAllocateInfo.commandPool        = context->commandPool;
+    commandBufferAllocateInfo.level              = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+    commandBufferAllocateInfo.commandBufferCount = 1;
+
+    VK( context->device->vkAllocateCommandBuffers( context->device->device,
+                                                   &commandBufferAllocateInfo, &this->cmdBuffer ) );
+
+    context->RegisterCommandBundle( this );
+}
+
+GpuCommandBundle::~GpuCommandBundle()
+{
+    assert( !this->recording );
+
+    context.UnregisterCommandBundle( this );
+
+    VC( context.device->vkFreeCommandBuffers( context.device->device, context.commandPool, 1,
+                                              &this->cmdBuffer ) );
+
+    delete this->descriptorSetCache;
+    delete this->spillBuffer;
+    for ( int i = 0; i < this->numFullSpillBuffers; i++ )
+    {
+        delete this->fullSpillBuffers[i];
+    }
+    free( this->fullSpillBuffers );
+    free( this->references );
+}
+
+void GpuCommandBundle::Begin( const ScreenRect* rect )
+{
+    assert( !this->recording );
+
+    GpuDevice* device = context.device;
+
+    // The descriptor sets of the previous recording are no longer referenced. Neither are the
+    // spill buffers it filled up, the current one is large enough to hold all of its data.
+    delete this->descriptorSetCache;
+    this->descriptorSetCache = new GpuDescriptorSetCache( &context );
+    for ( int i = 0; i < this->numFullSpillBuffers; i++ )
+    {
+        delete this->fullSpillBuffers[i];
+    }
+    this->numFullSpillBuffers  = 0;
+    this->spillBufferOffset    = 0;
+    this->numReferences        = 0;
+    this->currentGraphicsState = GpuGraphicsCommand();
+
+    VK( device->vkResetCommandBuffer( this->cmdBuffer, 0 ) );
+
+    VkCommandBufferInheritanceInfo inheritanceInfo;
+    inheritanceInfo.sType                = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.pNext                = nullptr;
+    inheritanceInfo.renderPass           = this->renderPass->renderPass;
+    inheritanceInfo.subpass              = 0;
+    inheritanceInfo.framebuffer          = VK_NULL_HANDLE;
+    inheritanceInfo.occlusionQueryEnable = VK_FALSE;
+    inheritanceInfo.queryFlags           = 0;
+    inheritanceInfo.pipelineStatistics   = 0;
+
+    // Simultaneous use because the bundle is replayed by every command buffer in the ring.
+    VkCommandBufferBeginInfo commandBufferBeginInfo;
+    commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    commandBufferBeginInfo.pNext = nullptr;
+    commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT |
+                                   VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+    commandBufferBeginInfo.pInheritanceInfo = &inheritanceInfo;
+
+    VK( device->vkBeginCommandBuffer( this->cmdBuffer, &commandBufferBeginInfo ) );
+
+    VkViewport viewport;
+    viewport.x        = (float)rect->x;
+    viewport.y        = (float)rect->y;
+    viewport.width    = (float)rect->width;
+    viewport.height   = (float)rect->height;
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    VC( device->vkCmdSetViewport( this->cmdBuffer, 0, 1, &viewport ) );
+
+    VkRect2D scissor;
+    scissor.offset.x      = rect->x;
+    scissor.offset.y      = rect->y;
+    scissor.extent.width  = rect->width;
+    scissor.extent.height = rect->height;
+    VC( device->vkCmdSetScissor( this->cmdBuffer, 0, 1, &scissor ) );
+
+    this->recording = true;
+    this->valid     = true;
+}
+
+void GpuCommandBundle::SubmitGraphicsCommand( const GpuGraphicsCommand* command )
+{
+    assert( this->recording );
+
+    // A pipeline that is still compiling is recorded with its fallback, or not at all. The
+    // bundle references the pipeline, so it is recorded again once the pipeline is compiled.
+    const GpuGraphicsPipeline* pipeline = command->pipeline->Resolve();
+    GpuGraphicsCommand         resolvedCommand;
+    if ( pipeline != command->pipeline )
+    {
+        AddReference( command->pipeline );
+        if ( pipeline == nullptr )
+        {
+            return;
+        }
+        resolvedCommand          = *command;
+        resolvedCommand.pipeline = pipeline;
+        command                  = &resolvedCommand;
+    }
+
+    GpuDevice*                device = context.device;
+    const GpuGraphicsCommand* state  = &this->currentGraphicsState;
+
+    if ( command->pipeline != state->pipeline )
+    {
+        // Pipelines that only differ in dynamic state share one.
+        if ( state->pipeline == nullptr ||
+             command->pipeline->pipeline != state->pipeline->pipeline )
+        {
+            VC( device->vkCmdBindPipeline( this->cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                           command->pipeline->pipeline ) );
+        }
+        AddReference( command->pipeline );
+        AddReference( command->pipeline->program );
+    }
+
+    // A bundle does not inherit dynamic state, the first draw sets all of it.
+    if ( context.dynamicRasterState != 0 )
+    {
+        command->pipeline->CmdSetDynamicState(
+            this->cmdBuffer, command->GetRasterOperations(),
+            ( state->pipeline != nullptr ) ? state->GetRasterOperations() : nullptr );
+    }
+
+    const GpuProgramParmLayout* commandLayout = &command->pipeline->program->parmLayout;
+    const GpuProgramParmLayout* stateLayout =
+        ( state->pipeline != nullptr ) ? &state->pipeline->program->parmLayout : nullptr;
+
+    for ( int i = 0; i < commandLayout->numBindings; i++ )
+    {
+        AddReference( command->parmState.parms[commandLayout->bindings[i]->index] );
+    }
+
+    UpdateProgramParms( commandLayout, stateLayout, &command->parmState, &state->parmState );
+
+    const GpuGeometry* geometry = command->pipeline->geometry;
+
+    if ( state->pipeline == nullptr || geometry != state->pipeline->geometry ||
+         command->vertexBuffer != state->vertexBuffer ||
+         command->instanceBuffer != state->instanceBuffer )
+    {
+        const GpuBuffer* vertexBuffer =
+            ( command->vertexBuffer != nullptr ) ? command->vertexBuffer : &geometry->vertexBuffer;
+        for ( int i = 0; i < command->pipeline->firstInstanceBinding; i++ )
+        {
+            VC( device->vkCmdBindVertexBuffers( this->cmdBuffer, i, 1, &vertexBuffer->buffer,
+                                                &command->pipeline->vertexBindingOffsets[i] ) );
+        }
+
+        const GpuBuffer* instanceBuffer = ( command->instanceBuffer != nullptr )
+                                              ? command->instanceBuffer
+                                              : &geometry->instanceBuffer;
+        for ( int i = command->pipeline->firstInstanceBinding;
+              i < command->pipeline->vertexBindingCount; i++ )
+        {
+            VC( device->vkCmdBindVertexBuffers( this->cmdBuffer, i, 1, &instanceBuffer->buffer,
+                                                &command->pipeline->vertexBindingOffsets[i] ) );
+        }
+
+        const VkIndexType indexType = ( sizeof( GpuTriangleIndex ) == sizeof( unsigned int ) )
+                                          ? VK_INDEX_TYPE_UINT32
+                                          : VK_INDEX_TYPE_UINT16;
+        VC( device->vkCmdBindIndexBuffer( this->cmdBuffer, geometry->indexBuffer.buffer, 0,
+                                          indexType ) );
+
+        AddReference( vertexBuffer );
+        AddReference( instanceBuffer );
+        AddReference( &geometry->indexBuffer );
+    }
+
+    VC( device->vkCmdDrawIndexed( this->cmdBuffer, geometry->indexCount, command->numInstances, 0,
+                                  0, 0 ) );
+
+    this->currentGraphicsState = *command;
+}
+
+void GpuCommandBundle::End()
+{
+    assert( this->recording );
+
+    GpuDevice* device = context.device;
+
+    FlushSpillBuffer();
+
+    VK( device->vkEndCommandBuffer( this->cmdBuffer ) );
+
+    this->recording = false;
+}
+
+void GpuCommandBundle::Invalidate( const void* resource )
+{
+    for ( int i = 0; i < this->numReferences; i++ )
+    {
+        if ( this->references[i] == resource )
+        {
+            this->valid = false;
+            return;
+        }
+    }
+}
+
+void GpuCommandBundle::AddReference( const void* resource )
+{
+    if ( resource == nullptr )
+    {
+        return;
+    }
+    // Consecutive draws mostly share resources, so only look at the most recent references.
+    for ( int i = this->numReferences - 1; i >= 0 && i >= this->numReferences - 8; i-- )
+    {
+        if ( this->references[i] == resource )
+        {
+            return;
+        }
+    }
+    if ( this->numReferences >= this->maxReferences )
+    {
+        this->maxReferences = ( this->maxReferences > 0 ) ? this->maxReferences * 2 : 64;
+        this->references    = static_cast<const void**>(
+            realloc( this->references, this->maxReferences * sizeof( const void* ) ) );
+    }
+    this->references[this->numReferences++] = resource;
+}
+
+void GpuCommandBundle::UpdateProgramParms( const GpuProgramParmLayout* newLayout,
+                                           const GpuProgramParmLayout* oldLayout,
+                                           const GpuProgramParmState*  newParmState,
+                                           const GpuProgramParmState*  oldParmState )
+{
+    GpuDevice* device = context.device;
+
+    const bool descriptorsMatch =
+        GpuProgramParmState::DescriptorsMatch( newLayout, newParmState, oldLayout, oldParmState );
+    const bool spillDataMatch =
+        GpuProgramParmState::SpillDataMatch( newLayout, newParmState, oldLayout, oldParmState );
+    if ( ( !descriptorsMatch || !spillDataMatch ) &&
+         ( newLayout->numBindings > 0 || newLayout->packing.spillSize > 0 ) )
+    {
+        uint32_t dynamicOffset      = 0;
+        uint32_t dynamicOffsetCount = 0;
+        if ( newLayout->packing.spillSize > 0 )
+        {
+            dynamicOffset = UploadSpillData( &newParmState->data[newLayout->spillDataOffset],
+                                             newLayout->packing.spillSize );
+            dynamicOffsetCount = 1;
+        }
+
+        const VkDescriptorSet descriptorSet = this->descriptorSetCache->GetDescriptorSet(
+            newLayout, newParmState, this->spillBuffer );
+
+        VC( device->vkCmdBindDescriptorSets( this->cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                             newLayout->pipelineLayout, 0, 1, &descriptorSet,
+                                             dynamicOffsetCount, &dynamicOffset ) );
+    }
+
+    if ( context.bindless != nullptr &&
+         ( oldLayout == nullptr || oldLayout->pipelineLayout != newLayout->pipelineLayout ) )
+    {
+        VC( device->vkCmdBindDescriptorSets( this->cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                             newLayout->pipelineLayout,
+                                             GPU_BINDLESS_DESCRIPTOR_SET, 1,
+                                             &context.bindless->descriptorSet, 0, nullptr ) );
+    }
+
+    VkPushConstantRange ranges[MAX_PUSH_CONSTANT_RANGES];
+    const int           numRanges = GpuProgramParmState::NewPushConstantRanges(
+        newLayout, newParmState, oldLayout, oldParmState, ranges );
+    for ( int i = 0; i < numRanges; i++ )
+    {
+        VC( device->vkCmdPushConstants( this->cmdBuffer, newLayout->pipelineLayout,
+                                        ranges[i].stageFlags, ranges[i].offset, ranges[i].size,
+                                        &newParmState->data[ranges[i].offset] ) );
+    }
+}
+
+uint32_t GpuCommandBundle::UploadSpillData( const void* data, const int size )
+{
+    const int alignment =
+        (int)context.device->physicalDeviceProperties.limits.minUniformBufferOffsetAlignment;
+    int offset = ( this->spillBufferOffset + alignment - 1 ) & ~( alignment - 1 );
+    if ( this->spillBuffer == nullptr || (size_t)( offset + size ) > this->spillBuffer->size )
+    {
+        NewSpillBuffer( size );
+        offset = 0;
+    }
+
+    memcpy( (unsigned char*)this->spillBuffer->mapped + offset, data, size );
+    this->spillBufferOffset = offset + size;
+
+    return (uint32_t)offset;
+}
+
+void GpuCommandBundle::NewSpillBuffer( const int size )
+{
+    size_t spillSize = GPU_COMMAND_BUNDLE_SPILL_SIZE;
+    if ( this->spillBuffer != nullptr )
+    {
+        // The draws recorded so far keep reading the full buffer, so it lives until the next
+        // recording, and the rest of this one continues in a buffer twice as large.
+        FlushSpillBuffer();
+        if ( this->numFullSpillBuffers >= this->maxFullSpillBuffers )
+        {
+            this->maxFullSpillBuffers =
+                ( this->maxFullSpillBuffers > 0 ) ? this->maxFullSpillBuffers * 2 : 4;
+            this->fullSpillBuffers = static_cast<GpuBuffer**>( realloc(
+                this->fullSpillBuffers, this->maxFullSpillBuffers * sizeof( GpuBuffer* ) ) );
+        }
+        this->fullSpillBuffers[this->numFullSpillBuffers++] = this->spillBuffer;
+        spillSize = 2 * this->spillBuffer->size;
+    }
+    while ( spillSize < (size_t)size )
+    {
+        spillSize *= 2;
+    }
+
+    this->spillBuffer =
+        new GpuBuffer( &context, GPU_BUFFER_TYPE_UNIFORM, spillSize, nullptr, true );
+    VK( context.device->vkMapMemory( context.device->device, this->spillBuffer->memory, 0,
+                                     VK_WHOLE_SIZE, 0, &this->spillBuffer->mapped ) );
+    this->spillBufferOffset = 0;
+}
+
+void GpuCommandBundle::FlushSpillBuffer()
+{
+    // The spill buffer may not be host coherent.
+    if ( this->spillBufferOffset > 0 )
+    {
+        VkMappedMemoryRange mappedMemoryRange;
+        mappedMemoryRange.sType  = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+        mappedMemoryRange.pNext  = nullptr;
+        mappedMemoryRange.memory = this->spillBuffer->memory;
+        mappedMemoryRange.offset = 0;
+        mappedMemoryRange.size   = VK_WHOLE_SIZE;
+        VC( context.device->vkFlushMappedMemoryRanges( context.device->device, 1,
+                                                       &mappedMemoryRange ) );
+    }
+}
+
+} // namespace lxd
@@ -1,6 +1,71 @@
 #include "GpuComputeCommand.hpp"
+#include "GpuComputePipeline.hpp"
+#include "GpuComputeProgram.hpp"
 
 namespace lxd
 {
+GpuComputeCommand::GpuComputeCommand() {}
 
-}
\ No newline at end of file
+GpuComputeCommand::~GpuComputeCommand() {}
+
+void GpuComputeCommand::SetPipeline( const GpuComputePipeline* pipeline )
+{
+    this->pipeline = pipeline;
+}
+void GpuComputeCommand::SetParmTextureSampled( const int index, const GpuTexture* texture )
+{
+    this->parmState.SetParm( &this->pipeline->program->parmLayout, index,
+                             GPU_PROGRAM_PARM_TYPE_TEXTURE_SAMPLED, texture );
+}
+void GpuComputeCommand::SetParmTextureStorage( const int index, const GpuTexture* texture )
+{
+    this->parmState.SetParm( &this->pipeline->program->parmLayout, index,
+                             GPU_PROGRAM_PARM_TYPE_TEXTURE_STORAGE, texture );
+}
+void GpuComputeCommand::SetParmBufferUniform( const int index, const GpuBuffer* buffer )
+{
+    this->parmState.SetParm( &this->pipeline->program->parmLayout, index,
+                             GPU_PROGRAM_PARM_TYPE_BUFFER_UNIFORM, buffer );
+}
+void GpuComputeCommand::SetParmBufferStorage( const int index, const GpuBuffer* buffer )
+{
+    this->parmState.SetParm( &this->pipeline->program->parmLayout, index,
+                             GPU_PROGRAM_PARM_TYPE_BUFFER_STORAGE, buffer );
+}
+void GpuComputeCommand::SetParmInt( const int index, const int* value )
+{
+    this->parmState.SetParm( &this->pipeline->program->parmLayout, index,
+                             GPU_PROGRAM_PARM_TYPE_PUSH_CONSTANT_INT, value );
+}
+void GpuComputeCommand::SetParmFloat( const int index, const float* value )
+{
+    this->parmState.SetParm( &this->pipeline->program->parmLayout, index,
+                             GPU_PROGRAM_PARM_TYPE_PUSH_CONSTANT_FLOAT, value );
+}
+void GpuComputeCommand::SetParmFloatVector2( const int index, const Vector2* value )
+{
+    this->parmState.SetParm( &this->pipeline->program->parmLayout, index,
+                             GPU_PROGRAM_PARM_TYPE_PUSH_CONSTANT_FLOAT_VECTOR2, value );
+}
+void GpuComputeCommand::SetParmFloatVector3( const int index, const Vector3* value )
+{
+    this->parmState.SetParm( &this->pipeline->program->parmLayout, index,
+                             GPU_PROGRAM_PARM_TYPE_PUSH_CONSTANT_FLOAT_VECTOR3, value );
+}
+void GpuComputeCommand::SetParmFloatVector4( const int index, const Vector4* value )
+{
+    this->parmState.SetParm( &this->pipeline->program->parmLayout, index,
+                             GPU_PROGRAM_PARM_TYPE_PUSH_CONSTANT_FLOAT_VECTOR4, value );
+}
+void GpuComputeCommand::SetParmFloatMatrix4x4( const int index, const Matrix4x4* value )
+{
+    this->parmState.SetParm( &this->pipeline->program->parmLayout, index,
+                             GPU_PROGRAM_PARM_TYPE_PUSH_CONSTANT_FLOAT_MATRIX4X4, value );
+}
+void GpuComputeCommand::SetDimensions( const int x, const int y, const int z )
+{
+    this->x = x;
+    this->y = y;
+    this->z = z;
+}
+} // namespace lxd
@@ -0,0 +1,32 @@
+#include "GpuComputePipeline.hpp"
+#include "GpuComputeProgram.hpp"
+#include "GpuDeletionQueue.hpp"
+#include "GpuDevice.hpp"
+
+namespace lxd
+{
+GpuComputePipeline::GpuComputePipeline( GpuContext* context, const GpuComputeProgram* program )
+    : context( *context )
+{
+    this->program = program;
+
+    VkComputePipelineCreateInfo computePipelineCreateInfo;
+    computePipelineCreateInfo.sType              = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    computePipelineCreateInfo.pNext              = nullptr;
+    computePipelineCreateInfo.flags              = 0;
+    computePipelineCreateInfo.stage              = program->pipelineStage;
+    computePipelineCreateInfo.layout             = program->parmLayout.pipelineLayout;
+    computePipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
+    computePipelineCreateInfo.basePipelineIndex  = 0;
+
+    VK( context->device->vkCreateComputePipelines( context->device->device,
+                                                   context->pipelineCache, 1,
+                                                   &computePipelineCreateInfo, VK_ALLOCATOR,
+                                                   &this->pipeline ) );
+}
+
+GpuComputePipeline::~GpuComputePipeline()
+{
+    context.deletionQueue->Destroy( GPU_DELETION_TYPE_PIPELINE, (uint64_t)this->pipeline );
+}
+} // namespace lxd
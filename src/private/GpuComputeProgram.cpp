@@ -0,0 +1,56 @@
+#include "GpuComputeProgram.hpp"
+#include "GpuDevice.hpp"
+#include "GpuShaderCache.hpp"
+#include "GpuShaderReflection.hpp"
+
+namespace lxd
+{
+GpuComputeProgram::GpuComputeProgram( GpuContext* context, const void* computeSourceData,
+                                      const size_t computeSourceSize, const GpuProgramParm* parms,
+                                      const int numParms )
+    : context( *context ), parmLayout( context, parms, numParms )
+{
+    this->computeShader = context->device->shaderCache->Acquire(
+        VK_SHADER_STAGE_COMPUTE_BIT, computeSourceData, computeSourceSize );
+    InitStage();
+}
+
+GpuComputeProgram::GpuComputeProgram( GpuContext* context, const GpuShaderBlob* computeShader,
+                                      const GpuProgramParm* parms, const int numParms )
+    : context( *context ), parmLayout( context, parms, numParms )
+{
+    assert( computeShader->stage == VK_SHADER_STAGE_COMPUTE_BIT );
+    this->computeShader = context->device->shaderCache->Acquire( computeShader );
+    InitStage();
+}
+
+GpuComputeProgram::GpuComputeProgram( GpuContext* context, const GpuShaderBlob* computeShader )
+    : context( *context ),
+      reflection( new GpuProgramReflection( computeShader ) ),
+      parmLayout( context, reflection->parms, reflection->numParms )
+{
+    assert( computeShader->stage == VK_SHADER_STAGE_COMPUTE_BIT );
+    this->computeShader = context->device->shaderCache->Acquire( computeShader );
+    InitStage();
+}
+
+void GpuComputeProgram::InitStage()
+{
+    // Compute pipelines are few and created up front, so the module is created right away.
+    GpuShaderCache* shaderCache = context.device->shaderCache;
+
+    this->pipelineStage.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    this->pipelineStage.pNext  = nullptr;
+    this->pipelineStage.flags  = 0;
+    this->pipelineStage.stage  = VK_SHADER_STAGE_COMPUTE_BIT;
+    this->pipelineStage.module = shaderCache->GetModule( this->computeShader );
+    this->pipelineStage.pName  = "main";
+    this->pipelineStage.pSpecializationInfo = nullptr;
+}
+
+GpuComputeProgram::~GpuComputeProgram()
+{
+    context.device->shaderCache->Release( this->computeShader );
+    delete this->reflection;
+}
+} // namespace lxd
@@ -1,20 +1,42 @@
 #include <GpuContext.hpp>
+#include "GpuBindless.hpp"
+#include "GpuCommandBundle.hpp"
+#include "GpuDeletionQueue.hpp"
 #include "GpuDevice.hpp"
+#include "GpuPipelineRegistry.hpp"
+#include "GpuSubmitBatch.hpp"
+#include "GpuSubmitQueue.hpp"
+#include "GpuTimeline.hpp"
 #include "threading.h"
 
 namespace lxd
 {
-GpuContext::GpuContext( GpuDevice* device, const int queueIndex )
+GpuContext::GpuContext( GpuDevice* device, const int queueIndex, const int queueProperties )
 {
+    const bool asyncCompute = ( queueProperties & GPU_QUEUE_PROPERTY_GRAPHICS ) == 0 &&
+                              ( queueProperties & GPU_QUEUE_PROPERTY_COMPUTE ) != 0;
+    assert( !asyncCompute || device->computeQueueFamilyIndex != -1 );
+    const int queueFamilyIndex =
+        asyncCompute ? device->computeQueueFamilyIndex : device->workQueueFamilyIndex;
+
     ksMutex_Lock( &device->queueFamilyMutex, true );
-    assert( ( device->queueFamilyUsedQueues[device->workQueueFamilyIndex] & ( 1 << queueIndex ) ) ==
-            0 );
-    device->queueFamilyUsedQueues[device->workQueueFamilyIndex] |= ( 1 << queueIndex );
+    assert( ( device->queueFamilyUsedQueues[queueFamilyIndex] & ( 1 << queueIndex ) ) == 0 );
+    device->queueFamilyUsedQueues[queueFamilyIndex] |= ( 1 << queueIndex );
     ksMutex_Unlock( &device->queueFamilyMutex );
 
-    this->device           = device;
-    this->queueFamilyIndex = device->workQueueFamilyIndex;
-    this->queueIndex       = queueIndex;
+    this->device             = device;
+    this->queueFamilyIndex   = queueFamilyIndex;
+    this->queueIndex         = queueIndex;
+    this->bindless           = nullptr;
+    this->submitQueue        = nullptr;
+    this->dynamicRasterState = 0;
+    this->pipelineLibraries  = false;
+    this->commandBundles     = nullptr;
+
+    this->setupCommandBuffer   = VK_NULL_HANDLE;
+    this->setupRecordingTicket = 0;
+
+    ksMutex_Create( &this->commandBundleMutex );
 
     VC( device->vkGetDeviceQueue( device->device, this->queueFamilyIndex, this->queueIndex,
                                   &this->queue ) );
@@ -37,6 +59,11 @@ GpuContext::GpuContext( GpuDevice* device, const int queueIndex )
 
     VK( device->vkCreatePipelineCache( device->device, &pipelineCacheCreateInfo, VK_ALLOCATOR,
                                        &this->pipelineCache ) );
+
+    this->timeline         = new GpuTimeline( this );
+    this->submitBatch      = new GpuSubmitBatch( this );
+    this->deletionQueue    = new GpuDeletionQueue( this );
+    this->pipelineRegistry = new GpuPipelineRegistry( this );
 }
 
 void GpuContext::CreateShared( const GpuContext* other, const int queueIndex )
@@ -58,6 +85,23 @@ GpuContext::~GpuContext()
     this->device->queueFamilyUsedQueues[this->queueFamilyIndex] &= ~( 1 << this->queueIndex );
     ksMutex_Unlock( &this->device->queueFamilyMutex );
 
+    // A setup command buffer that was never flushed is never submitted.
+    if ( this->setupRecordingTicket != 0 )
+    {
+        this->timeline->EndRecording( this->setupRecordingTicket, 0 );
+    }
+
+    // Waits for everything submitted through the timeline, also releases bindless indices.
+    delete this->submitBatch;
+    delete this->submitQueue;
+    delete this->pipelineRegistry;
+    delete this->deletionQueue;
+    delete this->bindless;
+    delete this->timeline;
+
+    assert( this->commandBundles == nullptr );
+    ksMutex_Destroy( &this->commandBundleMutex );
+
     if ( nullptr != this->setupCommandBuffer )
     {
         VC( this->device->vkFreeCommandBuffers( this->device->device, this->commandPool, 1,
@@ -71,6 +115,249 @@ GpuContext::~GpuContext()
 
 void GpuContext::WaitIdle() { VK( this->device->vkQueueWaitIdle( this->queue ) ); }
 
+bool GpuContext::EnableBindless()
+{
+    if ( !this->device->supportsBindless )
+    {
+        return false;
+    }
+    if ( this->bindless == nullptr )
+    {
+        this->bindless = new GpuBindlessTable( this );
+    }
+    return true;
+}
+
+bool GpuContext::EnableSubmitQueue()
+{
+    if ( !this->device->supportsTimelineSemaphores )
+    {
+        return false;
+    }
+    if ( this->submitQueue == nullptr )
+    {
+        this->submitBatch->Flush();
+        this->submitQueue = new GpuSubmitQueue( this );
+    }
+    return true;
+}
+
+bool GpuContext::EnableDynamicRasterState()
+{
+    if ( !this->device->supportsExtendedDynamicState )
+    {
+        return false;
+    }
+    this->dynamicRasterState = GPU_DYNAMIC_RASTER_STATE_DEPTH_CULL;
+    if ( this->device->supportsExtendedDynamicState3 )
+    {
+        this->dynamicRasterState |= GPU_DYNAMIC_RASTER_STATE_BLEND;
+    }
+    return true;
+}
+
+bool GpuContext::EnablePipelineLibraries()
+{
+    if ( !this->device->supportsGraphicsPipelineLibrary )
+    {
+        return false;
+    }
+    this->pipelineLibraries = true;
+    return true;
+}
+
+// Prefix of a pipeline cache file. The header of the cache data itself has no driver version, and
+// the checksum catches files that were cut short.
+struct GpuPipelineCacheFileHeader
+{
+    uint32_t     magic;
+    uint32_t     version;
+    uint32_t     vendorID;
+    uint32_t     deviceID;
+    uint32_t     driverVersion;
+    uint8_t      pipelineCacheUUID[VK_UUID_SIZE];
+    uint64_t     dataSize;
+    unsigned int dataHash;
+};
+
+static const uint32_t GPU_PIPELINE_CACHE_FILE_MAGIC   = 0x43505847; // 'GXPC'
+static const uint32_t GPU_PIPELINE_CACHE_FILE_VERSION = 1;
+
+static unsigned int PipelineCacheDataHash( const unsigned char* data, const size_t size )
+{
+    unsigned int hash = 5381;
+    for ( size_t i = 0; i < size; i++ )
+    {
+        hash = ( ( hash << 5 ) - hash ) + data[i];
+    }
+    return hash;
+}
+
+static void InitPipelineCacheFileHeader( GpuPipelineCacheFileHeader* header,
+                                         const VkPhysicalDeviceProperties* properties,
+                                         const unsigned char* data, const size_t dataSize )
+{
+    memset( header, 0, sizeof( GpuPipelineCacheFileHeader ) );
+    header->magic         = GPU_PIPELINE_CACHE_FILE_MAGIC;
+    header->version       = GPU_PIPELINE_CACHE_FILE_VERSION;
+    header->vendorID      = properties->vendorID;
+    header->deviceID      = properties->deviceID;
+    header->driverVersion = properties->driverVersion;
+    memcpy( header->pipelineCacheUUID, properties->pipelineCacheUUID, VK_UUID_SIZE );
+    header->dataSize = dataSize;
+    header->dataHash = PipelineCacheDataHash( data, dataSize );
+}
+
+bool GpuContext::LoadPipelineCache( const char* fileName )
+{
+    FILE* file = fopen( fileName, "rb" );
+    if ( file == nullptr )
+    {
+        return false;
+    }
+
+    fseek( file, 0, SEEK_END );
+    const long fileSize = ftell( file );
+    fseek( file, 0, SEEK_SET );
+
+    GpuPipelineCacheFileHeader header;
+    if ( fileSize < (long)sizeof( header ) || fread( &header, sizeof( header ), 1, file ) != 1 ||
+         header.dataSize != (uint64_t)( fileSize - sizeof( header ) ) )
+    {
+        fclose( file );
+        Print( "Pipeline cache '%s' is truncated.\n", fileName );
+        return false;
+    }
+
+    unsigned char* data = static_cast<unsigned char*>( malloc( (size_t)header.dataSize ) );
+    const bool     read = fread( data, (size_t)header.dataSize, 1, file ) == 1;
+    fclose( file );
+
+    GpuPipelineCacheFileHeader expected;
+    InitPipelineCacheFileHeader( &expected, &this->device->physicalDeviceProperties, data,
+                                 read ? (size_t)header.dataSize : 0 );
+
+    // The data starts with a VkPipelineCacheHeaderVersionOne, which has to match as well.
+    const VkPipelineCacheHeaderVersionOne* cacheHeader =
+        reinterpret_cast<const VkPipelineCacheHeaderVersionOne*>( data );
+    if ( !read || memcmp( &header, &expected, sizeof( header ) ) != 0 ||
+         header.dataSize < sizeof( VkPipelineCacheHeaderVersionOne ) ||
+         cacheHeader->headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+         cacheHeader->vendorID != expected.vendorID || cacheHeader->deviceID != expected.deviceID ||
+         memcmp( cacheHeader->pipelineCacheUUID, expected.pipelineCacheUUID, VK_UUID_SIZE ) != 0 )
+    {
+        free( data );
+        Print( "Pipeline cache '%s' does not match the device or driver.\n", fileName );
+        return false;
+    }
+
+    VkPipelineCacheCreateInfo pipelineCacheCreateInfo;
+    pipelineCacheCreateInfo.sType           = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    pipelineCacheCreateInfo.pNext           = nullptr;
+    pipelineCacheCreateInfo.flags           = 0;
+    pipelineCacheCreateInfo.initialDataSize = (size_t)header.dataSize;
+    pipelineCacheCreateInfo.pInitialData    = data;
+
+    VkPipelineCache fileCache;
+    VK( this->device->vkCreatePipelineCache( this->device->device, &pipelineCacheCreateInfo,
+                                             VK_ALLOCATOR, &fileCache ) );
+    free( data );
+
+    // The workers of a GpuPipelineCompiler hold on to the handle of the context cache, so the
+    // file is merged into it instead of replacing it, which also keeps anything that was
+    // compiled before the file was loaded.
+    VK( this->device->vkMergePipelineCaches( this->device->device, this->pipelineCache, 1,
+                                             &fileCache ) );
+    VC( this->device->vkDestroyPipelineCache( this->device->device, fileCache, VK_ALLOCATOR ) );
+    return true;
+}
+
+bool GpuContext::SavePipelineCache( const char* fileName )
+{
+    size_t dataSize = 0;
+    VK( this->device->vkGetPipelineCacheData( this->device->device, this->pipelineCache,
+                                              &dataSize, nullptr ) );
+    unsigned char* data = static_cast<unsigned char*>( malloc( dataSize ) );
+    VK( this->device->vkGetPipelineCacheData( this->device->device, this->pipelineCache,
+                                              &dataSize, data ) );
+
+    GpuPipelineCacheFileHeader header;
+    InitPipelineCacheFileHeader( &header, &this->device->physicalDeviceProperties, data,
+                                 dataSize );
+
+    char tempFileName[1024];
+    snprintf( tempFileName, sizeof( tempFileName ), "%s.tmp", fileName );
+
+    FILE* file = fopen( tempFileName, "wb" );
+    if ( file == nullptr )
+    {
+        free( data );
+        return false;
+    }
+    bool written = fwrite( &header, sizeof( header ), 1, file ) == 1 &&
+                   fwrite( data, dataSize, 1, file ) == 1;
+    written = ( fclose( file ) == 0 ) && written;
+    free( data );
+
+    if ( !written )
+    {
+        remove( tempFileName );
+        return false;
+    }
+
+#if defined( OS_WINDOWS )
+    const bool renamed = MoveFileExA( tempFileName, fileName, MOVEFILE_REPLACE_EXISTING ) != 0;
+#else
+    const bool renamed = rename( tempFileName, fileName ) == 0;
+#endif
+    if ( !renamed )
+    {
+        remove( tempFileName );
+    }
+    return renamed;
+}
+
+void GpuContext::MergePipelineCache( const GpuContext* other )
+{
+    assert( other->device == this->device );
+    VK( this->device->vkMergePipelineCaches( this->device->device, this->pipelineCache, 1,
+                                             &other->pipelineCache ) );
+}
+
+void GpuContext::RegisterCommandBundle( GpuCommandBundle* bundle )
+{
+    ksMutex_Lock( &this->commandBundleMutex, true );
+    bundle->next         = this->commandBundles;
+    this->commandBundles = bundle;
+    ksMutex_Unlock( &this->commandBundleMutex );
+}
+
+void GpuContext::UnregisterCommandBundle( GpuCommandBundle* bundle )
+{
+    ksMutex_Lock( &this->commandBundleMutex, true );
+    for ( GpuCommandBundle** link = &this->commandBundles; *link != nullptr;
+          link                    = &( *link )->next )
+    {
+        if ( *link == bundle )
+        {
+            *link = bundle->next;
+            break;
+        }
+    }
+    ksMutex_Unlock( &this->commandBundleMutex );
+}
+
+void GpuContext::InvalidateCommandBundles( const void* resource )
+{
+    ksMutex_Lock( &this->commandBundleMutex, true );
+    for ( GpuCommandBundle* bundle = this->commandBundles; bundle != nullptr;
+          bundle                   = bundle->next )
+    {
+        bundle->Invalidate( resource );
+    }
+    ksMutex_Unlock( &this->commandBundleMutex );
+}
+
 void GpuContext::GetLimits( GpuLimits* limits )
 {
     limits->maxPushConstantsSize =
@@ -113,6 +400,8 @@ void GpuContext::CreateSetupCmdBuffer()
     commandBufferBeginInfo.pInheritanceInfo = nullptr;
 
     VK( this->device->vkBeginCommandBuffer( this->setupCommandBuffer, &commandBufferBeginInfo ) );
+
+    this->setupRecordingTicket = this->timeline->BeginRecording();
 }
 
 void GpuContext::FlushSetupCmdBuffer()
@@ -135,8 +424,12 @@ void GpuContext::FlushSetupCmdBuffer()
     submitInfo.signalSemaphoreCount = 0;
     submitInfo.pSignalSemaphores    = nullptr;
 
-    VK( this->device->vkQueueSubmit( this->queue, 1, &submitInfo, VK_NULL_HANDLE ) );
-    VK( this->device->vkQueueWaitIdle( this->queue ) );
+    // Also flushes the submits that were batched before, which the setup commands may depend on
+    // being ordered after.
+    const uint64_t value = this->submitBatch->Submit( &submitInfo );
+    this->timeline->EndRecording( this->setupRecordingTicket, value );
+    this->setupRecordingTicket = 0;
+    this->timeline->Wait( this->submitBatch->Flush() );
 
     VC( this->device->vkFreeCommandBuffers( this->device->device, this->commandPool, 1,
                                             &this->setupCommandBuffer ) );
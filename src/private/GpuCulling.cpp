@@ -0,0 +1,294 @@
+#include "GpuCulling.hpp"
+#include "GpuCommandBuffer.hpp"
+#include "GpuComputeCommand.hpp"
+#include "GpuDevice.hpp"
+#include "GpuGeometry.hpp"
+#include "GpuShaderCache.hpp"
+#include "GpuStateTracker.hpp"
+#include "Culling.comp.h"
+#include <algorithm>
+#include <cmath>
+
+#undef max
+#undef min
+
+namespace lxd
+{
+
+// Compiled from shaders/Culling.comp at build time.
+static const GpuShaderBlob cullingComputeShader = {
+    VK_SHADER_STAGE_COMPUTE_BIT, cullingComputeSpirv, sizeof( cullingComputeSpirv ),
+    cullingComputeSpirvHash };
+
+// The program parms are reflected from the SPIR-V, which orders them by binding.
+enum
+{
+    CULLING_BINDING_BOUNDS,
+    CULLING_BINDING_INDIRECT,
+    CULLING_BINDING_VISIBLE_INSTANCES,
+    CULLING_BINDING_PARMS,
+    CULLING_BINDING_HIZ
+};
+
+void GpuCullingParms::SetViewProjection( const float* viewProjection )
+{
+    memcpy( this->viewProjection, viewProjection, sizeof( this->viewProjection ) );
+
+    // Gribb-Hartmann plane extraction for a column-major matrix with clip space depth in [0, 1].
+    const float* m = viewProjection;
+    for ( int i = 0; i < 3; i++ )
+    {
+        this->planes[0][i] = m[i * 4 + 3] + m[i * 4 + 0];
+        this->planes[1][i] = m[i * 4 + 3] - m[i * 4 + 0];
+        this->planes[2][i] = m[i * 4 + 3] + m[i * 4 + 1];
+        this->planes[3][i] = m[i * 4 + 3] - m[i * 4 + 1];
+        this->planes[4][i] = m[i * 4 + 2];
+        this->planes[5][i] = m[i * 4 + 3] - m[i * 4 + 2];
+    }
+    this->planes[0][3] = m[15] + m[12];
+    this->planes[1][3] = m[15] - m[12];
+    this->planes[2][3] = m[15] + m[13];
+    this->planes[3][3] = m[15] - m[13];
+    this->planes[4][3] = m[14];
+    this->planes[5][3] = m[15] - m[14];
+
+    for ( int p = 0; p < 6; p++ )
+    {
+        const float length =
+            sqrtf( this->planes[p][0] * this->planes[p][0] +
+                   this->planes[p][1] * this->planes[p][1] + this->planes[p][2] * this->planes[p][2] );
+        if ( length > 0.0f )
+        {
+            for ( int i = 0; i < 4; i++ )
+            {
+                this->planes[p][i] /= length;
+            }
+        }
+    }
+}
+
+GpuCullingPass::GpuCullingPass( GpuContext* context, const int maxInstances )
+    : context( *context ),
+      maxInstances( maxInstances ),
+      program( context, &cullingComputeShader ),
+      pipeline( context, &this->program ),
+      parmBuffer( context, GPU_BUFFER_TYPE_UNIFORM, sizeof( GpuCullingParms ), nullptr, false ),
+      indirectBuffer( context, GPU_BUFFER_TYPE_INDIRECT, sizeof( VkDrawIndexedIndirectCommand ),
+                      nullptr, false ),
+      visibleInstanceBuffer( context, GPU_BUFFER_TYPE_STORAGE, maxInstances * sizeof( uint32_t ),
+                             nullptr, false ),
+      emptyHiZ( context )
+{
+    assert( maxInstances > 0 );
+
+    memset( &this->parms, 0, sizeof( this->parms ) );
+
+    // Bound when no Hi-Z pyramid is available; the occlusion test is disabled in that case.
+    const float farDepth = 1.0f;
+    this->emptyHiZ.Create2D( GPU_TEXTURE_FORMAT_R32_SFLOAT, GPU_SAMPLE_COUNT_1, 1, 1, 1,
+                             GPU_TEXTURE_USAGE_SAMPLED, &farDepth, sizeof( farDepth ) );
+}
+
+GpuCullingPass::~GpuCullingPass() {}
+
+static int BoundsFloats( const GpuCullingBounds boundsType )
+{
+    return ( boundsType == GPU_CULLING_BOUNDS_AABB ) ? 8 : 4;
+}
+
+void GpuCullingPass::Cull( GpuCommandBuffer* commandBuffer, const GpuBuffer* boundsBuffer,
+                           const int instanceCount, const GpuGeometry* geometry,
+                           const GpuTexture* hiZ, const GpuCullingBounds boundsType )
+{
+    assert( commandBuffer->currentRenderPass == nullptr );
+    assert( instanceCount >= 0 && instanceCount <= this->maxInstances );
+    assert( boundsBuffer->size >= instanceCount * BoundsFloats( boundsType ) * sizeof( float ) );
+
+    GpuDevice*      device    = context.device;
+    VkCommandBuffer cmdBuffer = commandBuffer->cmdBuffers[commandBuffer->currentBuffer];
+
+    const GpuTexture* hiZTexture = ( hiZ != nullptr ) ? hiZ : &this->emptyHiZ;
+
+    this->parms.hiZParms[0] = (float)hiZTexture->width;
+    this->parms.hiZParms[1] = (float)hiZTexture->height;
+    this->parms.hiZParms[2] = (float)std::max( hiZTexture->mipCount, 1 );
+    this->parms.hiZParms[3] = 0.0f;
+    this->parms.counts[0]   = instanceCount;
+    this->parms.counts[1] =
+        GPU_CULLING_FLAG_FRUSTUM | ( ( hiZ != nullptr ) ? GPU_CULLING_FLAG_OCCLUSION : 0 );
+    this->parms.counts[2] = boundsType;
+    this->parms.counts[3] = 0;
+
+    VkDrawIndexedIndirectCommand indirectCommand;
+    indirectCommand.indexCount    = geometry->indexCount;
+    indirectCommand.instanceCount = 0;
+    indirectCommand.firstIndex    = 0;
+    indirectCommand.vertexOffset  = 0;
+    indirectCommand.firstInstance = 0;
+
+    // Waits for the previous frame's draw to consume the indirect arguments before they are
+    // overwritten.
+    commandBuffer->stateTracker->BufferAccess( &this->parmBuffer, 0, sizeof( this->parms ),
+                                               VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                               VK_ACCESS_TRANSFER_WRITE_BIT );
+    commandBuffer->stateTracker->BufferAccess( &this->indirectBuffer, 0, sizeof( indirectCommand ),
+                                               VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                               VK_ACCESS_TRANSFER_WRITE_BIT );
+    commandBuffer->stateTracker->Flush();
+
+    VC( device->vkCmdUpdateBuffer( cmdBuffer, this->parmBuffer.buffer, 0, sizeof( this->parms ),
+                                   &this->parms ) );
+    VC( device->vkCmdUpdateBuffer( cmdBuffer, this->indirectBuffer.buffer, 0,
+                                   sizeof( indirectCommand ), &indirectCommand ) );
+
+    // The command buffer adds the barriers from the updates to the dispatch, and from the
+    // dispatch to the indirect draw that reads the compacted instances and their count.
+    GpuComputeCommand command;
+    command.SetPipeline( &this->pipeline );
+    command.SetParmBufferStorage( CULLING_BINDING_BOUNDS, boundsBuffer );
+    command.SetParmBufferStorage( CULLING_BINDING_INDIRECT, &this->indirectBuffer );
+    command.SetParmBufferStorage( CULLING_BINDING_VISIBLE_INSTANCES, &this->visibleInstanceBuffer );
+    command.SetParmBufferUniform( CULLING_BINDING_PARMS, &this->parmBuffer );
+    command.SetParmTextureSampled( CULLING_BINDING_HIZ, hiZTexture );
+    command.SetDimensions(
+        ( instanceCount + GPU_CULLING_WORKGROUP_SIZE - 1 ) / GPU_CULLING_WORKGROUP_SIZE, 1, 1 );
+
+    commandBuffer->SubmitComputeCommand( &command );
+}
+
+static bool FrustumVisible( const GpuCullingParms* parms, const float* sphere )
+{
+    for ( int i = 0; i < 6; i++ )
+    {
+        const float distance = parms->planes[i][0] * sphere[0] + parms->planes[i][1] * sphere[1] +
+                               parms->planes[i][2] * sphere[2] + parms->planes[i][3];
+        if ( distance < -sphere[3] )
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// A box is outside once the corner that is farthest along the plane normal is behind the plane,
+// which comes down to the distance of the center and the extents projected on the normal.
+static bool FrustumVisibleBox( const GpuCullingParms* parms, const float* boxMin,
+                               const float* boxMax )
+{
+    float center[3];
+    float extents[3];
+    for ( int c = 0; c < 3; c++ )
+    {
+        center[c]  = ( boxMin[c] + boxMax[c] ) * 0.5f;
+        extents[c] = ( boxMax[c] - boxMin[c] ) * 0.5f;
+    }
+    for ( int i = 0; i < 6; i++ )
+    {
+        const float* plane = parms->planes[i];
+        const float  distance =
+            plane[0] * center[0] + plane[1] * center[1] + plane[2] * center[2] + plane[3];
+        const float radius = fabsf( plane[0] ) * extents[0] + fabsf( plane[1] ) * extents[1] +
+                             fabsf( plane[2] ) * extents[2];
+        if ( distance < -radius )
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static float SampleHiZ( const GpuCullingHiZ* hiZ, const int level, const float u, const float v )
+{
+    const int levelWidth  = std::max( hiZ->width >> level, 1 );
+    const int levelHeight = std::max( hiZ->height >> level, 1 );
+    const int x           = std::min( std::max( (int)( u * levelWidth ), 0 ), levelWidth - 1 );
+    const int y           = std::min( std::max( (int)( v * levelHeight ), 0 ), levelHeight - 1 );
+    return hiZ->levels[level][y * levelWidth + x];
+}
+
+static bool OcclusionVisible( const GpuCullingParms* parms, const float* boxMin,
+                              const float* boxMax, const GpuCullingHiZ* hiZ )
+{
+    const float* m         = parms->viewProjection;
+    float        ndcMin[3] = { 1.0f, 1.0f, 1.0f };
+    float        ndcMax[3] = { -1.0f, -1.0f, -1.0f };
+    for ( int i = 0; i < 8; i++ )
+    {
+        const float corner[3] = { ( ( i & 1 ) != 0 ) ? boxMax[0] : boxMin[0],
+                                  ( ( i & 2 ) != 0 ) ? boxMax[1] : boxMin[1],
+                                  ( ( i & 4 ) != 0 ) ? boxMax[2] : boxMin[2] };
+        float clip[4];
+        for ( int row = 0; row < 4; row++ )
+        {
+            clip[row] = m[0 * 4 + row] * corner[0] + m[1 * 4 + row] * corner[1] +
+                        m[2 * 4 + row] * corner[2] + m[3 * 4 + row];
+        }
+        if ( clip[3] <= 0.0f )
+        {
+            return true;
+        }
+        for ( int c = 0; c < 3; c++ )
+        {
+            ndcMin[c] = std::min( ndcMin[c], clip[c] / clip[3] );
+            ndcMax[c] = std::max( ndcMax[c], clip[c] / clip[3] );
+        }
+    }
+
+    const float uMin  = std::min( std::max( ndcMin[0] * 0.5f + 0.5f, 0.0f ), 1.0f );
+    const float vMin  = std::min( std::max( ndcMin[1] * 0.5f + 0.5f, 0.0f ), 1.0f );
+    const float uMax  = std::min( std::max( ndcMax[0] * 0.5f + 0.5f, 0.0f ), 1.0f );
+    const float vMax  = std::min( std::max( ndcMax[1] * 0.5f + 0.5f, 0.0f ), 1.0f );
+    const float sizeX = ( uMax - uMin ) * hiZ->width;
+    const float sizeY = ( vMax - vMin ) * hiZ->height;
+    const int   level = std::min( std::max( (int)ceilf( log2f( std::max( std::max( sizeX, sizeY ),
+                                                                            1.0f ) ) ),
+                                            0 ),
+                                  std::max( hiZ->mipCount, 1 ) - 1 );
+
+    const float depth =
+        std::max( std::max( SampleHiZ( hiZ, level, uMin, vMin ), SampleHiZ( hiZ, level, uMax, vMin ) ),
+                  std::max( SampleHiZ( hiZ, level, uMin, vMax ), SampleHiZ( hiZ, level, uMax, vMax ) ) );
+    return ndcMin[2] <= depth;
+}
+
+int GpuCullingPass::CullReference( const GpuCullingParms* parms, const float* bounds,
+                                   const int instanceCount, const GpuCullingHiZ* hiZ,
+                                   uint32_t*              visibleInstances,
+                                   const GpuCullingBounds boundsType )
+{
+    int visibleCount = 0;
+    for ( int instance = 0; instance < instanceCount; instance++ )
+    {
+        const float* instanceBounds = &bounds[instance * BoundsFloats( boundsType )];
+        float        boxMin[3];
+        float        boxMax[3];
+        bool         visible;
+        if ( boundsType == GPU_CULLING_BOUNDS_AABB )
+        {
+            memcpy( boxMin, &instanceBounds[0], sizeof( boxMin ) );
+            memcpy( boxMax, &instanceBounds[4], sizeof( boxMax ) );
+            visible = FrustumVisibleBox( parms, boxMin, boxMax );
+        }
+        else
+        {
+            // The occlusion test projects the box around the sphere.
+            for ( int c = 0; c < 3; c++ )
+            {
+                boxMin[c] = instanceBounds[c] - instanceBounds[3];
+                boxMax[c] = instanceBounds[c] + instanceBounds[3];
+            }
+            visible = FrustumVisible( parms, instanceBounds );
+        }
+        if ( visible && hiZ != nullptr )
+        {
+            visible = OcclusionVisible( parms, boxMin, boxMax, hiZ );
+        }
+        if ( visible )
+        {
+            visibleInstances[visibleCount++] = instance;
+        }
+    }
+    return visibleCount;
+}
+
+} // namespace lxd
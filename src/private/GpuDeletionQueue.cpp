@@ -0,0 +1,175 @@
+#include "GpuDeletionQueue.hpp"
+#include "GpuBindless.hpp"
+#include "GpuContext.hpp"
+#include "GpuDevice.hpp"
+#include "GpuTimeline.hpp"
+
+namespace lxd
+{
+
+GpuDeletionQueue::GpuDeletionQueue( GpuContext* context ) : context( *context )
+{
+    ksMutex_Create( &this->mutex );
+}
+
+GpuDeletionQueue::~GpuDeletionQueue()
+{
+    GpuDevice* device = context.device;
+    ksMutex_Lock( &device->timelineMutex, true );
+    for ( int slot = 0; slot < GPU_MAX_TIMELINES; slot++ )
+    {
+        GpuTimeline* timeline = device->timelines[slot];
+        if ( timeline != nullptr )
+        {
+            timeline->Wait( timeline->submittedValue.load() );
+        }
+    }
+    ksMutex_Unlock( &device->timelineMutex );
+
+    for ( int i = 0; i < this->numEntries; i++ )
+    {
+        DestroyNow( &this->entries[i] );
+    }
+    free( this->entries );
+
+    ksMutex_Destroy( &this->mutex );
+}
+
+void GpuDeletionQueue::Destroy( const GpuDeletionType type, const uint64_t handle )
+{
+    if ( handle == 0 && type != GPU_DELETION_TYPE_BINDLESS_TEXTURE &&
+         type != GPU_DELETION_TYPE_BINDLESS_BUFFER )
+    {
+        return;
+    }
+
+    ksMutex_Lock( &this->mutex, true );
+    if ( this->numEntries >= this->maxEntries )
+    {
+        this->maxEntries = ( this->maxEntries > 0 ) ? this->maxEntries * 2 : 64;
+        this->entries    = static_cast<Entry*>(
+            realloc( this->entries, this->maxEntries * sizeof( Entry ) ) );
+    }
+    Entry* entry  = &this->entries[this->numEntries++];
+    entry->type   = type;
+    entry->handle = handle;
+
+    // Recordings that begin from here on no longer use the object.
+    GpuDevice* device = context.device;
+    ksMutex_Lock( &device->timelineMutex, true );
+    for ( int slot = 0; slot < GPU_MAX_TIMELINES; slot++ )
+    {
+        GpuTimeline* timeline = device->timelines[slot];
+        Tag*         tag      = &entry->tags[slot];
+        tag->serial           = ( timeline != nullptr ) ? timeline->serial : 0;
+        tag->resolved         = false;
+        tag->ticket           = ( timeline != nullptr ) ? timeline->NextTicket() : 0;
+        tag->value            = 0;
+    }
+    ksMutex_Unlock( &device->timelineMutex );
+    ksMutex_Unlock( &this->mutex );
+}
+
+void GpuDeletionQueue::Collect()
+{
+    ksMutex_Lock( &this->mutex, true );
+    if ( this->numEntries > 0 )
+    {
+        GpuDevice* device = context.device;
+        ksMutex_Lock( &device->timelineMutex, true );
+        // Objects are not necessarily released in the order their last use completes, e.g. on
+        // different queues, so every entry is looked at and the rest keep their order.
+        int count = 0;
+        for ( int i = 0; i < this->numEntries; i++ )
+        {
+            if ( IsReleased( &this->entries[i] ) )
+            {
+                DestroyNow( &this->entries[i] );
+            }
+            else
+            {
+                this->entries[count++] = this->entries[i];
+            }
+        }
+        this->numEntries = count;
+        ksMutex_Unlock( &device->timelineMutex );
+    }
+    ksMutex_Unlock( &this->mutex );
+}
+
+// Called with the timeline mutex of the device held.
+bool GpuDeletionQueue::IsReleased( Entry* entry )
+{
+    GpuDevice* device = context.device;
+    for ( int slot = 0; slot < GPU_MAX_TIMELINES; slot++ )
+    {
+        Tag* tag = &entry->tags[slot];
+        if ( tag->serial == 0 )
+        {
+            continue;
+        }
+        // A timeline waits for all of its submits when it is destroyed.
+        GpuTimeline* timeline = device->timelines[slot];
+        if ( timeline == nullptr || timeline->serial != tag->serial )
+        {
+            tag->serial = 0;
+            continue;
+        }
+        if ( !tag->resolved )
+        {
+            if ( !timeline->ResolveRecordings( tag->ticket, &tag->value ) )
+            {
+                return false;
+            }
+            tag->resolved = true;
+        }
+        if ( !timeline->IsCompleted( tag->value ) )
+        {
+            return false;
+        }
+        tag->serial = 0;
+    }
+    return true;
+}
+
+void GpuDeletionQueue::DestroyNow( const Entry* entry )
+{
+    GpuDevice* device = context.device;
+    switch ( entry->type )
+    {
+        case GPU_DELETION_TYPE_BUFFER:
+            VC( device->vkDestroyBuffer( device->device, (VkBuffer)entry->handle, VK_ALLOCATOR ) );
+            break;
+        case GPU_DELETION_TYPE_IMAGE:
+            VC( device->vkDestroyImage( device->device, (VkImage)entry->handle, VK_ALLOCATOR ) );
+            break;
+        case GPU_DELETION_TYPE_IMAGE_VIEW:
+            VC( device->vkDestroyImageView( device->device, (VkImageView)entry->handle,
+                                            VK_ALLOCATOR ) );
+            break;
+        case GPU_DELETION_TYPE_SAMPLER:
+            VC( device->vkDestroySampler( device->device, (VkSampler)entry->handle,
+                                          VK_ALLOCATOR ) );
+            break;
+        case GPU_DELETION_TYPE_MEMORY:
+            VC( device->vkFreeMemory( device->device, (VkDeviceMemory)entry->handle,
+                                      VK_ALLOCATOR ) );
+            break;
+        case GPU_DELETION_TYPE_PIPELINE:
+            VC( device->vkDestroyPipeline( device->device, (VkPipeline)entry->handle,
+                                           VK_ALLOCATOR ) );
+            break;
+        case GPU_DELETION_TYPE_SHADER_MODULE:
+            VC( device->vkDestroyShaderModule( device->device, (VkShaderModule)entry->handle,
+                                               VK_ALLOCATOR ) );
+            break;
+        case GPU_DELETION_TYPE_BINDLESS_TEXTURE:
+            context.bindless->ReleaseTexture( (uint32_t)entry->handle );
+            break;
+        case GPU_DELETION_TYPE_BINDLESS_BUFFER:
+            context.bindless->ReleaseBuffer( (uint32_t)entry->handle );
+            break;
+    }
+}
+
+} // namespace lxd
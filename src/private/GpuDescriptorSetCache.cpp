@@ -0,0 +1,313 @@
+#include "GpuDescriptorSetCache.hpp"
+#include "GpuBuffer.hpp"
+#include "GpuContext.hpp"
+#include "GpuDevice.hpp"
+#include "GpuTexture.hpp"
+#include <iterator>
+
+namespace lxd
+{
+
+void GpuDescriptorSetKey::Set( const GpuProgramParmLayout* parmLayout,
+                               const GpuProgramParmState* parmState, const GpuBuffer* spillBuffer )
+{
+    memset( this, 0, sizeof( *this ) );
+
+    this->layout      = parmLayout->descriptorSetLayout;
+    this->numBindings = parmLayout->numBindings;
+    for ( int i = 0; i < parmLayout->numBindings; i++ )
+    {
+        const GpuProgramParm* binding = parmLayout->bindings[i];
+        const void*           parm    = parmState->parms[binding->index];
+        assert( parm != nullptr );
+
+        if ( binding->type == GPU_PROGRAM_PARM_TYPE_TEXTURE_SAMPLED ||
+             binding->type == GPU_PROGRAM_PARM_TYPE_TEXTURE_STORAGE )
+        {
+            const GpuTexture* texture = static_cast<const GpuTexture*>( parm );
+            this->resources[i][0]     = texture->resourceId;
+            this->resources[i][1]     = 0;
+        }
+        else
+        {
+            const GpuBuffer* buffer = static_cast<const GpuBuffer*>( parm );
+            this->resources[i][0]   = buffer->resourceId;
+            this->resources[i][1]   = (uint64_t)buffer->size;
+        }
+    }
+
+    // The spilled push constants are bound with a dynamic offset, so the offset is not part of
+    // the key and a single set serves every draw that uses the same spill buffer.
+    if ( parmLayout->packing.spillSize > 0 )
+    {
+        assert( spillBuffer != nullptr );
+        this->resources[this->numBindings][0] = spillBuffer->resourceId;
+        this->resources[this->numBindings][1] = (uint64_t)parmLayout->packing.spillSize;
+        this->numBindings++;
+    }
+}
+
+unsigned int GpuDescriptorSetKey::Hash() const
+{
+    unsigned int hash = 5381;
+    hash              = ( ( hash << 5 ) - hash ) + (unsigned int)( (uint64_t)this->layout );
+    hash              = ( ( hash << 5 ) - hash ) + (unsigned int)( (uint64_t)this->layout >> 32 );
+    for ( int i = 0; i < this->numBindings; i++ )
+    {
+        for ( int j = 0; j < 2; j++ )
+        {
+            hash = ( ( hash << 5 ) - hash ) + (unsigned int)( this->resources[i][j] );
+            hash = ( ( hash << 5 ) - hash ) + (unsigned int)( this->resources[i][j] >> 32 );
+        }
+    }
+    return hash;
+}
+
+bool GpuDescriptorSetKey::Equals( const GpuDescriptorSetKey* other ) const
+{
+    return this->layout == other->layout && this->numBindings == other->numBindings &&
+           memcmp( this->resources, other->resources,
+                   this->numBindings * sizeof( this->resources[0] ) ) == 0;
+}
+
+GpuDescriptorSetCache::GpuDescriptorSetCache( GpuContext* context ) : context( *context ) {}
+
+GpuDescriptorSetCache::~GpuDescriptorSetCache()
+{
+    Reset();
+
+    for ( int i = 0; i < this->numPools; i++ )
+    {
+        VC( context.device->vkDestroyDescriptorPool( context.device->device, this->pools[i],
+                                                     VK_ALLOCATOR ) );
+    }
+    free( this->pools );
+}
+
+void GpuDescriptorSetCache::BeginFrame()
+{
+    // Drop everything when most of the cached sets went unused the last time this command buffer
+    // was recorded. This keeps the pools from filling up with stale sets, while a steady-state
+    // frame that binds the same resources never resets and never allocates or updates a set.
+    if ( this->numSets > GPU_DESCRIPTOR_POOL_MAX_SETS && this->numSets > 2 * this->numSetsUsed )
+    {
+        Reset();
+    }
+
+    this->frame++;
+    this->numSetsUsed = 0;
+}
+
+VkDescriptorSet GpuDescriptorSetCache::GetDescriptorSet( const GpuProgramParmLayout* parmLayout,
+                                                         const GpuProgramParmState*  parmState,
+                                                         const GpuBuffer*            spillBuffer )
+{
+    GpuDescriptorSetKey key;
+    key.Set( parmLayout, parmState, spillBuffer );
+
+    const unsigned int hash = key.Hash();
+    Entry**            bucket = &this->buckets[hash % GPU_DESCRIPTOR_SET_CACHE_BUCKETS];
+
+    for ( Entry* entry = *bucket; entry != nullptr; entry = entry->next )
+    {
+        if ( entry->hash == hash && entry->key.Equals( &key ) )
+        {
+            if ( entry->lastUsedFrame != this->frame )
+            {
+                entry->lastUsedFrame = this->frame;
+                this->numSetsUsed++;
+            }
+            return entry->descriptorSet;
+        }
+    }
+
+    Entry* entry         = static_cast<Entry*>( malloc( sizeof( Entry ) ) );
+    entry->key           = key;
+    entry->hash          = hash;
+    entry->lastUsedFrame = this->frame;
+    entry->descriptorSet = AllocateDescriptorSet( parmLayout );
+    entry->next          = *bucket;
+    *bucket              = entry;
+
+    WriteDescriptorSet( entry->descriptorSet, parmLayout, parmState, spillBuffer );
+
+    this->numSets++;
+    this->numSetsUsed++;
+
+    return entry->descriptorSet;
+}
+
+void GpuDescriptorSetCache::Reset()
+{
+    for ( int i = 0; i < GPU_DESCRIPTOR_SET_CACHE_BUCKETS; i++ )
+    {
+        for ( Entry *entry = this->buckets[i], *next = nullptr; entry != nullptr; entry = next )
+        {
+            next = entry->next;
+            free( entry );
+        }
+        this->buckets[i] = nullptr;
+    }
+
+    // Resetting a pool returns all of its sets at once; individual sets are never freed.
+    for ( int i = 0; i < this->numPools; i++ )
+    {
+        VK( context.device->vkResetDescriptorPool( context.device->device, this->pools[i], 0 ) );
+    }
+
+    this->currentPool     = 0;
+    this->currentPoolSets = 0;
+    this->numSets         = 0;
+    this->numSetsUsed     = 0;
+}
+
+VkDescriptorSet GpuDescriptorSetCache::AllocateDescriptorSet( const GpuProgramParmLayout* parmLayout )
+{
+    GpuDevice* device = context.device;
+
+    if ( this->currentPoolSets >= GPU_DESCRIPTOR_POOL_MAX_SETS )
+    {
+        this->currentPool++;
+        this->currentPoolSets = 0;
+    }
+
+    if ( this->currentPool >= this->numPools )
+    {
+        // Every set uses at most MAX_PROGRAM_PARMS descriptors plus one spill buffer, so a pool
+        // never runs out of descriptors before it runs out of sets.
+        VkDescriptorPoolSize typeCounts[5];
+        typeCounts[0].type            = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        typeCounts[0].descriptorCount = GPU_DESCRIPTOR_POOL_MAX_SETS * MAX_PROGRAM_PARMS;
+        typeCounts[1].type            = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        typeCounts[1].descriptorCount = GPU_DESCRIPTOR_POOL_MAX_SETS * MAX_PROGRAM_PARMS;
+        typeCounts[2].type            = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        typeCounts[2].descriptorCount = GPU_DESCRIPTOR_POOL_MAX_SETS * MAX_PROGRAM_PARMS;
+        typeCounts[3].type            = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        typeCounts[3].descriptorCount = GPU_DESCRIPTOR_POOL_MAX_SETS * MAX_PROGRAM_PARMS;
+        typeCounts[4].type            = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        typeCounts[4].descriptorCount = GPU_DESCRIPTOR_POOL_MAX_SETS;
+
+        VkDescriptorPoolCreateInfo descriptorPoolCreateInfo;
+        descriptorPoolCreateInfo.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        descriptorPoolCreateInfo.pNext         = nullptr;
+        descriptorPoolCreateInfo.flags         = 0;
+        descriptorPoolCreateInfo.maxSets       = GPU_DESCRIPTOR_POOL_MAX_SETS;
+        descriptorPoolCreateInfo.poolSizeCount = static_cast<uint32_t>( std::size( typeCounts ) );
+        descriptorPoolCreateInfo.pPoolSizes    = typeCounts;
+
+        this->pools = static_cast<VkDescriptorPool*>(
+            realloc( this->pools, ( this->numPools + 1 ) * sizeof( VkDescriptorPool ) ) );
+        VK( device->vkCreateDescriptorPool( device->device, &descriptorPoolCreateInfo,
+                                            VK_ALLOCATOR, &this->pools[this->numPools] ) );
+        this->numPools++;
+    }
+
+    VkDescriptorSetAllocateInfo descriptorSetAllocateInfo;
+    descriptorSetAllocateInfo.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    descriptorSetAllocateInfo.pNext              = nullptr;
+    descriptorSetAllocateInfo.descriptorPool     = this->pools[this->currentPool];
+    descriptorSetAllocateInfo.descriptorSetCount = 1;
+    descriptorSetAllocateInfo.pSetLayouts        = &parmLayout->descriptorSetLayout;
+
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+    VK( device->vkAllocateDescriptorSets( device->device, &descriptorSetAllocateInfo,
+                                          &descriptorSet ) );
+    this->currentPoolSets++;
+
+    return descriptorSet;
+}
+
+void GpuDescriptorSetCache::WriteDescriptorSet( const VkDescriptorSet       descriptorSet,
+                                                const GpuProgramParmLayout* parmLayout,
+                                                const GpuProgramParmState*  parmState,
+                                                const GpuBuffer*            spillBuffer )
+{
+    VkWriteDescriptorSet   writes[MAX_PROGRAM_PARMS + 1];
+    VkDescriptorImageInfo  imageInfo[MAX_PROGRAM_PARMS];
+    VkDescriptorBufferInfo bufferInfo[MAX_PROGRAM_PARMS + 1];
+
+    int numWrites      = 0;
+    int numImageInfos  = 0;
+    int numBufferInfos = 0;
+    for ( int i = 0; i < parmLayout->numBindings; i++ )
+    {
+        const GpuProgramParm* binding = parmLayout->bindings[i];
+
+        writes[numWrites].sType            = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[numWrites].pNext            = nullptr;
+        writes[numWrites].dstSet           = descriptorSet;
+        writes[numWrites].dstBinding       = binding->binding;
+        writes[numWrites].dstArrayElement  = 0;
+        writes[numWrites].descriptorCount  = 1;
+        writes[numWrites].descriptorType   = GpuProgramParm::GetDescriptorType( binding->type );
+        writes[numWrites].pImageInfo       = nullptr;
+        writes[numWrites].pBufferInfo      = nullptr;
+        writes[numWrites].pTexelBufferView = nullptr;
+
+        const void* parm = parmState->parms[binding->index];
+
+        if ( binding->type == GPU_PROGRAM_PARM_TYPE_TEXTURE_SAMPLED )
+        {
+            const GpuTexture* texture = static_cast<const GpuTexture*>( parm );
+            assert( texture->usage == GPU_TEXTURE_USAGE_SAMPLED );
+            assert( texture->imageLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL );
+
+            imageInfo[numImageInfos].sampler     = texture->sampler;
+            imageInfo[numImageInfos].imageView   = texture->view;
+            imageInfo[numImageInfos].imageLayout = texture->imageLayout;
+
+            writes[numWrites].pImageInfo = &imageInfo[numImageInfos++];
+        }
+        else if ( binding->type == GPU_PROGRAM_PARM_TYPE_TEXTURE_STORAGE )
+        {
+            const GpuTexture* texture = static_cast<const GpuTexture*>( parm );
+            assert( texture->usage == GPU_TEXTURE_USAGE_STORAGE );
+            assert( texture->imageLayout == VK_IMAGE_LAYOUT_GENERAL );
+
+            imageInfo[numImageInfos].sampler     = VK_NULL_HANDLE;
+            imageInfo[numImageInfos].imageView   = texture->view;
+            imageInfo[numImageInfos].imageLayout = texture->imageLayout;
+
+            writes[numWrites].pImageInfo = &imageInfo[numImageInfos++];
+        }
+        else
+        {
+            const GpuBuffer* buffer = static_cast<const GpuBuffer*>( parm );
+
+            bufferInfo[numBufferInfos].buffer = buffer->buffer;
+            bufferInfo[numBufferInfos].offset = 0;
+            bufferInfo[numBufferInfos].range  = buffer->size;
+
+            writes[numWrites].pBufferInfo = &bufferInfo[numBufferInfos++];
+        }
+
+        numWrites++;
+    }
+
+    if ( parmLayout->packing.spillSize > 0 )
+    {
+        bufferInfo[numBufferInfos].buffer = spillBuffer->buffer;
+        bufferInfo[numBufferInfos].offset = 0;
+        bufferInfo[numBufferInfos].range  = parmLayout->packing.spillSize;
+
+        writes[numWrites].sType            = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[numWrites].pNext            = nullptr;
+        writes[numWrites].dstSet           = descriptorSet;
+        writes[numWrites].dstBinding       = parmLayout->packing.spillBinding;
+        writes[numWrites].dstArrayElement  = 0;
+        writes[numWrites].descriptorCount  = 1;
+        writes[numWrites].descriptorType   = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        writes[numWrites].pImageInfo       = nullptr;
+        writes[numWrites].pBufferInfo      = &bufferInfo[numBufferInfos++];
+        writes[numWrites].pTexelBufferView = nullptr;
+        numWrites++;
+    }
+
+    if ( numWrites > 0 )
+    {
+        VC( context.device->vkUpdateDescriptorSets( context.device->device, numWrites, writes, 0,
+                                                    nullptr ) );
+    }
+}
+
+} // namespace lxd
@@ -1,5 +1,7 @@
 #include "GpuDevice.hpp"
 #include "GpuInstance.hpp"
+#include "GpuLayoutCache.hpp"
+#include "GpuShaderCache.hpp"
 #include <iterator>
 
 namespace lxd
@@ -40,29 +42,102 @@ GpuDevice::GpuDevice( GpuInstance* instance, GpuQueueInfo const* queueInfo,
         }
     }
 
+    // Async compute queues run at medium priority, below a high priority graphics queue.
+    float computePriorities[MAX_QUEUES];
+    for ( int i = 0; i < MAX_QUEUES; i++ )
+    {
+        computePriorities[i] =
+            ( this->physicalDeviceProperties.limits.discreteQueuePriorities <= 2 ) ? 0.0f : 0.5f;
+    }
+
     // Create the device.
-    VkDeviceQueueCreateInfo deviceQueueCreateInfo[2];
-    deviceQueueCreateInfo[0].sType            = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    deviceQueueCreateInfo[0].pNext            = nullptr;
-    deviceQueueCreateInfo[0].flags            = 0;
-    deviceQueueCreateInfo[0].queueFamilyIndex = this->workQueueFamilyIndex;
-    deviceQueueCreateInfo[0].queueCount       = queueInfo->queueCount;
-    deviceQueueCreateInfo[0].pQueuePriorities = floatPriorities;
-
-    deviceQueueCreateInfo[1].sType            = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    deviceQueueCreateInfo[1].pNext            = nullptr;
-    deviceQueueCreateInfo[1].flags            = 0;
-    deviceQueueCreateInfo[1].queueFamilyIndex = this->presentQueueFamilyIndex;
-    deviceQueueCreateInfo[1].queueCount       = 1;
-    deviceQueueCreateInfo[1].pQueuePriorities = nullptr;
+    VkDeviceQueueCreateInfo deviceQueueCreateInfo[3];
+    uint32_t                queueCreateInfoCount = 0;
+
+    deviceQueueCreateInfo[queueCreateInfoCount].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    deviceQueueCreateInfo[queueCreateInfoCount].pNext = nullptr;
+    deviceQueueCreateInfo[queueCreateInfoCount].flags = 0;
+    deviceQueueCreateInfo[queueCreateInfoCount].queueFamilyIndex = this->workQueueFamilyIndex;
+    deviceQueueCreateInfo[queueCreateInfoCount].queueCount       = queueInfo->queueCount;
+    deviceQueueCreateInfo[queueCreateInfoCount].pQueuePriorities = floatPriorities;
+    queueCreateInfoCount++;
+
+    if ( this->presentQueueFamilyIndex != -1 &&
+         this->presentQueueFamilyIndex != this->workQueueFamilyIndex )
+    {
+        deviceQueueCreateInfo[queueCreateInfoCount].sType =
+            VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        deviceQueueCreateInfo[queueCreateInfoCount].pNext = nullptr;
+        deviceQueueCreateInfo[queueCreateInfoCount].flags = 0;
+        deviceQueueCreateInfo[queueCreateInfoCount].queueFamilyIndex =
+            this->presentQueueFamilyIndex;
+        deviceQueueCreateInfo[queueCreateInfoCount].queueCount       = 1;
+        deviceQueueCreateInfo[queueCreateInfoCount].pQueuePriorities = nullptr;
+        queueCreateInfoCount++;
+    }
+
+    if ( this->computeQueueFamilyIndex != -1 )
+    {
+        const int familyQueueCount =
+            (int)this->queueFamilyProperties[this->computeQueueFamilyIndex].queueCount;
+        const int computeQueueCount = ( queueInfo->computeQueueCount < familyQueueCount )
+                                          ? queueInfo->computeQueueCount
+                                          : familyQueueCount;
+        deviceQueueCreateInfo[queueCreateInfoCount].sType =
+            VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        deviceQueueCreateInfo[queueCreateInfoCount].pNext = nullptr;
+        deviceQueueCreateInfo[queueCreateInfoCount].flags = 0;
+        deviceQueueCreateInfo[queueCreateInfoCount].queueFamilyIndex =
+            this->computeQueueFamilyIndex;
+        deviceQueueCreateInfo[queueCreateInfoCount].queueCount       = computeQueueCount;
+        deviceQueueCreateInfo[queueCreateInfoCount].pQueuePriorities = computePriorities;
+        queueCreateInfoCount++;
+    }
+
+    // Chain the features of the optional extensions that are supported.
+    void* enabledFeatures = nullptr;
+    if ( this->supportsBindless )
+    {
+        this->descriptorIndexingFeatures.pNext = enabledFeatures;
+        enabledFeatures                        = &this->descriptorIndexingFeatures;
+    }
+    if ( this->supportsSynchronization2 )
+    {
+        this->synchronization2Features.pNext = enabledFeatures;
+        enabledFeatures                      = &this->synchronization2Features;
+    }
+    if ( this->supportsTimelineSemaphores )
+    {
+        this->timelineSemaphoreFeatures.pNext = enabledFeatures;
+        enabledFeatures                       = &this->timelineSemaphoreFeatures;
+    }
+    if ( this->supportsExtendedDynamicState )
+    {
+        this->extendedDynamicStateFeatures.pNext = enabledFeatures;
+        enabledFeatures                          = &this->extendedDynamicStateFeatures;
+    }
+    if ( this->supportsExtendedDynamicState3 )
+    {
+        this->extendedDynamicState3Features.pNext = enabledFeatures;
+        enabledFeatures                           = &this->extendedDynamicState3Features;
+    }
+    if ( this->supportsGraphicsPipelineLibrary )
+    {
+        this->graphicsPipelineLibraryFeatures.pNext = enabledFeatures;
+        enabledFeatures                             = &this->graphicsPipelineLibraryFeatures;
+    }
+    if ( this->supportsShaderModuleIdentifiers )
+    {
+        this->pipelineCreationCacheControlFeatures.pNext = enabledFeatures;
+        this->shaderModuleIdentifierFeatures.pNext = &this->pipelineCreationCacheControlFeatures;
+        enabledFeatures                            = &this->shaderModuleIdentifierFeatures;
+    }
 
     VkDeviceCreateInfo deviceCreateInfo;
     deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-    deviceCreateInfo.pNext = nullptr;
+    deviceCreateInfo.pNext = enabledFeatures;
     deviceCreateInfo.flags = 0;
-    deviceCreateInfo.queueCreateInfoCount =
-        1 + ( this->presentQueueFamilyIndex != -1 &&
-              this->presentQueueFamilyIndex != this->workQueueFamilyIndex );
+    deviceCreateInfo.queueCreateInfoCount = queueCreateInfoCount;
     deviceCreateInfo.pQueueCreateInfos = deviceQueueCreateInfo;
     deviceCreateInfo.enabledLayerCount = this->enabledLayerCount;
     deviceCreateInfo.ppEnabledLayerNames =
@@ -222,11 +297,71 @@ GpuDevice::GpuDevice( GpuInstance* instance, GpuQueueInfo const* queueInfo,
         GET_DEVICE_PROC_ADDR( vkAcquireNextImageKHR );
         GET_DEVICE_PROC_ADDR( vkQueuePresentKHR );
     }
+
+    this->vkCmdPipelineBarrier2KHR = nullptr;
+    if ( this->supportsSynchronization2 )
+    {
+        GET_DEVICE_PROC_ADDR( vkCmdPipelineBarrier2KHR );
+    }
+
+    this->vkGetSemaphoreCounterValueKHR = nullptr;
+    this->vkWaitSemaphoresKHR           = nullptr;
+    if ( this->supportsTimelineSemaphores )
+    {
+        GET_DEVICE_PROC_ADDR( vkGetSemaphoreCounterValueKHR );
+        GET_DEVICE_PROC_ADDR( vkWaitSemaphoresKHR );
+    }
+
+    this->vkGetShaderModuleCreateInfoIdentifierEXT = nullptr;
+    if ( this->supportsShaderModuleIdentifiers )
+    {
+        GET_DEVICE_PROC_ADDR( vkGetShaderModuleCreateInfoIdentifierEXT );
+    }
+
+    this->vkCmdSetCullModeEXT         = nullptr;
+    this->vkCmdSetFrontFaceEXT        = nullptr;
+    this->vkCmdSetDepthTestEnableEXT  = nullptr;
+    this->vkCmdSetDepthWriteEnableEXT = nullptr;
+    this->vkCmdSetDepthCompareOpEXT   = nullptr;
+    if ( this->supportsExtendedDynamicState )
+    {
+        GET_DEVICE_PROC_ADDR( vkCmdSetCullModeEXT );
+        GET_DEVICE_PROC_ADDR( vkCmdSetFrontFaceEXT );
+        GET_DEVICE_PROC_ADDR( vkCmdSetDepthTestEnableEXT );
+        GET_DEVICE_PROC_ADDR( vkCmdSetDepthWriteEnableEXT );
+        GET_DEVICE_PROC_ADDR( vkCmdSetDepthCompareOpEXT );
+    }
+
+    this->vkCmdSetColorBlendEnableEXT   = nullptr;
+    this->vkCmdSetColorBlendEquationEXT = nullptr;
+    this->vkCmdSetColorWriteMaskEXT     = nullptr;
+    if ( this->supportsExtendedDynamicState3 )
+    {
+        GET_DEVICE_PROC_ADDR( vkCmdSetColorBlendEnableEXT );
+        GET_DEVICE_PROC_ADDR( vkCmdSetColorBlendEquationEXT );
+        GET_DEVICE_PROC_ADDR( vkCmdSetColorWriteMaskEXT );
+    }
+
+    for ( int slot = 0; slot < GPU_MAX_TIMELINES; slot++ )
+    {
+        this->timelines[slot] = nullptr;
+    }
+    this->timelineSerial = 0;
+    ksMutex_Create( &this->timelineMutex );
+    this->resourceSerial = 0;
+
+    this->shaderCache = new GpuShaderCache( this );
+    this->layoutCache = new GpuLayoutCache( this );
 }
 GpuDevice::~GpuDevice()
 {
     VK( this->vkDeviceWaitIdle( this->device ) );
 
+    delete this->layoutCache;
+    delete this->shaderCache;
+
+    ksMutex_Destroy( &this->timelineMutex );
+
     free( this->queueFamilyProperties );
     free( this->queueFamilyUsedQueues );
 
@@ -378,12 +513,43 @@ bool GpuDevice::SelectPhysicalDevice( GpuInstance* instance, const GpuQueueInfo*
             continue;
         }
 
+        // Async compute needs a family that can compute but not draw, and that is not also
+        // used for the work or present queues.
+        int computeQueueFamilyIndex = -1;
+        if ( queueInfo->computeQueueCount > 0 )
+        {
+            for ( uint32_t queueFamilyIndex = 0; queueFamilyIndex < queueFamilyCount;
+                  queueFamilyIndex++ )
+            {
+                const VkQueueFlags queueFlags = queueFamilyProperties[queueFamilyIndex].queueFlags;
+                if ( ( queueFlags & VK_QUEUE_COMPUTE_BIT ) != 0 &&
+                     ( queueFlags & VK_QUEUE_GRAPHICS_BIT ) == 0 &&
+                     (int)queueFamilyIndex != workQueueFamilyIndex &&
+                     (int)queueFamilyIndex != presentQueueFamilyIndex )
+                {
+                    computeQueueFamilyIndex = queueFamilyIndex;
+                    break;
+                }
+            }
+        }
+
         Print( "Work Queue Family    : %d\n", workQueueFamilyIndex );
         Print( "Present Queue Family : %d\n", presentQueueFamilyIndex );
+        Print( "Compute Queue Family : %d\n", computeQueueFamilyIndex );
 
         const GpuFeature requestedExtensions[] = {
             { VK_KHR_SWAPCHAIN_EXTENSION_NAME, false, true },
             { "VK_NV_glsl_shader", false, false },
+            { VK_KHR_MAINTENANCE3_EXTENSION_NAME, false, false },
+            { VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME, false, false },
+            { VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME, false, false },
+            { VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME, false, false },
+            { VK_EXT_PIPELINE_CREATION_CACHE_CONTROL_EXTENSION_NAME, false, false },
+            { VK_EXT_SHADER_MODULE_IDENTIFIER_EXTENSION_NAME, false, false },
+            { VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME, false, false },
+            { VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME, false, false },
+            { VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME, false, false },
+            { VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME, false, false },
         };
 
         // Check the device extensions.
@@ -465,6 +631,7 @@ bool GpuDevice::SelectPhysicalDevice( GpuInstance* instance, const GpuQueueInfo*
         this->queueFamilyProperties   = queueFamilyProperties;
         this->workQueueFamilyIndex    = workQueueFamilyIndex;
         this->presentQueueFamilyIndex = presentQueueFamilyIndex;
+        this->computeQueueFamilyIndex = computeQueueFamilyIndex;
 
         VC( instance->vkGetPhysicalDeviceFeatures( physicalDevices[physicalDeviceIndex],
                                                    &this->physicalDeviceFeatures ) );
@@ -476,6 +643,181 @@ bool GpuDevice::SelectPhysicalDevice( GpuInstance* instance, const GpuQueueInfo*
                this->physicalDeviceFeatures.textureCompressionETC2 ? "true" : "false",
                this->physicalDeviceFeatures.textureCompressionASTC_LDR ? "true" : "false",
                this->physicalDeviceFeatures.textureCompressionBC ? "true" : "false" );
+
+        // The queried descriptor indexing features are enabled as is when the device is created.
+        memset( &this->descriptorIndexingFeatures, 0, sizeof( this->descriptorIndexingFeatures ) );
+        this->descriptorIndexingFeatures.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+        this->descriptorIndexingFeatures.pNext = nullptr;
+        memset( &this->descriptorIndexingProperties, 0,
+                sizeof( this->descriptorIndexingProperties ) );
+        this->descriptorIndexingProperties.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+        this->descriptorIndexingProperties.pNext = nullptr;
+        this->supportsBindless                   = false;
+        if ( instance->vkGetPhysicalDeviceFeatures2KHR != nullptr &&
+             instance->vkGetPhysicalDeviceProperties2KHR != nullptr &&
+             IsExtensionEnabled( VK_KHR_MAINTENANCE3_EXTENSION_NAME ) &&
+             IsExtensionEnabled( VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME ) )
+        {
+            VkPhysicalDeviceFeatures2KHR physicalDeviceFeatures2;
+            physicalDeviceFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+            physicalDeviceFeatures2.pNext = &this->descriptorIndexingFeatures;
+            VC( instance->vkGetPhysicalDeviceFeatures2KHR( physicalDevices[physicalDeviceIndex],
+                                                           &physicalDeviceFeatures2 ) );
+            this->descriptorIndexingFeatures.pNext = nullptr;
+
+            VkPhysicalDeviceProperties2KHR physicalDeviceProperties2;
+            physicalDeviceProperties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2_KHR;
+            physicalDeviceProperties2.pNext = &this->descriptorIndexingProperties;
+            VC( instance->vkGetPhysicalDeviceProperties2KHR( physicalDevices[physicalDeviceIndex],
+                                                             &physicalDeviceProperties2 ) );
+            this->descriptorIndexingProperties.pNext = nullptr;
+
+            const VkPhysicalDeviceDescriptorIndexingFeaturesEXT& features =
+                this->descriptorIndexingFeatures;
+            this->supportsBindless = features.runtimeDescriptorArray &&
+                                     features.descriptorBindingPartiallyBound &&
+                                     features.descriptorBindingUpdateUnusedWhilePending &&
+                                     features.descriptorBindingSampledImageUpdateAfterBind &&
+                                     features.descriptorBindingStorageBufferUpdateAfterBind;
+        }
+        Print( "Support bindless: %s\n", this->supportsBindless ? "true" : "false" );
+
+        memset( &this->synchronization2Features, 0, sizeof( this->synchronization2Features ) );
+        this->synchronization2Features.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR;
+        this->synchronization2Features.pNext = nullptr;
+        this->supportsSynchronization2       = false;
+        if ( instance->vkGetPhysicalDeviceFeatures2KHR != nullptr &&
+             IsExtensionEnabled( VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME ) )
+        {
+            VkPhysicalDeviceFeatures2KHR physicalDeviceFeatures2;
+            physicalDeviceFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+            physicalDeviceFeatures2.pNext = &this->synchronization2Features;
+            VC( instance->vkGetPhysicalDeviceFeatures2KHR( physicalDevices[physicalDeviceIndex],
+                                                           &physicalDeviceFeatures2 ) );
+            this->synchronization2Features.pNext = nullptr;
+            this->supportsSynchronization2 = this->synchronization2Features.synchronization2;
+        }
+        Print( "Support synchronization2: %s\n",
+               this->supportsSynchronization2 ? "true" : "false" );
+
+        memset( &this->timelineSemaphoreFeatures, 0, sizeof( this->timelineSemaphoreFeatures ) );
+        this->timelineSemaphoreFeatures.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+        this->timelineSemaphoreFeatures.pNext = nullptr;
+        this->supportsTimelineSemaphores      = false;
+        if ( instance->vkGetPhysicalDeviceFeatures2KHR != nullptr &&
+             IsExtensionEnabled( VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME ) )
+        {
+            VkPhysicalDeviceFeatures2KHR physicalDeviceFeatures2;
+            physicalDeviceFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+            physicalDeviceFeatures2.pNext = &this->timelineSemaphoreFeatures;
+            VC( instance->vkGetPhysicalDeviceFeatures2KHR( physicalDevices[physicalDeviceIndex],
+                                                           &physicalDeviceFeatures2 ) );
+            this->timelineSemaphoreFeatures.pNext = nullptr;
+            this->supportsTimelineSemaphores = this->timelineSemaphoreFeatures.timelineSemaphore;
+        }
+        Print( "Support timeline semaphores: %s\n",
+               this->supportsTimelineSemaphores ? "true" : "false" );
+
+        memset( &this->pipelineCreationCacheControlFeatures, 0,
+                sizeof( this->pipelineCreationCacheControlFeatures ) );
+        this->pipelineCreationCacheControlFeatures.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PIPELINE_CREATION_CACHE_CONTROL_FEATURES_EXT;
+        memset( &this->shaderModuleIdentifierFeatures, 0,
+                sizeof( this->shaderModuleIdentifierFeatures ) );
+        this->shaderModuleIdentifierFeatures.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_MODULE_IDENTIFIER_FEATURES_EXT;
+        this->supportsShaderModuleIdentifiers = false;
+        if ( instance->vkGetPhysicalDeviceFeatures2KHR != nullptr &&
+             IsExtensionEnabled( VK_EXT_PIPELINE_CREATION_CACHE_CONTROL_EXTENSION_NAME ) &&
+             IsExtensionEnabled( VK_EXT_SHADER_MODULE_IDENTIFIER_EXTENSION_NAME ) )
+        {
+            this->shaderModuleIdentifierFeatures.pNext =
+                &this->pipelineCreationCacheControlFeatures;
+
+            VkPhysicalDeviceFeatures2KHR physicalDeviceFeatures2;
+            physicalDeviceFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+            physicalDeviceFeatures2.pNext = &this->shaderModuleIdentifierFeatures;
+            VC( instance->vkGetPhysicalDeviceFeatures2KHR( physicalDevices[physicalDeviceIndex],
+                                                           &physicalDeviceFeatures2 ) );
+            this->shaderModuleIdentifierFeatures.pNext       = nullptr;
+            this->pipelineCreationCacheControlFeatures.pNext = nullptr;
+            this->supportsShaderModuleIdentifiers =
+                this->shaderModuleIdentifierFeatures.shaderModuleIdentifier &&
+                this->pipelineCreationCacheControlFeatures.pipelineCreationCacheControl;
+        }
+        Print( "Support shader module identifiers: %s\n",
+               this->supportsShaderModuleIdentifiers ? "true" : "false" );
+
+        memset( &this->extendedDynamicStateFeatures, 0,
+                sizeof( this->extendedDynamicStateFeatures ) );
+        this->extendedDynamicStateFeatures.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT;
+        this->supportsExtendedDynamicState = false;
+        if ( instance->vkGetPhysicalDeviceFeatures2KHR != nullptr &&
+             IsExtensionEnabled( VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME ) )
+        {
+            VkPhysicalDeviceFeatures2KHR physicalDeviceFeatures2;
+            physicalDeviceFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+            physicalDeviceFeatures2.pNext = &this->extendedDynamicStateFeatures;
+            VC( instance->vkGetPhysicalDeviceFeatures2KHR( physicalDevices[physicalDeviceIndex],
+                                                           &physicalDeviceFeatures2 ) );
+            this->extendedDynamicStateFeatures.pNext = nullptr;
+            this->supportsExtendedDynamicState =
+                this->extendedDynamicStateFeatures.extendedDynamicState;
+        }
+
+        // Only the blend state is used, the other features are enabled as queried.
+        memset( &this->extendedDynamicState3Features, 0,
+                sizeof( this->extendedDynamicState3Features ) );
+        this->extendedDynamicState3Features.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT;
+        this->supportsExtendedDynamicState3 = false;
+        if ( instance->vkGetPhysicalDeviceFeatures2KHR != nullptr &&
+             IsExtensionEnabled( VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME ) )
+        {
+            VkPhysicalDeviceFeatures2KHR physicalDeviceFeatures2;
+            physicalDeviceFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+            physicalDeviceFeatures2.pNext = &this->extendedDynamicState3Features;
+            VC( instance->vkGetPhysicalDeviceFeatures2KHR( physicalDevices[physicalDeviceIndex],
+                                                           &physicalDeviceFeatures2 ) );
+            this->extendedDynamicState3Features.pNext = nullptr;
+
+            const VkPhysicalDeviceExtendedDynamicState3FeaturesEXT& features =
+                this->extendedDynamicState3Features;
+            this->supportsExtendedDynamicState3 =
+                this->supportsExtendedDynamicState &&
+                features.extendedDynamicState3ColorBlendEnable &&
+                features.extendedDynamicState3ColorBlendEquation &&
+                features.extendedDynamicState3ColorWriteMask;
+        }
+        Print( "Support extended dynamic state: %s, 3: %s\n",
+               this->supportsExtendedDynamicState ? "true" : "false",
+               this->supportsExtendedDynamicState3 ? "true" : "false" );
+
+        memset( &this->graphicsPipelineLibraryFeatures, 0,
+                sizeof( this->graphicsPipelineLibraryFeatures ) );
+        this->graphicsPipelineLibraryFeatures.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+        this->supportsGraphicsPipelineLibrary = false;
+        if ( instance->vkGetPhysicalDeviceFeatures2KHR != nullptr &&
+             IsExtensionEnabled( VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME ) &&
+             IsExtensionEnabled( VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME ) )
+        {
+            VkPhysicalDeviceFeatures2KHR physicalDeviceFeatures2;
+            physicalDeviceFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+            physicalDeviceFeatures2.pNext = &this->graphicsPipelineLibraryFeatures;
+            VC( instance->vkGetPhysicalDeviceFeatures2KHR( physicalDevices[physicalDeviceIndex],
+                                                           &physicalDeviceFeatures2 ) );
+            this->graphicsPipelineLibraryFeatures.pNext = nullptr;
+            this->supportsGraphicsPipelineLibrary =
+                this->graphicsPipelineLibraryFeatures.graphicsPipelineLibrary;
+        }
+        Print( "Support graphics pipeline library: %s\n",
+               this->supportsGraphicsPipelineLibrary ? "true" : "false" );
         break;
     }
 
@@ -522,44 +864,16 @@ uint32_t GpuDevice::GetMemoryTypeIndex( const uint32_t              typeBits,
     return 0;
 }
 
-void GpuDevice::CreateShader( VkShaderModule* shaderModule, const VkShaderStageFlagBits stage,
-                              const void* code, size_t codeSize )
+bool GpuDevice::IsExtensionEnabled( const char* extensionName ) const
 {
-    UNUSED_PARM( stage );
-
-    VkShaderModuleCreateInfo moduleCreateInfo;
-    moduleCreateInfo.sType    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    moduleCreateInfo.pNext    = nullptr;
-    moduleCreateInfo.flags    = 0;
-    moduleCreateInfo.codeSize = 0;
-    moduleCreateInfo.pCode    = nullptr;
-
-    if ( *(uint32_t*)code == ICD_SPV_MAGIC )
+    for ( uint32_t i = 0; i < this->enabledExtensionCount; i++ )
     {
-        moduleCreateInfo.codeSize = codeSize;
-        moduleCreateInfo.pCode    = static_cast<const uint32_t*>( code );
-
-        VK( this->vkCreateShaderModule( this->device, &moduleCreateInfo, VK_ALLOCATOR,
-                                        shaderModule ) );
-    }
-    else
-    {
-        // Create fake SPV structure to feed GLSL to the driver "under the covers".
-        size_t    tempCodeSize = 3 * sizeof( uint32_t ) + codeSize + 1;
-        uint32_t* tempCode     = (uint32_t*)malloc( tempCodeSize );
-        tempCode[0]            = ICD_SPV_MAGIC;
-        tempCode[1]            = 0;
-        tempCode[2]            = stage;
-        memcpy( tempCode + 3, code, codeSize + 1 );
-
-        moduleCreateInfo.codeSize = tempCodeSize;
-        moduleCreateInfo.pCode    = tempCode;
-
-        VK( this->vkCreateShaderModule( this->device, &moduleCreateInfo, VK_ALLOCATOR,
-                                        shaderModule ) );
-
-        free( tempCode );
+        if ( strcmp( this->enabledExtensionNames[i], extensionName ) == 0 )
+        {
+            return true;
+        }
     }
+    return false;
 }
 
 } // namespace lxd
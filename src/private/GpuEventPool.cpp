@@ -0,0 +1,57 @@
+#include "GpuEventPool.hpp"
+#include "GpuContext.hpp"
+#include "GpuDevice.hpp"
+
+namespace lxd
+{
+
+GpuEventPool::GpuEventPool( GpuContext* context ) : context( *context ) {}
+
+GpuEventPool::~GpuEventPool()
+{
+    for ( int i = 0; i < this->numEvents; i++ )
+    {
+        VC( context.device->vkDestroyEvent( context.device->device, this->events[i],
+                                            VK_ALLOCATOR ) );
+    }
+    free( this->events );
+}
+
+void GpuEventPool::BeginFrame()
+{
+    // Only the events handed out last frame can be signaled. Resetting them from the host is
+    // cheaper than recording a vkCmdResetEvent() for each of them.
+    for ( int i = 0; i < this->numUsed; i++ )
+    {
+        VK( context.device->vkResetEvent( context.device->device, this->events[i] ) );
+    }
+    this->numUsed = 0;
+}
+
+VkEvent GpuEventPool::Allocate()
+{
+    if ( this->numUsed < this->numEvents )
+    {
+        return this->events[this->numUsed++];
+    }
+
+    if ( this->numEvents >= this->maxEvents )
+    {
+        this->maxEvents = ( this->maxEvents > 0 ) ? this->maxEvents * 2 : 16;
+        this->events    = static_cast<VkEvent*>(
+            realloc( this->events, this->maxEvents * sizeof( VkEvent ) ) );
+    }
+
+    VkEventCreateInfo eventCreateInfo;
+    eventCreateInfo.sType = VK_STRUCTURE_TYPE_EVENT_CREATE_INFO;
+    eventCreateInfo.pNext = nullptr;
+    eventCreateInfo.flags = 0;
+
+    VK( context.device->vkCreateEvent( context.device->device, &eventCreateInfo, VK_ALLOCATOR,
+                                       &this->events[this->numEvents] ) );
+    this->numEvents++;
+
+    return this->events[this->numUsed++];
+}
+
+} // namespace lxd
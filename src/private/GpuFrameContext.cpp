@@ -0,0 +1,157 @@
+#include "GpuFrameContext.hpp"
+#include "GpuCommandBuffer.hpp"
+#include "GpuContext.hpp"
+#include "GpuSubmitBatch.hpp"
+#include "GpuTimeline.hpp"
+
+namespace lxd
+{
+
+GpuFrameContext::GpuFrameContext( GpuContext* context, const int numFrames,
+                                  const size_t simulationDataSize, GpuFrameRecordFunc recordFunc,
+                                  void* userData )
+    : context( *context )
+{
+    assert( numFrames >= 1 && numFrames <= GPU_MAX_FRAMES_IN_FLIGHT );
+
+    this->numFrames      = numFrames;
+    this->framesInFlight = numFrames;
+    this->recordFunc     = recordFunc;
+    this->userData       = userData;
+    this->commandBuffer =
+        new GpuCommandBuffer( context, GPU_COMMAND_BUFFER_TYPE_PRIMARY, numFrames );
+
+    for ( int i = 0; i < GPU_FRAME_SIMULATION_BUFFERS; i++ )
+    {
+        this->simulationData[i] = ( simulationDataSize > 0 ) ? calloc( 1, simulationDataSize )
+                                                             : nullptr;
+    }
+}
+
+GpuFrameContext::~GpuFrameContext()
+{
+    SetPipelined( false );
+
+    context.timeline->Wait( context.timeline->submittedValue.load() );
+
+    delete this->commandBuffer;
+    for ( int i = 0; i < GPU_FRAME_SIMULATION_BUFFERS; i++ )
+    {
+        free( this->simulationData[i] );
+    }
+}
+
+void GpuFrameContext::SetFramesInFlight( const int framesInFlight )
+{
+    assert( framesInFlight >= 1 && framesInFlight <= this->numFrames );
+    // Read when the next frame is simulated, the frames before keep their pacing.
+    this->framesInFlight = framesInFlight;
+}
+
+void GpuFrameContext::SetPipelined( const bool pipelined )
+{
+    if ( pipelined == this->pipelined )
+    {
+        return;
+    }
+
+    if ( pipelined )
+    {
+        if ( !this->recordThreadCreated )
+        {
+            this->recordThreadCreated = ksThread_Create( &this->recordThread, "GpuFrameRecord",
+                                                         RecordThreadFunction, this );
+            if ( !this->recordThreadCreated )
+            {
+                Error( "Failed to create the frame record thread." );
+                return;
+            }
+        }
+    }
+    else if ( this->recordThreadCreated )
+    {
+        WaitRecording();
+        ksThread_Destroy( &this->recordThread );
+        this->recordThreadCreated = false;
+    }
+    this->pipelined = pipelined;
+}
+
+void* GpuFrameContext::BeginSimulation()
+{
+    GpuFrame* frame       = &this->simulatedFrame;
+    frame->index          = ++this->frameIndex;
+    frame->slot           = -1;
+    frame->framesInFlight = this->framesInFlight;
+    frame->simulationData = this->simulationData[frame->index % GPU_FRAME_SIMULATION_BUFFERS];
+
+    // While pipelined the record thread owns the timeline and paces the frames itself.
+    if ( !this->pipelined )
+    {
+        PaceFrame( frame );
+    }
+    return frame->simulationData;
+}
+
+void GpuFrameContext::SubmitFrame()
+{
+    assert( this->simulatedFrame.index == this->frameIndex );
+
+    if ( !this->pipelined )
+    {
+        RecordFrame( &this->simulatedFrame );
+        return;
+    }
+
+    // The previous frame has to be recorded before its copy is replaced. This also throttles
+    // the simulation to at most one frame ahead of the recording.
+    ksThread_Join( &this->recordThread );
+    this->recordedFrame = this->simulatedFrame;
+    ksThread_Submit( &this->recordThread, RecordThreadFunction, this );
+}
+
+void GpuFrameContext::WaitRecording()
+{
+    if ( this->recordThreadCreated )
+    {
+        ksThread_Join( &this->recordThread );
+    }
+}
+
+void GpuFrameContext::RecordThreadFunction( void* data )
+{
+    GpuFrameContext* frameContext = static_cast<GpuFrameContext*>( data );
+    frameContext->RecordFrame( &frameContext->recordedFrame );
+}
+
+void GpuFrameContext::PaceFrame( const GpuFrame* frame )
+{
+    // Keep at most 'framesInFlight' frames on the GPU, including this one. The command buffer
+    // ring on its own only limits the frames to 'numFrames'.
+    if ( frame->index > (uint64_t)frame->framesInFlight )
+    {
+        const uint64_t waitFrame = frame->index - frame->framesInFlight;
+        context.timeline->Wait( this->frameValues[waitFrame % GPU_MAX_FRAMES_IN_FLIGHT] );
+    }
+}
+
+void GpuFrameContext::RecordFrame( GpuFrame* frame )
+{
+    PaceFrame( frame );
+
+    // Everything the record function submits goes to the queue together with the frame.
+    context.submitBatch->Begin();
+
+    this->commandBuffer->BeginPrimary();
+    frame->slot = this->commandBuffer->currentBuffer;
+
+    this->recordFunc( this->commandBuffer, frame, this->userData );
+
+    this->commandBuffer->EndPrimary();
+    this->commandBuffer->SubmitPrimary();
+
+    const uint64_t value = context.submitBatch->End();
+    this->frameValues[frame->index % GPU_MAX_FRAMES_IN_FLIGHT] = value;
+}
+
+} // namespace lxd
@@ -73,4 +73,14 @@ void GpuGraphicsCommand::SetNumInstances( const int numInstances )
 {
     this->numInstances = numInstances;
 }
+void GpuGraphicsCommand::SetRasterOperations( const GpuRasterOperations* rop )
+{
+    assert( this->pipeline->context.dynamicRasterState != 0 );
+    this->rop    = *rop;
+    this->hasRop = true;
+}
+const GpuRasterOperations* GpuGraphicsCommand::GetRasterOperations() const
+{
+    return this->hasRop ? &this->rop : &this->pipeline->rop;
+}
 } // namespace lxd
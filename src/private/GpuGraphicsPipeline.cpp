@@ -1,9 +1,12 @@
 #include "GpuGraphicsPipeline.hpp"
+#include "GpuDeletionQueue.hpp"
 #include "GpuDevice.hpp"
 #include "GpuVertexAttribute.hpp"
 #include "GpuGeometry.hpp"
 #include "GpuGraphicsProgram.hpp"
+#include "GpuPipelineRegistry.hpp"
 #include "GpuRenderPass.hpp"
+#include "GpuShaderReflection.hpp"
 #include <algorithm>
 
 namespace lxd
@@ -53,12 +56,63 @@ GpuGraphicsPipeline::GpuGraphicsPipeline( GpuContext*                     contex
                                           const GpuGraphicsPipelineParms* parms )
     : context( *context )
 {
+    InitVertexInput( parms );
+    InitSpecialization( parms );
+    CreatePipeline();
+    this->ready.store( true, std::memory_order_release );
+}
+
+GpuGraphicsPipeline::GpuGraphicsPipeline( GpuContext*                     context,
+                                          const GpuGraphicsPipelineParms* parms,
+                                          GpuPipelineCompiler*            compiler,
+                                          const GpuGraphicsPipeline*      fallback,
+                                          GpuPipelineCompiledFunc         compiledFunc,
+                                          void*                           compiledUserData )
+    : context( *context )
+{
+    assert( fallback == nullptr ||
+            ( fallback->program == parms->program && fallback->geometry == parms->geometry ) );
+
+    this->fallback         = fallback;
+    this->compiledFunc     = compiledFunc;
+    this->compiledUserData = compiledUserData;
+
+    InitVertexInput( parms );
+    InitSpecialization( parms );
+
+    if ( context->pipelineLibraries )
+    {
+        GpuGraphicsPipelineKey key;
+        key.Set( this );
+        this->pipeline = context->pipelineRegistry->Acquire( &key );
+        if ( this->pipeline != VK_NULL_HANDLE )
+        {
+            AcquireLibraries( &key );
+            this->ready.store( true, std::memory_order_release );
+            return;
+        }
+        // Linking cached parts is cheap, so draws do not have to wait for the worker. A part that
+        // is not cached is a full compile, which is left to the worker like any other compile,
+        // and draws use the fallback until then.
+        if ( AcquireLibraries( &key ) )
+        {
+            this->pipeline = CompilePipeline( &key, true );
+            this->fastLinked.store( true, std::memory_order_release );
+        }
+    }
+    // Only a queued pipeline has to be cancelled when it is destroyed.
+    this->compiler = compiler;
+    compiler->Compile( this );
+}
 
+void GpuGraphicsPipeline::InitVertexInput( const GpuGraphicsPipelineParms* parms )
+{
     // Make sure the geometry provides all the attributes needed by the program.
     assert( ( ( parms->geometry->vertexAttribsFlags | parms->geometry->instanceAttribsFlags ) &
               parms->program->vertexAttribsFlags ) == parms->program->vertexAttribsFlags );
 
     this->rop                  = parms->rop;
+    this->renderPass           = parms->renderPass;
     this->program              = parms->program;
     this->geometry             = parms->geometry;
     this->vertexAttributeCount = 0;
@@ -76,6 +130,18 @@ GpuGraphicsPipeline::GpuGraphicsPipeline( GpuContext*                     contex
                           this->vertexAttributes, &this->vertexAttributeCount, this->vertexBindings,
                           &this->vertexBindingCount, this->vertexBindingOffsets );
 
+    // Make sure the vertex shader of a reflected program only reads attributes that are bound.
+    if ( parms->program->reflection != nullptr )
+    {
+        uint32_t locationMask = 0;
+        for ( int i = 0; i < this->vertexAttributeCount; i++ )
+        {
+            locationMask |= 1u << this->vertexAttributes[i].location;
+        }
+        assert( ( parms->program->reflection->vertexInputMask & ~locationMask ) == 0 );
+        UNUSED_PARM( locationMask );
+    }
+
     this->vertexInputState.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
     this->vertexInputState.pNext = NULL;
     this->vertexInputState.flags = 0;
@@ -89,7 +155,111 @@ GpuGraphicsPipeline::GpuGraphicsPipeline( GpuContext*                     contex
     this->inputAssemblyState.flags    = 0;
     this->inputAssemblyState.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
     this->inputAssemblyState.primitiveRestartEnable = VK_FALSE;
+}
+
+void GpuGraphicsPipeline::InitSpecialization( const GpuGraphicsPipelineParms* parms )
+{
+    // Only the constants with a value are specialized, the others keep the shader default.
+    this->specializationEntryCount = 0;
+    for ( int i = 0; i < parms->program->numSpecializationConstants; i++ )
+    {
+        const GpuSpecializationConstant* constant = &parms->program->specializationConstants[i];
+        assert( constant->index >= 0 && constant->index < 32 ); // bit in the set mask
+        if ( ( parms->specialization.setMask & ( 1u << constant->index ) ) == 0 )
+        {
+            continue;
+        }
+        // A bool constant has to be VK_TRUE or VK_FALSE, whichever setter stored it.
+        uint32_t value = parms->specialization.values[constant->index];
+        if ( constant->type == GPU_SPECIALIZATION_CONSTANT_TYPE_BOOL )
+        {
+            value = ( value != 0 ) ? VK_TRUE : VK_FALSE;
+        }
+        const int entry = this->specializationEntryCount++;
+        this->specializationEntries[entry].constantID = (uint32_t)constant->constantId;
+        this->specializationEntries[entry].offset     = entry * sizeof( uint32_t );
+        this->specializationEntries[entry].size       = sizeof( uint32_t );
+        this->specializationData[entry]               = value;
+    }
+
+    this->specializationInfo.mapEntryCount = this->specializationEntryCount;
+    this->specializationInfo.pMapEntries   = this->specializationEntries;
+    this->specializationInfo.dataSize      = this->specializationEntryCount * sizeof( uint32_t );
+    this->specializationInfo.pData         = this->specializationData;
+}
+
+const GpuGraphicsPipeline* GpuGraphicsPipeline::Resolve() const
+{
+    if ( this->ready.load( std::memory_order_acquire ) ||
+         this->fastLinked.load( std::memory_order_acquire ) )
+    {
+        return this;
+    }
+    if ( this->fallback != nullptr && this->fallback->ready.load( std::memory_order_acquire ) )
+    {
+        return this->fallback;
+    }
+    return nullptr;
+}
+
+void GpuGraphicsPipeline::CreatePipeline()
+{
+    // Geometries with the same vertex layout drawn with the same material share the pipeline.
+    GpuGraphicsPipelineKey key;
+    key.Set( this );
+    VkPipeline pipeline = context.pipelineRegistry->Acquire( &key );
+    if ( pipeline == VK_NULL_HANDLE )
+    {
+        pipeline = context.pipelineRegistry->Insert( &key, CompilePipeline( &key, false ) );
+    }
+    else if ( context.pipelineLibraries && this->libraries[0] == VK_NULL_HANDLE )
+    {
+        AcquireLibraries( &key );
+    }
+
+    if ( this->fastLinked.load( std::memory_order_acquire ) )
+    {
+        this->optimizedPipeline = pipeline;
+    }
+    else
+    {
+        this->pipeline = pipeline;
+    }
+}
+
+void GpuGraphicsPipeline::ReplaceFastLinkedPipeline()
+{
+    assert( this->fastLinked.load() && this->optimizedPipeline != VK_NULL_HANDLE );
 
+    context.deletionQueue->Destroy( GPU_DELETION_TYPE_PIPELINE, (uint64_t)this->pipeline );
+    this->pipeline          = this->optimizedPipeline;
+    this->optimizedPipeline = VK_NULL_HANDLE;
+    this->fastLinked.store( false, std::memory_order_release );
+}
+
+bool GpuGraphicsPipeline::AcquireLibraries( const GpuGraphicsPipelineKey* key )
+{
+    for ( int i = 0; i < GPU_PIPELINE_LIBRARY_PARTS; i++ )
+    {
+        GpuGraphicsPipelineKey partKey;
+        partKey.SetPart( key, (GpuPipelinePart)( GPU_PIPELINE_PART_VERTEX_INPUT + i ) );
+        this->libraries[i] = context.pipelineRegistry->Acquire( &partKey );
+        if ( this->libraries[i] == VK_NULL_HANDLE )
+        {
+            for ( int j = 0; j < i; j++ )
+            {
+                context.pipelineRegistry->Release( this->libraries[j] );
+                this->libraries[j] = VK_NULL_HANDLE;
+            }
+            return false;
+        }
+    }
+    return true;
+}
+
+VkPipeline GpuGraphicsPipeline::CompilePipeline( const GpuGraphicsPipelineKey* key,
+                                                 const bool                    fastLink )
+{
     VkPipelineTessellationStateCreateInfo tessellationStateCreateInfo;
     tessellationStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_TESSELLATION_STATE_CREATE_INFO;
     tessellationStateCreateInfo.pNext = NULL;
@@ -112,8 +282,8 @@ GpuGraphicsPipeline::GpuGraphicsPipeline( GpuContext*                     contex
     rasterizationStateCreateInfo.depthClampEnable        = VK_FALSE;
     rasterizationStateCreateInfo.rasterizerDiscardEnable = VK_FALSE;
     rasterizationStateCreateInfo.polygonMode             = VK_POLYGON_MODE_FILL;
-    rasterizationStateCreateInfo.cullMode                = (VkCullModeFlags)parms->rop.cullMode;
-    rasterizationStateCreateInfo.frontFace               = (VkFrontFace)parms->rop.frontFace;
+    rasterizationStateCreateInfo.cullMode                = (VkCullModeFlags)this->rop.cullMode;
+    rasterizationStateCreateInfo.frontFace               = (VkFrontFace)this->rop.frontFace;
     rasterizationStateCreateInfo.depthBiasEnable         = VK_FALSE;
     rasterizationStateCreateInfo.depthBiasConstantFactor = 0.0f;
     rasterizationStateCreateInfo.depthBiasClamp          = 0.0f;
@@ -125,7 +295,7 @@ GpuGraphicsPipeline::GpuGraphicsPipeline( GpuContext*                     contex
     multisampleStateCreateInfo.pNext = NULL;
     multisampleStateCreateInfo.flags = 0;
     multisampleStateCreateInfo.rasterizationSamples =
-        (VkSampleCountFlagBits)parms->renderPass->sampleCount;
+        (VkSampleCountFlagBits)this->renderPass->sampleCount;
     multisampleStateCreateInfo.sampleShadingEnable   = VK_FALSE;
     multisampleStateCreateInfo.minSampleShading      = 1.0f;
     multisampleStateCreateInfo.pSampleMask           = NULL;
@@ -136,9 +306,9 @@ GpuGraphicsPipeline::GpuGraphicsPipeline( GpuContext*                     contex
     depthStencilStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
     depthStencilStateCreateInfo.pNext = NULL;
     depthStencilStateCreateInfo.flags = 0;
-    depthStencilStateCreateInfo.depthTestEnable  = parms->rop.depthTestEnable ? VK_TRUE : VK_FALSE;
-    depthStencilStateCreateInfo.depthWriteEnable = parms->rop.depthWriteEnable ? VK_TRUE : VK_FALSE;
-    depthStencilStateCreateInfo.depthCompareOp   = (VkCompareOp)parms->rop.depthCompare;
+    depthStencilStateCreateInfo.depthTestEnable  = this->rop.depthTestEnable ? VK_TRUE : VK_FALSE;
+    depthStencilStateCreateInfo.depthWriteEnable = this->rop.depthWriteEnable ? VK_TRUE : VK_FALSE;
+    depthStencilStateCreateInfo.depthCompareOp   = (VkCompareOp)this->rop.depthCompare;
     depthStencilStateCreateInfo.depthBoundsTestEnable = VK_FALSE;
     depthStencilStateCreateInfo.stencilTestEnable     = VK_FALSE;
     depthStencilStateCreateInfo.front.failOp          = VK_STENCIL_OP_KEEP;
@@ -153,18 +323,18 @@ GpuGraphicsPipeline::GpuGraphicsPipeline( GpuContext*                     contex
     depthStencilStateCreateInfo.maxDepthBounds        = 1.0f;
 
     VkPipelineColorBlendAttachmentState colorBlendAttachementState[1];
-    colorBlendAttachementState[0].blendEnable         = parms->rop.blendEnable ? VK_TRUE : VK_FALSE;
-    colorBlendAttachementState[0].srcColorBlendFactor = (VkBlendFactor)parms->rop.blendSrcColor;
-    colorBlendAttachementState[0].dstColorBlendFactor = (VkBlendFactor)parms->rop.blendDstColor;
-    colorBlendAttachementState[0].colorBlendOp        = (VkBlendOp)parms->rop.blendOpColor;
-    colorBlendAttachementState[0].srcAlphaBlendFactor = (VkBlendFactor)parms->rop.blendSrcAlpha;
-    colorBlendAttachementState[0].dstAlphaBlendFactor = (VkBlendFactor)parms->rop.blendDstAlpha;
-    colorBlendAttachementState[0].alphaBlendOp        = (VkBlendOp)parms->rop.blendOpAlpha;
+    colorBlendAttachementState[0].blendEnable         = this->rop.blendEnable ? VK_TRUE : VK_FALSE;
+    colorBlendAttachementState[0].srcColorBlendFactor = (VkBlendFactor)this->rop.blendSrcColor;
+    colorBlendAttachementState[0].dstColorBlendFactor = (VkBlendFactor)this->rop.blendDstColor;
+    colorBlendAttachementState[0].colorBlendOp        = (VkBlendOp)this->rop.blendOpColor;
+    colorBlendAttachementState[0].srcAlphaBlendFactor = (VkBlendFactor)this->rop.blendSrcAlpha;
+    colorBlendAttachementState[0].dstAlphaBlendFactor = (VkBlendFactor)this->rop.blendDstAlpha;
+    colorBlendAttachementState[0].alphaBlendOp        = (VkBlendOp)this->rop.blendOpAlpha;
     colorBlendAttachementState[0].colorWriteMask =
-        ( parms->rop.redWriteEnable ? VK_COLOR_COMPONENT_R_BIT : 0 ) |
-        ( parms->rop.blueWriteEnable ? VK_COLOR_COMPONENT_G_BIT : 0 ) |
-        ( parms->rop.greenWriteEnable ? VK_COLOR_COMPONENT_B_BIT : 0 ) |
-        ( parms->rop.alphaWriteEnable ? VK_COLOR_COMPONENT_A_BIT : 0 );
+        ( this->rop.redWriteEnable ? VK_COLOR_COMPONENT_R_BIT : 0 ) |
+        ( this->rop.greenWriteEnable ? VK_COLOR_COMPONENT_G_BIT : 0 ) |
+        ( this->rop.blueWriteEnable ? VK_COLOR_COMPONENT_B_BIT : 0 ) |
+        ( this->rop.alphaWriteEnable ? VK_COLOR_COMPONENT_A_BIT : 0 );
 
     VkPipelineColorBlendStateCreateInfo colorBlendStateCreateInfo;
     colorBlendStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
@@ -174,30 +344,55 @@ GpuGraphicsPipeline::GpuGraphicsPipeline( GpuContext*                     contex
     colorBlendStateCreateInfo.logicOp           = VK_LOGIC_OP_CLEAR;
     colorBlendStateCreateInfo.attachmentCount   = 1;
     colorBlendStateCreateInfo.pAttachments      = colorBlendAttachementState;
-    colorBlendStateCreateInfo.blendConstants[0] = parms->rop.blendColor.x;
-    colorBlendStateCreateInfo.blendConstants[1] = parms->rop.blendColor.y;
-    colorBlendStateCreateInfo.blendConstants[2] = parms->rop.blendColor.z;
-    colorBlendStateCreateInfo.blendConstants[3] = parms->rop.blendColor.w;
+    colorBlendStateCreateInfo.blendConstants[0] = this->rop.blendColor.x;
+    colorBlendStateCreateInfo.blendConstants[1] = this->rop.blendColor.y;
+    colorBlendStateCreateInfo.blendConstants[2] = this->rop.blendColor.z;
+    colorBlendStateCreateInfo.blendConstants[3] = this->rop.blendColor.w;
 
-    VkDynamicState dynamicStateEnables[] = {
-        VK_DYNAMIC_STATE_VIEWPORT,
-        VK_DYNAMIC_STATE_SCISSOR,
-    };
+    // The raster operations that are dynamic are ignored above, see CmdSetDynamicState().
+    VkDynamicState dynamicStateEnables[16];
+    uint32_t       dynamicStateCount          = 0;
+    dynamicStateEnables[dynamicStateCount++] = VK_DYNAMIC_STATE_VIEWPORT;
+    dynamicStateEnables[dynamicStateCount++] = VK_DYNAMIC_STATE_SCISSOR;
+    if ( ( context.dynamicRasterState & GPU_DYNAMIC_RASTER_STATE_DEPTH_CULL ) != 0 )
+    {
+        dynamicStateEnables[dynamicStateCount++] = VK_DYNAMIC_STATE_CULL_MODE_EXT;
+        dynamicStateEnables[dynamicStateCount++] = VK_DYNAMIC_STATE_FRONT_FACE_EXT;
+        dynamicStateEnables[dynamicStateCount++] = VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE_EXT;
+        dynamicStateEnables[dynamicStateCount++] = VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE_EXT;
+        dynamicStateEnables[dynamicStateCount++] = VK_DYNAMIC_STATE_DEPTH_COMPARE_OP_EXT;
+        dynamicStateEnables[dynamicStateCount++] = VK_DYNAMIC_STATE_BLEND_CONSTANTS;
+    }
+    if ( ( context.dynamicRasterState & GPU_DYNAMIC_RASTER_STATE_BLEND ) != 0 )
+    {
+        dynamicStateEnables[dynamicStateCount++] = VK_DYNAMIC_STATE_COLOR_BLEND_ENABLE_EXT;
+        dynamicStateEnables[dynamicStateCount++] = VK_DYNAMIC_STATE_COLOR_BLEND_EQUATION_EXT;
+        dynamicStateEnables[dynamicStateCount++] = VK_DYNAMIC_STATE_COLOR_WRITE_MASK_EXT;
+    }
 
     VkPipelineDynamicStateCreateInfo pipelineDynamicStateCreateInfo;
     pipelineDynamicStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
     pipelineDynamicStateCreateInfo.pNext = NULL;
     pipelineDynamicStateCreateInfo.flags = 0;
-    pipelineDynamicStateCreateInfo.dynamicStateCount =
-        static_cast<uint32_t>( std::size( dynamicStateEnables ) );
-    pipelineDynamicStateCreateInfo.pDynamicStates = dynamicStateEnables;
+    pipelineDynamicStateCreateInfo.dynamicStateCount = dynamicStateCount;
+    pipelineDynamicStateCreateInfo.pDynamicStates    = dynamicStateEnables;
+
+    // Constants that a stage does not declare are ignored by that stage.
+    const VkSpecializationInfo* specializationInfo =
+        ( this->specializationEntryCount > 0 ) ? &this->specializationInfo : NULL;
+    VkPipelineShaderStageCreateInfo stages[2];
+    for ( int i = 0; i < 2; i++ )
+    {
+        stages[i]                     = this->program->pipelineStages[i];
+        stages[i].pSpecializationInfo = specializationInfo;
+    }
 
     VkGraphicsPipelineCreateInfo graphicsPipelineCreateInfo;
     graphicsPipelineCreateInfo.sType             = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
     graphicsPipelineCreateInfo.pNext             = NULL;
     graphicsPipelineCreateInfo.flags             = 0;
     graphicsPipelineCreateInfo.stageCount        = 2;
-    graphicsPipelineCreateInfo.pStages           = parms->program->pipelineStages;
+    graphicsPipelineCreateInfo.pStages           = stages;
     graphicsPipelineCreateInfo.pVertexInputState = &this->vertexInputState;
     graphicsPipelineCreateInfo.pInputAssemblyState = &this->inputAssemblyState;
     graphicsPipelineCreateInfo.pTessellationState  = &tessellationStateCreateInfo;
@@ -205,26 +400,234 @@ GpuGraphicsPipeline::GpuGraphicsPipeline( GpuContext*                     contex
     graphicsPipelineCreateInfo.pRasterizationState = &rasterizationStateCreateInfo;
     graphicsPipelineCreateInfo.pMultisampleState   = &multisampleStateCreateInfo;
     graphicsPipelineCreateInfo.pDepthStencilState =
-        ( parms->renderPass->internalDepthFormat != VK_FORMAT_UNDEFINED )
+        ( this->renderPass->internalDepthFormat != VK_FORMAT_UNDEFINED )
             ? &depthStencilStateCreateInfo
             : NULL;
     graphicsPipelineCreateInfo.pColorBlendState   = &colorBlendStateCreateInfo;
     graphicsPipelineCreateInfo.pDynamicState      = &pipelineDynamicStateCreateInfo;
-    graphicsPipelineCreateInfo.layout             = parms->program->parmLayout.pipelineLayout;
-    graphicsPipelineCreateInfo.renderPass         = parms->renderPass->renderPass;
+    graphicsPipelineCreateInfo.layout             = this->program->parmLayout.pipelineLayout;
+    graphicsPipelineCreateInfo.renderPass         = this->renderPass->renderPass;
     graphicsPipelineCreateInfo.subpass            = 0;
     graphicsPipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
     graphicsPipelineCreateInfo.basePipelineIndex  = 0;
 
-    VK( context->device->vkCreateGraphicsPipelines( context->device->device, context->pipelineCache,
-                                                    1, &graphicsPipelineCreateInfo, VK_ALLOCATOR,
-                                                    &this->pipeline ) );
+    if ( context.pipelineLibraries )
+    {
+        // The libraries are compiled from the modules, they are shared by too many pipelines to
+        // be worth looking up by identifier.
+        this->program->GetModuleStages( stages );
+        stages[0].pSpecializationInfo = specializationInfo;
+        stages[1].pSpecializationInfo = specializationInfo;
+        return LinkPipeline( key, &graphicsPipelineCreateInfo, fastLink );
+    }
+
+    // Shaders referenced by identifier only work if the pipeline is in the pipeline cache,
+    // otherwise the modules are created and the pipeline is compiled from them.
+    const bool useIdentifiers = this->program->pipelineStages[0].module == VK_NULL_HANDLE ||
+                                this->program->pipelineStages[1].module == VK_NULL_HANDLE;
+    if ( useIdentifiers )
+    {
+        graphicsPipelineCreateInfo.flags =
+            VK_PIPELINE_CREATE_FAIL_ON_PIPELINE_COMPILE_REQUIRED_BIT_EXT;
+        VkPipeline     pipeline = VK_NULL_HANDLE;
+        const VkResult result   = context.device->vkCreateGraphicsPipelines(
+            context.device->device, context.pipelineCache, 1, &graphicsPipelineCreateInfo,
+            VK_ALLOCATOR, &pipeline );
+        if ( result != VK_PIPELINE_COMPILE_REQUIRED_EXT )
+        {
+            VkCheckErrors( result, "vkCreateGraphicsPipelines" );
+            return pipeline;
+        }
+    }
+
+    if ( useIdentifiers )
+    {
+        this->program->GetModuleStages( stages );
+        stages[0].pSpecializationInfo    = specializationInfo;
+        stages[1].pSpecializationInfo    = specializationInfo;
+        graphicsPipelineCreateInfo.flags = 0;
+    }
+
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    VK( context.device->vkCreateGraphicsPipelines( context.device->device, context.pipelineCache,
+                                                   1, &graphicsPipelineCreateInfo, VK_ALLOCATOR,
+                                                   &pipeline ) );
+    return pipeline;
 }
 
-GpuGraphicsPipeline::~GpuGraphicsPipeline()
+VkPipeline GpuGraphicsPipeline::LinkPipeline( const GpuGraphicsPipelineKey*       key,
+                                              const VkGraphicsPipelineCreateInfo* createInfo,
+                                              const bool                          fastLink )
+{
+    static const VkGraphicsPipelineLibraryFlagsEXT partFlags[GPU_PIPELINE_LIBRARY_PARTS] = {
+        VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT,
+        VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT,
+        VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT,
+        VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT };
+
+    // The optimized link on the worker reuses the libraries acquired for the fast link. Each
+    // part only reads its own state from the create info.
+    if ( this->libraries[0] == VK_NULL_HANDLE )
+    {
+        for ( int i = 0; i < GPU_PIPELINE_LIBRARY_PARTS; i++ )
+        {
+            const GpuPipelinePart part = (GpuPipelinePart)( GPU_PIPELINE_PART_VERTEX_INPUT + i );
+
+            GpuGraphicsPipelineKey partKey;
+            partKey.SetPart( key, part );
+            this->libraries[i] = context.pipelineRegistry->Acquire( &partKey );
+            if ( this->libraries[i] != VK_NULL_HANDLE )
+            {
+                continue;
+            }
+
+            VkGraphicsPipelineLibraryCreateInfoEXT libraryCreateInfo;
+            libraryCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT;
+            libraryCreateInfo.pNext = nullptr;
+            libraryCreateInfo.flags = partFlags[i];
+
+            VkGraphicsPipelineCreateInfo partCreateInfo = *createInfo;
+            partCreateInfo.pNext = &libraryCreateInfo;
+            partCreateInfo.flags = VK_PIPELINE_CREATE_LIBRARY_BIT_KHR |
+                                   VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT;
+            partCreateInfo.stageCount = 0;
+            partCreateInfo.pStages    = nullptr;
+            if ( part == GPU_PIPELINE_PART_PRE_RASTERIZATION )
+            {
+                partCreateInfo.stageCount = 1;
+                partCreateInfo.pStages    = &createInfo->pStages[0];
+            }
+            else if ( part == GPU_PIPELINE_PART_FRAGMENT_SHADER )
+            {
+                partCreateInfo.stageCount = 1;
+                partCreateInfo.pStages    = &createInfo->pStages[1];
+            }
+
+            VkPipeline library = VK_NULL_HANDLE;
+            VK( context.device->vkCreateGraphicsPipelines( context.device->device,
+                                                           context.pipelineCache, 1,
+                                                           &partCreateInfo, VK_ALLOCATOR,
+                                                           &library ) );
+            this->libraries[i] = context.pipelineRegistry->Insert( &partKey, library );
+        }
+    }
+
+    VkPipelineLibraryCreateInfoKHR libraryCreateInfo;
+    libraryCreateInfo.sType        = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR;
+    libraryCreateInfo.pNext        = nullptr;
+    libraryCreateInfo.libraryCount = GPU_PIPELINE_LIBRARY_PARTS;
+    libraryCreateInfo.pLibraries   = this->libraries;
+
+    // All state comes from the libraries, except for the layout.
+    VkGraphicsPipelineCreateInfo linkCreateInfo = *createInfo;
+    linkCreateInfo.pNext      = &libraryCreateInfo;
+    linkCreateInfo.flags      = fastLink ? 0 : VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT;
+    linkCreateInfo.stageCount = 0;
+    linkCreateInfo.pStages    = nullptr;
+
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    VK( context.device->vkCreateGraphicsPipelines( context.device->device, context.pipelineCache,
+                                                   1, &linkCreateInfo, VK_ALLOCATOR, &pipeline ) );
+    return pipeline;
+}
+
+void GpuGraphicsPipeline::CmdSetDynamicState( VkCommandBuffer            cmdBuffer,
+                                              const GpuRasterOperations* rop,
+                                              const GpuRasterOperations* currentRop ) const
 {
-    VC( context.device->vkDestroyPipeline( context.device->device, this->pipeline, VK_ALLOCATOR ) );
+    GpuDevice* device = context.device;
 
-    memset( pipeline, 0, sizeof( GpuGraphicsPipeline ) );
+    if ( ( context.dynamicRasterState & GPU_DYNAMIC_RASTER_STATE_DEPTH_CULL ) != 0 )
+    {
+        if ( currentRop == nullptr || rop->cullMode != currentRop->cullMode )
+        {
+            VC( device->vkCmdSetCullModeEXT( cmdBuffer, (VkCullModeFlags)rop->cullMode ) );
+        }
+        if ( currentRop == nullptr || rop->frontFace != currentRop->frontFace )
+        {
+            VC( device->vkCmdSetFrontFaceEXT( cmdBuffer, (VkFrontFace)rop->frontFace ) );
+        }
+        if ( currentRop == nullptr || rop->depthTestEnable != currentRop->depthTestEnable )
+        {
+            VC( device->vkCmdSetDepthTestEnableEXT( cmdBuffer,
+                                                    rop->depthTestEnable ? VK_TRUE : VK_FALSE ) );
+        }
+        if ( currentRop == nullptr || rop->depthWriteEnable != currentRop->depthWriteEnable )
+        {
+            VC( device->vkCmdSetDepthWriteEnableEXT( cmdBuffer,
+                                                     rop->depthWriteEnable ? VK_TRUE : VK_FALSE ) );
+        }
+        if ( currentRop == nullptr || rop->depthCompare != currentRop->depthCompare )
+        {
+            VC( device->vkCmdSetDepthCompareOpEXT( cmdBuffer, (VkCompareOp)rop->depthCompare ) );
+        }
+        if ( currentRop == nullptr ||
+             memcmp( &rop->blendColor, &currentRop->blendColor, sizeof( rop->blendColor ) ) != 0 )
+        {
+            const float blendConstants[4] = { rop->blendColor.x, rop->blendColor.y,
+                                              rop->blendColor.z, rop->blendColor.w };
+            VC( device->vkCmdSetBlendConstants( cmdBuffer, blendConstants ) );
+        }
+    }
+
+    if ( ( context.dynamicRasterState & GPU_DYNAMIC_RASTER_STATE_BLEND ) != 0 )
+    {
+        if ( currentRop == nullptr || rop->blendEnable != currentRop->blendEnable )
+        {
+            const VkBool32 blendEnable = rop->blendEnable ? VK_TRUE : VK_FALSE;
+            VC( device->vkCmdSetColorBlendEnableEXT( cmdBuffer, 0, 1, &blendEnable ) );
+        }
+        if ( currentRop == nullptr || rop->blendOpColor != currentRop->blendOpColor ||
+             rop->blendSrcColor != currentRop->blendSrcColor ||
+             rop->blendDstColor != currentRop->blendDstColor ||
+             rop->blendOpAlpha != currentRop->blendOpAlpha ||
+             rop->blendSrcAlpha != currentRop->blendSrcAlpha ||
+             rop->blendDstAlpha != currentRop->blendDstAlpha )
+        {
+            VkColorBlendEquationEXT equation;
+            equation.srcColorBlendFactor = (VkBlendFactor)rop->blendSrcColor;
+            equation.dstColorBlendFactor = (VkBlendFactor)rop->blendDstColor;
+            equation.colorBlendOp        = (VkBlendOp)rop->blendOpColor;
+            equation.srcAlphaBlendFactor = (VkBlendFactor)rop->blendSrcAlpha;
+            equation.dstAlphaBlendFactor = (VkBlendFactor)rop->blendDstAlpha;
+            equation.alphaBlendOp        = (VkBlendOp)rop->blendOpAlpha;
+            VC( device->vkCmdSetColorBlendEquationEXT( cmdBuffer, 0, 1, &equation ) );
+        }
+        if ( currentRop == nullptr || rop->redWriteEnable != currentRop->redWriteEnable ||
+             rop->greenWriteEnable != currentRop->greenWriteEnable ||
+             rop->blueWriteEnable != currentRop->blueWriteEnable ||
+             rop->alphaWriteEnable != currentRop->alphaWriteEnable )
+        {
+            const VkColorComponentFlags writeMask =
+                ( rop->redWriteEnable ? VK_COLOR_COMPONENT_R_BIT : 0 ) |
+                ( rop->greenWriteEnable ? VK_COLOR_COMPONENT_G_BIT : 0 ) |
+                ( rop->blueWriteEnable ? VK_COLOR_COMPONENT_B_BIT : 0 ) |
+                ( rop->alphaWriteEnable ? VK_COLOR_COMPONENT_A_BIT : 0 );
+            VC( device->vkCmdSetColorWriteMaskEXT( cmdBuffer, 0, 1, &writeMask ) );
+        }
+    }
+}
+
+GpuGraphicsPipeline::~GpuGraphicsPipeline()
+{
+    if ( this->compiler != nullptr )
+    {
+        this->compiler->Cancel( this );
+    }
+    context.InvalidateCommandBundles( this );
+    if ( this->fastLinked.load() )
+    {
+        // The optimized pipeline was not swapped in by GpuPipelineCompiler::Update() yet.
+        context.deletionQueue->Destroy( GPU_DELETION_TYPE_PIPELINE, (uint64_t)this->pipeline );
+        context.pipelineRegistry->Release( this->optimizedPipeline );
+    }
+    else
+    {
+        context.pipelineRegistry->Release( this->pipeline );
+    }
+    for ( int i = 0; i < GPU_PIPELINE_LIBRARY_PARTS; i++ )
+    {
+        context.pipelineRegistry->Release( this->libraries[i] );
+    }
 }
 } // namespace lxd
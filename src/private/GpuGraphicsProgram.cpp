@@ -1,6 +1,11 @@
 #include "GpuGraphicsProgram.hpp"
+#include "GpuBindless.hpp"
 #include "GpuContext.hpp"
 #include "GpuDevice.hpp"
+#include "GpuLayoutCache.hpp"
+#include "GpuShaderCache.hpp"
+#include "GpuShaderReflection.hpp"
+#include <algorithm>
 #include <iterator>
 namespace lxd
 {
@@ -65,6 +70,61 @@ int GpuProgramParm::GetPushConstantSize( const GpuProgramParmType type )
     assert( std::size( parmSize ) == GPU_PROGRAM_PARM_TYPE_MAX );
     return parmSize[type];
 }
+// Base alignment of a push constant in a std430 block.
+int GpuProgramParm::GetPushConstantAlignment( const GpuProgramParmType type )
+{
+    switch ( type )
+    {
+        case GPU_PROGRAM_PARM_TYPE_PUSH_CONSTANT_INT:
+        case GPU_PROGRAM_PARM_TYPE_PUSH_CONSTANT_FLOAT:
+            return 4;
+        case GPU_PROGRAM_PARM_TYPE_PUSH_CONSTANT_INT_VECTOR2:
+        case GPU_PROGRAM_PARM_TYPE_PUSH_CONSTANT_FLOAT_VECTOR2:
+        case GPU_PROGRAM_PARM_TYPE_PUSH_CONSTANT_FLOAT_MATRIX2X2:
+        case GPU_PROGRAM_PARM_TYPE_PUSH_CONSTANT_FLOAT_MATRIX3X2:
+        case GPU_PROGRAM_PARM_TYPE_PUSH_CONSTANT_FLOAT_MATRIX4X2:
+            return 8;
+        default:
+            return 16;
+    }
+}
+int GpuProgramParm::GetMatrixColumns( const GpuProgramParmType type )
+{
+    switch ( type )
+    {
+        case GPU_PROGRAM_PARM_TYPE_PUSH_CONSTANT_FLOAT_MATRIX2X2:
+        case GPU_PROGRAM_PARM_TYPE_PUSH_CONSTANT_FLOAT_MATRIX2X3:
+        case GPU_PROGRAM_PARM_TYPE_PUSH_CONSTANT_FLOAT_MATRIX2X4:
+            return 2;
+        case GPU_PROGRAM_PARM_TYPE_PUSH_CONSTANT_FLOAT_MATRIX3X2:
+        case GPU_PROGRAM_PARM_TYPE_PUSH_CONSTANT_FLOAT_MATRIX3X3:
+        case GPU_PROGRAM_PARM_TYPE_PUSH_CONSTANT_FLOAT_MATRIX3X4:
+            return 3;
+        case GPU_PROGRAM_PARM_TYPE_PUSH_CONSTANT_FLOAT_MATRIX4X2:
+        case GPU_PROGRAM_PARM_TYPE_PUSH_CONSTANT_FLOAT_MATRIX4X3:
+        case GPU_PROGRAM_PARM_TYPE_PUSH_CONSTANT_FLOAT_MATRIX4X4:
+            return 4;
+        default:
+            return 0;
+    }
+}
+// std430 aligns the columns like the vector of their rows, std140 rounds them up to a vec4.
+int GpuProgramParm::GetColumnStride( const GpuProgramParmType type, const bool std140 )
+{
+    const int columns = GetMatrixColumns( type );
+    if ( columns == 0 )
+    {
+        return 0;
+    }
+    const int columnSize = GetPushConstantSize( type ) / columns;
+    return ( columnSize == 8 && !std140 ) ? 8 : 16;
+}
+int GpuProgramParm::GetBlockSize( const GpuProgramParmType type, const bool std140 )
+{
+    const int columns = GetMatrixColumns( type );
+    return ( columns > 0 ) ? columns * GetColumnStride( type, std140 )
+                           : GetPushConstantSize( type );
+}
 const char* GpuProgramParm::GetPushConstantGlslType( const GpuProgramParmType type )
 {
     static const char* glslType[GPU_PROGRAM_PARM_TYPE_MAX] = {
@@ -76,6 +136,150 @@ const char* GpuProgramParm::GetPushConstantGlslType( const GpuProgramParmType ty
     return glslType[type];
 }
 
+void GpuPushConstantPacking::Pack( const GpuProgramParm* parms, const int numParms,
+                                   const int maxPushConstantsSize )
+{
+    assert( numParms <= MAX_PROGRAM_PARMS );
+
+    memset( this->offsets, -1, sizeof( this->offsets ) );
+    memset( this->spilled, 0, sizeof( this->spilled ) );
+    memset( this->columnStrides, 0, sizeof( this->columnStrides ) );
+    this->pushConstantsSize = 0;
+    this->spillSize         = 0;
+    this->spillBinding      = 0;
+
+    // Explicit offsets are kept as is so existing shaders continue to work.
+    int autoParms[MAX_PROGRAM_PARMS];
+    int numAutoParms = 0;
+    for ( int i = 0; i < numParms; i++ )
+    {
+        if ( GpuProgramParm::IsOpaqueBinding( parms[i].type ) )
+        {
+            this->spillBinding = std::max( this->spillBinding, parms[i].binding + 1 );
+        }
+        else if ( parms[i].binding == GPU_PROGRAM_PARM_BINDING_AUTO )
+        {
+            autoParms[numAutoParms++] = i;
+        }
+        else
+        {
+            this->offsets[i]       = parms[i].binding;
+            this->columnStrides[i] = GpuProgramParm::GetColumnStride( parms[i].type, false );
+            this->pushConstantsSize =
+                std::max( this->pushConstantsSize,
+                          parms[i].binding + GpuProgramParm::GetBlockSize( parms[i].type, false ) );
+            assert( this->pushConstantsSize <= maxPushConstantsSize );
+        }
+    }
+
+    // Sort by decreasing alignment, then by decreasing size, so there is no padding between
+    // parms of the same alignment and the smallest parms are the ones that spill.
+    for ( int i = 1; i < numAutoParms; i++ )
+    {
+        const int parm      = autoParms[i];
+        const int alignment = GpuProgramParm::GetPushConstantAlignment( parms[parm].type );
+        const int size      = GpuProgramParm::GetBlockSize( parms[parm].type, false );
+        int       j         = i;
+        for ( ; j > 0; j-- )
+        {
+            const GpuProgramParmType prevType = parms[autoParms[j - 1]].type;
+            const int prevAlignment = GpuProgramParm::GetPushConstantAlignment( prevType );
+            const int prevSize      = GpuProgramParm::GetBlockSize( prevType, false );
+            if ( prevAlignment > alignment || ( prevAlignment == alignment && prevSize >= size ) )
+            {
+                break;
+            }
+            autoParms[j] = autoParms[j - 1];
+        }
+        autoParms[j] = parm;
+    }
+
+    for ( int i = 0; i < numAutoParms; i++ )
+    {
+        const int parm      = autoParms[i];
+        const int alignment = GpuProgramParm::GetPushConstantAlignment( parms[parm].type );
+        const int size      = GpuProgramParm::GetBlockSize( parms[parm].type, false );
+        const int offset    = ( this->pushConstantsSize + alignment - 1 ) & ~( alignment - 1 );
+        if ( offset + size <= maxPushConstantsSize )
+        {
+            this->offsets[parm]       = offset;
+            this->columnStrides[parm] = GpuProgramParm::GetColumnStride( parms[parm].type, false );
+            this->pushConstantsSize   = offset + size;
+        }
+        else
+        {
+            // std140 rounds the alignment of vec3, vec4 and matrices up to 16 bytes, and every
+            // matrix column is as large as a vec4.
+            const bool matrix         = GpuProgramParm::GetMatrixColumns( parms[parm].type ) > 0;
+            const int  spillAlignment = ( size > 8 || matrix ) ? 16 : alignment;
+            const int  spillOffset =
+                ( this->spillSize + spillAlignment - 1 ) & ~( spillAlignment - 1 );
+            this->offsets[parm]       = spillOffset;
+            this->spilled[parm]       = true;
+            this->columnStrides[parm] = GpuProgramParm::GetColumnStride( parms[parm].type, true );
+            this->spillSize = spillOffset + GpuProgramParm::GetBlockSize( parms[parm].type, true );
+        }
+    }
+
+    this->spillSize = ( this->spillSize + 15 ) & ~15;
+}
+
+int GpuPushConstantPacking::GetGlsl( const GpuProgramParm* parms, const int numParms, char* glsl,
+                                     const int maxLength ) const
+{
+    int length = 0;
+    for ( int block = 0; block < 2; block++ )
+    {
+        const bool spillBlock = ( block == 1 );
+        if ( ( spillBlock ? this->spillSize : this->pushConstantsSize ) == 0 )
+        {
+            continue;
+        }
+
+        if ( spillBlock )
+        {
+            length += snprintf( glsl + length, maxLength - length,
+                                "layout( std140, binding = %d ) uniform SpilledParms\n{\n",
+                                this->spillBinding );
+        }
+        else
+        {
+            length += snprintf( glsl + length, maxLength - length,
+                                "layout( std430, push_constant ) uniform PushConstants\n{\n" );
+        }
+        assert( length < maxLength );
+
+        // Members with an explicit offset must be declared in increasing offset order.
+        for ( int offset = -1;; )
+        {
+            int next = -1;
+            for ( int i = 0; i < numParms; i++ )
+            {
+                if ( this->offsets[i] > offset && this->spilled[i] == spillBlock &&
+                     !GpuProgramParm::IsOpaqueBinding( parms[i].type ) &&
+                     ( next == -1 || this->offsets[i] < this->offsets[next] ) )
+                {
+                    next = i;
+                }
+            }
+            if ( next == -1 )
+            {
+                break;
+            }
+            offset = this->offsets[next];
+            length += snprintf( glsl + length, maxLength - length,
+                                "    layout( offset = %d ) %s %s;\n", offset,
+                                GpuProgramParm::GetPushConstantGlslType( parms[next].type ),
+                                parms[next].name );
+            assert( length < maxLength );
+        }
+
+        length += snprintf( glsl + length, maxLength - length, "};\n" );
+        assert( length < maxLength );
+    }
+    return length;
+}
+
 GpuProgramParmLayout::GpuProgramParmLayout( GpuContext* context, GpuProgramParm const* parms,
                                             const int numParms )
     : context( *context )
@@ -88,7 +292,6 @@ GpuProgramParmLayout::GpuProgramParmLayout( GpuContext* context, GpuProgramParm
     int numUniformBufferBindings[GPU_PROGRAM_STAGE_MAX]  = { 0 };
     int numStorageBufferBindings[GPU_PROGRAM_STAGE_MAX]  = { 0 };
 
-    int offset = 0;
     memset( this->offsetForIndex, -1, sizeof( this->offsetForIndex ) );
 
     for ( int i = 0; i < numParms; i++ )
@@ -128,9 +331,6 @@ GpuProgramParmLayout::GpuProgramParmLayout( GpuContext* context, GpuProgramParm
         {
             assert( this->numPushConstants < MAX_PROGRAM_PARMS );
             this->pushConstants[this->numPushConstants++] = &parms[i];
-
-            this->offsetForIndex[parms[i].index] = offset;
-            offset += GpuProgramParm::GetPushConstantSize( parms[i].type );
         }
     }
 
@@ -140,23 +340,48 @@ GpuProgramParmLayout::GpuProgramParmLayout( GpuContext* context, GpuProgramParm
         assert( this->bindings[binding] != nullptr );
     }
 
-    // Verify the push constant layout.
-    for ( int push0 = 0; push0 < this->numPushConstants; push0++ )
+    // Place the push constants, spilling the ones that do not fit to a uniform buffer.
+    this->packing.Pack(
+        parms, numParms,
+        (int)context->device->physicalDeviceProperties.limits.maxPushConstantsSize );
+    assert( this->packing.spillBinding == this->numBindings );
+
+    this->spillDataOffset = ( this->packing.pushConstantsSize + 15 ) & ~15;
+    assert( this->spillDataOffset + this->packing.spillSize <= MAX_SAVED_PUSH_CONSTANT_BYTES );
+
+    for ( int i = 0; i < numParms; i++ )
     {
-        // The push constants for a pipeline cannot use more than 'maxPushConstantsSize' bytes.
-        assert( this->pushConstants[push0]->binding +
-                    GpuProgramParm::GetPushConstantSize( this->pushConstants[push0]->type ) <=
-                (int)context->device->physicalDeviceProperties.limits.maxPushConstantsSize );
+        if ( GpuProgramParm::IsOpaqueBinding( parms[i].type ) )
+        {
+            continue;
+        }
+        const VkShaderStageFlags stageFlags = GpuProgramParm::GetShaderStageFlags(
+            static_cast<GpuProgramStageFlags>( parms[i].stageFlags ) );
+        if ( this->packing.spilled[i] )
+        {
+            this->offsetForIndex[parms[i].index] = this->spillDataOffset + this->packing.offsets[i];
+            this->spillStageFlags |= stageFlags;
+        }
+        else
+        {
+            this->offsetForIndex[parms[i].index] = this->packing.offsets[i];
+            this->pushConstantStageFlags |= stageFlags;
+        }
+        this->columnStrideForIndex[parms[i].index] = this->packing.columnStrides[i];
+
         // Make sure no push constants overlap.
-        for ( int push1 = push0 + 1; push1 < this->numPushConstants; push1++ )
+        for ( int j = i + 1; j < numParms; j++ )
         {
-            assert(
-                this->pushConstants[push0]->binding >=
-                    this->pushConstants[push1]->binding +
-                        GpuProgramParm::GetPushConstantSize( this->pushConstants[push1]->type ) ||
-                this->pushConstants[push0]->binding +
-                        GpuProgramParm::GetPushConstantSize( this->pushConstants[push0]->type ) <=
-                    this->pushConstants[push1]->binding );
+            if ( GpuProgramParm::IsOpaqueBinding( parms[j].type ) ||
+                 this->packing.spilled[i] != this->packing.spilled[j] )
+            {
+                continue;
+            }
+            const bool std140 = this->packing.spilled[i];
+            const int  size0  = GpuProgramParm::GetBlockSize( parms[i].type, std140 );
+            const int  size1  = GpuProgramParm::GetBlockSize( parms[j].type, std140 );
+            assert( this->packing.offsets[i] >= this->packing.offsets[j] + size1 ||
+                    this->packing.offsets[i] + size0 <= this->packing.offsets[j] );
         }
     }
 
@@ -186,6 +411,10 @@ GpuProgramParmLayout::GpuProgramParmLayout( GpuContext* context, GpuProgramParm
         numTotalStorageBufferBindings += numStorageBufferBindings[stage];
     }
 
+    assert( this->packing.spillSize == 0 ||
+            context->device->physicalDeviceProperties.limits.maxDescriptorSetUniformBuffersDynamic >
+                0 );
+
     assert( numTotalSampledTextureBindings <=
             (int)context->device->physicalDeviceProperties.limits.maxDescriptorSetSampledImages );
     assert( numTotalStorageTextureBindings <=
@@ -196,88 +425,38 @@ GpuProgramParmLayout::GpuProgramParmLayout( GpuContext* context, GpuProgramParm
             (int)context->device->physicalDeviceProperties.limits.maxDescriptorSetStorageBuffers );
 
     //
-    // Create descriptor set layout and pipeline layout
+    // Acquire the shared descriptor set layout and pipeline layout
     //
 
+    GpuLayoutKey key;
+    memset( &key, 0, sizeof( key ) );
+    for ( int binding = 0; binding < this->numBindings; binding++ )
     {
-        VkDescriptorSetLayoutBinding descriptorSetBindings[MAX_PROGRAM_PARMS];
-        VkPushConstantRange          pushConstantRanges[MAX_PROGRAM_PARMS];
-
-        int numDescriptorSetBindings = 0;
-        int numPushConstantRanges    = 0;
-        for ( int i = 0; i < numParms; i++ )
-        {
-            if ( GpuProgramParm::IsOpaqueBinding( parms[i].type ) )
-            {
-                descriptorSetBindings[numDescriptorSetBindings].binding = parms[i].binding;
-                descriptorSetBindings[numDescriptorSetBindings].descriptorType =
-                    GpuProgramParm::GetDescriptorType( parms[i].type );
-                descriptorSetBindings[numDescriptorSetBindings].descriptorCount = 1;
-                descriptorSetBindings[numDescriptorSetBindings].stageFlags =
-                    GpuProgramParm::GetShaderStageFlags(
-                        static_cast<GpuProgramStageFlags>( parms[i].stageFlags ) );
-                // fixme: error on iOS
-                //                assert( descriptorSetBindings[numDescriptorSetBindings].stageFlags ==
-                //                            VK_SHADER_STAGE_VERTEX_BIT ||
-                //                        descriptorSetBindings[numDescriptorSetBindings].stageFlags ==
-                //                            VK_SHADER_STAGE_FRAGMENT_BIT );
-                descriptorSetBindings[numDescriptorSetBindings].pImmutableSamplers = nullptr;
-                numDescriptorSetBindings++;
-            }
-            else // push constant
-            {
-                pushConstantRanges[numPushConstantRanges].stageFlags =
-                    GpuProgramParm::GetShaderStageFlags(
-                        static_cast<GpuProgramStageFlags>( parms[i].stageFlags ) );
-                pushConstantRanges[numPushConstantRanges].offset = parms[i].binding;
-                pushConstantRanges[numPushConstantRanges].size =
-                    GpuProgramParm::GetPushConstantSize( parms[i].type );
-                numPushConstantRanges++;
-            }
-        }
-
-        VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo;
-        descriptorSetLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-        descriptorSetLayoutCreateInfo.pNext = nullptr;
-        descriptorSetLayoutCreateInfo.flags = 0;
-        descriptorSetLayoutCreateInfo.bindingCount = numDescriptorSetBindings;
-        descriptorSetLayoutCreateInfo.pBindings =
-            ( numDescriptorSetBindings != 0 ) ? descriptorSetBindings : nullptr;
-
-        VK( context->device->vkCreateDescriptorSetLayout(
-            context->device->device, &descriptorSetLayoutCreateInfo, VK_ALLOCATOR,
-            &this->descriptorSetLayout ) );
-
-        VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo;
-        pipelineLayoutCreateInfo.sType          = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-        pipelineLayoutCreateInfo.pNext          = nullptr;
-        pipelineLayoutCreateInfo.flags          = 0;
-        pipelineLayoutCreateInfo.setLayoutCount = 1;
-        pipelineLayoutCreateInfo.pSetLayouts    = &this->descriptorSetLayout;
-        pipelineLayoutCreateInfo.pushConstantRangeCount = numPushConstantRanges;
-        pipelineLayoutCreateInfo.pPushConstantRanges =
-            ( numPushConstantRanges != 0 ) ? pushConstantRanges : nullptr;
-
-        VK( context->device->vkCreatePipelineLayout( context->device->device,
-                                                     &pipelineLayoutCreateInfo, VK_ALLOCATOR,
-                                                     &this->pipelineLayout ) );
+        key.descriptorTypes[binding] =
+            GpuProgramParm::GetDescriptorType( this->bindings[binding]->type );
+        key.stageFlags[binding] = GpuProgramParm::GetShaderStageFlags(
+            static_cast<GpuProgramStageFlags>( this->bindings[binding]->stageFlags ) );
     }
-
-    // Calculate a hash of the layout.
-    unsigned int hash = 5381;
-    for ( int i = 0; i < numParms * (int)sizeof( parms[0] ); i++ )
+    key.numBindings = this->numBindings;
+    if ( this->packing.spillSize > 0 )
     {
-        hash = ( ( hash << 5 ) - hash ) + ( (const char*)parms )[i];
+        key.descriptorTypes[key.numBindings] = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        key.stageFlags[key.numBindings]      = this->spillStageFlags;
+        key.numBindings++;
     }
-    this->hash = hash;
+    key.pushConstantStageFlags = this->pushConstantStageFlags;
+    key.pushConstantsSize      = (uint32_t)this->packing.pushConstantsSize;
+    key.bindlessSetLayout =
+        ( context->bindless != nullptr ) ? context->bindless->descriptorSetLayout : VK_NULL_HANDLE;
+
+    this->layout              = context->device->layoutCache->Acquire( &key );
+    this->descriptorSetLayout = this->layout->descriptorSetLayout;
+    this->pipelineLayout      = this->layout->pipelineLayout;
 }
 
 GpuProgramParmLayout::~GpuProgramParmLayout()
 {
-    VC( context.device->vkDestroyPipelineLayout( context.device->device, this->pipelineLayout,
-                                                 VK_ALLOCATOR ) );
-    VC( context.device->vkDestroyDescriptorSetLayout( context.device->device,
-                                                      this->descriptorSetLayout, VK_ALLOCATOR ) );
+    context.device->layoutCache->Release( this->layout );
 }
 
 ///
@@ -309,35 +488,92 @@ void GpuProgramParmState::SetParm(const GpuProgramParmLayout* parmLayout, const
 	const int pushConstantSize = GpuProgramParm::GetPushConstantSize(parmType);
 	if (pushConstantSize > 0)
 	{
-		assert(parmLayout->offsetForIndex[index] >= 0);
-		assert(parmLayout->offsetForIndex[index] + pushConstantSize <=
-			MAX_SAVED_PUSH_CONSTANT_BYTES);
-		memcpy(&this->data[parmLayout->offsetForIndex[index]], pointer, pushConstantSize);
+		const int offset = parmLayout->offsetForIndex[index];
+		const int columns = GpuProgramParm::GetMatrixColumns(parmType);
+		const int columnStride = parmLayout->columnStrideForIndex[index];
+		const int columnSize = (columns > 0) ? pushConstantSize / columns : pushConstantSize;
+		assert(offset >= 0);
+		if (columnStride == 0 || columnStride == columnSize)
+		{
+			assert(offset + pushConstantSize <= MAX_SAVED_PUSH_CONSTANT_BYTES);
+			memcpy(&this->data[offset], pointer, pushConstantSize);
+		}
+		else
+		{
+			// The columns of the tightly packed matrix are padded out to the block layout.
+			assert(offset + columns * columnStride <= MAX_SAVED_PUSH_CONSTANT_BYTES);
+			for (int column = 0; column < columns; column++)
+			{
+				memcpy(&this->data[offset + column * columnStride],
+					(const unsigned char*)pointer + column * columnSize, columnSize);
+			}
+		}
 	}
 }
 
-const void* GpuProgramParmState::NewPushConstantData(const GpuProgramParmLayout* newLayout, const int newPushConstantIndex,
+int GpuProgramParmState::NewPushConstantRanges(const GpuProgramParmLayout* newLayout,
 	const GpuProgramParmState* newParmState, const GpuProgramParmLayout* oldLayout,
-	const int oldPushConstantIndex, const GpuProgramParmState* oldParmState, const bool force)
+	const GpuProgramParmState* oldParmState, VkPushConstantRange* ranges)
 {
-	const GpuProgramParm* newParm = newLayout->pushConstants[newPushConstantIndex];
-	const unsigned char* newData = &newParmState->data[newLayout->offsetForIndex[newParm->index]];
-	if (force || oldLayout == NULL || oldPushConstantIndex >= oldLayout->numPushConstants)
+	const int size = newLayout->packing.pushConstantsSize;
+	if (size == 0)
 	{
-		return reinterpret_cast<const void*>(newData) ;
+		return 0;
 	}
-	const GpuProgramParm* oldParm = oldLayout->pushConstants[oldPushConstantIndex];
-	const unsigned char* oldData = &oldParmState->data[oldLayout->offsetForIndex[oldParm->index]];
-	if (newParm->type != oldParm->type || newParm->binding != oldParm->binding)
+	// Push constants are only kept across pipeline binds with the same pipeline layout,
+	// otherwise upload the whole block.
+	if (oldLayout == NULL || oldLayout->layout != newLayout->layout)
 	{
-		return reinterpret_cast<const void*>(newData);
+		ranges[0].stageFlags = newLayout->pushConstantStageFlags;
+		ranges[0].offset = 0;
+		ranges[0].size = (uint32_t)size;
+		return 1;
 	}
-	const int pushConstantSize = GpuProgramParm::GetPushConstantSize(newParm->type);
-	if (memcmp(newData, oldData, pushConstantSize) != 0)
+	// Compare 4-byte words and merge changes that are separated by only a few unchanged bytes,
+	// because uploading those bytes again is cheaper than recording another command.
+	int numRanges = 0;
+	for (int offset = 0; offset < size; offset += 4)
 	{
-		return reinterpret_cast<const void*>(newData);
+		if (memcmp(&newParmState->data[offset], &oldParmState->data[offset], 4) == 0)
+		{
+			continue;
+		}
+		const int prevEnd = (numRanges > 0)
+			? (int)(ranges[numRanges - 1].offset + ranges[numRanges - 1].size)
+			: 0;
+		if (numRanges > 0 &&
+			(prevEnd + MAX_PUSH_CONSTANT_RANGE_GAP >= offset || numRanges == MAX_PUSH_CONSTANT_RANGES))
+		{
+			ranges[numRanges - 1].size = (uint32_t)offset + 4 - ranges[numRanges - 1].offset;
+		}
+		else
+		{
+			ranges[numRanges].stageFlags = newLayout->pushConstantStageFlags;
+			ranges[numRanges].offset = (uint32_t)offset;
+			ranges[numRanges].size = 4;
+			numRanges++;
+		}
 	}
-	return NULL;
+	return numRanges;
+}
+
+bool GpuProgramParmState::SpillDataMatch(const GpuProgramParmLayout* layout1,
+	const GpuProgramParmState*  parmState1,
+	const GpuProgramParmLayout* layout2,
+	const GpuProgramParmState*  parmState2)
+{
+	if (layout1 == NULL || layout2 == NULL)
+	{
+		return false;
+	}
+	// The bound descriptor set covers 'spillSize' bytes of the uniform ring.
+	if (layout1->layout != layout2->layout ||
+		layout1->packing.spillSize != layout2->packing.spillSize)
+	{
+		return false;
+	}
+	return memcmp(&parmState1->data[layout1->spillDataOffset],
+		&parmState2->data[layout2->spillDataOffset], layout1->packing.spillSize) == 0;
 }
 
 bool GpuProgramParmState::DescriptorsMatch(const GpuProgramParmLayout* layout1,
@@ -349,7 +585,9 @@ bool GpuProgramParmState::DescriptorsMatch(const GpuProgramParmLayout* layout1,
 	{
 		return false;
 	}
-	if (layout1->hash != layout2->hash)
+	// Programs with the same shared layout have compatible pipeline layouts, so the bound
+	// descriptor set stays valid if it holds the same resources.
+	if (layout1->layout != layout2->layout)
 	{
 		return false;
 	}
@@ -364,43 +602,158 @@ bool GpuProgramParmState::DescriptorsMatch(const GpuProgramParmLayout* layout1,
 	return true;
 }
 
+void GpuSpecializationValues::SetBool( const int index, const bool value )
+{
+    SetUint( index, value ? VK_TRUE : VK_FALSE );
+}
+
+void GpuSpecializationValues::SetInt( const int index, const int value )
+{
+    SetUint( index, (uint32_t)value );
+}
+
+void GpuSpecializationValues::SetUint( const int index, const uint32_t value )
+{
+    assert( index >= 0 && index < MAX_SPECIALIZATION_CONSTANTS );
+    this->values[index] = value;
+    this->setMask |= 1u << index;
+}
+
+void GpuSpecializationValues::SetFloat( const int index, const float value )
+{
+    uint32_t bits;
+    memcpy( &bits, &value, sizeof( bits ) );
+    SetUint( index, bits );
+}
 
 GpuGraphicsProgram::GpuGraphicsProgram(
     GpuContext* context, const void* vertexSourceData, const size_t vertexSourceSize,
     const void* fragmentSourceData, const size_t fragmentSourceSize, const GpuProgramParm* parms,
-    const int numParms, const GpuVertexAttribute* vertexLayout, const int vertexAttribsFlags )
+    const int numParms, const GpuVertexAttribute* vertexLayout, const int vertexAttribsFlags,
+    const GpuSpecializationConstant* specializationConstants, const int numSpecializationConstants )
     : context( *context ), parmLayout( context, parms, numParms )
 {
     this->vertexAttribsFlags = vertexAttribsFlags;
+    InitSpecializationConstants( specializationConstants, numSpecializationConstants );
+
+    GpuShaderCache* shaderCache = context->device->shaderCache;
+    this->vertexShader =
+        shaderCache->Acquire( VK_SHADER_STAGE_VERTEX_BIT, vertexSourceData, vertexSourceSize );
+    this->fragmentShader = shaderCache->Acquire( VK_SHADER_STAGE_FRAGMENT_BIT, fragmentSourceData,
+                                                 fragmentSourceSize );
+    InitStages();
+}
+
+GpuGraphicsProgram::GpuGraphicsProgram(
+    GpuContext* context, const GpuShaderBlob* vertexShader, const GpuShaderBlob* fragmentShader,
+    const GpuProgramParm* parms, const int numParms, const GpuVertexAttribute* vertexLayout,
+    const int vertexAttribsFlags, const GpuSpecializationConstant* specializationConstants,
+    const int numSpecializationConstants )
+    : context( *context ), parmLayout( context, parms, numParms )
+{
+    assert( vertexShader->stage == VK_SHADER_STAGE_VERTEX_BIT );
+    assert( fragmentShader->stage == VK_SHADER_STAGE_FRAGMENT_BIT );
+
+    this->vertexAttribsFlags = vertexAttribsFlags;
+    InitSpecializationConstants( specializationConstants, numSpecializationConstants );
+
+    GpuShaderCache* shaderCache = context->device->shaderCache;
+    this->vertexShader          = shaderCache->Acquire( vertexShader );
+    this->fragmentShader        = shaderCache->Acquire( fragmentShader );
+    InitStages();
+}
+
+GpuGraphicsProgram::GpuGraphicsProgram(
+    GpuContext* context, const GpuShaderBlob* vertexShader, const GpuShaderBlob* fragmentShader,
+    const GpuVertexAttribute* vertexLayout, const int vertexAttribsFlags,
+    const GpuSpecializationConstant* specializationConstants, const int numSpecializationConstants )
+    : context( *context ),
+      reflection( new GpuProgramReflection( vertexShader, fragmentShader ) ),
+      parmLayout( context, reflection->parms, reflection->numParms )
+{
+    assert( vertexShader->stage == VK_SHADER_STAGE_VERTEX_BIT );
+    assert( fragmentShader->stage == VK_SHADER_STAGE_FRAGMENT_BIT );
+
+    this->vertexAttribsFlags = vertexAttribsFlags;
+    InitSpecializationConstants( specializationConstants, numSpecializationConstants );
+
+    GpuShaderCache* shaderCache = context->device->shaderCache;
+    this->vertexShader          = shaderCache->Acquire( vertexShader );
+    this->fragmentShader        = shaderCache->Acquire( fragmentShader );
+    InitStages();
+}
+
+void GpuGraphicsProgram::InitStages()
+{
+    const GpuShader* shaders[2] = { this->vertexShader, this->fragmentShader };
+    for ( int i = 0; i < 2; i++ )
+    {
+        this->stageIdentifiers[i].sType =
+            VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_MODULE_IDENTIFIER_CREATE_INFO_EXT;
+        this->stageIdentifiers[i].pNext          = nullptr;
+        this->stageIdentifiers[i].identifierSize = shaders[i]->identifierSize;
+        this->stageIdentifiers[i].pIdentifier    = shaders[i]->identifier;
+
+        // Without an identifier the shader always has a module.
+        this->pipelineStages[i].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        this->pipelineStages[i].pNext =
+            ( shaders[i]->identifierSize > 0 ) ? &this->stageIdentifiers[i] : nullptr;
+        this->pipelineStages[i].flags  = 0;
+        this->pipelineStages[i].stage  = shaders[i]->stage;
+        this->pipelineStages[i].module = shaders[i]->module;
+        this->pipelineStages[i].pName  = "main";
+        this->pipelineStages[i].pSpecializationInfo = nullptr;
+    }
+}
 
-    context->device->CreateShader( &this->vertexShaderModule, VK_SHADER_STAGE_VERTEX_BIT,
-                                   vertexSourceData, vertexSourceSize );
-    context->device->CreateShader( &this->fragmentShaderModule, VK_SHADER_STAGE_FRAGMENT_BIT,
-                                   fragmentSourceData, fragmentSourceSize );
-
-    this->pipelineStages[0].sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    this->pipelineStages[0].pNext  = nullptr;
-    this->pipelineStages[0].flags  = 0;
-    this->pipelineStages[0].stage  = VK_SHADER_STAGE_VERTEX_BIT;
-    this->pipelineStages[0].module = this->vertexShaderModule;
-    this->pipelineStages[0].pName  = "main";
-    this->pipelineStages[0].pSpecializationInfo = nullptr;
-
-    this->pipelineStages[1].sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    this->pipelineStages[1].pNext  = nullptr;
-    this->pipelineStages[1].flags  = 0;
-    this->pipelineStages[1].stage  = VK_SHADER_STAGE_FRAGMENT_BIT;
-    this->pipelineStages[1].module = this->fragmentShaderModule;
-    this->pipelineStages[1].pName  = "main";
-    this->pipelineStages[1].pSpecializationInfo = nullptr;
+void GpuGraphicsProgram::InitSpecializationConstants( const GpuSpecializationConstant* constants,
+                                                      const int numConstants )
+{
+    assert( numConstants <= MAX_SPECIALIZATION_CONSTANTS );
+    // Every constant needs its own bit in GpuSpecializationValues::setMask and its own id.
+    for ( int i = 0; i < numConstants; i++ )
+    {
+        assert( constants[i].index >= 0 && constants[i].index < MAX_SPECIALIZATION_CONSTANTS );
+        for ( int j = 0; j < i; j++ )
+        {
+            assert( constants[j].index != constants[i].index );
+            assert( constants[j].constantId != constants[i].constantId );
+        }
+    }
+
+    this->specializationConstants    = constants;
+    this->numSpecializationConstants = numConstants;
+}
+
+int GpuGraphicsProgram::FindSpecializationConstant( const char* name ) const
+{
+    for ( int i = 0; i < this->numSpecializationConstants; i++ )
+    {
+        if ( strcmp( this->specializationConstants[i].name, name ) == 0 )
+        {
+            return this->specializationConstants[i].index;
+        }
+    }
+    return -1;
 }
 
 GpuGraphicsProgram::~GpuGraphicsProgram()
 {
-    VC( context.device->vkDestroyShaderModule( context.device->device, this->vertexShaderModule,
-                                               VK_ALLOCATOR ) );
-    VC( context.device->vkDestroyShaderModule( context.device->device, this->fragmentShaderModule,
-                                               VK_ALLOCATOR ) );
+    context.InvalidateCommandBundles( this );
+    context.device->shaderCache->Release( this->vertexShader );
+    context.device->shaderCache->Release( this->fragmentShader );
+    delete this->reflection;
+}
+
+void GpuGraphicsProgram::GetModuleStages( VkPipelineShaderStageCreateInfo stages[2] ) const
+{
+    GpuShader* shaders[2] = { this->vertexShader, this->fragmentShader };
+    for ( int i = 0; i < 2; i++ )
+    {
+        stages[i]        = this->pipelineStages[i];
+        stages[i].pNext  = nullptr;
+        stages[i].module = context.device->shaderCache->GetModule( shaders[i] );
+    }
 }
 
 } // namespace lxd
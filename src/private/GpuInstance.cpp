@@ -167,6 +167,7 @@ GpuInstance::GpuInstance()
 #endif
         { VK_KHR_PLATFORM_SURFACE_EXTENSION_NAME, false, true },
         { VK_EXT_DEBUG_REPORT_EXTENSION_NAME, true, false },
+        { VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME, false, false },
     };
 
     const char* enabledExtensionNames[32]  = { nullptr };
@@ -294,6 +295,12 @@ GpuInstance::GpuInstance()
     GET_INSTANCE_PROC_ADDR( vkGetPhysicalDeviceSurfaceFormatsKHR );
     GET_INSTANCE_PROC_ADDR( vkGetPhysicalDeviceSurfacePresentModesKHR );
 
+    // Not asserted, the extension is optional and only used to query descriptor indexing.
+    this->vkGetPhysicalDeviceFeatures2KHR = (PFN_vkGetPhysicalDeviceFeatures2KHR)(
+        this->vkGetInstanceProcAddr( this->instance, "vkGetPhysicalDeviceFeatures2KHR" ) );
+    this->vkGetPhysicalDeviceProperties2KHR = (PFN_vkGetPhysicalDeviceProperties2KHR)(
+        this->vkGetInstanceProcAddr( this->instance, "vkGetPhysicalDeviceProperties2KHR" ) );
+
     if ( this->validate )
     {
         GET_INSTANCE_PROC_ADDR( vkCreateDebugReportCallbackEXT );
@@ -0,0 +1,151 @@
+#include "GpuLayoutCache.hpp"
+#include "GpuDevice.hpp"
+
+namespace lxd
+{
+
+unsigned int GpuLayoutKey::Hash() const
+{
+    static_assert( sizeof( GpuLayoutKey ) % sizeof( unsigned int ) == 0,
+                   "GpuLayoutKey is hashed by word" );
+
+    const unsigned int* words = reinterpret_cast<const unsigned int*>( this );
+    unsigned int        hash  = 5381;
+    for ( size_t i = 0; i < sizeof( *this ) / sizeof( unsigned int ); i++ )
+    {
+        hash = ( ( hash << 5 ) - hash ) + words[i];
+    }
+    return hash;
+}
+
+bool GpuLayoutKey::Equals( const GpuLayoutKey* other ) const
+{
+    return memcmp( this, other, sizeof( *this ) ) == 0;
+}
+
+GpuLayoutCache::GpuLayoutCache( GpuDevice* device ) : device( *device )
+{
+    ksMutex_Create( &this->mutex );
+}
+
+GpuLayoutCache::~GpuLayoutCache()
+{
+    assert( this->numLayouts == 0 );
+    ksMutex_Destroy( &this->mutex );
+}
+
+GpuLayout* GpuLayoutCache::Acquire( const GpuLayoutKey* key )
+{
+    const unsigned int hash = key->Hash();
+
+    ksMutex_Lock( &this->mutex, true );
+    GpuLayout** bucket = &this->buckets[hash % GPU_LAYOUT_CACHE_BUCKETS];
+    for ( GpuLayout* layout = *bucket; layout != nullptr; layout = layout->next )
+    {
+        if ( layout->hash == hash && layout->key.Equals( key ) )
+        {
+            layout->refCount++;
+            this->numHits++;
+            ksMutex_Unlock( &this->mutex );
+            return layout;
+        }
+    }
+
+    // Layouts are created while programs are, so holding the lock is fine.
+    GpuLayout* layout = static_cast<GpuLayout*>( malloc( sizeof( GpuLayout ) ) );
+    layout->key       = *key;
+    layout->hash      = hash;
+    layout->refCount  = 1;
+    CreateLayout( layout );
+
+    layout->next = *bucket;
+    *bucket      = layout;
+    this->numLayouts++;
+    this->numMisses++;
+    ksMutex_Unlock( &this->mutex );
+
+    return layout;
+}
+
+void GpuLayoutCache::Release( GpuLayout* layout )
+{
+    ksMutex_Lock( &this->mutex, true );
+    if ( --layout->refCount > 0 )
+    {
+        ksMutex_Unlock( &this->mutex );
+        return;
+    }
+
+    for ( GpuLayout** link = &this->buckets[layout->hash % GPU_LAYOUT_CACHE_BUCKETS];
+          *link != nullptr; link = &( *link )->next )
+    {
+        if ( *link == layout )
+        {
+            *link = layout->next;
+            break;
+        }
+    }
+    this->numLayouts--;
+    ksMutex_Unlock( &this->mutex );
+
+    VC( this->device.vkDestroyPipelineLayout( this->device.device, layout->pipelineLayout,
+                                              VK_ALLOCATOR ) );
+    VC( this->device.vkDestroyDescriptorSetLayout( this->device.device,
+                                                   layout->descriptorSetLayout, VK_ALLOCATOR ) );
+    free( layout );
+}
+
+void GpuLayoutCache::CreateLayout( GpuLayout* layout )
+{
+    const GpuLayoutKey* key = &layout->key;
+
+    VkDescriptorSetLayoutBinding descriptorSetBindings[MAX_PROGRAM_PARMS + 1];
+    for ( int binding = 0; binding < key->numBindings; binding++ )
+    {
+        descriptorSetBindings[binding].binding            = binding;
+        descriptorSetBindings[binding].descriptorType     = key->descriptorTypes[binding];
+        descriptorSetBindings[binding].descriptorCount    = 1;
+        descriptorSetBindings[binding].stageFlags         = key->stageFlags[binding];
+        descriptorSetBindings[binding].pImmutableSamplers = nullptr;
+    }
+
+    // A single range covers all push constants so they can be updated with a few
+    // contiguous uploads regardless of which stages read them.
+    VkPushConstantRange pushConstantRange;
+    pushConstantRange.stageFlags = key->pushConstantStageFlags;
+    pushConstantRange.offset     = 0;
+    pushConstantRange.size       = key->pushConstantsSize;
+
+    const int numPushConstantRanges = ( key->pushConstantsSize > 0 ) ? 1 : 0;
+
+    VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo;
+    descriptorSetLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    descriptorSetLayoutCreateInfo.pNext = nullptr;
+    descriptorSetLayoutCreateInfo.flags = 0;
+    descriptorSetLayoutCreateInfo.bindingCount = key->numBindings;
+    descriptorSetLayoutCreateInfo.pBindings =
+        ( key->numBindings != 0 ) ? descriptorSetBindings : nullptr;
+
+    VK( this->device.vkCreateDescriptorSetLayout( this->device.device,
+                                                  &descriptorSetLayoutCreateInfo, VK_ALLOCATOR,
+                                                  &layout->descriptorSetLayout ) );
+
+    // In bindless mode the context wide table follows the descriptors of the program.
+    const VkDescriptorSetLayout setLayouts[2] = { layout->descriptorSetLayout,
+                                                  key->bindlessSetLayout };
+
+    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo;
+    pipelineLayoutCreateInfo.sType          = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutCreateInfo.pNext          = nullptr;
+    pipelineLayoutCreateInfo.flags          = 0;
+    pipelineLayoutCreateInfo.setLayoutCount = ( key->bindlessSetLayout != VK_NULL_HANDLE ) ? 2 : 1;
+    pipelineLayoutCreateInfo.pSetLayouts    = setLayouts;
+    pipelineLayoutCreateInfo.pushConstantRangeCount = numPushConstantRanges;
+    pipelineLayoutCreateInfo.pPushConstantRanges =
+        ( numPushConstantRanges != 0 ) ? &pushConstantRange : nullptr;
+
+    VK( this->device.vkCreatePipelineLayout( this->device.device, &pipelineLayoutCreateInfo,
+                                             VK_ALLOCATOR, &layout->pipelineLayout ) );
+}
+
+} // namespace lxd
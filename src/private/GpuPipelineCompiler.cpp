@@ -0,0 +1,175 @@
+#include "GpuPipelineCompiler.hpp"
+#include "GpuContext.hpp"
+#include "GpuGraphicsPipeline.hpp"
+
+#include <thread>
+
+namespace lxd
+{
+
+GpuPipelineCompiler::GpuPipelineCompiler( GpuContext* context, const int numWorkers )
+    : context( *context )
+{
+    ksMutex_Create( &this->mutex );
+    ksThreadPool_Create( &this->pool, numWorkers );
+    for ( int i = 0; i < this->pool.threadCount; i++ )
+    {
+        this->workers[i].compiler = this;
+        this->workers[i].index    = i;
+        this->workers[i].busy     = false;
+    }
+}
+
+GpuPipelineCompiler::~GpuPipelineCompiler()
+{
+    // A pipeline that outlives the compiler would cancel on freed memory. Destroying the
+    // pipelines also removed them from the queue, so the workers are idle.
+    assert( this->numPipelines == 0 );
+    ksThreadPool_Join( &this->pool );
+    ksThreadPool_Destroy( &this->pool );
+    assert( this->numQueued == 0 && this->numCompiling == 0 );
+
+    free( this->queued );
+    free( this->compiled );
+    ksMutex_Destroy( &this->mutex );
+}
+
+void GpuPipelineCompiler::Compile( GpuGraphicsPipeline* pipeline )
+{
+    ksMutex_Lock( &this->mutex, true );
+    if ( this->numQueued >= this->maxQueued )
+    {
+        this->maxQueued = ( this->maxQueued > 0 ) ? this->maxQueued * 2 : 64;
+        this->queued    = static_cast<GpuGraphicsPipeline**>(
+            realloc( this->queued, this->maxQueued * sizeof( GpuGraphicsPipeline* ) ) );
+    }
+    this->queued[this->numQueued++] = pipeline;
+    this->numPipelines++;
+
+    // Busy workers look at the queue again before they go idle, so they only need to be woken
+    // while idle.
+    Worker* idleWorker = nullptr;
+    for ( int i = 0; i < this->pool.threadCount; i++ )
+    {
+        if ( !this->workers[i].busy )
+        {
+            idleWorker       = &this->workers[i];
+            idleWorker->busy = true;
+            break;
+        }
+    }
+    ksMutex_Unlock( &this->mutex );
+
+    if ( idleWorker != nullptr )
+    {
+        ksThread_Submit( &this->pool.threads[idleWorker->index], WorkerFunction, idleWorker );
+    }
+}
+
+void GpuPipelineCompiler::Cancel( GpuGraphicsPipeline* pipeline )
+{
+    ksMutex_Lock( &this->mutex, true );
+    assert( this->numPipelines > 0 );
+    this->numPipelines--;
+    for ( int i = 0; i < this->numQueued; i++ )
+    {
+        if ( this->queued[i] == pipeline )
+        {
+            this->numQueued--;
+            memmove( &this->queued[i], &this->queued[i + 1],
+                     ( this->numQueued - i ) * sizeof( GpuGraphicsPipeline* ) );
+            ksMutex_Unlock( &this->mutex );
+            return;
+        }
+    }
+    ksMutex_Unlock( &this->mutex );
+
+    // A worker is compiling it. Destroying a pipeline that is still compiling is rare, so this
+    // does not warrant a signal per pipeline.
+    while ( !pipeline->ready.load( std::memory_order_acquire ) )
+    {
+        std::this_thread::yield();
+    }
+
+    // The worker marks the pipeline as ready after adding it to the compiled pipelines.
+    ksMutex_Lock( &this->mutex, true );
+    for ( int i = 0; i < this->numCompiled; i++ )
+    {
+        if ( this->compiled[i] == pipeline )
+        {
+            this->compiled[i] = this->compiled[--this->numCompiled];
+            break;
+        }
+    }
+    ksMutex_Unlock( &this->mutex );
+}
+
+void GpuPipelineCompiler::Update()
+{
+    // One at a time, the callbacks may create or destroy pipelines.
+    for ( ;; )
+    {
+        ksMutex_Lock( &this->mutex, true );
+        if ( this->numCompiled == 0 )
+        {
+            ksMutex_Unlock( &this->mutex );
+            break;
+        }
+        GpuGraphicsPipeline* pipeline = this->compiled[--this->numCompiled];
+        ksMutex_Unlock( &this->mutex );
+
+        // Bundles that were recorded with the fallback or the fast-linked pipeline are recorded
+        // again.
+        if ( pipeline->fastLinked )
+        {
+            pipeline->ReplaceFastLinkedPipeline();
+        }
+        context.InvalidateCommandBundles( pipeline );
+        if ( pipeline->compiledFunc != nullptr )
+        {
+            pipeline->compiledFunc( pipeline, pipeline->compiledUserData );
+        }
+    }
+}
+
+int GpuPipelineCompiler::NumPending()
+{
+    ksMutex_Lock( &this->mutex, true );
+    const int numPending = this->numQueued + this->numCompiling;
+    ksMutex_Unlock( &this->mutex );
+    return numPending;
+}
+
+void GpuPipelineCompiler::WorkerFunction( void* data )
+{
+    Worker*              worker   = static_cast<Worker*>( data );
+    GpuPipelineCompiler* compiler = worker->compiler;
+
+    ksMutex_Lock( &compiler->mutex, true );
+    while ( compiler->numQueued > 0 )
+    {
+        GpuGraphicsPipeline* pipeline = compiler->queued[0];
+        compiler->numQueued--;
+        memmove( compiler->queued, compiler->queued + 1,
+                 compiler->numQueued * sizeof( GpuGraphicsPipeline* ) );
+        compiler->numCompiling++;
+        ksMutex_Unlock( &compiler->mutex );
+
+        pipeline->CreatePipeline();
+
+        ksMutex_Lock( &compiler->mutex, true );
+        if ( compiler->numCompiled >= compiler->maxCompiled )
+        {
+            compiler->maxCompiled = ( compiler->maxCompiled > 0 ) ? compiler->maxCompiled * 2 : 64;
+            compiler->compiled    = static_cast<GpuGraphicsPipeline**>( realloc(
+                compiler->compiled, compiler->maxCompiled * sizeof( GpuGraphicsPipeline* ) ) );
+        }
+        compiler->compiled[compiler->numCompiled++] = pipeline;
+        compiler->numCompiling--;
+        pipeline->ready.store( true, std::memory_order_release );
+    }
+    worker->busy = false;
+    ksMutex_Unlock( &compiler->mutex );
+}
+
+} // namespace lxd
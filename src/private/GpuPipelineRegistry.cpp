@@ -0,0 +1,286 @@
+#include "GpuPipelineRegistry.hpp"
+#include "GpuContext.hpp"
+#include "GpuDeletionQueue.hpp"
+#include "GpuDevice.hpp"
+#include "GpuGraphicsPipeline.hpp"
+#include "GpuGraphicsProgram.hpp"
+#include "GpuRenderPass.hpp"
+
+namespace lxd
+{
+
+void GpuGraphicsPipelineKey::Set( const GpuGraphicsPipeline* pipeline )
+{
+    memset( this, 0, sizeof( *this ) );
+
+    const GpuRasterOperations* rop = &pipeline->rop;
+
+    this->renderPass       = pipeline->renderPass->renderPass;
+    this->pipelineLayout   = pipeline->program->parmLayout.pipelineLayout;
+    this->shaders[0]       = pipeline->program->vertexShader;
+    this->shaders[1]       = pipeline->program->fragmentShader;
+    this->sampleCount      = (int)pipeline->renderPass->sampleCount;
+    this->depthStencil     = ( pipeline->renderPass->internalDepthFormat != VK_FORMAT_UNDEFINED );
+    this->blendEnable      = rop->blendEnable;
+    this->colorWriteMask   = ( rop->redWriteEnable ? 1 : 0 ) | ( rop->greenWriteEnable ? 2 : 0 ) |
+                           ( rop->blueWriteEnable ? 4 : 0 ) | ( rop->alphaWriteEnable ? 8 : 0 );
+    this->depthTestEnable  = rop->depthTestEnable;
+    this->depthWriteEnable = rop->depthWriteEnable;
+    this->frontFace        = rop->frontFace;
+    this->cullMode         = rop->cullMode;
+    this->depthCompare     = rop->depthCompare;
+    this->blendColor[0]    = rop->blendColor.x;
+    this->blendColor[1]    = rop->blendColor.y;
+    this->blendColor[2]    = rop->blendColor.z;
+    this->blendColor[3]    = rop->blendColor.w;
+    this->blendOpColor     = rop->blendOpColor;
+    this->blendSrcColor    = rop->blendSrcColor;
+    this->blendDstColor    = rop->blendDstColor;
+    this->blendOpAlpha     = rop->blendOpAlpha;
+    this->blendSrcAlpha    = rop->blendSrcAlpha;
+    this->blendDstAlpha    = rop->blendDstAlpha;
+
+    // Dynamic raster operations are not in the pipeline, so they are left out of the key.
+    const int dynamicRasterState = pipeline->context.dynamicRasterState;
+    if ( ( dynamicRasterState & GPU_DYNAMIC_RASTER_STATE_DEPTH_CULL ) != 0 )
+    {
+        this->depthTestEnable  = 0;
+        this->depthWriteEnable = 0;
+        this->frontFace        = 0;
+        this->cullMode         = 0;
+        this->depthCompare     = 0;
+        memset( this->blendColor, 0, sizeof( this->blendColor ) );
+    }
+    if ( ( dynamicRasterState & GPU_DYNAMIC_RASTER_STATE_BLEND ) != 0 )
+    {
+        this->blendEnable    = 0;
+        this->colorWriteMask = 0;
+        this->blendOpColor   = 0;
+        this->blendSrcColor  = 0;
+        this->blendDstColor  = 0;
+        this->blendOpAlpha   = 0;
+        this->blendSrcAlpha  = 0;
+        this->blendDstAlpha  = 0;
+    }
+
+    this->specializationEntryCount = pipeline->specializationEntryCount;
+    for ( int i = 0; i < pipeline->specializationEntryCount; i++ )
+    {
+        this->specializationIds[i]  = pipeline->specializationEntries[i].constantID;
+        this->specializationData[i] = pipeline->specializationData[i];
+    }
+
+    // The binding offsets only matter when binding the geometry, they are not part of the key.
+    this->vertexAttributeCount = pipeline->vertexAttributeCount;
+    this->vertexBindingCount   = pipeline->vertexBindingCount;
+    memcpy( this->vertexAttributes, pipeline->vertexAttributes,
+            pipeline->vertexAttributeCount * sizeof( VkVertexInputAttributeDescription ) );
+    memcpy( this->vertexBindings, pipeline->vertexBindings,
+            pipeline->vertexBindingCount * sizeof( VkVertexInputBindingDescription ) );
+}
+
+void GpuGraphicsPipelineKey::SetPart( const GpuGraphicsPipelineKey* key,
+                                      const GpuPipelinePart         part )
+{
+    assert( key->part == GPU_PIPELINE_PART_COMPLETE && part != GPU_PIPELINE_PART_COMPLETE );
+
+    memset( this, 0, sizeof( *this ) );
+    this->part = part;
+
+    switch ( part )
+    {
+        case GPU_PIPELINE_PART_VERTEX_INPUT:
+            this->vertexAttributeCount = key->vertexAttributeCount;
+            this->vertexBindingCount   = key->vertexBindingCount;
+            memcpy( this->vertexAttributes, key->vertexAttributes,
+                    sizeof( this->vertexAttributes ) );
+            memcpy( this->vertexBindings, key->vertexBindings, sizeof( this->vertexBindings ) );
+            break;
+        case GPU_PIPELINE_PART_PRE_RASTERIZATION:
+        case GPU_PIPELINE_PART_FRAGMENT_SHADER:
+            this->renderPass               = key->renderPass;
+            this->pipelineLayout           = key->pipelineLayout;
+            this->specializationEntryCount = key->specializationEntryCount;
+            memcpy( this->specializationIds, key->specializationIds,
+                    sizeof( this->specializationIds ) );
+            memcpy( this->specializationData, key->specializationData,
+                    sizeof( this->specializationData ) );
+            if ( part == GPU_PIPELINE_PART_PRE_RASTERIZATION )
+            {
+                this->shaders[0] = key->shaders[0];
+                this->frontFace  = key->frontFace;
+                this->cullMode   = key->cullMode;
+            }
+            else
+            {
+                this->shaders[1]       = key->shaders[1];
+                this->sampleCount      = key->sampleCount;
+                this->depthStencil     = key->depthStencil;
+                this->depthTestEnable  = key->depthTestEnable;
+                this->depthWriteEnable = key->depthWriteEnable;
+                this->depthCompare     = key->depthCompare;
+            }
+            break;
+        case GPU_PIPELINE_PART_FRAGMENT_OUTPUT:
+            this->renderPass     = key->renderPass;
+            this->sampleCount    = key->sampleCount;
+            this->blendEnable    = key->blendEnable;
+            this->colorWriteMask = key->colorWriteMask;
+            this->blendOpColor   = key->blendOpColor;
+            this->blendSrcColor  = key->blendSrcColor;
+            this->blendDstColor  = key->blendDstColor;
+            this->blendOpAlpha   = key->blendOpAlpha;
+            this->blendSrcAlpha  = key->blendSrcAlpha;
+            this->blendDstAlpha  = key->blendDstAlpha;
+            memcpy( this->blendColor, key->blendColor, sizeof( this->blendColor ) );
+            break;
+        default:
+            break;
+    }
+}
+
+unsigned int GpuGraphicsPipelineKey::Hash() const
+{
+    static_assert( sizeof( GpuGraphicsPipelineKey ) % sizeof( unsigned int ) == 0,
+                   "GpuGraphicsPipelineKey is hashed by word" );
+
+    const unsigned int* words = reinterpret_cast<const unsigned int*>( this );
+    unsigned int        hash  = 5381;
+    for ( size_t i = 0; i < sizeof( *this ) / sizeof( unsigned int ); i++ )
+    {
+        hash = ( ( hash << 5 ) - hash ) + words[i];
+    }
+    return hash;
+}
+
+bool GpuGraphicsPipelineKey::Equals( const GpuGraphicsPipelineKey* other ) const
+{
+    return memcmp( this, other, sizeof( *this ) ) == 0;
+}
+
+GpuPipelineRegistry::GpuPipelineRegistry( GpuContext* context ) : context( *context )
+{
+    ksMutex_Create( &this->mutex );
+}
+
+GpuPipelineRegistry::~GpuPipelineRegistry()
+{
+    assert( this->numPipelines == 0 );
+
+    for ( int i = 0; i < GPU_PIPELINE_REGISTRY_BUCKETS; i++ )
+    {
+        for ( Entry* entry = this->buckets[i]; entry != nullptr; )
+        {
+            Entry* next = entry->next;
+            free( entry );
+            entry = next;
+        }
+    }
+    ksMutex_Destroy( &this->mutex );
+}
+
+GpuPipelineRegistry::Entry* GpuPipelineRegistry::Find( const GpuGraphicsPipelineKey* key,
+                                                       const unsigned int            hash )
+{
+    for ( Entry* entry = this->buckets[hash % GPU_PIPELINE_REGISTRY_BUCKETS]; entry != nullptr;
+          entry        = entry->next )
+    {
+        if ( entry->hash == hash && entry->key.Equals( key ) )
+        {
+            return entry;
+        }
+    }
+    return nullptr;
+}
+
+VkPipeline GpuPipelineRegistry::Acquire( const GpuGraphicsPipelineKey* key )
+{
+    const unsigned int hash = key->Hash();
+
+    ksMutex_Lock( &this->mutex, true );
+    Entry*           entry    = Find( key, hash );
+    const VkPipeline pipeline = ( entry != nullptr ) ? entry->pipeline : VK_NULL_HANDLE;
+    if ( entry != nullptr )
+    {
+        entry->refCount++;
+        this->numHits++;
+    }
+    else
+    {
+        this->numMisses++;
+    }
+    ksMutex_Unlock( &this->mutex );
+
+    return pipeline;
+}
+
+VkPipeline GpuPipelineRegistry::Insert( const GpuGraphicsPipelineKey* key,
+                                        const VkPipeline              pipeline )
+{
+    const unsigned int hash = key->Hash();
+
+    ksMutex_Lock( &this->mutex, true );
+    Entry* entry = Find( key, hash );
+    if ( entry != nullptr )
+    {
+        // Both threads missed and compiled the same pipeline, keep the first one.
+        entry->refCount++;
+        const VkPipeline existing = entry->pipeline;
+        ksMutex_Unlock( &this->mutex );
+
+        VC( context.device->vkDestroyPipeline( context.device->device, pipeline, VK_ALLOCATOR ) );
+        return existing;
+    }
+
+    Entry** bucket  = &this->buckets[hash % GPU_PIPELINE_REGISTRY_BUCKETS];
+    entry           = static_cast<Entry*>( malloc( sizeof( Entry ) ) );
+    entry->key      = *key;
+    entry->hash     = hash;
+    entry->refCount = 1;
+    entry->pipeline = pipeline;
+    entry->next     = *bucket;
+    *bucket         = entry;
+    this->numPipelines++;
+    ksMutex_Unlock( &this->mutex );
+
+    return pipeline;
+}
+
+void GpuPipelineRegistry::Release( const VkPipeline pipeline )
+{
+    if ( pipeline == VK_NULL_HANDLE )
+    {
+        return;
+    }
+
+    // Pipelines are rarely destroyed, so this looks through all buckets instead of keeping the
+    // key around in every GpuGraphicsPipeline.
+    ksMutex_Lock( &this->mutex, true );
+    for ( int i = 0; i < GPU_PIPELINE_REGISTRY_BUCKETS; i++ )
+    {
+        for ( Entry** link = &this->buckets[i]; *link != nullptr; link = &( *link )->next )
+        {
+            Entry* entry = *link;
+            if ( entry->pipeline != pipeline )
+            {
+                continue;
+            }
+            if ( --entry->refCount == 0 )
+            {
+                *link = entry->next;
+                free( entry );
+                this->numPipelines--;
+                ksMutex_Unlock( &this->mutex );
+
+                context.deletionQueue->Destroy( GPU_DELETION_TYPE_PIPELINE, (uint64_t)pipeline );
+                return;
+            }
+            ksMutex_Unlock( &this->mutex );
+            return;
+        }
+    }
+    ksMutex_Unlock( &this->mutex );
+    assert( false );
+}
+
+} // namespace lxd
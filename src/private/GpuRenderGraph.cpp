@@ -0,0 +1,911 @@
+#include "GpuRenderGraph.hpp"
+#include "GpuBuffer.hpp"
+#include "GpuCommandBuffer.hpp"
+#include "GpuDeletionQueue.hpp"
+#include "GpuDevice.hpp"
+#include "GpuStateTracker.hpp"
+#include "GpuTexture.hpp"
+
+#include <algorithm>
+
+namespace lxd
+{
+
+GpuRenderGraphState GpuRenderGraphState::ForAccess( const GpuRenderGraphAccess access )
+{
+    GpuRenderGraphState state;
+    switch ( access )
+    {
+        case GPU_RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT:
+            state.stageMask  = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+            state.accessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
+                               VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+            state.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+            break;
+        case GPU_RENDER_GRAPH_ACCESS_DEPTH_ATTACHMENT:
+            state.stageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                              VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+            state.accessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                               VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+            state.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+            break;
+        case GPU_RENDER_GRAPH_ACCESS_SAMPLED_FRAGMENT:
+            state.stageMask  = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+            state.accessMask = VK_ACCESS_SHADER_READ_BIT;
+            state.layout     = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            break;
+        case GPU_RENDER_GRAPH_ACCESS_SAMPLED_COMPUTE:
+            state.stageMask  = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+            state.accessMask = VK_ACCESS_SHADER_READ_BIT;
+            state.layout     = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            break;
+        case GPU_RENDER_GRAPH_ACCESS_STORAGE_READ_COMPUTE:
+            state.stageMask  = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+            state.accessMask = VK_ACCESS_SHADER_READ_BIT;
+            state.layout     = VK_IMAGE_LAYOUT_GENERAL;
+            break;
+        case GPU_RENDER_GRAPH_ACCESS_STORAGE_WRITE_COMPUTE:
+            state.stageMask  = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+            state.accessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+            state.layout     = VK_IMAGE_LAYOUT_GENERAL;
+            break;
+        case GPU_RENDER_GRAPH_ACCESS_UNIFORM_READ:
+            state.stageMask =
+                VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+            state.accessMask = VK_ACCESS_UNIFORM_READ_BIT;
+            state.layout     = VK_IMAGE_LAYOUT_UNDEFINED;
+            break;
+        case GPU_RENDER_GRAPH_ACCESS_VERTEX_READ:
+            state.stageMask  = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+            state.accessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+            state.layout     = VK_IMAGE_LAYOUT_UNDEFINED;
+            break;
+        case GPU_RENDER_GRAPH_ACCESS_INDIRECT_READ:
+            state.stageMask  = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+            state.accessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+            state.layout     = VK_IMAGE_LAYOUT_UNDEFINED;
+            break;
+        case GPU_RENDER_GRAPH_ACCESS_TRANSFER_SRC:
+            state.stageMask  = VK_PIPELINE_STAGE_TRANSFER_BIT;
+            state.accessMask = VK_ACCESS_TRANSFER_READ_BIT;
+            state.layout     = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+            break;
+        case GPU_RENDER_GRAPH_ACCESS_TRANSFER_DST:
+            state.stageMask  = VK_PIPELINE_STAGE_TRANSFER_BIT;
+            state.accessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            state.layout     = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            break;
+        case GPU_RENDER_GRAPH_ACCESS_PRESENT:
+            state.stageMask  = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+            state.accessMask = 0;
+            state.layout     = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+            break;
+        default:
+            state.stageMask  = 0;
+            state.accessMask = 0;
+            state.layout     = VK_IMAGE_LAYOUT_UNDEFINED;
+            break;
+    }
+    return state;
+}
+
+bool GpuRenderGraphState::IsWrite() const
+{
+    return ( this->accessMask & GPU_WRITE_ACCESS_MASK ) != 0;
+}
+
+static bool IsDepthFormat( const VkFormat format )
+{
+    return format == VK_FORMAT_D16_UNORM || format == VK_FORMAT_D24_UNORM_S8_UINT ||
+           format == VK_FORMAT_D32_SFLOAT || format == VK_FORMAT_D32_SFLOAT_S8_UINT ||
+           format == VK_FORMAT_X8_D24_UNORM_PACK32;
+}
+
+static VkImageUsageFlags ImageUsageForAccess( const GpuRenderGraphAccess access )
+{
+    switch ( access )
+    {
+        case GPU_RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT:
+            return VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+        case GPU_RENDER_GRAPH_ACCESS_DEPTH_ATTACHMENT:
+            return VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+        case GPU_RENDER_GRAPH_ACCESS_SAMPLED_FRAGMENT:
+        case GPU_RENDER_GRAPH_ACCESS_SAMPLED_COMPUTE:
+            return VK_IMAGE_USAGE_SAMPLED_BIT;
+        case GPU_RENDER_GRAPH_ACCESS_STORAGE_READ_COMPUTE:
+        case GPU_RENDER_GRAPH_ACCESS_STORAGE_WRITE_COMPUTE:
+            return VK_IMAGE_USAGE_STORAGE_BIT;
+        case GPU_RENDER_GRAPH_ACCESS_TRANSFER_SRC:
+            return VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        case GPU_RENDER_GRAPH_ACCESS_TRANSFER_DST:
+            return VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        default:
+            return 0;
+    }
+}
+
+GpuRenderGraph::GpuRenderGraph( GpuContext* context ) : context( context ) {}
+
+GpuRenderGraph::~GpuRenderGraph() { ReleaseTransients(); }
+
+void GpuRenderGraph::Reset()
+{
+    this->numResources     = 0;
+    this->numPasses        = 0;
+    this->numFinalBarriers = 0;
+    this->numAliasGroups   = 0;
+    this->compiled         = false;
+}
+
+int GpuRenderGraph::ImportTexture( const char* name, GpuTexture* texture,
+                                   const GpuRenderGraphAccess initialAccess )
+{
+    assert( this->numResources < GPU_RENDER_GRAPH_MAX_RESOURCES );
+
+    GpuRenderGraphResource* resource = &this->resources[this->numResources];
+    memset( resource, 0, sizeof( *resource ) );
+    resource->name         = name;
+    resource->texture      = texture;
+    resource->image        = true;
+    resource->initialState = GpuRenderGraphState::ForAccess( initialAccess );
+    if ( initialAccess == GPU_RENDER_GRAPH_ACCESS_NONE && texture != nullptr )
+    {
+        resource->initialState.layout = texture->imageLayout;
+    }
+    resource->aliasGroup = GPU_RENDER_GRAPH_INVALID_ALIAS_GROUP;
+    return this->numResources++;
+}
+
+int GpuRenderGraph::ImportBuffer( const char* name, GpuBuffer* buffer,
+                                  const GpuRenderGraphAccess initialAccess )
+{
+    assert( this->numResources < GPU_RENDER_GRAPH_MAX_RESOURCES );
+
+    GpuRenderGraphResource* resource = &this->resources[this->numResources];
+    memset( resource, 0, sizeof( *resource ) );
+    resource->name                = name;
+    resource->buffer              = buffer;
+    resource->initialState        = GpuRenderGraphState::ForAccess( initialAccess );
+    resource->initialState.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    resource->aliasGroup          = GPU_RENDER_GRAPH_INVALID_ALIAS_GROUP;
+    return this->numResources++;
+}
+
+int GpuRenderGraph::CreateTransientTexture( const char*                      name,
+                                            const GpuRenderGraphTextureDesc* desc )
+{
+    assert( this->numResources < GPU_RENDER_GRAPH_MAX_RESOURCES );
+
+    GpuRenderGraphResource* resource = &this->resources[this->numResources];
+    memset( resource, 0, sizeof( *resource ) );
+    resource->name         = name;
+    resource->image        = true;
+    resource->transient    = true;
+    resource->desc         = *desc;
+    resource->initialState = GpuRenderGraphState::ForAccess( GPU_RENDER_GRAPH_ACCESS_NONE );
+    resource->aliasGroup   = GPU_RENDER_GRAPH_INVALID_ALIAS_GROUP;
+    return this->numResources++;
+}
+
+int GpuRenderGraph::AddPass( const char* name, GpuRenderGraphExecuteFunc execute, void* userData )
+{
+    assert( this->numPasses < GPU_RENDER_GRAPH_MAX_PASSES );
+
+    GpuRenderGraphPass* pass = &this->passes[this->numPasses];
+    memset( pass, 0, sizeof( *pass ) );
+    pass->name     = name;
+    pass->execute  = execute;
+    pass->userData = userData;
+    return this->numPasses++;
+}
+
+void GpuRenderGraph::AddAccess( const int pass, const int resource,
+                                const GpuRenderGraphAccess access )
+{
+    assert( pass >= 0 && pass < this->numPasses );
+    assert( resource >= 0 && resource < this->numResources );
+
+    GpuRenderGraphPass* p = &this->passes[pass];
+    assert( p->numAccesses < GPU_RENDER_GRAPH_MAX_PASS_ACCESSES );
+    p->resources[p->numAccesses] = resource;
+    p->accesses[p->numAccesses]  = access;
+    p->numAccesses++;
+}
+
+void GpuRenderGraph::MarkOutput( const int resource, const GpuRenderGraphAccess finalAccess )
+{
+    assert( resource >= 0 && resource < this->numResources );
+    assert( !this->resources[resource].transient );
+
+    this->resources[resource].output       = true;
+    this->resources[resource].outputAccess = finalAccess;
+}
+
+void GpuRenderGraph::Compile()
+{
+    CullPasses();
+    ComputeLifetimes();
+    AssignAliasGroups();
+    ComputeBarriers();
+    this->compiled = true;
+}
+
+// Walks the passes back to front. A pass is kept if it writes a resource that is an output of
+// the graph or that is read by a later pass that is kept. Writes never make an earlier write
+// redundant, because a pass may only update part of a resource.
+void GpuRenderGraph::CullPasses()
+{
+    bool needed[GPU_RENDER_GRAPH_MAX_RESOURCES];
+    for ( int r = 0; r < this->numResources; r++ )
+    {
+        needed[r] = this->resources[r].output;
+    }
+
+    for ( int p = this->numPasses - 1; p >= 0; p-- )
+    {
+        GpuRenderGraphPass* pass = &this->passes[p];
+
+        pass->culled = true;
+        for ( int a = 0; a < pass->numAccesses; a++ )
+        {
+            if ( GpuRenderGraphState::ForAccess( pass->accesses[a] ).IsWrite() &&
+                 needed[pass->resources[a]] )
+            {
+                pass->culled = false;
+                break;
+            }
+        }
+        if ( pass->culled )
+        {
+            continue;
+        }
+        for ( int a = 0; a < pass->numAccesses; a++ )
+        {
+            if ( !GpuRenderGraphState::ForAccess( pass->accesses[a] ).IsWrite() ||
+                 pass->accesses[a] == GPU_RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT ||
+                 pass->accesses[a] == GPU_RENDER_GRAPH_ACCESS_DEPTH_ATTACHMENT ||
+                 pass->accesses[a] == GPU_RENDER_GRAPH_ACCESS_STORAGE_WRITE_COMPUTE )
+            {
+                // Attachments and storage writes also read the previous contents.
+                needed[pass->resources[a]] = true;
+            }
+        }
+    }
+}
+
+void GpuRenderGraph::ComputeLifetimes()
+{
+    for ( int r = 0; r < this->numResources; r++ )
+    {
+        this->resources[r].firstPass  = -1;
+        this->resources[r].lastPass   = -1;
+        this->resources[r].imageUsage = 0;
+    }
+    for ( int p = 0; p < this->numPasses; p++ )
+    {
+        const GpuRenderGraphPass* pass = &this->passes[p];
+        if ( pass->culled )
+        {
+            continue;
+        }
+        for ( int a = 0; a < pass->numAccesses; a++ )
+        {
+            GpuRenderGraphResource* resource = &this->resources[pass->resources[a]];
+            if ( resource->firstPass == -1 )
+            {
+                resource->firstPass = p;
+            }
+            resource->lastPass = p;
+            resource->imageUsage |= ImageUsageForAccess( pass->accesses[a] );
+        }
+    }
+}
+
+// Greedy interval assignment: the largest transient textures are placed first, each into the
+// first group of the same kind that has no member with an overlapping lifetime. Ties are broken
+// by declaration order so the result only depends on the graph.
+void GpuRenderGraph::AssignAliasGroups()
+{
+    int order[GPU_RENDER_GRAPH_MAX_RESOURCES];
+    int numOrder = 0;
+    for ( int r = 0; r < this->numResources; r++ )
+    {
+        this->resources[r].aliasGroup = GPU_RENDER_GRAPH_INVALID_ALIAS_GROUP;
+        if ( this->resources[r].transient && this->resources[r].firstPass >= 0 )
+        {
+            order[numOrder++] = r;
+        }
+    }
+
+    auto sizeEstimate = [this]( const int r ) {
+        const GpuRenderGraphTextureDesc* desc = &this->resources[r].desc;
+        return (size_t)desc->width * desc->height * std::max( desc->layerCount, 1 ) *
+               (size_t)desc->sampleCount;
+    };
+
+    for ( int i = 1; i < numOrder; i++ )
+    {
+        const int r = order[i];
+        int       j = i;
+        for ( ; j > 0 && sizeEstimate( order[j - 1] ) < sizeEstimate( r ); j-- )
+        {
+            order[j] = order[j - 1];
+        }
+        order[j] = r;
+    }
+
+    this->numAliasGroups = 0;
+    for ( int i = 0; i < numOrder; i++ )
+    {
+        GpuRenderGraphResource* resource = &this->resources[order[i]];
+        const bool              depth    = IsDepthFormat( resource->desc.format );
+
+        int group = 0;
+        for ( ; group < this->numAliasGroups; group++ )
+        {
+            if ( this->aliasGroups[group].depth != depth )
+            {
+                continue;
+            }
+            bool overlaps = false;
+            for ( int j = 0; j < i && !overlaps; j++ )
+            {
+                const GpuRenderGraphResource* other = &this->resources[order[j]];
+                overlaps = other->aliasGroup == group && other->firstPass <= resource->lastPass &&
+                           resource->firstPass <= other->lastPass;
+            }
+            if ( !overlaps )
+            {
+                break;
+            }
+        }
+        if ( group == this->numAliasGroups )
+        {
+            this->aliasGroups[group].depth        = depth;
+            this->aliasGroups[group].sizeEstimate = 0;
+            this->numAliasGroups++;
+        }
+        this->aliasGroups[group].sizeEstimate =
+            std::max( this->aliasGroups[group].sizeEstimate, sizeEstimate( order[i] ) );
+        resource->aliasGroup = group;
+    }
+}
+
+// The resource states are tracked the same way as by GpuStateTracker, only at compile time.
+static bool TrackAccess( GpuSubresourceState* tracker, const GpuRenderGraphState* state,
+                         const bool image, GpuRenderGraphBarrier* barrier )
+{
+    const VkImageLayout layout = image ? state->layout : VK_IMAGE_LAYOUT_UNDEFINED;
+
+    barrier->src.layout = tracker->layout;
+    barrier->dst        = *state;
+    barrier->dst.layout = layout;
+    barrier->srcPass    = -1;
+    barrier->split      = false;
+    return tracker->Access( state->stageMask, state->accessMask, layout, &barrier->src.stageMask,
+                            &barrier->src.accessMask );
+}
+
+void GpuRenderGraph::ComputeBarriers()
+{
+    GpuSubresourceState trackers[GPU_RENDER_GRAPH_MAX_RESOURCES];
+    GpuSubresourceState groupTrackers[GPU_RENDER_GRAPH_MAX_RESOURCES];
+    int                 lastAccessPass[GPU_RENDER_GRAPH_MAX_RESOURCES];
+    int                 groupLastPass[GPU_RENDER_GRAPH_MAX_RESOURCES];
+    int                 previousPass = -1;
+
+    for ( int r = 0; r < this->numResources; r++ )
+    {
+        lastAccessPass[r] = -1;
+
+        const GpuRenderGraphState* initial = &this->resources[r].initialState;
+        trackers[r]             = GpuSubresourceState::Undefined();
+        trackers[r].layout      = initial->layout;
+        trackers[r].writeStages = initial->IsWrite() ? initial->stageMask : 0;
+        trackers[r].writeAccess = initial->accessMask & GPU_WRITE_ACCESS_MASK;
+        trackers[r].readStages  = initial->IsWrite() ? 0 : initial->stageMask;
+        trackers[r].readAccess  = initial->IsWrite() ? 0 : initial->accessMask;
+    }
+    for ( int g = 0; g < this->numAliasGroups; g++ )
+    {
+        groupTrackers[g] = GpuSubresourceState::Undefined();
+        groupLastPass[g] = -1;
+    }
+    for ( int p = 0; p < this->numPasses; p++ )
+    {
+        this->passes[p].signalStages = 0;
+    }
+
+    for ( int p = 0; p < this->numPasses; p++ )
+    {
+        GpuRenderGraphPass* pass = &this->passes[p];
+        pass->numBarriers        = 0;
+        if ( pass->culled )
+        {
+            continue;
+        }
+
+        // Combine multiple accesses of the same resource by this pass.
+        int                 merged[GPU_RENDER_GRAPH_MAX_PASS_ACCESSES];
+        GpuRenderGraphState states[GPU_RENDER_GRAPH_MAX_PASS_ACCESSES];
+        int                 numMerged = 0;
+        for ( int a = 0; a < pass->numAccesses; a++ )
+        {
+            const GpuRenderGraphState state = GpuRenderGraphState::ForAccess( pass->accesses[a] );
+
+            int m = 0;
+            for ( ; m < numMerged && merged[m] != pass->resources[a]; m++ )
+            {
+            }
+            if ( m == numMerged )
+            {
+                merged[numMerged]   = pass->resources[a];
+                states[numMerged++] = state;
+                continue;
+            }
+            // A pass cannot use an image in two layouts at once.
+            assert( !this->resources[merged[m]].image || states[m].layout == state.layout );
+            states[m].stageMask |= state.stageMask;
+            states[m].accessMask |= state.accessMask;
+        }
+
+        for ( int m = 0; m < numMerged; m++ )
+        {
+            const int                     r        = merged[m];
+            const GpuRenderGraphResource* resource = &this->resources[r];
+            int                           srcPass  = lastAccessPass[r];
+
+            // The first use of an aliased texture waits for the previous user of the memory.
+            if ( resource->aliasGroup != GPU_RENDER_GRAPH_INVALID_ALIAS_GROUP &&
+                 resource->firstPass == p )
+            {
+                trackers[r]        = groupTrackers[resource->aliasGroup];
+                trackers[r].layout = VK_IMAGE_LAYOUT_UNDEFINED;
+                srcPass            = groupLastPass[resource->aliasGroup];
+            }
+
+            GpuRenderGraphBarrier* barrier = &pass->barriers[pass->numBarriers];
+            barrier->resource              = r;
+            if ( TrackAccess( &trackers[r], &states[m], resource->image, barrier ) )
+            {
+                // The event is set after the whole source pass, which also covers any earlier
+                // passes that accessed the resource.
+                barrier->srcPass = srcPass;
+                barrier->split   = srcPass >= 0 && srcPass != previousPass &&
+                                 barrier->src.stageMask != 0;
+                if ( barrier->split )
+                {
+                    this->passes[srcPass].signalStages |= barrier->src.stageMask;
+                }
+                pass->numBarriers++;
+            }
+            lastAccessPass[r] = p;
+
+            if ( resource->aliasGroup != GPU_RENDER_GRAPH_INVALID_ALIAS_GROUP &&
+                 resource->lastPass == p )
+            {
+                GpuSubresourceState* group = &groupTrackers[resource->aliasGroup];
+                group->writeStages = trackers[r].writeStages | trackers[r].readStages;
+                group->writeAccess = trackers[r].writeAccess;
+                group->readStages  = 0;
+                group->readAccess  = 0;
+
+                groupLastPass[resource->aliasGroup] = p;
+            }
+        }
+        previousPass = p;
+    }
+
+    this->numFinalBarriers = 0;
+    for ( int r = 0; r < this->numResources; r++ )
+    {
+        GpuRenderGraphResource* resource = &this->resources[r];
+        if ( resource->output && resource->outputAccess != GPU_RENDER_GRAPH_ACCESS_NONE )
+        {
+            const GpuRenderGraphState state =
+                GpuRenderGraphState::ForAccess( resource->outputAccess );
+            GpuRenderGraphBarrier* barrier = &this->finalBarriers[this->numFinalBarriers];
+            barrier->resource              = r;
+            if ( TrackAccess( &trackers[r], &state, resource->image, barrier ) )
+            {
+                this->numFinalBarriers++;
+            }
+        }
+        resource->finalState.layout     = trackers[r].layout;
+        resource->finalState.stageMask  = trackers[r].writeStages | trackers[r].readStages;
+        resource->finalState.accessMask = trackers[r].writeAccess | trackers[r].readAccess;
+    }
+}
+
+void GpuRenderGraph::Execute( GpuCommandBuffer* commandBuffer )
+{
+    assert( this->compiled );
+    assert( this->context != nullptr );
+
+    RealizeTransients();
+
+    // The events signaled after each pass, only valid for passes with signal stages.
+    GpuSplitBarrier passSignals[GPU_RENDER_GRAPH_MAX_PASSES];
+
+    for ( int p = 0; p < this->numPasses; p++ )
+    {
+        const GpuRenderGraphPass* pass = &this->passes[p];
+        if ( pass->culled )
+        {
+            continue;
+        }
+        RecordBarriers( commandBuffer, pass->barriers, pass->numBarriers, passSignals );
+        if ( pass->execute != nullptr )
+        {
+            pass->execute( commandBuffer, this, pass->userData );
+        }
+        if ( pass->signalStages != 0 )
+        {
+            passSignals[p] = commandBuffer->SignalSplitBarrier( pass->signalStages );
+        }
+    }
+
+    RecordBarriers( commandBuffer, this->finalBarriers, this->numFinalBarriers, passSignals );
+}
+
+void GpuRenderGraph::RecordBarriers( GpuCommandBuffer*            commandBuffer,
+                                     const GpuRenderGraphBarrier* barriers, const int numBarriers,
+                                     const GpuSplitBarrier*       passSignals )
+{
+    if ( numBarriers == 0 )
+    {
+        return;
+    }
+
+    // Index 0 collects the regular barriers, index 1 the split barriers.
+    VkImageMemoryBarrier  imageBarriers[2][GPU_RENDER_GRAPH_MAX_RESOURCES];
+    VkBufferMemoryBarrier bufferBarriers[2][GPU_RENDER_GRAPH_MAX_RESOURCES];
+    int                   numImageBarriers[2]  = { 0, 0 };
+    int                   numBufferBarriers[2] = { 0, 0 };
+    VkPipelineStageFlags  srcStages            = 0;
+    VkPipelineStageFlags  dstStages[2]         = { 0, 0 };
+    GpuSplitBarrier       waits[GPU_RENDER_GRAPH_MAX_PASS_ACCESSES];
+    int                   waitPasses[GPU_RENDER_GRAPH_MAX_PASS_ACCESSES];
+    int                   numWaits = 0;
+
+    for ( int i = 0; i < numBarriers; i++ )
+    {
+        const GpuRenderGraphBarrier*  barrier  = &barriers[i];
+        const GpuRenderGraphResource* resource = &this->resources[barrier->resource];
+        const int                     split    = barrier->split ? 1 : 0;
+
+        // There is nothing to transition for a resource that was imported as null.
+        if ( resource->image ? resource->texture == nullptr : resource->buffer == nullptr )
+        {
+            continue;
+        }
+
+        dstStages[split] |= barrier->dst.stageMask;
+        if ( barrier->split )
+        {
+            // Passes that produce several resources for this pass are only waited on once.
+            int w = 0;
+            for ( ; w < numWaits && waitPasses[w] != barrier->srcPass; w++ )
+            {
+            }
+            if ( w == numWaits )
+            {
+                waits[numWaits]        = passSignals[barrier->srcPass];
+                waitPasses[numWaits++] = barrier->srcPass;
+            }
+        }
+        else
+        {
+            srcStages |= barrier->src.stageMask;
+        }
+
+        if ( resource->image )
+        {
+            GpuTexture* texture = resource->texture;
+
+            VkImageMemoryBarrier* imageBarrier = &imageBarriers[split][numImageBarriers[split]++];
+            imageBarrier->sType                = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            imageBarrier->pNext                = nullptr;
+            imageBarrier->srcAccessMask        = barrier->src.accessMask;
+            imageBarrier->dstAccessMask        = barrier->dst.accessMask;
+            imageBarrier->oldLayout            = barrier->src.layout;
+            imageBarrier->newLayout            = barrier->dst.layout;
+            imageBarrier->srcQueueFamilyIndex  = VK_QUEUE_FAMILY_IGNORED;
+            imageBarrier->dstQueueFamilyIndex  = VK_QUEUE_FAMILY_IGNORED;
+            imageBarrier->image                = texture->image;
+            imageBarrier->subresourceRange.aspectMask =
+                IsDepthFormat( texture->format )
+                    ? ( VK_IMAGE_ASPECT_DEPTH_BIT |
+                        ( ( texture->format == VK_FORMAT_D24_UNORM_S8_UINT ||
+                            texture->format == VK_FORMAT_D32_SFLOAT_S8_UINT )
+                              ? VK_IMAGE_ASPECT_STENCIL_BIT
+                              : 0 ) )
+                    : VK_IMAGE_ASPECT_COLOR_BIT;
+            imageBarrier->subresourceRange.baseMipLevel   = 0;
+            imageBarrier->subresourceRange.levelCount     = VK_REMAINING_MIP_LEVELS;
+            imageBarrier->subresourceRange.baseArrayLayer = 0;
+            imageBarrier->subresourceRange.layerCount     = VK_REMAINING_ARRAY_LAYERS;
+
+            // Keep the texture consistent for code that still looks at its layout. The barrier
+            // covers the whole texture, so any GpuStateTracker starts over from the new layout.
+            texture->imageLayout = barrier->dst.layout;
+            texture->usage       = TextureUsageForLayout( barrier->dst.layout );
+            free( texture->subresourceStates );
+            texture->subresourceStates = nullptr;
+        }
+        else
+        {
+            VkBufferMemoryBarrier* bufferBarrier =
+                &bufferBarriers[split][numBufferBarriers[split]++];
+            bufferBarrier->sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            bufferBarrier->pNext               = nullptr;
+            bufferBarrier->srcAccessMask       = barrier->src.accessMask;
+            bufferBarrier->dstAccessMask       = barrier->dst.accessMask;
+            bufferBarrier->srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            bufferBarrier->dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            bufferBarrier->buffer              = resource->buffer->buffer;
+            bufferBarrier->offset              = 0;
+            bufferBarrier->size                = VK_WHOLE_SIZE;
+
+            // Same for the ranges a GpuStateTracker recorded on the buffer.
+            GpuBuffer* buffer = resource->buffer;
+            free( buffer->rangeStates );
+            buffer->rangeStates    = nullptr;
+            buffer->numRangeStates = 0;
+            buffer->maxRangeStates = 0;
+        }
+    }
+
+    if ( numImageBarriers[0] + numBufferBarriers[0] > 0 )
+    {
+        if ( srcStages == 0 )
+        {
+            srcStages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        }
+
+        VkCommandBuffer cmdBuffer = commandBuffer->cmdBuffers[commandBuffer->currentBuffer];
+        VC( context->device->vkCmdPipelineBarrier( cmdBuffer, srcStages, dstStages[0], 0, 0,
+                                                   nullptr, numBufferBarriers[0],
+                                                   bufferBarriers[0], numImageBarriers[0],
+                                                   imageBarriers[0] ) );
+    }
+    if ( numWaits > 0 )
+    {
+        commandBuffer->WaitSplitBarriers( waits, numWaits, dstStages[1], numBufferBarriers[1],
+                                          bufferBarriers[1], numImageBarriers[1],
+                                          imageBarriers[1] );
+    }
+}
+
+void GpuRenderGraph::RealizeTransients()
+{
+    // The signature covers everything that goes into creating the transient textures.
+    unsigned int signature = 5381;
+    for ( int r = 0; r < this->numResources; r++ )
+    {
+        const GpuRenderGraphResource* resource = &this->resources[r];
+        if ( !resource->transient )
+        {
+            continue;
+        }
+        const int values[] = { r,
+                               (int)resource->desc.format,
+                               resource->desc.width,
+                               resource->desc.height,
+                               resource->desc.layerCount,
+                               (int)resource->desc.sampleCount,
+                               (int)resource->imageUsage,
+                               resource->aliasGroup };
+        for ( int i = 0; i < (int)( sizeof( values ) / sizeof( values[0] ) ); i++ )
+        {
+            signature = ( ( signature << 5 ) - signature ) + (unsigned int)values[i];
+        }
+    }
+
+    if ( signature != this->realizedSignature || this->numRealizedMemory == 0 )
+    {
+        // Only happens when the frame setup changes, for instance when the window is resized.
+        // The old textures are released through the deletion queue, so there is no need to wait
+        // for the frames that still use them.
+        ReleaseTransients();
+
+        GpuDevice*           device = context->device;
+        VkMemoryRequirements groupRequirements[GPU_RENDER_GRAPH_MAX_RESOURCES];
+        memset( groupRequirements, 0, sizeof( groupRequirements ) );
+        for ( int g = 0; g < this->numAliasGroups; g++ )
+        {
+            groupRequirements[g].memoryTypeBits = ~0u;
+        }
+
+        for ( int r = 0; r < this->numResources; r++ )
+        {
+            const GpuRenderGraphResource* resource = &this->resources[r];
+            if ( !resource->transient ||
+                 resource->aliasGroup == GPU_RENDER_GRAPH_INVALID_ALIAS_GROUP )
+            {
+                continue;
+            }
+
+            GpuTexture* texture  = new GpuTexture( context );
+            texture->width       = resource->desc.width;
+            texture->height      = resource->desc.height;
+            texture->depth       = 1;
+            texture->layerCount  = std::max( resource->desc.layerCount, 1 );
+            texture->mipCount    = 1;
+            texture->sampleCount = resource->desc.sampleCount;
+            texture->format      = resource->desc.format;
+            texture->usage       = GPU_TEXTURE_USAGE_UNDEFINED;
+            texture->usageFlags =
+                ( ( resource->imageUsage & VK_IMAGE_USAGE_SAMPLED_BIT ) ? GPU_TEXTURE_USAGE_SAMPLED
+                                                                        : 0 ) |
+                ( ( resource->imageUsage & VK_IMAGE_USAGE_STORAGE_BIT ) ? GPU_TEXTURE_USAGE_STORAGE
+                                                                        : 0 ) |
+                ( ( resource->imageUsage & VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT )
+                      ? GPU_TEXTURE_USAGE_COLOR_ATTACHMENT
+                      : 0 );
+            texture->imageLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+            VkImageCreateInfo imageCreateInfo;
+            imageCreateInfo.sType                 = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+            imageCreateInfo.pNext                 = nullptr;
+            imageCreateInfo.flags                 = 0;
+            imageCreateInfo.imageType             = VK_IMAGE_TYPE_2D;
+            imageCreateInfo.format                = texture->format;
+            imageCreateInfo.extent.width          = texture->width;
+            imageCreateInfo.extent.height         = texture->height;
+            imageCreateInfo.extent.depth          = 1;
+            imageCreateInfo.mipLevels             = 1;
+            imageCreateInfo.arrayLayers           = texture->layerCount;
+            imageCreateInfo.samples               = (VkSampleCountFlagBits)texture->sampleCount;
+            imageCreateInfo.tiling                = VK_IMAGE_TILING_OPTIMAL;
+            imageCreateInfo.usage                 = resource->imageUsage;
+            imageCreateInfo.sharingMode           = VK_SHARING_MODE_EXCLUSIVE;
+            imageCreateInfo.queueFamilyIndexCount = 0;
+            imageCreateInfo.pQueueFamilyIndices   = nullptr;
+            imageCreateInfo.initialLayout         = VK_IMAGE_LAYOUT_UNDEFINED;
+
+            VK( device->vkCreateImage( device->device, &imageCreateInfo, VK_ALLOCATOR,
+                                       &texture->image ) );
+
+            VkMemoryRequirements memoryRequirements;
+            VC( device->vkGetImageMemoryRequirements( device->device, texture->image,
+                                                      &memoryRequirements ) );
+
+            VkMemoryRequirements* group = &groupRequirements[resource->aliasGroup];
+            group->size           = std::max( group->size, memoryRequirements.size );
+            group->alignment      = std::max( group->alignment, memoryRequirements.alignment );
+            group->memoryTypeBits &= memoryRequirements.memoryTypeBits;
+
+            this->realizedTextures[r] = texture;
+        }
+
+        for ( int g = 0; g < this->numAliasGroups; g++ )
+        {
+            // Images of the same kind can share memory on all known implementations; if not,
+            // the assert below fires and the group should be split by format.
+            assert( groupRequirements[g].memoryTypeBits != 0 );
+
+            VkMemoryAllocateInfo memoryAllocateInfo;
+            memoryAllocateInfo.sType          = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+            memoryAllocateInfo.pNext          = nullptr;
+            memoryAllocateInfo.allocationSize = groupRequirements[g].size;
+            memoryAllocateInfo.memoryTypeIndex = device->GetMemoryTypeIndex(
+                groupRequirements[g].memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT );
+
+            VK( device->vkAllocateMemory( device->device, &memoryAllocateInfo, VK_ALLOCATOR,
+                                          &this->realizedMemory[g] ) );
+        }
+        this->numRealizedMemory = this->numAliasGroups;
+
+        for ( int r = 0; r < this->numResources; r++ )
+        {
+            GpuTexture* texture = this->realizedTextures[r];
+            if ( texture == nullptr )
+            {
+                continue;
+            }
+            const GpuRenderGraphResource* resource = &this->resources[r];
+
+            texture->memory = this->realizedMemory[resource->aliasGroup];
+            VK( device->vkBindImageMemory( device->device, texture->image, texture->memory, 0 ) );
+
+            const bool depth = IsDepthFormat( texture->format );
+
+            VkImageViewCreateInfo imageViewCreateInfo;
+            imageViewCreateInfo.sType    = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            imageViewCreateInfo.pNext    = nullptr;
+            imageViewCreateInfo.flags    = 0;
+            imageViewCreateInfo.image    = texture->image;
+            imageViewCreateInfo.viewType = ( texture->layerCount > 1 )
+                                               ? VK_IMAGE_VIEW_TYPE_2D_ARRAY
+                                               : VK_IMAGE_VIEW_TYPE_2D;
+            imageViewCreateInfo.format                          = texture->format;
+            imageViewCreateInfo.components.r                    = VK_COMPONENT_SWIZZLE_IDENTITY;
+            imageViewCreateInfo.components.g                    = VK_COMPONENT_SWIZZLE_IDENTITY;
+            imageViewCreateInfo.components.b                    = VK_COMPONENT_SWIZZLE_IDENTITY;
+            imageViewCreateInfo.components.a                    = VK_COMPONENT_SWIZZLE_IDENTITY;
+            imageViewCreateInfo.subresourceRange.aspectMask     = depth
+                                                                      ? VK_IMAGE_ASPECT_DEPTH_BIT
+                                                                      : VK_IMAGE_ASPECT_COLOR_BIT;
+            imageViewCreateInfo.subresourceRange.baseMipLevel   = 0;
+            imageViewCreateInfo.subresourceRange.levelCount     = 1;
+            imageViewCreateInfo.subresourceRange.baseArrayLayer = 0;
+            imageViewCreateInfo.subresourceRange.layerCount     = texture->layerCount;
+
+            VK( device->vkCreateImageView( device->device, &imageViewCreateInfo, VK_ALLOCATOR,
+                                           &texture->view ) );
+
+            if ( ( resource->imageUsage & VK_IMAGE_USAGE_SAMPLED_BIT ) != 0 )
+            {
+                texture->filter        = GPU_TEXTURE_FILTER_LINEAR;
+                texture->wrapMode      = GPU_TEXTURE_WRAP_MODE_CLAMP_TO_EDGE;
+                texture->maxAnisotropy = 1.0f;
+                texture->UpdateSampler();
+            }
+        }
+
+        this->realizedSignature = signature;
+    }
+
+    // Aliased textures start out undefined every frame.
+    for ( int r = 0; r < this->numResources; r++ )
+    {
+        if ( this->resources[r].transient )
+        {
+            this->resources[r].texture = this->realizedTextures[r];
+            if ( this->realizedTextures[r] != nullptr )
+            {
+                this->realizedTextures[r]->imageLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+                this->realizedTextures[r]->usage       = GPU_TEXTURE_USAGE_UNDEFINED;
+                free( this->realizedTextures[r]->subresourceStates );
+                this->realizedTextures[r]->subresourceStates = nullptr;
+            }
+        }
+    }
+}
+
+void GpuRenderGraph::ReleaseTransients()
+{
+    if ( this->context == nullptr )
+    {
+        return;
+    }
+
+    GpuDeletionQueue* deletionQueue = context->deletionQueue;
+    for ( int r = 0; r < GPU_RENDER_GRAPH_MAX_RESOURCES; r++ )
+    {
+        GpuTexture* texture = this->realizedTextures[r];
+        if ( texture == nullptr )
+        {
+            continue;
+        }
+        // The memory is shared by the alias group and released below. Without memory the
+        // destructor leaves the image and view alone, so they are released here.
+        deletionQueue->Destroy( GPU_DELETION_TYPE_IMAGE_VIEW, (uint64_t)texture->view );
+        deletionQueue->Destroy( GPU_DELETION_TYPE_IMAGE, (uint64_t)texture->image );
+        texture->memory = VK_NULL_HANDLE;
+        delete texture;
+        this->realizedTextures[r] = nullptr;
+    }
+    for ( int g = 0; g < this->numRealizedMemory; g++ )
+    {
+        deletionQueue->Destroy( GPU_DELETION_TYPE_MEMORY, (uint64_t)this->realizedMemory[g] );
+        this->realizedMemory[g] = VK_NULL_HANDLE;
+    }
+    this->numRealizedMemory = 0;
+    this->realizedSignature = 0;
+}
+
+GpuTexture* GpuRenderGraph::GetTexture( const int resource ) const
+{
+    assert( resource >= 0 && resource < this->numResources );
+    return this->resources[resource].texture;
+}
+
+GpuBuffer* GpuRenderGraph::GetBuffer( const int resource ) const
+{
+    assert( resource >= 0 && resource < this->numResources );
+    return this->resources[resource].buffer;
+}
+
+} // namespace lxd
@@ -0,0 +1,188 @@
+#include "GpuShaderCache.hpp"
+#include "GpuDevice.hpp"
+
+namespace lxd
+{
+
+GpuShaderCache::GpuShaderCache( GpuDevice* device ) : device( *device )
+{
+    ksMutex_Create( &this->mutex );
+}
+
+GpuShaderCache::~GpuShaderCache()
+{
+    assert( this->numShaders == 0 );
+    ksMutex_Destroy( &this->mutex );
+}
+
+// EmbedShader.cmake computes the same hash for embedded shaders.
+unsigned int GpuShaderCache::Hash( const VkShaderStageFlagBits stage, const void* code,
+                                   const size_t codeSize )
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>( code );
+    unsigned int         hash  = 5381;
+    hash                       = ( ( hash << 5 ) - hash ) + (unsigned int)stage;
+    for ( size_t i = 0; i < codeSize; i++ )
+    {
+        hash = ( ( hash << 5 ) - hash ) + bytes[i];
+    }
+    return hash;
+}
+
+GpuShader* GpuShaderCache::Acquire( const VkShaderStageFlagBits stage, const void* code,
+                                    const size_t codeSize )
+{
+    return Acquire( stage, code, codeSize, Hash( stage, code, codeSize ) );
+}
+
+GpuShader* GpuShaderCache::Acquire( const GpuShaderBlob* blob )
+{
+    assert( blob->hash == Hash( blob->stage, blob->code, blob->codeSize ) );
+    return Acquire( blob->stage, blob->code, blob->codeSize, blob->hash );
+}
+
+GpuShader* GpuShaderCache::Acquire( const VkShaderStageFlagBits stage, const void* code,
+                                    const size_t codeSize, const unsigned int hash )
+{
+    ksMutex_Lock( &this->mutex, true );
+    GpuShader** bucket = &this->buckets[hash % GPU_SHADER_CACHE_BUCKETS];
+    for ( GpuShader* shader = *bucket; shader != nullptr; shader = shader->next )
+    {
+        if ( shader->hash == hash && shader->stage == stage && shader->codeSize == codeSize &&
+             memcmp( shader->code, code, codeSize ) == 0 )
+        {
+            shader->refCount++;
+            ksMutex_Unlock( &this->mutex );
+            return shader;
+        }
+    }
+
+    GpuShader* shader      = static_cast<GpuShader*>( malloc( sizeof( GpuShader ) ) );
+    shader->stage          = stage;
+    shader->module         = VK_NULL_HANDLE;
+    shader->identifierSize = 0;
+    shader->hash           = hash;
+    shader->codeSize       = codeSize;
+    shader->code           = malloc( codeSize + 1 );
+    shader->refCount       = 1;
+    memcpy( shader->code, code, codeSize );
+    static_cast<unsigned char*>( shader->code )[codeSize] = 0;
+
+    const bool isSpirv = ( *static_cast<const uint32_t*>( code ) == ICD_SPV_MAGIC );
+    if ( isSpirv && this->device.supportsShaderModuleIdentifiers )
+    {
+        VkShaderModuleCreateInfo moduleCreateInfo;
+        moduleCreateInfo.sType    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        moduleCreateInfo.pNext    = nullptr;
+        moduleCreateInfo.flags    = 0;
+        moduleCreateInfo.codeSize = codeSize;
+        moduleCreateInfo.pCode    = static_cast<const uint32_t*>( code );
+
+        VkShaderModuleIdentifierEXT moduleIdentifier;
+        moduleIdentifier.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_IDENTIFIER_EXT;
+        moduleIdentifier.pNext = nullptr;
+        VC( this->device.vkGetShaderModuleCreateInfoIdentifierEXT(
+            this->device.device, &moduleCreateInfo, &moduleIdentifier ) );
+
+        shader->identifierSize = moduleIdentifier.identifierSize;
+        memcpy( shader->identifier, moduleIdentifier.identifier, moduleIdentifier.identifierSize );
+    }
+    if ( shader->identifierSize == 0 )
+    {
+        CreateModule( shader );
+    }
+
+    shader->next = *bucket;
+    *bucket      = shader;
+    this->numShaders++;
+    ksMutex_Unlock( &this->mutex );
+
+    return shader;
+}
+
+void GpuShaderCache::Release( GpuShader* shader )
+{
+    ksMutex_Lock( &this->mutex, true );
+    if ( --shader->refCount > 0 )
+    {
+        ksMutex_Unlock( &this->mutex );
+        return;
+    }
+
+    for ( GpuShader** link = &this->buckets[shader->hash % GPU_SHADER_CACHE_BUCKETS];
+          *link != nullptr; link = &( *link )->next )
+    {
+        if ( *link == shader )
+        {
+            *link = shader->next;
+            break;
+        }
+    }
+    this->numShaders--;
+    if ( shader->module != VK_NULL_HANDLE )
+    {
+        this->numModules--;
+    }
+    ksMutex_Unlock( &this->mutex );
+
+    // Pipelines do not reference the module once created, so it can go right away.
+    if ( shader->module != VK_NULL_HANDLE )
+    {
+        VC( this->device.vkDestroyShaderModule( this->device.device, shader->module,
+                                                VK_ALLOCATOR ) );
+    }
+    free( shader->code );
+    free( shader );
+}
+
+VkShaderModule GpuShaderCache::GetModule( GpuShader* shader )
+{
+    ksMutex_Lock( &this->mutex, true );
+    if ( shader->module == VK_NULL_HANDLE )
+    {
+        CreateModule( shader );
+    }
+    const VkShaderModule module = shader->module;
+    ksMutex_Unlock( &this->mutex );
+    return module;
+}
+
+void GpuShaderCache::CreateModule( GpuShader* shader )
+{
+    VkShaderModuleCreateInfo moduleCreateInfo;
+    moduleCreateInfo.sType    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    moduleCreateInfo.pNext    = nullptr;
+    moduleCreateInfo.flags    = 0;
+    moduleCreateInfo.codeSize = 0;
+    moduleCreateInfo.pCode    = nullptr;
+
+    if ( *static_cast<const uint32_t*>( shader->code ) == ICD_SPV_MAGIC )
+    {
+        moduleCreateInfo.codeSize = shader->codeSize;
+        moduleCreateInfo.pCode    = static_cast<const uint32_t*>( shader->code );
+
+        VK( this->device.vkCreateShaderModule( this->device.device, &moduleCreateInfo,
+                                               VK_ALLOCATOR, &shader->module ) );
+    }
+    else
+    {
+        // Create fake SPV structure to feed GLSL to the driver "under the covers".
+        size_t    tempCodeSize = 3 * sizeof( uint32_t ) + shader->codeSize + 1;
+        uint32_t* tempCode     = (uint32_t*)malloc( tempCodeSize );
+        tempCode[0]            = ICD_SPV_MAGIC;
+        tempCode[1]            = 0;
+        tempCode[2]            = shader->stage;
+        memcpy( tempCode + 3, shader->code, shader->codeSize + 1 );
+
+        moduleCreateInfo.codeSize = tempCodeSize;
+        moduleCreateInfo.pCode    = tempCode;
+
+        VK( this->device.vkCreateShaderModule( this->device.device, &moduleCreateInfo,
+                                               VK_ALLOCATOR, &shader->module ) );
+
+        free( tempCode );
+    }
+    this->numModules++;
+}
+
+} // namespace lxd
@@ -0,0 +1,400 @@
+#include "GpuShaderReflection.hpp"
+#include "GpuShaderCache.hpp"
+
+namespace lxd
+{
+
+// The few opcodes, decorations and storage classes of the SPIR-V specification used here.
+enum
+{
+    SPV_OP_NAME                  = 5,
+    SPV_OP_MEMBER_NAME           = 6,
+    SPV_OP_TYPE_INT              = 21,
+    SPV_OP_TYPE_FLOAT            = 22,
+    SPV_OP_TYPE_VECTOR           = 23,
+    SPV_OP_TYPE_MATRIX           = 24,
+    SPV_OP_TYPE_IMAGE            = 25,
+    SPV_OP_TYPE_SAMPLER          = 26,
+    SPV_OP_TYPE_SAMPLED_IMAGE    = 27,
+    SPV_OP_TYPE_ARRAY            = 28,
+    SPV_OP_TYPE_RUNTIME_ARRAY    = 29,
+    SPV_OP_TYPE_STRUCT           = 30,
+    SPV_OP_TYPE_POINTER          = 32,
+    SPV_OP_VARIABLE              = 59,
+    SPV_OP_DECORATE              = 71,
+    SPV_OP_MEMBER_DECORATE       = 72,
+    SPV_DECORATION_BLOCK         = 2,
+    SPV_DECORATION_BUFFER_BLOCK  = 3,
+    SPV_DECORATION_BUILT_IN      = 11,
+    SPV_DECORATION_NON_WRITABLE  = 24,
+    SPV_DECORATION_NON_READABLE  = 25,
+    SPV_DECORATION_LOCATION      = 30,
+    SPV_DECORATION_BINDING       = 33,
+    SPV_DECORATION_SET           = 34,
+    SPV_DECORATION_OFFSET        = 35,
+    SPV_STORAGE_UNIFORM_CONSTANT = 0,
+    SPV_STORAGE_INPUT            = 1,
+    SPV_STORAGE_UNIFORM          = 2,
+    SPV_STORAGE_PUSH_CONSTANT    = 9,
+    SPV_STORAGE_STORAGE_BUFFER   = 12
+};
+
+enum
+{
+    SPV_ID_BLOCK        = 0b1,
+    SPV_ID_BUFFER_BLOCK = 0b10,
+    SPV_ID_BUILT_IN     = 0b100,
+    SPV_ID_NON_WRITABLE = 0b1000,
+    SPV_ID_NON_READABLE = 0b10000,
+    SPV_ID_LOCATION     = 0b100000
+};
+
+// What the decorations say about an id, and where it is defined and named.
+struct SpvId
+{
+    uint32_t definition; // word offset of the instruction, 0 if not a type or variable
+    uint32_t name;       // word offset of OpName, 0 if unnamed
+    uint32_t binding;
+    uint32_t set;
+    uint32_t location;
+    uint32_t flags;
+    uint32_t numNonWritableMembers;
+    uint32_t numNonReadableMembers;
+};
+
+static int GetLocationCount( const uint32_t* code, const SpvId* ids, const uint32_t typeId )
+{
+    const uint32_t* type = code + ids[typeId].definition;
+    return ( ( type[0] & 0xFFFF ) == SPV_OP_TYPE_MATRIX ) ? (int)type[3] : 1;
+}
+
+static GpuProgramParmType GetPushConstantType( const uint32_t* code, const SpvId* ids,
+                                               const uint32_t typeId )
+{
+    const uint32_t* type = code + ids[typeId].definition;
+    switch ( type[0] & 0xFFFF )
+    {
+        case SPV_OP_TYPE_INT:
+            return GPU_PROGRAM_PARM_TYPE_PUSH_CONSTANT_INT;
+        case SPV_OP_TYPE_FLOAT:
+            return GPU_PROGRAM_PARM_TYPE_PUSH_CONSTANT_FLOAT;
+        case SPV_OP_TYPE_VECTOR:
+        {
+            const GpuProgramParmType scalarType = GetPushConstantType( code, ids, type[2] );
+            return (GpuProgramParmType)( scalarType + type[3] - 1 );
+        }
+        case SPV_OP_TYPE_MATRIX:
+        {
+            // The matrix types are ordered by columns, then by rows.
+            const uint32_t* column  = code + ids[type[2]].definition;
+            const int       columns = (int)type[3];
+            const int       rows    = (int)column[3];
+            return (GpuProgramParmType)( GPU_PROGRAM_PARM_TYPE_PUSH_CONSTANT_FLOAT_MATRIX2X2 +
+                                         ( columns - 2 ) * 3 + ( rows - 2 ) );
+        }
+        default:
+            return GPU_PROGRAM_PARM_TYPE_MAX;
+    }
+}
+
+static GpuProgramStageFlags GetStageFlag( const VkShaderStageFlagBits stage )
+{
+    switch ( stage )
+    {
+        case VK_SHADER_STAGE_VERTEX_BIT:
+            return GPU_PROGRAM_STAGE_FLAG_VERTEX;
+        case VK_SHADER_STAGE_FRAGMENT_BIT:
+            return GPU_PROGRAM_STAGE_FLAG_FRAGMENT;
+        default:
+            return GPU_PROGRAM_STAGE_FLAG_COMPUTE;
+    }
+}
+
+GpuProgramReflection::GpuProgramReflection( const GpuShaderBlob* shader0,
+                                            const GpuShaderBlob* shader1 )
+{
+    Reflect( shader0 );
+    if ( shader1 != nullptr )
+    {
+        Reflect( shader1 );
+    }
+}
+
+void GpuProgramReflection::Reflect( const GpuShaderBlob* shader )
+{
+    const uint32_t* code     = shader->code;
+    const uint32_t  numWords = (uint32_t)( shader->codeSize / sizeof( uint32_t ) );
+    assert( numWords > 5 && code[0] == ICD_SPV_MAGIC );
+
+    const int      stageFlag = GetStageFlag( shader->stage );
+    const uint32_t bound     = code[3];
+    SpvId*         ids       = static_cast<SpvId*>( calloc( bound, sizeof( SpvId ) ) );
+
+    for ( uint32_t offset = 5; offset < numWords; offset += code[offset] >> 16 )
+    {
+        const uint32_t* ins = code + offset;
+        assert( ( ins[0] >> 16 ) > 0 );
+        switch ( ins[0] & 0xFFFF )
+        {
+            case SPV_OP_NAME:
+                ids[ins[1]].name = offset;
+                break;
+            case SPV_OP_DECORATE:
+                switch ( ins[2] )
+                {
+                    case SPV_DECORATION_BLOCK:
+                        ids[ins[1]].flags |= SPV_ID_BLOCK;
+                        break;
+                    case SPV_DECORATION_BUFFER_BLOCK:
+                        ids[ins[1]].flags |= SPV_ID_BUFFER_BLOCK;
+                        break;
+                    case SPV_DECORATION_BUILT_IN:
+                        ids[ins[1]].flags |= SPV_ID_BUILT_IN;
+                        break;
+                    case SPV_DECORATION_NON_WRITABLE:
+                        ids[ins[1]].flags |= SPV_ID_NON_WRITABLE;
+                        break;
+                    case SPV_DECORATION_NON_READABLE:
+                        ids[ins[1]].flags |= SPV_ID_NON_READABLE;
+                        break;
+                    case SPV_DECORATION_LOCATION:
+                        ids[ins[1]].flags |= SPV_ID_LOCATION;
+                        ids[ins[1]].location = ins[3];
+                        break;
+                    case SPV_DECORATION_BINDING:
+                        ids[ins[1]].binding = ins[3];
+                        break;
+                    case SPV_DECORATION_SET:
+                        ids[ins[1]].set = ins[3];
+                        break;
+                }
+                break;
+            case SPV_OP_MEMBER_DECORATE:
+                // glslang puts readonly and writeonly of a buffer on every member.
+                ids[ins[1]].numNonWritableMembers += ( ins[3] == SPV_DECORATION_NON_WRITABLE );
+                ids[ins[1]].numNonReadableMembers += ( ins[3] == SPV_DECORATION_NON_READABLE );
+                break;
+            case SPV_OP_TYPE_INT:
+            case SPV_OP_TYPE_FLOAT:
+            case SPV_OP_TYPE_VECTOR:
+            case SPV_OP_TYPE_MATRIX:
+            case SPV_OP_TYPE_IMAGE:
+            case SPV_OP_TYPE_SAMPLER:
+            case SPV_OP_TYPE_SAMPLED_IMAGE:
+            case SPV_OP_TYPE_ARRAY:
+            case SPV_OP_TYPE_RUNTIME_ARRAY:
+            case SPV_OP_TYPE_STRUCT:
+            case SPV_OP_TYPE_POINTER:
+                ids[ins[1]].definition = offset;
+                break;
+            case SPV_OP_VARIABLE:
+                ids[ins[2]].definition = offset;
+                break;
+        }
+    }
+
+    for ( uint32_t id = 0; id < bound; id++ )
+    {
+        if ( ids[id].definition == 0 || ( code[ids[id].definition] & 0xFFFF ) != SPV_OP_VARIABLE )
+        {
+            continue;
+        }
+        const uint32_t* variable     = code + ids[id].definition;
+        const uint32_t  storageClass = variable[3];
+        const uint32_t* pointer      = code + ids[variable[1]].definition;
+        const uint32_t  typeId       = pointer[3];
+        const uint32_t* type         = code + ids[typeId].definition;
+        const uint32_t  typeOp       = type[0] & 0xFFFF;
+
+        if ( storageClass == SPV_STORAGE_INPUT )
+        {
+            if ( shader->stage == VK_SHADER_STAGE_VERTEX_BIT &&
+                 ( ids[id].flags & SPV_ID_LOCATION ) != 0 &&
+                 ( ids[id].flags & SPV_ID_BUILT_IN ) == 0 )
+            {
+                const int locationCount = GetLocationCount( code, ids, typeId );
+                this->vertexInputMask |= ( ( 1u << locationCount ) - 1 ) << ids[id].location;
+            }
+            continue;
+        }
+
+        if ( storageClass == SPV_STORAGE_PUSH_CONSTANT )
+        {
+            // Every member of the block is a parm at its declared offset.
+            const uint32_t numMembers = ( type[0] >> 16 ) - 2;
+            for ( uint32_t member = 0; member < numMembers; member++ )
+            {
+                int         memberOffset = -1;
+                const char* memberName   = "";
+                for ( uint32_t offset = 5; offset < numWords; offset += code[offset] >> 16 )
+                {
+                    const uint32_t* ins = code + offset;
+                    const uint32_t  op  = ins[0] & 0xFFFF;
+                    if ( ( op != SPV_OP_MEMBER_NAME && op != SPV_OP_MEMBER_DECORATE ) ||
+                         ins[1] != typeId || ins[2] != member )
+                    {
+                        continue;
+                    }
+                    if ( op == SPV_OP_MEMBER_NAME )
+                    {
+                        memberName = reinterpret_cast<const char*>( &ins[3] );
+                    }
+                    else if ( ins[3] == SPV_DECORATION_OFFSET )
+                    {
+                        memberOffset = (int)ins[4];
+                    }
+                }
+
+                const GpuProgramParmType parmType =
+                    GetPushConstantType( code, ids, type[2 + member] );
+                assert( parmType != GPU_PROGRAM_PARM_TYPE_MAX && memberOffset >= 0 );
+
+                int i = 0;
+                for ( ; i < this->numParms; i++ )
+                {
+                    if ( !GpuProgramParm::IsOpaqueBinding( this->parms[i].type ) &&
+                         this->parms[i].binding == memberOffset )
+                    {
+                        break;
+                    }
+                }
+                if ( i == this->numParms )
+                {
+                    assert( this->numParms < MAX_PROGRAM_PARMS );
+                    this->numParms++;
+                    this->parms[i].stageFlags = 0;
+                    this->parms[i].type       = parmType;
+                    this->parms[i].access     = GPU_PROGRAM_PARM_ACCESS_READ_ONLY;
+                    this->parms[i].binding    = memberOffset;
+                    strncpy( this->names[i], memberName, MAX_REFLECTED_NAME_LENGTH - 1 );
+                    this->names[i][MAX_REFLECTED_NAME_LENGTH - 1] = '\0';
+                }
+                assert( this->parms[i].type == parmType );
+                this->parms[i].stageFlags |= stageFlag;
+            }
+            continue;
+        }
+
+        if ( ( storageClass != SPV_STORAGE_UNIFORM_CONSTANT &&
+               storageClass != SPV_STORAGE_UNIFORM &&
+               storageClass != SPV_STORAGE_STORAGE_BUFFER ) ||
+             ids[id].set != 0 )
+        {
+            continue;
+        }
+
+        // A GpuProgramParm is a single descriptor.
+        assert( typeOp != SPV_OP_TYPE_ARRAY && typeOp != SPV_OP_TYPE_RUNTIME_ARRAY );
+
+        GpuProgramParmType parmType = GPU_PROGRAM_PARM_TYPE_MAX;
+        uint32_t           nameId   = id;
+        uint32_t           access   = ids[id].flags;
+        if ( typeOp == SPV_OP_TYPE_SAMPLED_IMAGE )
+        {
+            parmType = GPU_PROGRAM_PARM_TYPE_TEXTURE_SAMPLED;
+        }
+        else if ( typeOp == SPV_OP_TYPE_IMAGE && type[7] == 2 )
+        {
+            parmType = GPU_PROGRAM_PARM_TYPE_TEXTURE_STORAGE;
+        }
+        else if ( typeOp == SPV_OP_TYPE_STRUCT )
+        {
+            // Blocks are named by their type, the variable is often anonymous.
+            const bool     storage    = storageClass == SPV_STORAGE_STORAGE_BUFFER ||
+                                     ( ids[typeId].flags & SPV_ID_BUFFER_BLOCK ) != 0;
+            const uint32_t numMembers = ( type[0] >> 16 ) - 2;
+            parmType = storage ? GPU_PROGRAM_PARM_TYPE_BUFFER_STORAGE
+                               : GPU_PROGRAM_PARM_TYPE_BUFFER_UNIFORM;
+            nameId   = typeId;
+            access |= ( ids[typeId].numNonWritableMembers == numMembers ) ? SPV_ID_NON_WRITABLE : 0;
+            access |= ( ids[typeId].numNonReadableMembers == numMembers ) ? SPV_ID_NON_READABLE : 0;
+        }
+        assert( parmType != GPU_PROGRAM_PARM_TYPE_MAX );
+        if ( parmType == GPU_PROGRAM_PARM_TYPE_MAX )
+        {
+            continue;
+        }
+
+        int i = 0;
+        for ( ; i < this->numParms; i++ )
+        {
+            if ( GpuProgramParm::IsOpaqueBinding( this->parms[i].type ) &&
+                 this->parms[i].binding == (int)ids[id].binding )
+            {
+                break;
+            }
+        }
+        if ( i == this->numParms )
+        {
+            assert( this->numParms < MAX_PROGRAM_PARMS );
+            this->numParms++;
+            this->parms[i].stageFlags = 0;
+            this->parms[i].type       = parmType;
+            this->parms[i].access     = GPU_PROGRAM_PARM_ACCESS_READ_WRITE;
+            if ( parmType == GPU_PROGRAM_PARM_TYPE_TEXTURE_SAMPLED ||
+                 parmType == GPU_PROGRAM_PARM_TYPE_BUFFER_UNIFORM ||
+                 ( access & SPV_ID_NON_WRITABLE ) != 0 )
+            {
+                this->parms[i].access = GPU_PROGRAM_PARM_ACCESS_READ_ONLY;
+            }
+            else if ( ( access & SPV_ID_NON_READABLE ) != 0 )
+            {
+                this->parms[i].access = GPU_PROGRAM_PARM_ACCESS_WRITE_ONLY;
+            }
+            this->parms[i].binding = (int)ids[id].binding;
+            const char* name =
+                ( ids[nameId].name != 0 )
+                    ? reinterpret_cast<const char*>( &code[ids[nameId].name + 2] )
+                    : "";
+            strncpy( this->names[i], name, MAX_REFLECTED_NAME_LENGTH - 1 );
+            this->names[i][MAX_REFLECTED_NAME_LENGTH - 1] = '\0';
+        }
+        assert( this->parms[i].type == parmType );
+        this->parms[i].stageFlags |= stageFlag;
+    }
+
+    free( ids );
+
+    // Canonical order: descriptors by binding, then push constants by offset.
+    for ( int i = 1; i < this->numParms; i++ )
+    {
+        const GpuProgramParm parm = this->parms[i];
+        char                 name[MAX_REFLECTED_NAME_LENGTH];
+        memcpy( name, this->names[i], sizeof( name ) );
+
+        const bool opaque = GpuProgramParm::IsOpaqueBinding( parm.type );
+        int        j      = i;
+        for ( ; j > 0; j-- )
+        {
+            const bool prevOpaque = GpuProgramParm::IsOpaqueBinding( this->parms[j - 1].type );
+            if ( ( prevOpaque && !opaque ) ||
+                 ( prevOpaque == opaque && this->parms[j - 1].binding < parm.binding ) )
+            {
+                break;
+            }
+            this->parms[j] = this->parms[j - 1];
+            memcpy( this->names[j], this->names[j - 1], sizeof( name ) );
+        }
+        this->parms[j] = parm;
+        memcpy( this->names[j], name, sizeof( name ) );
+    }
+    for ( int i = 0; i < this->numParms; i++ )
+    {
+        this->parms[i].index = i;
+        this->parms[i].name  = this->names[i];
+    }
+}
+
+int GpuProgramReflection::FindParm( const char* name ) const
+{
+    for ( int i = 0; i < this->numParms; i++ )
+    {
+        if ( strcmp( this->names[i], name ) == 0 )
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+} // namespace lxd
@@ -0,0 +1,708 @@
+#include "GpuStateTracker.hpp"
+#include "GpuBuffer.hpp"
+#include "GpuContext.hpp"
+#include "GpuDevice.hpp"
+#include "GpuTexture.hpp"
+#include "GpuTimeline.hpp"
+
+#include <algorithm>
+
+namespace lxd
+{
+
+GpuSubresourceState GpuSubresourceState::Undefined()
+{
+    GpuSubresourceState state;
+    state.layout          = VK_IMAGE_LAYOUT_UNDEFINED;
+    state.writeStages     = 0;
+    state.writeAccess     = 0;
+    state.readStages      = 0;
+    state.readAccess      = 0;
+    state.pendingTracker  = nullptr;
+    state.pendingFlush    = 0;
+    state.timelineSerial  = 0;
+    state.recordingTicket = 0;
+    return state;
+}
+
+GpuSubresourceState GpuSubresourceState::Unknown( const VkImageLayout layout )
+{
+    GpuSubresourceState state;
+    state.layout          = layout;
+    state.writeStages     = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    state.writeAccess     = VK_ACCESS_MEMORY_WRITE_BIT;
+    state.readStages      = 0;
+    state.readAccess      = 0;
+    state.pendingTracker  = nullptr;
+    state.pendingFlush    = 0;
+    state.timelineSerial  = 0;
+    state.recordingTicket = 0;
+    return state;
+}
+
+bool GpuSubresourceState::Access( const VkPipelineStageFlags stageMask,
+                                  const VkAccessFlags accessMask, const VkImageLayout newLayout,
+                                  VkPipelineStageFlags* srcStages, VkAccessFlags* srcAccess )
+{
+    const bool write = ( accessMask & GPU_WRITE_ACCESS_MASK ) != 0;
+
+    if ( write || newLayout != this->layout )
+    {
+        // Writes and layout transitions wait for all previous accesses, but reads only need an
+        // execution dependency.
+        *srcStages = this->writeStages | this->readStages;
+        *srcAccess = this->writeAccess;
+
+        // A layout transition is a write that later reads in other stages have to wait for.
+        this->layout      = newLayout;
+        this->writeStages = stageMask;
+        this->writeAccess = accessMask & GPU_WRITE_ACCESS_MASK;
+        this->readStages  = write ? 0 : stageMask;
+        this->readAccess  = write ? 0 : accessMask;
+        return true;
+    }
+
+    const bool visible = this->writeStages == 0 || ( ( stageMask & ~this->readStages ) == 0 &&
+                                                     ( accessMask & ~this->readAccess ) == 0 );
+    this->readStages |= stageMask;
+    this->readAccess |= accessMask;
+    if ( visible )
+    {
+        return false;
+    }
+
+    *srcStages = this->writeStages;
+    *srcAccess = this->writeAccess;
+    return true;
+}
+
+static bool SameState( const GpuSubresourceState* a, const GpuSubresourceState* b )
+{
+    return a->layout == b->layout && a->writeStages == b->writeStages &&
+           a->writeAccess == b->writeAccess && a->readStages == b->readStages &&
+           a->readAccess == b->readAccess && a->pendingTracker == b->pendingTracker &&
+           a->pendingFlush == b->pendingFlush;
+}
+
+static VkImageAspectFlags AspectForFormat( const VkFormat format )
+{
+    switch ( format )
+    {
+        case VK_FORMAT_D16_UNORM:
+        case VK_FORMAT_X8_D24_UNORM_PACK32:
+        case VK_FORMAT_D32_SFLOAT:
+            return VK_IMAGE_ASPECT_DEPTH_BIT;
+        case VK_FORMAT_D16_UNORM_S8_UINT:
+        case VK_FORMAT_D24_UNORM_S8_UINT:
+        case VK_FORMAT_D32_SFLOAT_S8_UINT:
+            return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+        default:
+            return VK_IMAGE_ASPECT_COLOR_BIT;
+    }
+}
+
+GpuStateTracker::GpuStateTracker( GpuContext* context ) : context( *context )
+{
+    const VkQueueFlags queueFlags =
+        context->device->queueFamilyProperties[context->queueFamilyIndex].queueFlags;
+    if ( ( queueFlags & VK_QUEUE_GRAPHICS_BIT ) != 0 )
+    {
+        this->supportedStages = ~(VkPipelineStageFlags)0;
+    }
+    else
+    {
+        this->supportedStages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT |
+                                VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT |
+                                VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_HOST_BIT |
+                                VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+        if ( ( queueFlags & VK_QUEUE_COMPUTE_BIT ) != 0 )
+        {
+            this->supportedStages |=
+                VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        }
+    }
+}
+
+GpuStateTracker::~GpuStateTracker()
+{
+    assert( this->numPending == 0 );
+    free( this->pending );
+    free( this->imageBarriers );
+    free( this->bufferBarriers );
+}
+
+void GpuStateTracker::Begin( VkCommandBuffer cmdBuffer, const uint64_t recordingTicket )
+{
+    assert( this->numPending == 0 );
+    this->cmdBuffer       = cmdBuffer;
+    this->recordingTicket = recordingTicket;
+}
+
+GpuStateTracker::PendingBarrier* GpuStateTracker::AddPending()
+{
+    if ( this->numPending == this->maxPending )
+    {
+        this->maxPending = ( this->maxPending == 0 ) ? 16 : this->maxPending * 2;
+        this->pending    = static_cast<PendingBarrier*>(
+            realloc( this->pending, this->maxPending * sizeof( PendingBarrier ) ) );
+        // Room for the Vulkan barriers of either flavor, filled in by Flush().
+        const size_t imageSize =
+            std::max( sizeof( VkImageMemoryBarrier ), sizeof( VkImageMemoryBarrier2KHR ) );
+        const size_t bufferSize =
+            std::max( sizeof( VkBufferMemoryBarrier ), sizeof( VkBufferMemoryBarrier2KHR ) );
+        this->imageBarriers  = realloc( this->imageBarriers, this->maxPending * imageSize );
+        this->bufferBarriers = realloc( this->bufferBarriers, this->maxPending * bufferSize );
+    }
+    return &this->pending[this->numPending++];
+}
+
+// Grows 'a' to also cover 'b' if both barriers are the same and 'b' directly follows 'a'.
+bool GpuStateTracker::MergePending( PendingBarrier* a, const PendingBarrier* b )
+{
+    if ( a->image != b->image || a->buffer != b->buffer || a->srcStages != b->srcStages ||
+         a->srcAccess != b->srcAccess || a->dstStages != b->dstStages ||
+         a->dstAccess != b->dstAccess || a->oldLayout != b->oldLayout ||
+         a->newLayout != b->newLayout || a->srcQueueFamily != b->srcQueueFamily ||
+         a->dstQueueFamily != b->dstQueueFamily )
+    {
+        return false;
+    }
+    if ( a->buffer != VK_NULL_HANDLE )
+    {
+        if ( a->offset + a->size != b->offset )
+        {
+            return false;
+        }
+        a->size += b->size;
+        return true;
+    }
+    if ( a->range.aspectMask != b->range.aspectMask )
+    {
+        return false;
+    }
+    if ( a->range.baseMipLevel == b->range.baseMipLevel &&
+         a->range.levelCount == b->range.levelCount &&
+         a->range.baseArrayLayer + a->range.layerCount == b->range.baseArrayLayer )
+    {
+        a->range.layerCount += b->range.layerCount;
+        return true;
+    }
+    if ( a->range.baseArrayLayer == b->range.baseArrayLayer &&
+         a->range.layerCount == b->range.layerCount &&
+         a->range.baseMipLevel + a->range.levelCount == b->range.baseMipLevel )
+    {
+        a->range.levelCount += b->range.levelCount;
+        return true;
+    }
+    return false;
+}
+
+bool GpuStateTracker::AccessState( GpuSubresourceState* state, const VkPipelineStageFlags stageMask,
+                                   const VkAccessFlags accessMask, const VkImageLayout layout,
+                                   const OwnershipTransfer* transfer, PendingBarrier* barrier )
+{
+    // Barriers in a single batch are not ordered, so a second transition of the same state has
+    // to wait for the first one to be recorded.
+    if ( state->pendingTracker == this && state->pendingFlush == this->flushCount )
+    {
+        Flush();
+    }
+
+    // The state moves in recording order, see the class comment.
+    GpuTimeline* timeline = context.timeline;
+    assert( state->recordingTicket == 0 || state->recordingTicket == this->recordingTicket ||
+            state->timelineSerial != timeline->serial ||
+            !timeline->IsRecording( state->recordingTicket ) );
+    state->timelineSerial  = timeline->serial;
+    state->recordingTicket = this->recordingTicket;
+
+    barrier->oldLayout      = state->layout;
+    barrier->srcQueueFamily = VK_QUEUE_FAMILY_IGNORED;
+    barrier->dstQueueFamily = VK_QUEUE_FAMILY_IGNORED;
+
+    if ( transfer != nullptr )
+    {
+        // Both halves use the same layouts. The release waits for everything that came before
+        // it, and leaves the state as if the resource was never accessed on the other queue,
+        // except for the layout that the acquire transitions from.
+        barrier->srcQueueFamily = transfer->srcQueueFamily;
+        barrier->dstQueueFamily = transfer->dstQueueFamily;
+        barrier->newLayout      = layout;
+        if ( transfer->release )
+        {
+            barrier->srcStages = state->writeStages | state->readStages;
+            barrier->srcAccess = state->writeAccess;
+            barrier->dstStages = 0;
+            barrier->dstAccess = 0;
+
+            const GpuSubresourceState oldState = *state;
+            *state                 = GpuSubresourceState::Undefined();
+            state->layout          = oldState.layout;
+            state->timelineSerial  = oldState.timelineSerial;
+            state->recordingTicket = oldState.recordingTicket;
+        }
+        else
+        {
+            // The acquire makes the contents visible to 'stageMask', later accesses in other
+            // stages wait for it like for a write.
+            barrier->srcStages = 0;
+            barrier->srcAccess = 0;
+            barrier->dstStages = stageMask;
+            barrier->dstAccess = accessMask;
+
+            state->layout      = layout;
+            state->writeStages = stageMask;
+            state->writeAccess = 0;
+            state->readStages  = stageMask;
+            state->readAccess  = accessMask;
+        }
+        state->pendingTracker = this;
+        state->pendingFlush   = this->flushCount;
+        return true;
+    }
+
+    if ( !state->Access( stageMask, accessMask, layout, &barrier->srcStages,
+                         &barrier->srcAccess ) )
+    {
+        return false;
+    }
+    barrier->dstStages    = stageMask;
+    barrier->dstAccess    = accessMask;
+    barrier->newLayout    = layout;
+    state->pendingTracker = this;
+    state->pendingFlush   = this->flushCount;
+    return true;
+}
+
+void GpuStateTracker::ImageAccess( const VkImage image, GpuSubresourceState* states,
+                                   const int mipCount, const int layerCount,
+                                   const VkImageSubresourceRange* range,
+                                   const VkPipelineStageFlags stageMask,
+                                   const VkAccessFlags accessMask, const VkImageLayout layout )
+{
+    ImageAccessInternal( image, states, mipCount, layerCount, range, stageMask, accessMask, layout,
+                         nullptr );
+}
+
+void GpuStateTracker::ImageAccessInternal( const VkImage image, GpuSubresourceState* states,
+                                           const int mipCount, const int layerCount,
+                                           const VkImageSubresourceRange* range,
+                                           const VkPipelineStageFlags     stageMask,
+                                           const VkAccessFlags accessMask,
+                                           const VkImageLayout layout,
+                                           const OwnershipTransfer* transfer )
+{
+    const int baseMip    = (int)range->baseMipLevel;
+    const int baseLayer  = (int)range->baseArrayLayer;
+    const int levelCount = ( range->levelCount == VK_REMAINING_MIP_LEVELS )
+                               ? mipCount - baseMip
+                               : (int)range->levelCount;
+    const int rangeLayerCount = ( range->layerCount == VK_REMAINING_ARRAY_LAYERS )
+                                    ? layerCount - baseLayer
+                                    : (int)range->layerCount;
+    assert( baseMip + levelCount <= mipCount );
+    assert( baseLayer + rangeLayerCount <= layerCount );
+
+    for ( int mip = baseMip; mip < baseMip + levelCount; mip++ )
+    {
+        for ( int layer = baseLayer; layer < baseLayer + rangeLayerCount; layer++ )
+        {
+            PendingBarrier barrier;
+            if ( !AccessState( &states[mip * layerCount + layer], stageMask, accessMask, layout,
+                               transfer, &barrier ) )
+            {
+                continue;
+            }
+            barrier.image                = image;
+            barrier.buffer               = VK_NULL_HANDLE;
+            barrier.range.aspectMask     = range->aspectMask;
+            barrier.range.baseMipLevel   = mip;
+            barrier.range.levelCount     = 1;
+            barrier.range.baseArrayLayer = layer;
+            barrier.range.layerCount     = 1;
+            barrier.offset               = 0;
+            barrier.size                 = 0;
+            if ( this->numPending == 0 ||
+                 !MergePending( &this->pending[this->numPending - 1], &barrier ) )
+            {
+                *AddPending() = barrier;
+            }
+        }
+        // Fold the barrier of this mip level into the previous level if it covers the same layers.
+        if ( this->numPending >= 2 && MergePending( &this->pending[this->numPending - 2],
+                                                    &this->pending[this->numPending - 1] ) )
+        {
+            this->numPending--;
+        }
+    }
+}
+
+void GpuStateTracker::TextureAccess( GpuTexture* texture, const VkImageSubresourceRange* range,
+                                     const VkPipelineStageFlags stageMask,
+                                     const VkAccessFlags accessMask, const VkImageLayout layout )
+{
+    TextureAccessInternal( texture, range, stageMask, accessMask, layout, nullptr );
+}
+
+void GpuStateTracker::TextureAccessInternal( GpuTexture*                    texture,
+                                             const VkImageSubresourceRange* range,
+                                             const VkPipelineStageFlags     stageMask,
+                                             const VkAccessFlags            accessMask,
+                                             const VkImageLayout            layout,
+                                             const OwnershipTransfer*       transfer )
+{
+    const int mipCount   = std::max( texture->mipCount, 1 );
+    const int layerCount = std::max( texture->layerCount, 1 );
+
+    if ( texture->subresourceStates == nullptr )
+    {
+        texture->subresourceStates = static_cast<GpuSubresourceState*>(
+            malloc( mipCount * layerCount * sizeof( GpuSubresourceState ) ) );
+        for ( int i = 0; i < mipCount * layerCount; i++ )
+        {
+            texture->subresourceStates[i] =
+                ( texture->imageLayout == VK_IMAGE_LAYOUT_UNDEFINED )
+                    ? GpuSubresourceState::Undefined()
+                    : GpuSubresourceState::Unknown( texture->imageLayout );
+        }
+    }
+
+    ImageAccessInternal( texture->image, texture->subresourceStates, mipCount, layerCount, range,
+                         stageMask, accessMask, layout, transfer );
+
+    // The layout only changes with the acquire of an ownership transfer.
+    if ( transfer != nullptr && transfer->release )
+    {
+        return;
+    }
+
+    // Keep the texture wide layout for code that does not look at subresources.
+    const bool allMips   = range->baseMipLevel == 0 &&
+                         ( range->levelCount == VK_REMAINING_MIP_LEVELS ||
+                           (int)range->levelCount == mipCount );
+    const bool allLayers = range->baseArrayLayer == 0 &&
+                           ( range->layerCount == VK_REMAINING_ARRAY_LAYERS ||
+                             (int)range->layerCount == layerCount );
+    if ( allMips && allLayers )
+    {
+        texture->imageLayout = layout;
+        texture->usage       = TextureUsageForLayout( layout );
+    }
+}
+
+void GpuStateTracker::TextureAccess( GpuTexture* texture, const VkPipelineStageFlags stageMask,
+                                     const VkAccessFlags accessMask, const VkImageLayout layout )
+{
+    VkImageSubresourceRange range;
+    range.aspectMask     = AspectForFormat( texture->format );
+    range.baseMipLevel   = 0;
+    range.levelCount     = VK_REMAINING_MIP_LEVELS;
+    range.baseArrayLayer = 0;
+    range.layerCount     = VK_REMAINING_ARRAY_LAYERS;
+
+    TextureAccess( texture, &range, stageMask, accessMask, layout );
+}
+
+static void SplitBufferRange( GpuBuffer* buffer, const VkDeviceSize offset )
+{
+    for ( int i = 0; i < buffer->numRangeStates; i++ )
+    {
+        GpuBufferRangeState* range = &buffer->rangeStates[i];
+        if ( offset <= range->offset || offset >= range->offset + range->size )
+        {
+            continue;
+        }
+        if ( buffer->numRangeStates == buffer->maxRangeStates )
+        {
+            buffer->maxRangeStates *= 2;
+            buffer->rangeStates = static_cast<GpuBufferRangeState*>( realloc(
+                buffer->rangeStates, buffer->maxRangeStates * sizeof( GpuBufferRangeState ) ) );
+            range = &buffer->rangeStates[i];
+        }
+        memmove( range + 1, range, ( buffer->numRangeStates - i ) * sizeof( GpuBufferRangeState ) );
+        buffer->numRangeStates++;
+
+        range[1].offset = offset;
+        range[1].size   = range[0].offset + range[0].size - offset;
+        range[0].size   = offset - range[0].offset;
+        return;
+    }
+}
+
+void GpuStateTracker::BufferAccess( GpuBuffer* buffer, const VkDeviceSize offset,
+                                    const VkDeviceSize size, const VkPipelineStageFlags stageMask,
+                                    const VkAccessFlags accessMask )
+{
+    BufferAccessInternal( buffer, offset, size, stageMask, accessMask, nullptr );
+}
+
+void GpuStateTracker::BufferAccessInternal( GpuBuffer* buffer, const VkDeviceSize offset,
+                                            const VkDeviceSize         size,
+                                            const VkPipelineStageFlags stageMask,
+                                            const VkAccessFlags        accessMask,
+                                            const OwnershipTransfer*   transfer )
+{
+    const VkDeviceSize accessSize = ( size == VK_WHOLE_SIZE ) ? buffer->size - offset : size;
+    assert( offset + accessSize <= buffer->size );
+
+    if ( buffer->rangeStates == nullptr )
+    {
+        buffer->maxRangeStates = 4;
+        buffer->numRangeStates = 1;
+        buffer->rangeStates    = static_cast<GpuBufferRangeState*>(
+            malloc( buffer->maxRangeStates * sizeof( GpuBufferRangeState ) ) );
+        buffer->rangeStates[0].offset = 0;
+        buffer->rangeStates[0].size   = buffer->size;
+        buffer->rangeStates[0].state  = GpuSubresourceState::Unknown( VK_IMAGE_LAYOUT_UNDEFINED );
+    }
+
+    SplitBufferRange( buffer, offset );
+    SplitBufferRange( buffer, offset + accessSize );
+
+    for ( int i = 0; i < buffer->numRangeStates; i++ )
+    {
+        GpuBufferRangeState* range = &buffer->rangeStates[i];
+        if ( range->offset < offset || range->offset + range->size > offset + accessSize )
+        {
+            continue;
+        }
+        PendingBarrier barrier;
+        if ( !AccessState( &range->state, stageMask, accessMask, VK_IMAGE_LAYOUT_UNDEFINED,
+                           transfer, &barrier ) )
+        {
+            continue;
+        }
+        barrier.image  = VK_NULL_HANDLE;
+        barrier.buffer = buffer->buffer;
+        memset( &barrier.range, 0, sizeof( barrier.range ) );
+        barrier.offset = range->offset;
+        barrier.size   = range->size;
+        if ( this->numPending == 0 ||
+             !MergePending( &this->pending[this->numPending - 1], &barrier ) )
+        {
+            *AddPending() = barrier;
+        }
+    }
+
+    // Join neighbouring ranges that ended up in the same state.
+    int numRanges = 1;
+    for ( int i = 1; i < buffer->numRangeStates; i++ )
+    {
+        GpuBufferRangeState* last = &buffer->rangeStates[numRanges - 1];
+        if ( SameState( &last->state, &buffer->rangeStates[i].state ) )
+        {
+            last->size += buffer->rangeStates[i].size;
+        }
+        else
+        {
+            buffer->rangeStates[numRanges++] = buffer->rangeStates[i];
+        }
+    }
+    buffer->numRangeStates = numRanges;
+}
+
+void GpuStateTracker::ReleaseTexture( GpuTexture* texture, const uint32_t dstQueueFamily,
+                                      const VkImageLayout layout )
+{
+    if ( dstQueueFamily == context.queueFamilyIndex || dstQueueFamily == VK_QUEUE_FAMILY_IGNORED )
+    {
+        return;
+    }
+
+    VkImageSubresourceRange range;
+    range.aspectMask     = AspectForFormat( texture->format );
+    range.baseMipLevel   = 0;
+    range.levelCount     = VK_REMAINING_MIP_LEVELS;
+    range.baseArrayLayer = 0;
+    range.layerCount     = VK_REMAINING_ARRAY_LAYERS;
+
+    const OwnershipTransfer transfer = { context.queueFamilyIndex, dstQueueFamily, true };
+    TextureAccessInternal( texture, &range, 0, 0, layout, &transfer );
+}
+
+void GpuStateTracker::AcquireTexture( GpuTexture* texture, const uint32_t srcQueueFamily,
+                                      const VkPipelineStageFlags stageMask,
+                                      const VkAccessFlags accessMask, const VkImageLayout layout )
+{
+    if ( srcQueueFamily == context.queueFamilyIndex || srcQueueFamily == VK_QUEUE_FAMILY_IGNORED )
+    {
+        TextureAccess( texture, stageMask, accessMask, layout );
+        return;
+    }
+
+    VkImageSubresourceRange range;
+    range.aspectMask     = AspectForFormat( texture->format );
+    range.baseMipLevel   = 0;
+    range.levelCount     = VK_REMAINING_MIP_LEVELS;
+    range.baseArrayLayer = 0;
+    range.layerCount     = VK_REMAINING_ARRAY_LAYERS;
+
+    const OwnershipTransfer transfer = { srcQueueFamily, context.queueFamilyIndex, false };
+    TextureAccessInternal( texture, &range, stageMask, accessMask, layout, &transfer );
+}
+
+void GpuStateTracker::ReleaseBuffer( GpuBuffer* buffer, const uint32_t dstQueueFamily )
+{
+    if ( dstQueueFamily == context.queueFamilyIndex || dstQueueFamily == VK_QUEUE_FAMILY_IGNORED )
+    {
+        return;
+    }
+
+    const OwnershipTransfer transfer = { context.queueFamilyIndex, dstQueueFamily, true };
+    BufferAccessInternal( buffer, 0, VK_WHOLE_SIZE, 0, 0, &transfer );
+}
+
+void GpuStateTracker::AcquireBuffer( GpuBuffer* buffer, const uint32_t srcQueueFamily,
+                                     const VkPipelineStageFlags stageMask,
+                                     const VkAccessFlags        accessMask )
+{
+    if ( srcQueueFamily == context.queueFamilyIndex || srcQueueFamily == VK_QUEUE_FAMILY_IGNORED )
+    {
+        BufferAccess( buffer, 0, VK_WHOLE_SIZE, stageMask, accessMask );
+        return;
+    }
+
+    const OwnershipTransfer transfer = { srcQueueFamily, context.queueFamilyIndex, false };
+    BufferAccessInternal( buffer, 0, VK_WHOLE_SIZE, stageMask, accessMask, &transfer );
+}
+
+void GpuStateTracker::Flush()
+{
+    if ( this->numPending == 0 )
+    {
+        return;
+    }
+    assert( this->cmdBuffer != VK_NULL_HANDLE );
+
+    GpuDevice* device            = context.device;
+    int        numImageBarriers  = 0;
+    int        numBufferBarriers = 0;
+
+    if ( device->supportsSynchronization2 )
+    {
+        VkImageMemoryBarrier2KHR* imageBarriers =
+            static_cast<VkImageMemoryBarrier2KHR*>( this->imageBarriers );
+        VkBufferMemoryBarrier2KHR* bufferBarriers =
+            static_cast<VkBufferMemoryBarrier2KHR*>( this->bufferBarriers );
+
+        for ( int i = 0; i < this->numPending; i++ )
+        {
+            const PendingBarrier*      p         = &this->pending[i];
+            const VkPipelineStageFlags srcStages = p->srcStages & this->supportedStages;
+            const VkPipelineStageFlags dstStages = p->dstStages & this->supportedStages;
+            const VkAccessFlags        srcAccess = ( srcStages != 0 ) ? p->srcAccess : 0;
+            const VkAccessFlags        dstAccess = ( dstStages != 0 ) ? p->dstAccess : 0;
+            if ( p->image != VK_NULL_HANDLE )
+            {
+                VkImageMemoryBarrier2KHR* b = &imageBarriers[numImageBarriers++];
+                b->sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2_KHR;
+                b->pNext               = nullptr;
+                b->srcStageMask        = srcStages;
+                b->srcAccessMask       = srcAccess;
+                b->dstStageMask        = dstStages;
+                b->dstAccessMask       = dstAccess;
+                b->oldLayout           = p->oldLayout;
+                b->newLayout           = p->newLayout;
+                b->srcQueueFamilyIndex = p->srcQueueFamily;
+                b->dstQueueFamilyIndex = p->dstQueueFamily;
+                b->image               = p->image;
+                b->subresourceRange    = p->range;
+            }
+            else
+            {
+                VkBufferMemoryBarrier2KHR* b = &bufferBarriers[numBufferBarriers++];
+                b->sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2_KHR;
+                b->pNext               = nullptr;
+                b->srcStageMask        = srcStages;
+                b->srcAccessMask       = srcAccess;
+                b->dstStageMask        = dstStages;
+                b->dstAccessMask       = dstAccess;
+                b->srcQueueFamilyIndex = p->srcQueueFamily;
+                b->dstQueueFamilyIndex = p->dstQueueFamily;
+                b->buffer              = p->buffer;
+                b->offset              = p->offset;
+                b->size                = p->size;
+            }
+        }
+
+        VkDependencyInfoKHR dependencyInfo;
+        dependencyInfo.sType                    = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR;
+        dependencyInfo.pNext                    = nullptr;
+        dependencyInfo.dependencyFlags          = 0;
+        dependencyInfo.memoryBarrierCount       = 0;
+        dependencyInfo.pMemoryBarriers          = nullptr;
+        dependencyInfo.bufferMemoryBarrierCount = numBufferBarriers;
+        dependencyInfo.pBufferMemoryBarriers    = bufferBarriers;
+        dependencyInfo.imageMemoryBarrierCount  = numImageBarriers;
+        dependencyInfo.pImageMemoryBarriers     = imageBarriers;
+
+        VC( device->vkCmdPipelineBarrier2KHR( this->cmdBuffer, &dependencyInfo ) );
+    }
+    else
+    {
+        VkImageMemoryBarrier* imageBarriers =
+            static_cast<VkImageMemoryBarrier*>( this->imageBarriers );
+        VkBufferMemoryBarrier* bufferBarriers =
+            static_cast<VkBufferMemoryBarrier*>( this->bufferBarriers );
+        VkPipelineStageFlags src_stages = 0;
+        VkPipelineStageFlags dst_stages = 0;
+
+        for ( int i = 0; i < this->numPending; i++ )
+        {
+            const PendingBarrier*      p         = &this->pending[i];
+            const VkPipelineStageFlags srcStages = p->srcStages & this->supportedStages;
+            const VkPipelineStageFlags dstStages = p->dstStages & this->supportedStages;
+            const VkAccessFlags        srcAccess = ( srcStages != 0 ) ? p->srcAccess : 0;
+            const VkAccessFlags        dstAccess = ( dstStages != 0 ) ? p->dstAccess : 0;
+            src_stages |= srcStages;
+            dst_stages |= dstStages;
+            if ( p->image != VK_NULL_HANDLE )
+            {
+                VkImageMemoryBarrier* b = &imageBarriers[numImageBarriers++];
+                b->sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+                b->pNext               = nullptr;
+                b->srcAccessMask       = srcAccess;
+                b->dstAccessMask       = dstAccess;
+                b->oldLayout           = p->oldLayout;
+                b->newLayout           = p->newLayout;
+                b->srcQueueFamilyIndex = p->srcQueueFamily;
+                b->dstQueueFamilyIndex = p->dstQueueFamily;
+                b->image               = p->image;
+                b->subresourceRange    = p->range;
+            }
+            else
+            {
+                VkBufferMemoryBarrier* b = &bufferBarriers[numBufferBarriers++];
+                b->sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+                b->pNext               = nullptr;
+                b->srcAccessMask       = srcAccess;
+                b->dstAccessMask       = dstAccess;
+                b->srcQueueFamilyIndex = p->srcQueueFamily;
+                b->dstQueueFamilyIndex = p->dstQueueFamily;
+                b->buffer              = p->buffer;
+                b->offset              = p->offset;
+                b->size                = p->size;
+            }
+        }
+
+        // Without synchronization2 the stage masks cannot be empty.
+        if ( src_stages == 0 )
+        {
+            src_stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        }
+        if ( dst_stages == 0 )
+        {
+            dst_stages = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+        }
+        const VkDependencyFlags flags = 0;
+
+        VC( device->vkCmdPipelineBarrier( this->cmdBuffer, src_stages, dst_stages, flags, 0,
+                                          nullptr, numBufferBarriers, bufferBarriers,
+                                          numImageBarriers, imageBarriers ) );
+    }
+
+    this->numPending = 0;
+    this->flushCount++;
+}
+
+} // namespace lxd
@@ -0,0 +1,159 @@
+#include "GpuSubmitBatch.hpp"
+#include "GpuContext.hpp"
+#include "GpuSubmitQueue.hpp"
+#include "GpuTimeline.hpp"
+
+namespace lxd
+{
+
+GpuSubmitBatch::GpuSubmitBatch( GpuContext* context ) : context( *context ) {}
+
+GpuSubmitBatch::~GpuSubmitBatch()
+{
+    Flush();
+
+    free( this->entries );
+    free( this->commandBuffers );
+    free( this->waitSemaphores );
+    free( this->waitStages );
+    free( this->signalSemaphores );
+}
+
+void GpuSubmitBatch::Begin() { this->depth++; }
+
+uint64_t GpuSubmitBatch::End()
+{
+    assert( this->depth > 0 );
+    if ( --this->depth > 0 )
+    {
+        return context.timeline->PendingValue();
+    }
+    return Flush();
+}
+
+uint64_t GpuSubmitBatch::Submit( const VkSubmitInfo* submitInfo )
+{
+    assert( submitInfo->pNext == nullptr );
+
+    // The submit queue hands out the value of a submit when it is claimed, so submits that are
+    // held back here would end up with a later value than returned.
+    if ( context.submitQueue != nullptr )
+    {
+        return context.submitQueue->Submit( submitInfo );
+    }
+    if ( this->depth == 0 )
+    {
+        return context.timeline->Submit( submitInfo );
+    }
+
+    // Append to the previous submit if that does not change when the waits and signals happen.
+    Entry* entry = ( this->numEntries > 0 ) ? &this->entries[this->numEntries - 1] : nullptr;
+    if ( entry == nullptr || entry->numSignals > 0 || submitInfo->waitSemaphoreCount > 0 )
+    {
+        // A full batch is flushed early, the submits that follow get the next value.
+        if ( this->numEntries >= GPU_TIMELINE_MAX_SUBMITS )
+        {
+            Flush();
+        }
+        if ( this->numEntries >= this->maxEntries )
+        {
+            this->maxEntries = ( this->maxEntries > 0 ) ? this->maxEntries * 2 : 8;
+            this->entries    = static_cast<Entry*>(
+                realloc( this->entries, this->maxEntries * sizeof( Entry ) ) );
+        }
+        entry                     = &this->entries[this->numEntries++];
+        entry->firstCommandBuffer = this->numCommandBuffers;
+        entry->numCommandBuffers  = 0;
+        entry->firstWait          = this->numWaits;
+        entry->numWaits           = 0;
+        entry->firstSignal        = this->numSignals;
+        entry->numSignals         = 0;
+    }
+
+    if ( this->numCommandBuffers + (int)submitInfo->commandBufferCount > this->maxCommandBuffers )
+    {
+        while ( this->numCommandBuffers + (int)submitInfo->commandBufferCount >
+                this->maxCommandBuffers )
+        {
+            this->maxCommandBuffers =
+                ( this->maxCommandBuffers > 0 ) ? this->maxCommandBuffers * 2 : 16;
+        }
+        this->commandBuffers = static_cast<VkCommandBuffer*>(
+            realloc( this->commandBuffers, this->maxCommandBuffers * sizeof( VkCommandBuffer ) ) );
+    }
+    for ( uint32_t i = 0; i < submitInfo->commandBufferCount; i++ )
+    {
+        this->commandBuffers[this->numCommandBuffers++] = submitInfo->pCommandBuffers[i];
+    }
+    entry->numCommandBuffers += submitInfo->commandBufferCount;
+
+    if ( this->numWaits + (int)submitInfo->waitSemaphoreCount > this->maxWaits )
+    {
+        while ( this->numWaits + (int)submitInfo->waitSemaphoreCount > this->maxWaits )
+        {
+            this->maxWaits = ( this->maxWaits > 0 ) ? this->maxWaits * 2 : 4;
+        }
+        this->waitSemaphores = static_cast<VkSemaphore*>(
+            realloc( this->waitSemaphores, this->maxWaits * sizeof( VkSemaphore ) ) );
+        this->waitStages = static_cast<VkPipelineStageFlags*>(
+            realloc( this->waitStages, this->maxWaits * sizeof( VkPipelineStageFlags ) ) );
+    }
+    for ( uint32_t i = 0; i < submitInfo->waitSemaphoreCount; i++ )
+    {
+        this->waitSemaphores[this->numWaits] = submitInfo->pWaitSemaphores[i];
+        this->waitStages[this->numWaits]     = submitInfo->pWaitDstStageMask[i];
+        this->numWaits++;
+    }
+    entry->numWaits += submitInfo->waitSemaphoreCount;
+
+    if ( this->numSignals + (int)submitInfo->signalSemaphoreCount > this->maxSignals )
+    {
+        while ( this->numSignals + (int)submitInfo->signalSemaphoreCount > this->maxSignals )
+        {
+            this->maxSignals = ( this->maxSignals > 0 ) ? this->maxSignals * 2 : 4;
+        }
+        this->signalSemaphores = static_cast<VkSemaphore*>(
+            realloc( this->signalSemaphores, this->maxSignals * sizeof( VkSemaphore ) ) );
+    }
+    for ( uint32_t i = 0; i < submitInfo->signalSemaphoreCount; i++ )
+    {
+        this->signalSemaphores[this->numSignals++] = submitInfo->pSignalSemaphores[i];
+    }
+    entry->numSignals += submitInfo->signalSemaphoreCount;
+
+    return context.timeline->PendingValue();
+}
+
+uint64_t GpuSubmitBatch::Flush()
+{
+    if ( this->numEntries == 0 )
+    {
+        return context.timeline->PendingValue() - 1;
+    }
+
+    VkSubmitInfo submitInfos[GPU_TIMELINE_MAX_SUBMITS];
+    for ( int i = 0; i < this->numEntries; i++ )
+    {
+        const Entry*  entry      = &this->entries[i];
+        VkSubmitInfo* submitInfo = &submitInfos[i];
+        submitInfo->sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo->pNext                = nullptr;
+        submitInfo->waitSemaphoreCount   = entry->numWaits;
+        submitInfo->pWaitSemaphores      = this->waitSemaphores + entry->firstWait;
+        submitInfo->pWaitDstStageMask    = this->waitStages + entry->firstWait;
+        submitInfo->commandBufferCount   = entry->numCommandBuffers;
+        submitInfo->pCommandBuffers      = this->commandBuffers + entry->firstCommandBuffer;
+        submitInfo->signalSemaphoreCount = entry->numSignals;
+        submitInfo->pSignalSemaphores    = this->signalSemaphores + entry->firstSignal;
+    }
+
+    const uint64_t value = context.timeline->Submit( submitInfos, this->numEntries );
+
+    this->numEntries        = 0;
+    this->numCommandBuffers = 0;
+    this->numWaits          = 0;
+    this->numSignals        = 0;
+    return value;
+}
+
+} // namespace lxd
@@ -0,0 +1,185 @@
+#include "GpuSubmitQueue.hpp"
+#include "GpuContext.hpp"
+#include "GpuDevice.hpp"
+#include "GpuTimeline.hpp"
+
+namespace lxd
+{
+
+GpuSubmitQueue::GpuSubmitQueue( GpuContext* context ) : context( *context )
+{
+    assert( context->device->supportsTimelineSemaphores );
+    static_assert( ( GPU_SUBMIT_QUEUE_SIZE & ( GPU_SUBMIT_QUEUE_SIZE - 1 ) ) == 0,
+                   "GPU_SUBMIT_QUEUE_SIZE must be a power of two" );
+
+    this->baseValue = context->timeline->submittedValue.load();
+    for ( int i = 0; i < GPU_SUBMIT_QUEUE_SIZE; i++ )
+    {
+        this->cells[i].sequence.store( i, std::memory_order_relaxed );
+    }
+
+    ksSignal_Create( &this->wakeUpSignal, true );
+    ksSignal_Create( &this->spaceSignal, true );
+    if ( !ksThread_Create( &this->thread, "GpuSubmitQueue", ThreadFunction, this ) )
+    {
+        Error( "Failed to create the submit thread." );
+    }
+    // The thread function runs until the queue is destroyed.
+    ksThread_Submit( &this->thread, ThreadFunction, this );
+}
+
+GpuSubmitQueue::~GpuSubmitQueue()
+{
+    // The thread drains the ring before it looks at the flag.
+    this->terminate.store( true );
+    ksSignal_Raise( &this->wakeUpSignal );
+    ksThread_Join( &this->thread );
+    ksThread_Destroy( &this->thread );
+    ksSignal_Destroy( &this->wakeUpSignal );
+    ksSignal_Destroy( &this->spaceSignal );
+
+    assert( this->dequeuePos == this->enqueuePos.load() );
+}
+
+uint64_t GpuSubmitQueue::Submit( const VkSubmitInfo* submitInfo )
+{
+    assert( submitInfo->pNext == nullptr );
+    assert( submitInfo->commandBufferCount <= GPU_SUBMIT_MAX_COMMAND_BUFFERS );
+    assert( submitInfo->waitSemaphoreCount <= GPU_SUBMIT_MAX_BINARY_SEMAPHORES );
+    assert( submitInfo->signalSemaphoreCount <= GPU_SUBMIT_MAX_BINARY_SEMAPHORES );
+
+    // Claim the next free cell. A cell is free once its sequence caught up with the position,
+    // a smaller sequence means the ring is full and the thread has to submit first.
+    uint64_t pos = this->enqueuePos.load( std::memory_order_relaxed );
+    Cell*    cell;
+    for ( ;; )
+    {
+        cell                    = &this->cells[pos & ( GPU_SUBMIT_QUEUE_SIZE - 1 )];
+        const uint64_t sequence = cell->sequence.load( std::memory_order_acquire );
+        const int64_t  diff     = (int64_t)( sequence - pos );
+        if ( diff == 0 )
+        {
+            if ( this->enqueuePos.compare_exchange_weak( pos, pos + 1,
+                                                         std::memory_order_relaxed ) )
+            {
+                break;
+            }
+        }
+        else if ( diff < 0 )
+        {
+            // Announce the sleep before looking at the cell again, the thread raises the signal
+            // after it frees a cell while producers wait.
+            WakeUp();
+            this->numWaitingForSpace.fetch_add( 1 );
+            if ( (int64_t)( cell->sequence.load() - pos ) < 0 )
+            {
+                ksSignal_Wait( &this->spaceSignal, SIGNAL_TIMEOUT_INFINITE );
+            }
+            this->numWaitingForSpace.fetch_sub( 1 );
+            pos = this->enqueuePos.load( std::memory_order_relaxed );
+        }
+        else
+        {
+            pos = this->enqueuePos.load( std::memory_order_relaxed );
+        }
+    }
+
+    cell->numCommandBuffers = submitInfo->commandBufferCount;
+    cell->numWaits          = submitInfo->waitSemaphoreCount;
+    cell->numSignals        = submitInfo->signalSemaphoreCount;
+    for ( uint32_t i = 0; i < submitInfo->commandBufferCount; i++ )
+    {
+        cell->commandBuffers[i] = submitInfo->pCommandBuffers[i];
+    }
+    for ( uint32_t i = 0; i < submitInfo->waitSemaphoreCount; i++ )
+    {
+        cell->waitSemaphores[i] = submitInfo->pWaitSemaphores[i];
+        cell->waitStages[i]     = submitInfo->pWaitDstStageMask[i];
+    }
+    for ( uint32_t i = 0; i < submitInfo->signalSemaphoreCount; i++ )
+    {
+        cell->signalSemaphores[i] = submitInfo->pSignalSemaphores[i];
+    }
+    cell->sequence.store( pos + 1 );
+
+    WakeUp();
+    // Raises of the auto-reset signal that came in at once only release one producer, so each
+    // producer that got a cell passes the signal on to the next one.
+    if ( this->numWaitingForSpace.load() > 0 )
+    {
+        ksSignal_Raise( &this->spaceSignal );
+    }
+
+    return this->baseValue + pos + 1;
+}
+
+uint64_t GpuSubmitQueue::PendingValue() const
+{
+    return this->baseValue + this->enqueuePos.load( std::memory_order_relaxed ) + 1;
+}
+
+void GpuSubmitQueue::WakeUp()
+{
+    // Sequentially consistent with the check of the thread before it goes to sleep, so either
+    // the thread sees the new cell or this sees that the thread sleeps.
+    if ( this->sleeping.load() && this->sleeping.exchange( false ) )
+    {
+        ksSignal_Raise( &this->wakeUpSignal );
+    }
+}
+
+void GpuSubmitQueue::SubmitCell( Cell* cell )
+{
+    VkSubmitInfo submitInfo;
+    submitInfo.sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext                = nullptr;
+    submitInfo.waitSemaphoreCount   = cell->numWaits;
+    submitInfo.pWaitSemaphores      = cell->waitSemaphores;
+    submitInfo.pWaitDstStageMask    = cell->waitStages;
+    submitInfo.commandBufferCount   = cell->numCommandBuffers;
+    submitInfo.pCommandBuffers      = cell->commandBuffers;
+    submitInfo.signalSemaphoreCount = cell->numSignals;
+    submitInfo.pSignalSemaphores    = cell->signalSemaphores;
+
+    const uint64_t value = context.timeline->Submit( &submitInfo );
+    assert( value == this->baseValue + this->dequeuePos + 1 );
+    UNUSED_PARM( value );
+}
+
+void GpuSubmitQueue::ThreadFunction( void* data )
+{
+    GpuSubmitQueue* queue = static_cast<GpuSubmitQueue*>( data );
+
+    for ( ;; )
+    {
+        Cell* cell = &queue->cells[queue->dequeuePos & ( GPU_SUBMIT_QUEUE_SIZE - 1 )];
+        if ( cell->sequence.load( std::memory_order_acquire ) == queue->dequeuePos + 1 )
+        {
+            queue->SubmitCell( cell );
+            // Sequentially consistent with the check of a producer before it sleeps, so either
+            // the producer sees the free cell or this sees that the producer waits.
+            cell->sequence.store( queue->dequeuePos + GPU_SUBMIT_QUEUE_SIZE );
+            queue->dequeuePos++;
+            if ( queue->numWaitingForSpace.load() > 0 )
+            {
+                ksSignal_Raise( &queue->spaceSignal );
+            }
+            continue;
+        }
+        if ( queue->terminate.load() )
+        {
+            break;
+        }
+
+        // Announce the sleep before looking at the cell again, see WakeUp().
+        queue->sleeping.store( true );
+        if ( cell->sequence.load() == queue->dequeuePos + 1 || queue->terminate.load() )
+        {
+            queue->sleeping.store( false );
+            continue;
+        }
+        ksSignal_Wait( &queue->wakeUpSignal, SIGNAL_TIMEOUT_INFINITE );
+    }
+}
+
+} // namespace lxd
@@ -1,6 +1,8 @@
 #include "GpuTexture.hpp"
+#include "GpuDeletionQueue.hpp"
 #include "GpuDevice.hpp"
 #include "GpuInstance.hpp"
+#include "GpuStateTracker.hpp"
 #include "GpuWindow.hpp"
 #include <algorithm>
 
@@ -8,9 +10,30 @@
 
 namespace lxd
 {
-GpuTexture::GpuTexture( GpuContext* context ) : context( *context ) {}
+GpuTexture::GpuTexture( GpuContext* context ) : context( *context )
+{
+    this->resourceId = ++context->device->resourceSerial;
+}
 
-GpuTexture::~GpuTexture() {}
+GpuTexture::~GpuTexture()
+{
+    context.InvalidateCommandBundles( this );
+    // The GPU may still sample the texture, so everything is only released once the submits
+    // that are in flight or being recorded completed.
+    if ( this->bindlessIndex != GPU_BINDLESS_INVALID_INDEX )
+    {
+        context.deletionQueue->Destroy( GPU_DELETION_TYPE_BINDLESS_TEXTURE, this->bindlessIndex );
+    }
+    context.deletionQueue->Destroy( GPU_DELETION_TYPE_SAMPLER, (uint64_t)this->sampler );
+    // Without memory the image and view belong to someone else, e.g. the swapchain.
+    if ( this->memory != VK_NULL_HANDLE )
+    {
+        context.deletionQueue->Destroy( GPU_DELETION_TYPE_IMAGE_VIEW, (uint64_t)this->view );
+        context.deletionQueue->Destroy( GPU_DELETION_TYPE_IMAGE, (uint64_t)this->image );
+        context.deletionQueue->Destroy( GPU_DELETION_TYPE_MEMORY, (uint64_t)this->memory );
+    }
+    free( this->subresourceStates );
+}
 
 static int IntegerLog2( int i )
 {
@@ -111,6 +134,27 @@ VkPipelineStageFlags PipelineStagesForTextureUsage( const GpuTextureUsage usage,
                                                                     : 0 ) ) ) ) ) ) ) );
 }
 
+GpuTextureUsage TextureUsageForLayout( const VkImageLayout layout )
+{
+    switch ( layout )
+    {
+        case VK_IMAGE_LAYOUT_GENERAL:
+            return GPU_TEXTURE_USAGE_STORAGE;
+        case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:
+            return GPU_TEXTURE_USAGE_TRANSFER_SRC;
+        case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
+            return GPU_TEXTURE_USAGE_TRANSFER_DST;
+        case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
+            return GPU_TEXTURE_USAGE_SAMPLED;
+        case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL:
+            return GPU_TEXTURE_USAGE_COLOR_ATTACHMENT;
+        case VK_IMAGE_LAYOUT_PRESENT_SRC_KHR:
+            return GPU_TEXTURE_USAGE_PRESENTATION;
+        default:
+            return GPU_TEXTURE_USAGE_UNDEFINED;
+    }
+}
+
 void GpuTexture::ChangeUsage( VkCommandBuffer cmdBuffer, const GpuTextureUsage usage )
 {
     assert( ( this->usageFlags & usage ) != 0 );
@@ -142,14 +186,18 @@ void GpuTexture::ChangeUsage( VkCommandBuffer cmdBuffer, const GpuTextureUsage u
 
     this->usage       = usage;
     this->imageLayout = newImageLayout;
+
+    // The whole texture changed state, any GpuStateTracker starts over from the new layout.
+    free( this->subresourceStates );
+    this->subresourceStates = nullptr;
 }
 void GpuTexture::UpdateSampler()
 {
-    if ( this->sampler != VK_NULL_HANDLE )
-    {
-        VC( context.device->vkDestroySampler( context.device->device, this->sampler,
-                                              VK_ALLOCATOR ) );
-    }
+    // Also called when the texture is (re)created, any recorded descriptors are now stale.
+    context.InvalidateCommandBundles( this );
+
+    // Descriptors recorded before may still reference the old sampler.
+    context.deletionQueue->Destroy( GPU_DELETION_TYPE_SAMPLER, (uint64_t)this->sampler );
 
     const VkSamplerMipmapMode  mipmapMode = ( ( this->filter == GPU_TEXTURE_FILTER_NEAREST )
                                                  ? VK_SAMPLER_MIPMAP_MODE_NEAREST
@@ -187,6 +235,12 @@ void GpuTexture::UpdateSampler()
 
     VK( context.device->vkCreateSampler( context.device->device, &samplerCreateInfo, VK_ALLOCATOR,
                                          &this->sampler ) );
+    this->resourceId = ++context.device->resourceSerial;
+
+    if ( this->bindlessIndex != GPU_BINDLESS_INVALID_INDEX )
+    {
+        context.bindless->UpdateTexture( this->bindlessIndex, this );
+    }
 }
 
 bool GpuTexture::CreateInternal( const char* fileName, const VkFormat format,
@@ -283,6 +337,10 @@ bool GpuTexture::CreateInternal( const char* fileName, const VkFormat format,
         ( numStorageLevels > 1 ) ? GPU_TEXTURE_FILTER_BILINEAR : GPU_TEXTURE_FILTER_LINEAR;
     this->maxAnisotropy = 1.0f;
     this->format        = format;
+    this->imageLayout   = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    free( this->subresourceStates );
+    this->subresourceStates = NULL;
 
     const VkImageUsageFlags usage =
         // Must be able to copy to the image for initialization.
@@ -345,32 +403,13 @@ bool GpuTexture::CreateInternal( const char* fileName, const VkFormat format,
         context.CreateSetupCmdBuffer();
 
         // Set optimal image layout for shader read access.
-        {
-            VkImageMemoryBarrier imageMemoryBarrier;
-            imageMemoryBarrier.sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-            imageMemoryBarrier.pNext               = NULL;
-            imageMemoryBarrier.srcAccessMask       = 0;
-            imageMemoryBarrier.dstAccessMask       = VK_ACCESS_SHADER_READ_BIT;
-            imageMemoryBarrier.oldLayout           = VK_IMAGE_LAYOUT_UNDEFINED;
-            imageMemoryBarrier.newLayout           = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-            imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-            imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-            imageMemoryBarrier.image               = this->image;
-            imageMemoryBarrier.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
-            imageMemoryBarrier.subresourceRange.baseMipLevel   = 0;
-            imageMemoryBarrier.subresourceRange.levelCount     = numStorageLevels;
-            imageMemoryBarrier.subresourceRange.baseArrayLayer = 0;
-            imageMemoryBarrier.subresourceRange.layerCount     = arrayLayerCount;
-
-            const VkPipelineStageFlags src_stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-            const VkPipelineStageFlags dst_stages =
-                VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT; // fixme: optimise
-            const VkDependencyFlags flags = 0;
-
-            VC( context.device->vkCmdPipelineBarrier( context.setupCommandBuffer, src_stages,
-                                                      dst_stages, flags, 0, NULL, 0, NULL, 1,
-                                                      &imageMemoryBarrier ) );
-        }
+        GpuStateTracker stateTracker( &context );
+        stateTracker.Begin( context.setupCommandBuffer );
+        stateTracker.TextureAccess(
+            this, PipelineStagesForTextureUsage( GPU_TEXTURE_USAGE_SAMPLED, false ),
+            VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL );
+        stateTracker.Flush();
+
         context.FlushSetupCmdBuffer();
     }
     else // Copy source data through a staging buffer.
@@ -379,32 +418,13 @@ bool GpuTexture::CreateInternal( const char* fileName, const VkFormat format,
 
         context.CreateSetupCmdBuffer();
 
+        GpuStateTracker stateTracker( &context );
+        stateTracker.Begin( context.setupCommandBuffer );
+
         // Set optimal image layout for transfer destination.
-        {
-            VkImageMemoryBarrier imageMemoryBarrier;
-            imageMemoryBarrier.sType                       = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-            imageMemoryBarrier.pNext                       = NULL;
-            imageMemoryBarrier.srcAccessMask               = 0;
-            imageMemoryBarrier.dstAccessMask               = VK_ACCESS_TRANSFER_WRITE_BIT;
-            imageMemoryBarrier.oldLayout                   = VK_IMAGE_LAYOUT_UNDEFINED;
-            imageMemoryBarrier.newLayout                   = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-            imageMemoryBarrier.srcQueueFamilyIndex         = VK_QUEUE_FAMILY_IGNORED;
-            imageMemoryBarrier.dstQueueFamilyIndex         = VK_QUEUE_FAMILY_IGNORED;
-            imageMemoryBarrier.image                       = this->image;
-            imageMemoryBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            imageMemoryBarrier.subresourceRange.baseMipLevel   = 0;
-            imageMemoryBarrier.subresourceRange.levelCount     = numStorageLevels;
-            imageMemoryBarrier.subresourceRange.baseArrayLayer = 0;
-            imageMemoryBarrier.subresourceRange.layerCount     = arrayLayerCount;
-
-            const VkPipelineStageFlags src_stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-            const VkPipelineStageFlags dst_stages = VK_PIPELINE_STAGE_TRANSFER_BIT;
-            const VkDependencyFlags    flags      = 0;
-
-            VC( context.device->vkCmdPipelineBarrier( context.setupCommandBuffer, src_stages,
-                                                      dst_stages, flags, 0, NULL, 0, NULL, 1,
-                                                      &imageMemoryBarrier ) );
-        }
+        stateTracker.TextureAccess( this, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                    VK_ACCESS_TRANSFER_WRITE_BIT,
+                                    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL );
 
         const int numDataLevels = ( mipCount >= 1 ) ? mipCount : 1;
         bool      compressed    = false;
@@ -447,28 +467,6 @@ bool GpuTexture::CreateInternal( const char* fileName, const VkFormat format,
         //        memcpy(mapped, data, dataSize);
         //        VC(context.device->vkUnmapMemory(context.device->device, stagingMemory));
 
-        // Make sure the CPU writes to the buffer are flushed.
-        {
-            VkBufferMemoryBarrier bufferMemoryBarrier;
-            bufferMemoryBarrier.sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
-            bufferMemoryBarrier.pNext               = NULL;
-            bufferMemoryBarrier.srcAccessMask       = VK_ACCESS_HOST_WRITE_BIT;
-            bufferMemoryBarrier.dstAccessMask       = VK_ACCESS_TRANSFER_READ_BIT;
-            bufferMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-            bufferMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-            bufferMemoryBarrier.buffer              = stagingBuffer;
-            bufferMemoryBarrier.offset              = 0;
-            bufferMemoryBarrier.size                = dataSize;
-
-            const VkPipelineStageFlags src_stages = VK_PIPELINE_STAGE_HOST_BIT;
-            const VkPipelineStageFlags dst_stages = VK_PIPELINE_STAGE_TRANSFER_BIT;
-            const VkDependencyFlags    flags      = 0;
-
-            VC( context.device->vkCmdPipelineBarrier( context.setupCommandBuffer, src_stages,
-                                                      dst_stages, flags, 0, NULL, 1,
-                                                      &bufferMemoryBarrier, 0, NULL ) );
-        }
-
         // to store the pixels, only used when mipSizeStored equals true
         uint8_t* pixelsData = (uint8_t*)malloc( dataSize );
         uint8_t* SrcData    = (uint8_t*)data;
@@ -1136,6 +1134,9 @@ bool GpuTexture::CreateInternal( const char* fileName, const VkFormat format,
 
         assert( dataOffset == dataSize );
 
+        // The host writes to the staging buffer are made visible by the queue submit.
+        stateTracker.Flush();
+
         VC( context.device->vkCmdCopyBufferToImage(
             context.setupCommandBuffer, stagingBuffer, this->image,
             VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
@@ -1147,105 +1148,71 @@ bool GpuTexture::CreateInternal( const char* fileName, const VkFormat format,
             UNUSED_PARM( compressed );
 
             // Generate mip levels for the tiled image in place.
-            for ( int mipLevel = 1; mipLevel <= numStorageLevels; mipLevel++ )
+            for ( int mipLevel = 1; mipLevel < numStorageLevels; mipLevel++ )
             {
                 const int prevMipLevel = mipLevel - 1;
 
-                // Make sure any copies to the image are flushed and set optimal image layout for transfer source.
-                {
-                    VkImageMemoryBarrier imageMemoryBarrier;
-                    imageMemoryBarrier.sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-                    imageMemoryBarrier.pNext               = NULL;
-                    imageMemoryBarrier.srcAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT;
-                    imageMemoryBarrier.dstAccessMask       = VK_ACCESS_TRANSFER_READ_BIT;
-                    imageMemoryBarrier.oldLayout           = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-                    imageMemoryBarrier.newLayout           = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-                    imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-                    imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-                    imageMemoryBarrier.image               = this->image;
-                    imageMemoryBarrier.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
-                    imageMemoryBarrier.subresourceRange.baseMipLevel   = prevMipLevel;
-                    imageMemoryBarrier.subresourceRange.levelCount     = 1;
-                    imageMemoryBarrier.subresourceRange.baseArrayLayer = 0;
-                    imageMemoryBarrier.subresourceRange.layerCount     = arrayLayerCount;
-
-                    const VkPipelineStageFlags src_stages = VK_PIPELINE_STAGE_TRANSFER_BIT;
-                    const VkPipelineStageFlags dst_stages = VK_PIPELINE_STAGE_TRANSFER_BIT;
-                    const VkDependencyFlags    flags      = 0;
-
-                    VC( context.device->vkCmdPipelineBarrier(
-                        context.setupCommandBuffer, src_stages, dst_stages, flags, 0, NULL, 0, NULL,
-                        1, &imageMemoryBarrier ) );
-                }
+                // Make sure any copies or blits to the previous mip level are flushed and set
+                // optimal image layout for transfer source.
+                VkImageSubresourceRange range;
+                range.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+                range.baseMipLevel   = prevMipLevel;
+                range.levelCount     = 1;
+                range.baseArrayLayer = 0;
+                range.layerCount     = arrayLayerCount;
+                stateTracker.TextureAccess( this, &range, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                            VK_ACCESS_TRANSFER_READ_BIT,
+                                            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL );
+                range.baseMipLevel = mipLevel;
+                stateTracker.TextureAccess( this, &range, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                            VK_ACCESS_TRANSFER_WRITE_BIT,
+                                            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL );
+                stateTracker.Flush();
 
                 // Blit from the previous mip level to the current mip level.
-                if ( mipLevel < numStorageLevels )
-                {
-                    VkImageBlit imageBlit;
-                    imageBlit.srcSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
-                    imageBlit.srcSubresource.mipLevel       = prevMipLevel;
-                    imageBlit.srcSubresource.baseArrayLayer = 0;
-                    imageBlit.srcSubresource.layerCount     = arrayLayerCount;
-                    imageBlit.srcOffsets[0].x               = 0;
-                    imageBlit.srcOffsets[0].y               = 0;
-                    imageBlit.srcOffsets[0].z               = 0;
-                    imageBlit.srcOffsets[1].x =
-                        ( width >> prevMipLevel ) >= 1 ? ( width >> prevMipLevel ) : 0;
-                    imageBlit.srcOffsets[1].y =
-                        ( height >> prevMipLevel ) >= 1 ? ( height >> prevMipLevel ) : 0;
-                    imageBlit.srcOffsets[1].z =
-                        ( depth >> prevMipLevel ) >= 1 ? ( depth >> prevMipLevel ) : 1;
-                    imageBlit.dstSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
-                    imageBlit.dstSubresource.mipLevel       = mipLevel;
-                    imageBlit.dstSubresource.baseArrayLayer = 0;
-                    imageBlit.dstSubresource.layerCount     = arrayLayerCount;
-                    imageBlit.dstOffsets[0].x               = 0;
-                    imageBlit.dstOffsets[0].y               = 0;
-                    imageBlit.dstOffsets[0].z               = 0;
-                    imageBlit.dstOffsets[1].x =
-                        ( width >> mipLevel ) >= 1 ? ( width >> mipLevel ) : 0;
-                    imageBlit.dstOffsets[1].y =
-                        ( height >> mipLevel ) >= 1 ? ( height >> mipLevel ) : 0;
-                    imageBlit.dstOffsets[1].z =
-                        ( depth >> mipLevel ) >= 1 ? ( depth >> mipLevel ) : 1;
-
-                    VC( context.device->vkCmdBlitImage(
-                        context.setupCommandBuffer, this->image,
-                        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, this->image,
-                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageBlit, VK_FILTER_LINEAR ) );
-                }
+                VkImageBlit imageBlit;
+                imageBlit.srcSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+                imageBlit.srcSubresource.mipLevel       = prevMipLevel;
+                imageBlit.srcSubresource.baseArrayLayer = 0;
+                imageBlit.srcSubresource.layerCount     = arrayLayerCount;
+                imageBlit.srcOffsets[0].x               = 0;
+                imageBlit.srcOffsets[0].y               = 0;
+                imageBlit.srcOffsets[0].z               = 0;
+                imageBlit.srcOffsets[1].x =
+                    ( width >> prevMipLevel ) >= 1 ? ( width >> prevMipLevel ) : 0;
+                imageBlit.srcOffsets[1].y =
+                    ( height >> prevMipLevel ) >= 1 ? ( height >> prevMipLevel ) : 0;
+                imageBlit.srcOffsets[1].z =
+                    ( depth >> prevMipLevel ) >= 1 ? ( depth >> prevMipLevel ) : 1;
+                imageBlit.dstSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+                imageBlit.dstSubresource.mipLevel       = mipLevel;
+                imageBlit.dstSubresource.baseArrayLayer = 0;
+                imageBlit.dstSubresource.layerCount     = arrayLayerCount;
+                imageBlit.dstOffsets[0].x               = 0;
+                imageBlit.dstOffsets[0].y               = 0;
+                imageBlit.dstOffsets[0].z               = 0;
+                imageBlit.dstOffsets[1].x =
+                    ( width >> mipLevel ) >= 1 ? ( width >> mipLevel ) : 0;
+                imageBlit.dstOffsets[1].y =
+                    ( height >> mipLevel ) >= 1 ? ( height >> mipLevel ) : 0;
+                imageBlit.dstOffsets[1].z =
+                    ( depth >> mipLevel ) >= 1 ? ( depth >> mipLevel ) : 1;
+
+                VC( context.device->vkCmdBlitImage(
+                    context.setupCommandBuffer, this->image,
+                    VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, this->image,
+                    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageBlit, VK_FILTER_LINEAR ) );
             }
         }
 
-        // Make sure any copies or blits to the image are flushed and set optimal image layout for shader read access.
-        {
-            VkImageMemoryBarrier imageMemoryBarrier;
-            imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-            imageMemoryBarrier.pNext = NULL;
-            imageMemoryBarrier.srcAccessMask =
-                ( mipCount >= 1 ) ? VK_ACCESS_TRANSFER_WRITE_BIT : VK_ACCESS_TRANSFER_READ_BIT;
-            imageMemoryBarrier.dstAccessMask =
-                VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_INPUT_ATTACHMENT_READ_BIT;
-            imageMemoryBarrier.oldLayout = ( mipCount >= 1 ) ? VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
-                                                             : VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-            imageMemoryBarrier.newLayout           = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-            imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-            imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-            imageMemoryBarrier.image               = this->image;
-            imageMemoryBarrier.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
-            imageMemoryBarrier.subresourceRange.baseMipLevel   = 0;
-            imageMemoryBarrier.subresourceRange.levelCount     = numStorageLevels;
-            imageMemoryBarrier.subresourceRange.baseArrayLayer = 0;
-            imageMemoryBarrier.subresourceRange.layerCount     = arrayLayerCount;
-
-            const VkPipelineStageFlags src_stages = VK_PIPELINE_STAGE_TRANSFER_BIT;
-            const VkPipelineStageFlags dst_stages = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-            const VkDependencyFlags    flags      = 0;
-
-            VC( context.device->vkCmdPipelineBarrier( context.setupCommandBuffer, src_stages,
-                                                      dst_stages, flags, 0, NULL, 0, NULL, 1,
-                                                      &imageMemoryBarrier ) );
-        }
+        // Make sure any copies or blits to the image are flushed and set optimal image layout for
+        // shader read access. The mip levels that were blitted from are in a different layout than
+        // the last one, but all transitions go into a single pipeline barrier.
+        stateTracker.TextureAccess(
+            this, PipelineStagesForTextureUsage( GPU_TEXTURE_USAGE_SAMPLED, false ),
+            VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_INPUT_ATTACHMENT_READ_BIT,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL );
+        stateTracker.Flush();
 
         context.FlushSetupCmdBuffer();
 
@@ -1286,8 +1253,22 @@ bool GpuTexture::CreateInternal( const char* fileName, const VkFormat format,
     VK( context.device->vkCreateImageView( context.device->device, &imageViewCreateInfo,
                                            VK_ALLOCATOR, &this->view ) );
 
+    // Created again: submitted work may still read the old slot, so it is released through the
+    // deletion queue before UpdateSampler() could write the new view to it, and a new slot is
+    // registered below.
+    if ( this->bindlessIndex != GPU_BINDLESS_INVALID_INDEX )
+    {
+        context.deletionQueue->Destroy( GPU_DELETION_TYPE_BINDLESS_TEXTURE, this->bindlessIndex );
+        this->bindlessIndex = GPU_BINDLESS_INVALID_INDEX;
+    }
+
     UpdateSampler();
 
+    if ( context.bindless != nullptr && ( usageFlags & GPU_TEXTURE_USAGE_SAMPLED ) != 0 )
+    {
+        this->bindlessIndex = context.bindless->RegisterTexture( this );
+    }
+
     return true;
 }
 
@@ -0,0 +1,449 @@
+#include "GpuTimeline.hpp"
+#include "GpuContext.hpp"
+#include "GpuDevice.hpp"
+#include "GpuSubmitQueue.hpp"
+
+#include <algorithm>
+
+namespace lxd
+{
+
+// Threads that look at the completed value race to update it, so it only ever moves forward.
+static uint64_t AdvanceValue( std::atomic<uint64_t>* atomicValue, const uint64_t value )
+{
+    uint64_t current = atomicValue->load();
+    while ( current < value && !atomicValue->compare_exchange_weak( current, value ) )
+    {
+    }
+    return std::max( current, value );
+}
+
+GpuTimeline::GpuTimeline( GpuContext* context ) : context( *context )
+{
+    ksMutex_Create( &this->fenceMutex );
+    ksMutex_Create( &this->recordingMutex );
+
+    GpuDevice* device = context->device;
+    ksMutex_Lock( &device->timelineMutex, true );
+    for ( int slot = 0; slot < GPU_MAX_TIMELINES; slot++ )
+    {
+        if ( device->timelines[slot] == nullptr )
+        {
+            device->timelines[slot] = this;
+            this->deviceSlot        = slot;
+            this->serial            = ++device->timelineSerial;
+            break;
+        }
+    }
+    ksMutex_Unlock( &device->timelineMutex );
+    assert( this->deviceSlot >= 0 );
+
+    if ( !context->device->supportsTimelineSemaphores )
+    {
+        return;
+    }
+
+    VkSemaphoreTypeCreateInfoKHR semaphoreTypeCreateInfo;
+    semaphoreTypeCreateInfo.sType         = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+    semaphoreTypeCreateInfo.pNext         = nullptr;
+    semaphoreTypeCreateInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+    semaphoreTypeCreateInfo.initialValue  = 0;
+
+    VkSemaphoreCreateInfo semaphoreCreateInfo;
+    semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreCreateInfo.pNext = &semaphoreTypeCreateInfo;
+    semaphoreCreateInfo.flags = 0;
+
+    VK( context->device->vkCreateSemaphore( context->device->device, &semaphoreCreateInfo,
+                                            VK_ALLOCATOR, &this->semaphore ) );
+}
+
+GpuTimeline::~GpuTimeline()
+{
+    Wait( this->submittedValue.load() );
+    assert( this->numOpenTickets == 0 );
+
+    // Deletion queues that still refer to the slot see that the timeline is gone, which is the
+    // same as all of its submits being complete.
+    GpuDevice* device = context.device;
+    ksMutex_Lock( &device->timelineMutex, true );
+    device->timelines[this->deviceSlot] = nullptr;
+    ksMutex_Unlock( &device->timelineMutex );
+
+    if ( this->semaphore != VK_NULL_HANDLE )
+    {
+        VC( context.device->vkDestroySemaphore( context.device->device, this->semaphore,
+                                                VK_ALLOCATOR ) );
+    }
+    assert( this->numInFlight == 0 );
+    for ( int i = 0; i < this->numFreeFences; i++ )
+    {
+        VC( context.device->vkDestroyFence( context.device->device, this->freeFences[i],
+                                            VK_ALLOCATOR ) );
+    }
+    free( this->freeFences );
+    free( this->inFlight );
+    free( this->openTickets );
+    ksMutex_Destroy( &this->recordingMutex );
+    ksMutex_Destroy( &this->fenceMutex );
+}
+
+// Called with the fence mutex held.
+VkFence GpuTimeline::AcquireFence()
+{
+    if ( this->numFreeFences > 0 )
+    {
+        return this->freeFences[--this->numFreeFences];
+    }
+
+    VkFenceCreateInfo fenceCreateInfo;
+    fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fenceCreateInfo.pNext = nullptr;
+    fenceCreateInfo.flags = 0;
+
+    VkFence fence;
+    VK( context.device->vkCreateFence( context.device->device, &fenceCreateInfo, VK_ALLOCATOR,
+                                       &fence ) );
+    return fence;
+}
+
+void GpuTimeline::AddWait( const GpuTimeline* other, const uint64_t value,
+                           const VkPipelineStageFlags dstStages )
+{
+    assert( this->semaphore != VK_NULL_HANDLE && other->semaphore != VK_NULL_HANDLE );
+    assert( other != this );
+    // The submit thread reads the waits, see GpuSubmitQueue.
+    assert( context.submitQueue == nullptr );
+
+    // Waiting twice on the same timeline only needs the larger value.
+    for ( int i = 0; i < this->numWaits; i++ )
+    {
+        if ( this->waitSemaphores[i] == other->semaphore )
+        {
+            this->waitValues[i] = std::max( this->waitValues[i], value );
+            this->waitStages[i] |= dstStages;
+            return;
+        }
+    }
+
+    assert( this->numWaits < GPU_TIMELINE_MAX_WAIT_SEMAPHORES );
+    this->waitSemaphores[this->numWaits] = other->semaphore;
+    this->waitValues[this->numWaits]     = value;
+    this->waitStages[this->numWaits]     = dstStages;
+    this->numWaits++;
+}
+
+uint64_t GpuTimeline::Submit( const VkSubmitInfo* submitInfos, const int numSubmits )
+{
+    assert( numSubmits >= 1 && numSubmits <= GPU_TIMELINE_MAX_SUBMITS );
+    // Only this thread submits, other threads just read the value.
+    const uint64_t value = this->submittedValue.load( std::memory_order_relaxed ) + 1;
+
+    if ( this->semaphore != VK_NULL_HANDLE )
+    {
+        // The cross-queue waits are added to the first submit and the timeline semaphore is
+        // signaled by the last one. A semaphore signal waits for all commands that were submitted
+        // before it, so the value also covers the earlier submits of the batch.
+        VkSubmitInfo timelineInfos[GPU_TIMELINE_MAX_SUBMITS];
+        memcpy( timelineInfos, submitInfos, numSubmits * sizeof( VkSubmitInfo ) );
+        VkSubmitInfo* firstInfo = &timelineInfos[0];
+        VkSubmitInfo* lastInfo  = &timelineInfos[numSubmits - 1];
+
+        // The cross-queue waits follow the binary semaphores of the submit info, which again
+        // ignore their value.
+        assert( firstInfo->waitSemaphoreCount + this->numWaits <=
+                GPU_TIMELINE_MAX_WAIT_SEMAPHORES );
+        VkSemaphore          waitSemaphores[GPU_TIMELINE_MAX_WAIT_SEMAPHORES];
+        uint64_t             waitValues[GPU_TIMELINE_MAX_WAIT_SEMAPHORES];
+        VkPipelineStageFlags waitStages[GPU_TIMELINE_MAX_WAIT_SEMAPHORES];
+        uint32_t             waitCount = 0;
+        for ( ; waitCount < firstInfo->waitSemaphoreCount; waitCount++ )
+        {
+            waitSemaphores[waitCount] = firstInfo->pWaitSemaphores[waitCount];
+            waitValues[waitCount]     = 0;
+            waitStages[waitCount]     = firstInfo->pWaitDstStageMask[waitCount];
+        }
+        for ( int i = 0; i < this->numWaits; i++, waitCount++ )
+        {
+            waitSemaphores[waitCount] = this->waitSemaphores[i];
+            waitValues[waitCount]     = this->waitValues[i];
+            waitStages[waitCount]     = this->waitStages[i];
+        }
+        this->numWaits = 0;
+
+        // Binary semaphores ignore their value, the timeline semaphore is signaled last.
+        assert( lastInfo->signalSemaphoreCount < GPU_TIMELINE_MAX_SIGNAL_SEMAPHORES );
+        VkSemaphore signalSemaphores[GPU_TIMELINE_MAX_SIGNAL_SEMAPHORES];
+        uint64_t    signalValues[GPU_TIMELINE_MAX_SIGNAL_SEMAPHORES];
+        uint32_t    signalCount = 0;
+        for ( ; signalCount < lastInfo->signalSemaphoreCount; signalCount++ )
+        {
+            signalSemaphores[signalCount] = lastInfo->pSignalSemaphores[signalCount];
+            signalValues[signalCount]     = 0;
+        }
+        signalSemaphores[signalCount] = this->semaphore;
+        signalValues[signalCount]     = value;
+        signalCount++;
+
+        // The submits in between only use binary semaphores and are passed as is.
+        VkTimelineSemaphoreSubmitInfoKHR waitSubmitInfo;
+        waitSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+        waitSubmitInfo.pNext = firstInfo->pNext;
+        waitSubmitInfo.waitSemaphoreValueCount   = waitCount;
+        waitSubmitInfo.pWaitSemaphoreValues      = waitValues;
+        waitSubmitInfo.signalSemaphoreValueCount = 0;
+        waitSubmitInfo.pSignalSemaphoreValues    = nullptr;
+
+        VkTimelineSemaphoreSubmitInfoKHR signalSubmitInfo;
+        signalSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+        signalSubmitInfo.pNext = lastInfo->pNext;
+        signalSubmitInfo.waitSemaphoreValueCount   = 0;
+        signalSubmitInfo.pWaitSemaphoreValues      = nullptr;
+        signalSubmitInfo.signalSemaphoreValueCount = signalCount;
+        signalSubmitInfo.pSignalSemaphoreValues    = signalValues;
+
+        if ( numSubmits == 1 )
+        {
+            signalSubmitInfo.waitSemaphoreValueCount = waitCount;
+            signalSubmitInfo.pWaitSemaphoreValues    = waitValues;
+        }
+        else
+        {
+            firstInfo->pNext = &waitSubmitInfo;
+        }
+
+        firstInfo->waitSemaphoreCount  = waitCount;
+        firstInfo->pWaitSemaphores     = waitSemaphores;
+        firstInfo->pWaitDstStageMask   = waitStages;
+        lastInfo->pNext                = &signalSubmitInfo;
+        lastInfo->signalSemaphoreCount = signalCount;
+        lastInfo->pSignalSemaphores    = signalSemaphores;
+
+        VK( context.device->vkQueueSubmit( context.queue, numSubmits, timelineInfos,
+                                           VK_NULL_HANDLE ) );
+    }
+    else
+    {
+        assert( this->numWaits == 0 );
+        ksMutex_Lock( &this->fenceMutex, true );
+        if ( this->numInFlight >= this->maxInFlight )
+        {
+            this->maxInFlight = ( this->maxInFlight > 0 ) ? this->maxInFlight * 2 : 8;
+            this->inFlight    = static_cast<InFlightFence*>(
+                realloc( this->inFlight, this->maxInFlight * sizeof( InFlightFence ) ) );
+        }
+        InFlightFence* entry = &this->inFlight[this->numInFlight++];
+        entry->fence         = AcquireFence();
+        entry->value         = value;
+        entry->waiters       = 0;
+
+        // The fence signals once all submits of the call completed.
+        VK( context.device->vkQueueSubmit( context.queue, numSubmits, submitInfos,
+                                           entry->fence ) );
+        ksMutex_Unlock( &this->fenceMutex );
+    }
+
+    this->submittedValue.store( value );
+    return value;
+}
+
+uint64_t GpuTimeline::PendingValue() const
+{
+    if ( context.submitQueue != nullptr )
+    {
+        return context.submitQueue->PendingValue();
+    }
+    return this->submittedValue.load() + 1;
+}
+
+uint64_t GpuTimeline::GetCompletedValue()
+{
+    if ( this->semaphore != VK_NULL_HANDLE )
+    {
+        uint64_t value = 0;
+        VK( context.device->vkGetSemaphoreCounterValueKHR( context.device->device,
+                                                           this->semaphore, &value ) );
+        return AdvanceValue( &this->completedValue, value );
+    }
+
+    ksMutex_Lock( &this->fenceMutex, true );
+    RetireFences();
+    ksMutex_Unlock( &this->fenceMutex );
+    return this->completedValue.load();
+}
+
+// Called with the fence mutex held.
+void GpuTimeline::RetireFences()
+{
+    // The queue completes submits in order, so only the oldest fences need to be looked at.
+    int retired = 0;
+    for ( ; retired < this->numInFlight; retired++ )
+    {
+        VkFence fence = this->inFlight[retired].fence;
+        if ( context.device->vkGetFenceStatus( context.device->device, fence ) != VK_SUCCESS )
+        {
+            break;
+        }
+        // A fence that another thread still waits on cannot be reset, the last waiter retires
+        // it and the fences behind it.
+        if ( this->inFlight[retired].waiters > 0 )
+        {
+            AdvanceValue( &this->completedValue, this->inFlight[retired].value );
+            break;
+        }
+        VK( context.device->vkResetFences( context.device->device, 1, &fence ) );
+        if ( this->numFreeFences >= this->maxFreeFences )
+        {
+            this->maxFreeFences = ( this->maxFreeFences > 0 ) ? this->maxFreeFences * 2 : 8;
+            this->freeFences    = static_cast<VkFence*>(
+                realloc( this->freeFences, this->maxFreeFences * sizeof( VkFence ) ) );
+        }
+        this->freeFences[this->numFreeFences++] = fence;
+        AdvanceValue( &this->completedValue, this->inFlight[retired].value );
+    }
+    if ( retired > 0 )
+    {
+        this->numInFlight -= retired;
+        memmove( this->inFlight, this->inFlight + retired,
+                 this->numInFlight * sizeof( InFlightFence ) );
+    }
+}
+
+bool GpuTimeline::IsCompleted( const uint64_t value )
+{
+    return value <= this->completedValue.load() || value <= GetCompletedValue();
+}
+
+void GpuTimeline::Wait( const uint64_t value )
+{
+    // A timeline semaphore may be waited on before the value is submitted, as happens with the
+    // submit queue of the context.
+    assert( this->semaphore != VK_NULL_HANDLE || value <= this->submittedValue.load() );
+    if ( IsCompleted( value ) )
+    {
+        return;
+    }
+
+    if ( this->semaphore != VK_NULL_HANDLE )
+    {
+        VkSemaphoreWaitInfoKHR semaphoreWaitInfo;
+        semaphoreWaitInfo.sType          = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+        semaphoreWaitInfo.pNext          = nullptr;
+        semaphoreWaitInfo.flags          = 0;
+        semaphoreWaitInfo.semaphoreCount = 1;
+        semaphoreWaitInfo.pSemaphores    = &this->semaphore;
+        semaphoreWaitInfo.pValues        = &value;
+
+        VK( context.device->vkWaitSemaphoresKHR( context.device->device, &semaphoreWaitInfo,
+                                                 UINT64_MAX ) );
+        AdvanceValue( &this->completedValue, value );
+        return;
+    }
+
+    // Every submit has its own fence, so the value of the submit is found exactly. The fence
+    // is waited on without the lock, so other threads can submit and retire meanwhile. Its
+    // waiter count keeps it from being reset and reused until this thread is done with it.
+    ksMutex_Lock( &this->fenceMutex, true );
+    VkFence fence = VK_NULL_HANDLE;
+    for ( int i = 0; i < this->numInFlight; i++ )
+    {
+        if ( this->inFlight[i].value == value )
+        {
+            fence = this->inFlight[i].fence;
+            this->inFlight[i].waiters++;
+            break;
+        }
+    }
+    ksMutex_Unlock( &this->fenceMutex );
+
+    if ( fence != VK_NULL_HANDLE )
+    {
+        VK( context.device->vkWaitForFences( context.device->device, 1, &fence, VK_TRUE,
+                                             UINT64_MAX ) );
+    }
+
+    ksMutex_Lock( &this->fenceMutex, true );
+    if ( fence != VK_NULL_HANDLE )
+    {
+        // Only retired entries move, and this one is not retired while it has waiters.
+        for ( int i = 0; i < this->numInFlight; i++ )
+        {
+            if ( this->inFlight[i].fence == fence )
+            {
+                this->inFlight[i].waiters--;
+                break;
+            }
+        }
+    }
+    RetireFences();
+    ksMutex_Unlock( &this->fenceMutex );
+}
+
+uint64_t GpuTimeline::BeginRecording()
+{
+    ksMutex_Lock( &this->recordingMutex, true );
+    if ( this->numOpenTickets >= this->maxOpenTickets )
+    {
+        this->maxOpenTickets = ( this->maxOpenTickets > 0 ) ? this->maxOpenTickets * 2 : 8;
+        this->openTickets    = static_cast<uint64_t*>(
+            realloc( this->openTickets, this->maxOpenTickets * sizeof( uint64_t ) ) );
+    }
+    const uint64_t ticket                     = this->nextTicket++;
+    this->openTickets[this->numOpenTickets++] = ticket;
+    ksMutex_Unlock( &this->recordingMutex );
+    return ticket;
+}
+
+void GpuTimeline::EndRecording( const uint64_t ticket, const uint64_t value )
+{
+    ksMutex_Lock( &this->recordingMutex, true );
+    for ( int i = 0; i < this->numOpenTickets; i++ )
+    {
+        if ( this->openTickets[i] == ticket )
+        {
+            this->openTickets[i] = this->openTickets[--this->numOpenTickets];
+            break;
+        }
+    }
+    this->recordedValue = std::max( this->recordedValue, value );
+    ksMutex_Unlock( &this->recordingMutex );
+}
+
+uint64_t GpuTimeline::NextTicket()
+{
+    ksMutex_Lock( &this->recordingMutex, true );
+    const uint64_t ticket = this->nextTicket;
+    ksMutex_Unlock( &this->recordingMutex );
+    return ticket;
+}
+
+bool GpuTimeline::ResolveRecordings( const uint64_t ticket, uint64_t* value )
+{
+    ksMutex_Lock( &this->recordingMutex, true );
+    for ( int i = 0; i < this->numOpenTickets; i++ )
+    {
+        if ( this->openTickets[i] < ticket )
+        {
+            ksMutex_Unlock( &this->recordingMutex );
+            return false;
+        }
+    }
+    // May also cover recordings that began later, which only makes the value conservative.
+    *value = this->recordedValue;
+    ksMutex_Unlock( &this->recordingMutex );
+    return true;
+}
+
+bool GpuTimeline::IsRecording( const uint64_t ticket )
+{
+    ksMutex_Lock( &this->recordingMutex, true );
+    bool open = false;
+    for ( int i = 0; i < this->numOpenTickets && !open; i++ )
+    {
+        open = ( this->openTickets[i] == ticket );
+    }
+    ksMutex_Unlock( &this->recordingMutex );
+    return open;
+}
+
+} // namespace lxd
@@ -3,8 +3,9 @@
 
 namespace lxd
 {
-GpuTimer::GpuTimer( GpuContext* context ) : context( *context )
+GpuTimer::GpuTimer( GpuContext* context, const int framesDelayed ) : context( *context )
 {
+    this->framesDelayed = framesDelayed;
     this->supported =
         context->device->queueFamilyProperties[context->queueFamilyIndex].timestampValidBits != 0;
     if ( !this->supported )
@@ -14,7 +15,7 @@ GpuTimer::GpuTimer( GpuContext* context ) : context( *context )
 
     this->period = (ksNanoseconds)context->device->physicalDeviceProperties.limits.timestampPeriod;
 
-    const uint32_t queryCount = ( GPU_TIMER_FRAMES_DELAYED + 1 ) * 2;
+    const uint32_t queryCount = ( this->framesDelayed + 1 ) * 2;
 
     VkQueryPoolCreateInfo queryPoolCreateInfo;
     queryPoolCreateInfo.sType              = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
@@ -237,6 +237,8 @@ typedef VkResult( VKAPI_PTR* PFN_vkCreateMacOSSurfaceKHR )(
 #    define PROGRAM( name ) name##GLSL
 #endif
 
+// For GLSL that is handed to the driver at runtime. The shaders of the library itself are compiled
+// to SPIR-V at build time, see lxd_embed_shader() in CMakeLists.txt.
 #define SPIRV_VERSION "99"
 #define GLSL_VERSION "440 core" // maintain precision decorations: "310 es"
 #define GLSL_EXTENSIONS                                                                            \
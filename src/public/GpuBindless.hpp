@@ -0,0 +1,73 @@
+#pragma once
+
+#include "Gfx.hpp"
+#include "threading.h"
+
+namespace lxd
+{
+
+class GpuContext;
+class GpuTexture;
+class GpuBuffer;
+
+// Upper bounds, the table is smaller when the update-after-bind limits of the device are.
+static const int      GPU_BINDLESS_MAX_TEXTURES   = 4096;
+static const int      GPU_BINDLESS_MAX_BUFFERS    = 4096;
+static const uint32_t GPU_BINDLESS_INVALID_INDEX  = 0xFFFFFFFF;
+static const int      GPU_BINDLESS_DESCRIPTOR_SET = 1; // the program's own descriptors stay in set 0
+
+enum GpuBindlessBinding
+{
+    GPU_BINDLESS_BINDING_TEXTURES, // sampled images, indexed by GpuTexture::bindlessIndex
+    GPU_BINDLESS_BINDING_SAMPLERS, // the sampler of each texture, same index as the image
+    GPU_BINDLESS_BINDING_BUFFERS   // storage buffers, indexed by GpuBuffer::bindlessIndex
+};
+
+// GLSL declarations of the bindless arrays, to be added after GLSL_EXTENSIONS.
+// A texture is sampled with: texture( sampler2D( bindlessTextures[i], bindlessSamplers[i] ), uv )
+#define GLSL_BINDLESS_DECLARATIONS                                                                 \
+    "#extension GL_EXT_nonuniform_qualifier : enable\n"                                            \
+    "layout( set = 1, binding = 0 ) uniform texture2D bindlessTextures[];\n"                       \
+    "layout( set = 1, binding = 1 ) uniform sampler bindlessSamplers[];\n"                         \
+    "layout( std430, set = 1, binding = 2 ) buffer BindlessBuffer { uint data[]; } "               \
+    "bindlessBuffers[];\n"
+
+// One large update-after-bind descriptor set with every sampled texture and storage buffer of
+// the context. Resources get a stable index when they are created and programs receive those
+// indices through push constants, so switching materials does not bind any descriptors.
+// The set is bound at GPU_BINDLESS_DESCRIPTOR_SET whenever the pipeline layout changes.
+// Sampled textures are expected to be in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL when a shader
+// reads them through the table.
+class GpuBindlessTable
+{
+  public:
+    GpuBindlessTable( GpuContext* context );
+    ~GpuBindlessTable();
+
+    uint32_t RegisterTexture( const GpuTexture* texture );
+    void     UpdateTexture( const uint32_t index, const GpuTexture* texture );
+    void     ReleaseTexture( const uint32_t index );
+    uint32_t RegisterBuffer( const GpuBuffer* buffer );
+    void     ReleaseBuffer( const uint32_t index );
+
+  private:
+    static uint32_t AllocateIndex( uint32_t* freeIndices, int* numFreeIndices, int* nextIndex,
+                                   const int maxIndices );
+
+  public:
+    GpuContext&           context;
+    VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+    VkDescriptorPool      descriptorPool      = VK_NULL_HANDLE;
+    VkDescriptorSet       descriptorSet       = VK_NULL_HANDLE;
+    int                   maxTextures         = 0; // descriptor counts of the table
+    int                   maxBuffers          = 0;
+    ksMutex               mutex;
+    uint32_t              freeTextures[GPU_BINDLESS_MAX_TEXTURES] = {};
+    int                   numFreeTextures                         = 0;
+    int                   nextTexture                             = 0;
+    uint32_t              freeBuffers[GPU_BINDLESS_MAX_BUFFERS]   = {};
+    int                   numFreeBuffers                          = 0;
+    int                   nextBuffer                              = 0;
+};
+
+} // namespace lxd
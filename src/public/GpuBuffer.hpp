@@ -1,5 +1,6 @@
 #pragma once
 
+#include "GpuBindless.hpp"
 #include "GpuContext.hpp"
 
 namespace lxd
@@ -10,9 +11,12 @@ enum GpuBufferType
     GPU_BUFFER_TYPE_VERTEX,
     GPU_BUFFER_TYPE_INDEX,
     GPU_BUFFER_TYPE_UNIFORM,
-    GPU_BUFFER_TYPE_STORAGE
+    GPU_BUFFER_TYPE_STORAGE,
+    GPU_BUFFER_TYPE_INDIRECT // indirect draw arguments, also writable from compute shaders
 };
 
+struct GpuBufferRangeState;
+
 class GpuBuffer
 {
   public:
@@ -20,20 +24,28 @@ class GpuBuffer
                const void* data, const bool hostVisible, const bool dynamic = false );
     ~GpuBuffer();
 
-    static VkBufferUsageFlags GetBufferUsage( const GpuBufferType type );
-    static VkAccessFlags      GetBufferAccess( const GpuBufferType type );
+    static VkBufferUsageFlags   GetBufferUsage( const GpuBufferType type );
+    static VkAccessFlags        GetBufferAccess( const GpuBufferType type );
+    // Stages that consume a buffer of the given type.
+    static VkPipelineStageFlags GetBufferStages( const GpuBufferType type );
 
   public:
     GpuContext&           context;
-    GpuBuffer*            next        = nullptr;
-    int                   unusedCount = 0;
-    GpuBufferType         type        = {};
-    size_t                size        = 0;
-    VkMemoryPropertyFlags flags       = {};
-    VkBuffer              buffer      = nullptr;
-    VkDeviceMemory        memory      = nullptr;
-    void*                 mapped      = nullptr;
-    bool                  owner       = false;
+    GpuBuffer*            next           = nullptr;
+    int                   unusedCount    = 0;
+    GpuBufferType         type           = {};
+    size_t                size           = 0;
+    VkMemoryPropertyFlags flags          = {};
+    VkBuffer              buffer         = nullptr;
+    VkDeviceMemory        memory         = nullptr;
+    uint64_t              resourceId     = 0; // see GpuDevice::resourceSerial
+    void*                 mapped         = nullptr;
+    bool                  owner          = false;
+    uint32_t              bindlessIndex  = GPU_BINDLESS_INVALID_INDEX;
+    // Allocated by the first GpuStateTracker that uses the buffer.
+    GpuBufferRangeState*  rangeStates    = nullptr;
+    int                   numRangeStates = 0;
+    int                   maxRangeStates = 0;
 };
 
 class GpuDepthBuffer
@@ -4,6 +4,7 @@
 #include "GpuGraphicsCommand.hpp"
 #include "GpuComputeCommand.hpp"
 #include "GpuTexture.hpp"
+#include "GpuEventPool.hpp"
 
 namespace lxd
 {
@@ -21,11 +22,13 @@ enum GpuCommandBufferType
 };
 
 static const int MAX_COMMAND_BUFFER_TIMERS = 16;
+static const int MAX_COMMAND_BUFFER_SPLIT_WAITS = 16; // events per WaitSplitBarriers()
+static const int GPU_UNIFORM_RING_SIZE     = 64 * 1024; // initial size per command buffer in the ring
 
 class GpuContext;
-class GpuFence;
 class GpuBuffer;
-class GpuPipelineResources;
+class GpuDescriptorSetCache;
+class GpuCommandBundle;
 class GpuSwapchainBuffer;
 class GpuFramebuffer;
 class GpuRenderPass;
@@ -33,25 +36,46 @@ class GpuTimer;
 class GpuGeometry;
 struct ScreenRect;
 class GpuVertexAttributeArrays;
+class GpuStateTracker;
 
 class GpuCommandBuffer
 {
   public:
-    GpuCommandBuffer();
+    // 'numBuffers' is the ring size, the number of frames that can be in flight.
+    GpuCommandBuffer( GpuContext* context, const GpuCommandBufferType type, const int numBuffers );
     ~GpuCommandBuffer();
 
 	void BeginPrimary();
 	void EndPrimary();
-	GpuFence * SubmitPrimary();
+	// Returns the timeline value that is reached once the GPU finished the command buffer.
+	uint64_t SubmitPrimary();
 
 	void ChangeTextureUsage(GpuTexture * texture, const GpuTextureUsage usage);
 
+	// Queue family ownership transfers between contexts on different queue families, e.g. a
+	// graphics context and an async compute context. The producer releases the resource at the
+	// end of its work, and the consumer acquires it before its first use, after making its next
+	// submit wait for the producer with consumer->timeline->AddWait(producer->timeline, value,
+	// stages). Between contexts on the same family these only change the usage.
+	void ReleaseTexture(GpuTexture * texture, const GpuContext * dstContext, const GpuTextureUsage usage);
+	void AcquireTexture(GpuTexture * texture, const GpuContext * srcContext, const GpuTextureUsage usage);
+	void ReleaseBuffer(GpuBuffer * buffer, const GpuContext * dstContext);
+	void AcquireBuffer(GpuBuffer * buffer, const GpuContext * srcContext);
+
 	void BeginFramebuffer(GpuFramebuffer * framebuffer, const int arrayLayer, const GpuTextureUsage usage);
 	void EndFramebuffer(GpuFramebuffer * framebuffer, const int arrayLayer, const GpuTextureUsage usage);
 
 	void BeginTimer(GpuTimer * timer);
 	void EndTimer(GpuTimer * timer);
 
+	// Split barrier: signal after the producer and wait right before the consumer, so the
+	// commands recorded in between are not stalled. Both have to be outside a render pass.
+	GpuSplitBarrier SignalSplitBarrier(const VkPipelineStageFlags srcStages);
+	void WaitSplitBarriers(const GpuSplitBarrier * barriers, const int numBarriers,
+		const VkPipelineStageFlags dstStages,
+		const int numBufferBarriers, const VkBufferMemoryBarrier * bufferBarriers,
+		const int numImageBarriers, const VkImageMemoryBarrier * imageBarriers);
+
 	void BeginRenderPass(GpuRenderPass * renderPass, GpuFramebuffer * framebuffer, const ScreenRect * rect);
 	void EndRenderPass(GpuRenderPass * renderPass);
 
@@ -59,7 +83,10 @@ class GpuCommandBuffer
 	void SetScissor(const ScreenRect * rect);
 
 	void SubmitGraphicsCommand(const GpuGraphicsCommand * command);
+	void SubmitIndirectGraphicsCommand(const GpuGraphicsCommand * command, const GpuBuffer * indirectBuffer);
 	void SubmitComputeCommand(const GpuComputeCommand * command);
+	void SubmitIndirectComputeCommand(const GpuComputeCommand * command, const GpuBuffer * indirectBuffer);
+	void ExecuteCommandBundle(const GpuCommandBundle * bundle);
 
 	GpuBuffer * MapBuffer(GpuBuffer * buffer, void ** data);
 	void UnmapBuffer(GpuBuffer * buffer, GpuBuffer * mappedBuffer, const GpuBufferUnmapType type);
@@ -70,16 +97,32 @@ class GpuCommandBuffer
 	GpuBuffer * MapInstanceAttributes(GpuGeometry * geometry, GpuVertexAttributeArrays * attribs);
 	void UnmapInstanceAttributes(GpuGeometry * geometry, GpuBuffer * mappedInstanceBuffer, const GpuBufferUnmapType type);
 
+private:
+	void BindGraphicsCommand(const GpuGraphicsCommand * command);
+	void BindComputeCommand(const GpuComputeCommand * command);
+	void MakeComputeWritesAvailable(const GpuComputeCommand * command);
+	void UpdateProgramParms(const GpuProgramParmLayout * newLayout, const GpuProgramParmLayout * oldLayout,
+		const GpuProgramParmState * newParmState, const GpuProgramParmState * oldParmState,
+		const VkPipelineBindPoint bindPoint);
+	uint32_t UploadUniformData(const void * data, const int size);
+	void GrowUniformRing(const int size);
+	void FlushUniformRing();
+	void ManageTimers();
+
 public:
 	GpuCommandBufferType   type = {};
 	int                    numBuffers = {};
 	int                    currentBuffer = {};
 	VkCommandBuffer*       cmdBuffers = {};
 	GpuContext*            context = {};
-	GpuFence*              fences = {};
+	uint64_t*              submitValues = {}; // timeline value of the last submit per buffer
+	uint64_t               recordingTicket = {}; // ticket of the open recording, or 0
 	GpuBuffer**            mappedBuffers = {};
 	GpuBuffer**            oldMappedBuffers = {};
-	GpuPipelineResources** pipelineResources = {};
+	GpuDescriptorSetCache** descriptorSetCaches = {};
+	GpuEventPool**         eventPools = {};
+	GpuBuffer**            uniformRings = {};
+	int                    uniformRingOffset = {};
 	GpuSwapchainBuffer*    swapchainBuffer = {};
 	GpuGraphicsCommand     currentGraphicsState = {};
 	GpuComputeCommand      currentComputeState = {};
@@ -87,5 +130,6 @@ public:
 	GpuRenderPass*         currentRenderPass = {};
 	GpuTimer*              currentTimers[MAX_COMMAND_BUFFER_TIMERS] = {};
 	int                    currentTimerCount = {};
+	GpuStateTracker*       stateTracker = {}; // barriers are batched until the next command
 };
 } // namespace lxd
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "Gfx.hpp"
+#include "GpuGraphicsCommand.hpp"
+
+namespace lxd
+{
+
+static const int GPU_COMMAND_BUNDLE_SPILL_SIZE = 16 * 1024; // initial size of the spill buffer
+
+class GpuContext;
+class GpuBuffer;
+class GpuRenderPass;
+class GpuDescriptorSetCache;
+struct ScreenRect;
+
+// A sequence of graphics commands that is recorded once into a secondary command buffer and then
+// replayed every frame with GpuCommandBuffer::ExecuteCommandBundle(), for content that does not
+// change from frame to frame such as static world geometry or UI chrome.
+// The bundle keeps track of every pipeline, buffer and texture it references. When one of them
+// is destroyed or recreated the bundle becomes invalid, and it has to be recorded again before
+// it can be executed. Recording may only start again once the GPU no longer executes the bundle.
+// The bundle can only be executed inside 'renderPass', which must be of type
+// GPU_RENDERPASS_TYPE_SECONDARY_COMMAND_BUFFERS.
+class GpuCommandBundle
+{
+  public:
+    GpuCommandBundle( GpuContext* context, GpuRenderPass* renderPass );
+    ~GpuCommandBundle();
+
+    // The viewport and scissor are not inherited from the primary command buffer.
+    void Begin( const ScreenRect* rect );
+    void SubmitGraphicsCommand( const GpuGraphicsCommand* command );
+    void End();
+
+    bool IsValid() const { return this->valid; }
+    // Called through GpuContext::InvalidateCommandBundles() when a resource goes away.
+    void Invalidate( const void* resource );
+
+  private:
+    void     AddReference( const void* resource );
+    void     UpdateProgramParms( const GpuProgramParmLayout* newLayout,
+                                 const GpuProgramParmLayout* oldLayout,
+                                 const GpuProgramParmState*  newParmState,
+                                 const GpuProgramParmState*  oldParmState );
+    uint32_t UploadSpillData( const void* data, const int size );
+    void     NewSpillBuffer( const int size );
+    void     FlushSpillBuffer();
+
+  public:
+    GpuContext&            context;
+    GpuRenderPass*         renderPass           = nullptr;
+    VkCommandBuffer        cmdBuffer            = VK_NULL_HANDLE;
+    GpuDescriptorSetCache* descriptorSetCache   = nullptr; // never reset while the bundle is valid
+    GpuBuffer*             spillBuffer          = nullptr; // spilled push constants, created on use
+    int                    spillBufferOffset    = 0;
+    // Spill buffers that ran out of space during this recording, read by the draws before.
+    GpuBuffer**            fullSpillBuffers     = nullptr;
+    int                    numFullSpillBuffers  = 0;
+    int                    maxFullSpillBuffers  = 0;
+    const void**           references           = nullptr;
+    int                    numReferences        = 0;
+    int                    maxReferences        = 0;
+    GpuGraphicsCommand     currentGraphicsState = {};
+    bool                   recording            = false;
+    bool                   valid                = false;
+    GpuCommandBundle*      next                 = nullptr; // next bundle of the context
+};
+
+} // namespace lxd
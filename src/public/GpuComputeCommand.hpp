@@ -1,13 +1,39 @@
 #pragma once
+#include "GpuGraphicsProgram.hpp"
 
 namespace lxd
 {
-	class GpuComputeCommand
-	{
-	public:
-		GpuComputeCommand();
-		~GpuComputeCommand();
+class GpuComputePipeline;
+class GpuBuffer;
+class GpuTexture;
+class Vector2;
+class Vector3;
+class Vector4;
+class Matrix4x4;
+class GpuComputeCommand
+{
+  public:
+    GpuComputeCommand();
+    ~GpuComputeCommand();
 
+    void SetPipeline( const GpuComputePipeline* pipeline );
+    void SetParmTextureSampled( const int index, const GpuTexture* texture );
+    void SetParmTextureStorage( const int index, const GpuTexture* texture );
+    void SetParmBufferUniform( const int index, const GpuBuffer* buffer );
+    void SetParmBufferStorage( const int index, const GpuBuffer* buffer );
+    void SetParmInt( const int index, const int* value );
+    void SetParmFloat( const int index, const float* value );
+    void SetParmFloatVector2( const int index, const Vector2* value );
+    void SetParmFloatVector3( const int index, const Vector3* value );
+    void SetParmFloatVector4( const int index, const Vector4* value );
+    void SetParmFloatMatrix4x4( const int index, const Matrix4x4* value );
+    // Number of work groups, ignored by GpuCommandBuffer::SubmitIndirectComputeCommand().
+    void SetDimensions( const int x, const int y, const int z );
 
-	};
-}
\ No newline at end of file
+    const GpuComputePipeline* pipeline  = {};
+    GpuProgramParmState       parmState = {};
+    int                       x         = {};
+    int                       y         = {};
+    int                       z         = {};
+};
+} // namespace lxd
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "Gfx.hpp"
+#include "GpuContext.hpp"
+
+namespace lxd
+{
+
+class GpuComputeProgram;
+
+class GpuComputePipeline
+{
+  public:
+    GpuComputePipeline( GpuContext* context, const GpuComputeProgram* program );
+    ~GpuComputePipeline();
+
+    GpuContext&              context;
+    const GpuComputeProgram* program  = nullptr;
+    VkPipeline               pipeline = VK_NULL_HANDLE;
+};
+} // namespace lxd
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "Gfx.hpp"
+#include "GpuGraphicsProgram.hpp"
+
+namespace lxd
+{
+class GpuComputeProgram
+{
+  public:
+    GpuComputeProgram( GpuContext* context, const void* computeSourceData,
+                       const size_t computeSourceSize, const GpuProgramParm* parms,
+                       const int numParms );
+    GpuComputeProgram( GpuContext* context, const GpuShaderBlob* computeShader,
+                       const GpuProgramParm* parms, const int numParms );
+    // The parms are reflected from the SPIR-V, see GpuProgramReflection.
+    GpuComputeProgram( GpuContext* context, const GpuShaderBlob* computeShader );
+    ~GpuComputeProgram();
+
+  private:
+    void InitStage();
+
+  public:
+    GpuContext&                     context;
+    GpuShader*                      computeShader; // from the shader cache of the device
+    VkPipelineShaderStageCreateInfo pipelineStage;
+    GpuProgramReflection*           reflection = nullptr; // owns the parms
+    GpuProgramParmLayout            parmLayout;
+};
+} // namespace lxd
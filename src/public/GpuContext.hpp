@@ -1,11 +1,20 @@
 #pragma once
 
 #include "Gfx.hpp"
+#include "GpuDevice.hpp"
+#include "threading.h"
 
 namespace lxd
 {
 
 class GpuDevice;
+class GpuBindlessTable;
+class GpuCommandBundle;
+class GpuTimeline;
+class GpuSubmitBatch;
+class GpuSubmitQueue;
+class GpuDeletionQueue;
+class GpuPipelineRegistry;
 
 enum GpuSurfaceColorFormat
 {
@@ -35,6 +44,13 @@ enum GpuSampleCount
     GPU_SAMPLE_COUNT_64 = VK_SAMPLE_COUNT_64_BIT,
 };
 
+// The parts of GpuRasterOperations that are set when drawing instead of baked into pipelines.
+enum GpuDynamicRasterState
+{
+    GPU_DYNAMIC_RASTER_STATE_DEPTH_CULL = 0b1,  // cull mode, front face, depth test and blend color
+    GPU_DYNAMIC_RASTER_STATE_BLEND      = 0b10, // blend enable, blend equation and write mask
+};
+
 struct GpuLimits
 {
     size_t maxPushConstantsSize;
@@ -54,7 +70,12 @@ class GpuContext
         unsigned char depthBits;
     };
 
-    GpuContext( GpuDevice* device, const int queueIndex );
+    // A context with only GPU_QUEUE_PROPERTY_COMPUTE uses a queue of the async compute family
+    // of the device, so its work overlaps with the graphics queue. Resources are shared with
+    // such a context through the queue family ownership transfers of GpuCommandBuffer, and the
+    // submits are ordered with GpuTimeline::AddWait().
+    GpuContext( GpuDevice* device, const int queueIndex,
+                const int queueProperties = GPU_QUEUE_PROPERTY_GRAPHICS );
     ~GpuContext();
 
     GpuSurfaceBits BitsForSurfaceFormat( const GpuSurfaceColorFormat colorFormat,
@@ -71,6 +92,45 @@ class GpuContext
     void CreateSetupCmdBuffer();
     void FlushSetupCmdBuffer();
 
+    // Must be called before any textures, buffers or programs are created.
+    // Returns false if the device does not support descriptor indexing.
+    bool EnableBindless();
+    // Moves the submits to a dedicated thread, so any thread can submit to the queue without a
+    // lock, see GpuSubmitQueue. Returns false if the device does not support timeline semaphores.
+    bool EnableSubmitQueue();
+    // Must be called before any graphics pipelines are created. Sets the raster operations with
+    // VK_EXT_extended_dynamic_state when drawing, so pipelines that only differ in those share one
+    // VkPipeline, see GpuGraphicsCommand::SetRasterOperations(). The blend state is only dynamic
+    // with VK_EXT_extended_dynamic_state3. Returns false without extended dynamic state.
+    bool EnableDynamicRasterState();
+    // Must be called before any graphics pipelines are created. Graphics pipelines are linked from
+    // VK_EXT_graphics_pipeline_library parts that are shared through the pipeline registry, so a
+    // new combination of known parts only costs a link. Returns false without pipeline libraries.
+    bool EnablePipelineLibraries();
+
+    // Pipeline compilation dominates the startup time, so the pipeline cache is kept on disk.
+    // Load before the first pipeline is created. The file is merged into the cache of the context,
+    // so the handle never changes, but vkMergePipelineCaches needs the cache externally
+    // synchronized, so no GpuPipelineCompiler of the context may be compiling at that time.
+    // A file written for another device, driver version or pipeline cache UUID, or a truncated
+    // file, is ignored and false is returned.
+    bool LoadPipelineCache( const char* fileName );
+    // Writes to a temporary file that replaces 'fileName' once complete, so a crash while saving
+    // never leaves a broken cache behind.
+    bool SavePipelineCache( const char* fileName );
+    // Adds the pipelines compiled by a context on the same device, so one file covers both.
+    // Like LoadPipelineCache(), vkMergePipelineCaches needs the cache of this context externally
+    // synchronized, so no GpuPipelineCompiler of this context may be compiling and no other
+    // thread may create pipelines with this context at that time. The cache of 'other' is only
+    // read and may be in use.
+    void MergePipelineCache( const GpuContext* other );
+
+    // Command bundles register themselves so they can be invalidated when a pipeline, program,
+    // buffer or texture they reference is destroyed or recreated.
+    void RegisterCommandBundle( GpuCommandBundle* bundle );
+    void UnregisterCommandBundle( GpuCommandBundle* bundle );
+    void InvalidateCommandBundles( const void* resource );
+
   public:
     GpuDevice*      device;
     uint32_t        queueFamilyIndex;
@@ -79,6 +139,22 @@ class GpuContext
     VkCommandPool   commandPool;
     VkPipelineCache pipelineCache;
     VkCommandBuffer setupCommandBuffer;
+    uint64_t        setupRecordingTicket; // see GpuTimeline::BeginRecording()
+
+    GpuTimeline*      timeline;      // submit values of the queue
+    GpuSubmitBatch*   submitBatch;   // all submits to the queue go through here
+    GpuSubmitQueue*   submitQueue;   // nullptr unless EnableSubmitQueue() succeeded
+    GpuDeletionQueue* deletionQueue; // objects released while the GPU may still use them
+
+    GpuPipelineRegistry* pipelineRegistry; // graphics pipelines shared by state
+
+    GpuBindlessTable* bindless; // nullptr unless EnableBindless() succeeded
+
+    int  dynamicRasterState; // GpuDynamicRasterState flags set by EnableDynamicRasterState()
+    bool pipelineLibraries;  // set by EnablePipelineLibraries()
+
+    GpuCommandBundle* commandBundles; // linked through GpuCommandBundle::next
+    ksMutex           commandBundleMutex;
 };
 
 } // namespace lxd
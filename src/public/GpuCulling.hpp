@@ -0,0 +1,89 @@
+#pragma once
+
+#include "Gfx.hpp"
+#include "GpuBuffer.hpp"
+#include "GpuComputePipeline.hpp"
+#include "GpuComputeProgram.hpp"
+#include "GpuTexture.hpp"
+
+namespace lxd
+{
+
+class GpuCommandBuffer;
+class GpuGeometry;
+
+static const int GPU_CULLING_WORKGROUP_SIZE = 64;
+
+enum GpuCullingFlags
+{
+    GPU_CULLING_FLAG_FRUSTUM   = 0b01,
+    GPU_CULLING_FLAG_OCCLUSION = 0b10
+};
+
+// Layout of the per-instance bounds.
+enum GpuCullingBounds
+{
+    GPU_CULLING_BOUNDS_SPHERE, // one vec4: xyz = world space center, w = radius
+    GPU_CULLING_BOUNDS_AABB    // two vec4: xyz = world space minimum, then xyz = maximum
+};
+
+// Layout matches the std140 'CullParms' uniform block of the culling compute shader.
+struct GpuCullingParms
+{
+    float    planes[6][4];       // left, right, bottom, top, near, far (xyz = normal, w = distance)
+    float    viewProjection[16]; // column-major, clip space depth in [0, 1]
+    float    hiZParms[4];        // Hi-Z width, height, mip count, unused
+    uint32_t counts[4];          // instance count, GpuCullingFlags, GpuCullingBounds, unused
+
+    void SetViewProjection( const float* viewProjection );
+};
+
+// Hi-Z pyramid on the CPU, used by the reference implementation.
+// Each level stores the farthest depth of the 2x2 texels below it.
+struct GpuCullingHiZ
+{
+    const float* const* levels;
+    int                 width;
+    int                 height;
+    int                 mipCount;
+};
+
+// Culls per-instance bounding spheres or boxes against the view frustum and the Hi-Z pyramid of
+// the previous frame. The indices of the surviving instances are compacted into
+// 'visibleInstanceBuffer' and their count is written to the instanceCount of the single
+// VkDrawIndexedIndirectCommand in 'indirectBuffer', ready for
+// GpuCommandBuffer::SubmitIndirectGraphicsCommand(). The vertex program fetches its instance
+// data through visibleInstances[gl_InstanceIndex].
+class GpuCullingPass
+{
+  public:
+    GpuCullingPass( GpuContext* context, const int maxInstances );
+    ~GpuCullingPass();
+
+    // 'boundsBuffer' holds the bounds of each instance in the layout of 'boundsType'.
+    // 'hiZ' is the depth pyramid of the previous frame in GPU_TEXTURE_USAGE_SAMPLED usage,
+    // or nullptr to only cull against the frustum.
+    void Cull( GpuCommandBuffer* commandBuffer, const GpuBuffer* boundsBuffer,
+               const int instanceCount, const GpuGeometry* geometry, const GpuTexture* hiZ,
+               const GpuCullingBounds boundsType = GPU_CULLING_BOUNDS_SPHERE );
+
+    // CPU reference implementation of the compute shader. Returns the number of visible
+    // instances written to 'visibleInstances' in ascending instance order.
+    static int CullReference( const GpuCullingParms* parms, const float* bounds,
+                              const int instanceCount, const GpuCullingHiZ* hiZ,
+                              uint32_t*              visibleInstances,
+                              const GpuCullingBounds boundsType = GPU_CULLING_BOUNDS_SPHERE );
+
+  public:
+    GpuContext&        context;
+    int                maxInstances;
+    GpuCullingParms    parms;
+    GpuComputeProgram  program;
+    GpuComputePipeline pipeline;
+    GpuBuffer          parmBuffer;
+    GpuBuffer          indirectBuffer;
+    GpuBuffer          visibleInstanceBuffer;
+    GpuTexture         emptyHiZ;
+};
+
+} // namespace lxd
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "Gfx.hpp"
+#include "GpuDevice.hpp"
+#include "threading.h"
+
+namespace lxd
+{
+
+class GpuContext;
+
+enum GpuDeletionType
+{
+    GPU_DELETION_TYPE_BUFFER,
+    GPU_DELETION_TYPE_IMAGE,
+    GPU_DELETION_TYPE_IMAGE_VIEW,
+    GPU_DELETION_TYPE_SAMPLER,
+    GPU_DELETION_TYPE_MEMORY,
+    GPU_DELETION_TYPE_PIPELINE,
+    GPU_DELETION_TYPE_SHADER_MODULE,
+    GPU_DELETION_TYPE_BINDLESS_TEXTURE, // index in the bindless table
+    GPU_DELETION_TYPE_BINDLESS_BUFFER
+};
+
+// Vulkan objects that are released while the GPU may still use them. Any queue of the device may
+// use an object, e.g. an async compute context, so each object is tagged with a ticket per
+// timeline of the device. Once the recordings that were open when the object was released are
+// submitted, the ticket resolves to the value of those submits, and the object is destroyed once
+// every timeline completed its value. Releasing an object never has to wait for a queue to drain.
+// Destroy() may be called from any thread. Collect() is called from BeginPrimary() on the thread
+// that records the context.
+class GpuDeletionQueue
+{
+  public:
+    GpuDeletionQueue( GpuContext* context );
+    // Waits for the queues of all contexts and destroys everything that is still pending.
+    ~GpuDeletionQueue();
+
+    // Non-dispatchable handles are passed as uint64_t, as in VkDebugUtilsObjectNameInfoEXT.
+    void Destroy( const GpuDeletionType type, const uint64_t handle );
+    // Destroys the objects of all submits that completed.
+    void Collect();
+
+  private:
+    // Where the object stands on the timeline in one slot of GpuDevice::timelines.
+    struct Tag
+    {
+        uint32_t serial;   // 0 once the timeline no longer uses the object
+        bool     resolved; // 'ticket' resolved to 'value'
+        uint64_t ticket;
+        uint64_t value;
+    };
+
+    struct Entry
+    {
+        GpuDeletionType type;
+        uint64_t        handle;
+        Tag             tags[GPU_MAX_TIMELINES];
+    };
+
+    bool IsReleased( Entry* entry );
+    void DestroyNow( const Entry* entry );
+
+  public:
+    GpuContext& context;
+    Entry*      entries    = nullptr; // in the order they were released
+    int         numEntries = 0;
+    int         maxEntries = 0;
+    ksMutex     mutex;
+};
+
+} // namespace lxd
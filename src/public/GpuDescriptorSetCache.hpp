@@ -0,0 +1,77 @@
+#pragma once
+
+#include "Gfx.hpp"
+#include "GpuGraphicsProgram.hpp"
+
+namespace lxd
+{
+
+class GpuBuffer;
+
+static const int GPU_DESCRIPTOR_POOL_MAX_SETS     = 64;
+static const int GPU_DESCRIPTOR_SET_CACHE_BUCKETS = 256;
+
+// Identifies the contents of a descriptor set: the set layout plus the resource written to each
+// binding (resource ID + range), followed by the uniform buffer of the spilled push constants if
+// the layout has any. Resource IDs are never reused, unlike Vulkan handles, so a set that still
+// references a destroyed resource is never returned for a new one; it is dropped with the rest.
+struct GpuDescriptorSetKey
+{
+    VkDescriptorSetLayout layout;
+    int                   numBindings;
+    uint64_t              resources[MAX_PROGRAM_PARMS + 1][2];
+
+    void         Set( const GpuProgramParmLayout* parmLayout, const GpuProgramParmState* parmState,
+                      const GpuBuffer* spillBuffer );
+    unsigned int Hash() const;
+    bool         Equals( const GpuDescriptorSetKey* other ) const;
+};
+
+// Descriptor sets that are written once and then reused for as long as the same resources
+// are bound with the same layout, across draws and across frames.
+// There is one cache per command buffer in the ring. All sets come from a chain of descriptor
+// pools that is only ever reset as a whole, and only from BeginFrame() after the fence of the
+// command buffer has been waited on, so no set is reset while the GPU may still read it.
+class GpuDescriptorSetCache
+{
+  public:
+    GpuDescriptorSetCache( GpuContext* context );
+    ~GpuDescriptorSetCache();
+
+    // Must be called after the GPU finished executing the previous use of the command buffer.
+    void            BeginFrame();
+    // 'spillBuffer' is only used when the layout spills push constants.
+    VkDescriptorSet GetDescriptorSet( const GpuProgramParmLayout* parmLayout,
+                                      const GpuProgramParmState*  parmState,
+                                      const GpuBuffer*            spillBuffer );
+
+  private:
+    struct Entry
+    {
+        GpuDescriptorSetKey key;
+        unsigned int        hash;
+        int                 lastUsedFrame;
+        VkDescriptorSet     descriptorSet;
+        Entry*              next;
+    };
+
+    void            Reset();
+    VkDescriptorSet AllocateDescriptorSet( const GpuProgramParmLayout* parmLayout );
+    void            WriteDescriptorSet( const VkDescriptorSet       descriptorSet,
+                                        const GpuProgramParmLayout* parmLayout,
+                                        const GpuProgramParmState*  parmState,
+                                        const GpuBuffer*            spillBuffer );
+
+  public:
+    GpuContext&       context;
+    VkDescriptorPool* pools                                     = nullptr;
+    int               numPools                                  = 0;
+    int               currentPool                               = 0;
+    int               currentPoolSets                           = 0;
+    Entry*            buckets[GPU_DESCRIPTOR_SET_CACHE_BUCKETS] = {};
+    int               numSets                                   = 0;
+    int               numSetsUsed                               = 0;
+    int               frame                                     = 0;
+};
+
+} // namespace lxd
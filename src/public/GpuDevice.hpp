@@ -2,17 +2,21 @@
 
 #include "Gfx.hpp"
 #include "threading.h"
+#include <atomic>
 
 namespace lxd
 {
 
 class GpuInstance;
+class GpuShaderCache;
+class GpuLayoutCache;
+class GpuTimeline;
 
 enum GpuQueueProperty
 {
-    GPU_QUEUE_PROPERTY_GRAPHICS = 0b0,
-    GPU_QUEUE_PROPERTY_COMPUTE  = 0b1,
-    GPU_QUEUE_PROPERTY_TRANSFER = 0b10
+    GPU_QUEUE_PROPERTY_GRAPHICS = 0b1,
+    GPU_QUEUE_PROPERTY_COMPUTE  = 0b10,
+    GPU_QUEUE_PROPERTY_TRANSFER = 0b100
 };
 
 enum GpuQueuePriority
@@ -22,12 +26,14 @@ enum GpuQueuePriority
     GPU_QUEUE_PRIORITY_HIGH
 };
 
-static int const MAX_QUEUES = 16;
+static int const MAX_QUEUES        = 16;
+static int const GPU_MAX_TIMELINES = 16; // contexts that exist at the same time
 struct GpuQueueInfo
 {
     int              queueCount;                  // number of queues
     GpuQueueProperty queueProperties;             // desired queue family properties
     GpuQueuePriority queuePriorities[MAX_QUEUES]; // individual queue priorities
+    int computeQueueCount; // queues on a compute-only family for async compute, if there is one
 };
 
 class GpuDevice
@@ -40,8 +46,7 @@ class GpuDevice
     uint32_t GetMemoryTypeIndex( const uint32_t              typeBits,
                                  const VkMemoryPropertyFlags requiredProperties );
 
-    void CreateShader( VkShaderModule* shaderModule, const VkShaderStageFlagBits stage,
-                       const void* code, size_t codeSize );
+    bool IsExtensionEnabled( const char* extensionName ) const;
 
   private:
     bool SelectPhysicalDevice( GpuInstance* instance, const GpuQueueInfo* queueInfo,
@@ -64,6 +69,51 @@ class GpuDevice
     ksMutex                          queueFamilyMutex;
     int                              workQueueFamilyIndex;
     int                              presentQueueFamilyIndex;
+    int                              computeQueueFamilyIndex; // -1 without async compute queues
+
+    // VK_EXT_descriptor_indexing, required for GpuBindlessTable. The properties hold the
+    // update-after-bind limits that bound the size of the table.
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT   descriptorIndexingFeatures;
+    VkPhysicalDeviceDescriptorIndexingPropertiesEXT descriptorIndexingProperties;
+    bool                                            supportsBindless;
+
+    // VK_KHR_synchronization2, used for barriers with per-barrier stage masks when available.
+    VkPhysicalDeviceSynchronization2FeaturesKHR synchronization2Features;
+    bool                                        supportsSynchronization2;
+
+    // VK_KHR_timeline_semaphore (core in Vulkan 1.2), GpuTimeline falls back to fences without it.
+    VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineSemaphoreFeatures;
+    bool                                         supportsTimelineSemaphores;
+
+    // VK_EXT_shader_module_identifier, with VK_EXT_pipeline_creation_cache_control to try the
+    // pipeline cache first. Lets GpuShaderCache skip creating modules.
+    VkPhysicalDevicePipelineCreationCacheControlFeaturesEXT pipelineCreationCacheControlFeatures;
+    VkPhysicalDeviceShaderModuleIdentifierFeaturesEXT       shaderModuleIdentifierFeatures;
+    bool                                                    supportsShaderModuleIdentifiers;
+
+    // VK_EXT_extended_dynamic_state for the depth and cull state, VK_EXT_extended_dynamic_state3
+    // for the blend state, see GpuContext::EnableDynamicRasterState().
+    VkPhysicalDeviceExtendedDynamicStateFeaturesEXT  extendedDynamicStateFeatures;
+    VkPhysicalDeviceExtendedDynamicState3FeaturesEXT extendedDynamicState3Features;
+    bool                                             supportsExtendedDynamicState;
+    bool                                             supportsExtendedDynamicState3;
+
+    // VK_EXT_graphics_pipeline_library, see GpuContext::EnablePipelineLibraries().
+    VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT graphicsPipelineLibraryFeatures;
+    bool                                               supportsGraphicsPipelineLibrary;
+
+    GpuShaderCache* shaderCache; // shader modules shared by all contexts
+    GpuLayoutCache* layoutCache; // descriptor set and pipeline layouts shared by all programs
+
+    // The timelines of all contexts, so an object that is released waits for every queue that
+    // may use it, see GpuDeletionQueue. A slot is null once its timeline is destroyed.
+    GpuTimeline* timelines[GPU_MAX_TIMELINES];
+    uint32_t     timelineSerial; // last serial handed out
+    ksMutex      timelineMutex;
+
+    // Last GpuBuffer or GpuTexture ID handed out. Unlike Vulkan handles these are never reused,
+    // so descriptor sets can be cached by them after a resource is destroyed.
+    std::atomic<uint64_t> resourceSerial;
 
     // The logical device.
     VkDevice device;
@@ -196,5 +246,18 @@ class GpuDevice
     PFN_vkGetSwapchainImagesKHR vkGetSwapchainImagesKHR;
     PFN_vkAcquireNextImageKHR   vkAcquireNextImageKHR;
     PFN_vkQueuePresentKHR       vkQueuePresentKHR;
+    PFN_vkCmdPipelineBarrier2KHR vkCmdPipelineBarrier2KHR; // null without synchronization2
+    PFN_vkGetSemaphoreCounterValueKHR vkGetSemaphoreCounterValueKHR; // null without timelines
+    PFN_vkWaitSemaphoresKHR           vkWaitSemaphoresKHR;
+    PFN_vkGetShaderModuleCreateInfoIdentifierEXT
+        vkGetShaderModuleCreateInfoIdentifierEXT; // null without shader module identifiers
+    PFN_vkCmdSetCullModeEXT            vkCmdSetCullModeEXT; // null without extended dynamic state
+    PFN_vkCmdSetFrontFaceEXT           vkCmdSetFrontFaceEXT;
+    PFN_vkCmdSetDepthTestEnableEXT     vkCmdSetDepthTestEnableEXT;
+    PFN_vkCmdSetDepthWriteEnableEXT    vkCmdSetDepthWriteEnableEXT;
+    PFN_vkCmdSetDepthCompareOpEXT      vkCmdSetDepthCompareOpEXT;
+    PFN_vkCmdSetColorBlendEnableEXT    vkCmdSetColorBlendEnableEXT; // null without state 3
+    PFN_vkCmdSetColorBlendEquationEXT  vkCmdSetColorBlendEquationEXT;
+    PFN_vkCmdSetColorWriteMaskEXT      vkCmdSetColorWriteMaskEXT;
 };
 } // namespace lxd
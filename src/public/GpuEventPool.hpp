@@ -0,0 +1,41 @@
+#pragma once
+
+#include "Gfx.hpp"
+
+namespace lxd
+{
+
+class GpuContext;
+
+// Events for split barriers: the producer signals an event right after it is recorded, and the
+// consumer waits on it right before it is recorded, so unrelated work in between can overlap
+// with the producer instead of being stalled by a full pipeline barrier.
+struct GpuSplitBarrier
+{
+    VkEvent              event;
+    VkPipelineStageFlags srcStages; // stages passed to vkCmdSetEvent()
+};
+
+// There is one pool per command buffer in the ring. Events are handed out in order during a
+// frame and only reset by BeginFrame() after the fence of the command buffer has been waited
+// on, so an event is never reset while the GPU may still signal or wait on it.
+class GpuEventPool
+{
+  public:
+    GpuEventPool( GpuContext* context );
+    ~GpuEventPool();
+
+    // Must be called after the GPU finished executing the previous use of the command buffer.
+    void    BeginFrame();
+    // Returns an event in the unsignaled state, valid until the next BeginFrame().
+    VkEvent Allocate();
+
+  public:
+    GpuContext& context;
+    VkEvent*    events    = nullptr;
+    int         numEvents = 0;
+    int         maxEvents = 0;
+    int         numUsed   = 0;
+};
+
+} // namespace lxd
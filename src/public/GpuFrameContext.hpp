@@ -0,0 +1,80 @@
+#pragma once
+
+#include "Gfx.hpp"
+#include "threading.h"
+
+namespace lxd
+{
+
+class GpuContext;
+class GpuCommandBuffer;
+
+static const int GPU_MAX_FRAMES_IN_FLIGHT     = 4;
+static const int GPU_FRAME_SIMULATION_BUFFERS = 2; // one is simulated while the other is recorded
+
+struct GpuFrame
+{
+    uint64_t index;          // 1 for the first frame
+    int      slot;           // per-frame resources in the command buffer ring, set while recording
+    int      framesInFlight; // pacing at the time the frame was simulated
+    void*    simulationData; // written by the simulation, read while recording
+};
+
+typedef void ( *GpuFrameRecordFunc )( GpuCommandBuffer* commandBuffer, const GpuFrame* frame,
+                                      void* userData );
+
+// Owns the frames in flight of a context. The command buffer ring holds the per-frame resources
+// (command buffers, mapped buffers, descriptor pools, uniform rings and events), so one frame
+// index selects all of them. Timers for the frames should delay their results by 'numFrames',
+// see GpuTimer.
+// Every frame is first simulated on the calling thread between BeginSimulation() and
+// SubmitFrame(), and then recorded and submitted by the record function. When pipelined, the
+// recording happens on a separate thread, so frame N+1 is simulated while frame N is recorded
+// and frame N-1 executes on the GPU, at the cost of one more frame of latency.
+// Both the number of frames in flight (1 for the lowest latency, 'numFrames' for the highest
+// throughput) and the pipelining can be changed at runtime. While pipelined, only the record
+// thread may submit to the queue of the context; call WaitRecording() before using it elsewhere.
+class GpuFrameContext
+{
+  public:
+    GpuFrameContext( GpuContext* context, const int numFrames, const size_t simulationDataSize,
+                     GpuFrameRecordFunc recordFunc, void* userData );
+    // Waits for the frames that are still recorded or executed.
+    ~GpuFrameContext();
+
+    void SetFramesInFlight( const int framesInFlight ); // 1 to 'numFrames'
+    void SetPipelined( const bool pipelined );
+
+    // Returns the simulation data of the next frame. Without pipelining this first waits until
+    // the GPU is less than 'framesInFlight' frames behind, so the simulation starts as late as
+    // possible.
+    void* BeginSimulation();
+    // Records and submits the simulated frame, or hands it to the record thread.
+    void SubmitFrame();
+    // Waits until the record thread submitted all frames.
+    void WaitRecording();
+
+  private:
+    static void RecordThreadFunction( void* data );
+    void        RecordFrame( GpuFrame* frame );
+    void        PaceFrame( const GpuFrame* frame );
+
+  public:
+    GpuContext&        context;
+    int                numFrames           = 0;
+    int                framesInFlight      = 0;
+    bool               pipelined           = false;
+    GpuCommandBuffer*  commandBuffer       = nullptr;
+    GpuFrameRecordFunc recordFunc          = nullptr;
+    void*              userData            = nullptr;
+    void*              simulationData[GPU_FRAME_SIMULATION_BUFFERS] = {};
+    uint64_t           frameIndex          = 0;  // last frame that started simulating
+    GpuFrame           simulatedFrame      = {}; // between BeginSimulation() and SubmitFrame()
+    GpuFrame           recordedFrame       = {}; // handed to the record thread
+    // Timeline value of every frame, indexed by frame index modulo GPU_MAX_FRAMES_IN_FLIGHT.
+    uint64_t           frameValues[GPU_MAX_FRAMES_IN_FLIGHT] = {};
+    ksThread           recordThread;
+    bool               recordThreadCreated = false;
+};
+
+} // namespace lxd
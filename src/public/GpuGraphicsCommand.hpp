@@ -1,4 +1,5 @@
 #pragma once
+#include "GpuGraphicsPipeline.hpp"
 #include "GpuGraphicsProgram.hpp"
 
 namespace lxd
@@ -29,6 +30,11 @@ class GpuGraphicsCommand
     void SetParmFloatVector4( const int index, const Vector3* value );
     void SetParmFloatMatrix4x4( const int index, const Matrix4x4* value );
     void SetNumInstances( const int numInstances );
+    // Only with GpuContext::EnableDynamicRasterState(), the parts of 'rop' that are dynamic
+    // replace those of the pipeline for this draw. The others have to match the pipeline.
+    void SetRasterOperations( const GpuRasterOperations* rop );
+
+    const GpuRasterOperations* GetRasterOperations() const;
 
     const GpuGraphicsPipeline* pipeline = {};
     const GpuBuffer*           vertexBuffer =
@@ -37,5 +43,7 @@ class GpuGraphicsCommand
         {}; // instance buffer returned by GpuCommandBuffer_MapInstanceAttributes
     GpuProgramParmState parmState    = {};
     int                 numInstances = {};
+    GpuRasterOperations rop          = {};
+    bool                hasRop       = false; // draw with 'rop' instead of the pipeline rop
 };
 } // namespace lxd
@@ -3,12 +3,16 @@
 #include "Gfx.hpp"
 #include "Matrix.hpp"
 #include "GpuContext.hpp"
+#include "GpuGraphicsProgram.hpp"
+#include "GpuPipelineCompiler.hpp"
+#include "GpuPipelineRegistry.hpp"
+
+#include <atomic>
 
 namespace lxd
 {
 
 class GpuRenderPass;
-class GpuGraphicsProgram;
 class GpuGeometry;
 
 typedef enum
@@ -119,6 +123,9 @@ struct GpuGraphicsPipelineParms
     const GpuRenderPass*      renderPass;
     const GpuGraphicsProgram* program;
     const GpuGeometry*        geometry;
+    // For the specialization constants declared on the program. A pipeline without values can
+    // serve as the fallback of specialized variants that are compiled asynchronously.
+    GpuSpecializationValues   specialization;
 };
 
 class GpuGraphicsPipeline
@@ -126,13 +133,54 @@ class GpuGraphicsPipeline
   public:
     GpuGraphicsPipeline(GpuContext* context,
 		const GpuGraphicsPipelineParms* parms);
+    // Returns right away and compiles on a worker of the compiler. Until then draws use the
+    // fallback if that is ready, which has to use the same program and geometry, and are skipped
+    // otherwise. The render pass, program and geometry have to stay alive until it is compiled.
+    // With pipeline libraries whose parts are all cached, the pipeline is fast-linked right away
+    // instead, and the worker links an optimized pipeline that replaces it. Parts that are not
+    // cached yet are compiled by the worker.
+    // 'compiledFunc' is called from GpuPipelineCompiler::Update() once the pipeline is ready.
+    GpuGraphicsPipeline(GpuContext* context,
+		const GpuGraphicsPipelineParms* parms, GpuPipelineCompiler* compiler,
+		const GpuGraphicsPipeline* fallback = nullptr,
+		GpuPipelineCompiledFunc compiledFunc = nullptr, void* compiledUserData = nullptr);
     ~GpuGraphicsPipeline();
 
+    // The pipeline to draw with: this one once compiled, otherwise the fallback if that is
+    // compiled, otherwise nullptr.
+    const GpuGraphicsPipeline* Resolve() const;
+    // Called by the constructor, or by a worker of the compiler.
+    void CreatePipeline();
+    // Called by GpuPipelineCompiler::Update() once the optimized pipeline is linked.
+    void ReplaceFastLinkedPipeline();
+    // Records the raster operations that are dynamic in the context and differ from
+    // 'currentRop', or all of them when 'currentRop' is nullptr.
+    void CmdSetDynamicState(VkCommandBuffer cmdBuffer, const GpuRasterOperations* rop,
+		const GpuRasterOperations* currentRop) const;
+
+  private:
+    void InitVertexInput(const GpuGraphicsPipelineParms* parms);
+    void InitSpecialization(const GpuGraphicsPipelineParms* parms);
+    VkPipeline CompilePipeline(const GpuGraphicsPipelineKey* key, const bool fastLink);
+    VkPipeline LinkPipeline(const GpuGraphicsPipelineKey* key,
+		const VkGraphicsPipelineCreateInfo* createInfo, const bool fastLink);
+    // Takes a reference to every library part of 'key' that is in the registry, without creating
+    // any. Returns false and holds none if a part is missing.
+    bool AcquireLibraries(const GpuGraphicsPipelineKey* key);
+
+  public:
 	GpuContext& context;
     GpuRasterOperations       rop;
+    const GpuRenderPass*      renderPass;
     const GpuGraphicsProgram* program;
     const GpuGeometry*        geometry;
 
+    GpuPipelineCompiler*       compiler         = nullptr; // nullptr unless queued on a compiler
+    const GpuGraphicsPipeline* fallback         = nullptr;
+    GpuPipelineCompiledFunc    compiledFunc     = nullptr;
+    void*                      compiledUserData = nullptr;
+    std::atomic<bool>          ready{ false };
+
     int                                    vertexAttributeCount;
     int                                    vertexBindingCount;
     int                                    firstInstanceBinding;
@@ -141,6 +189,17 @@ class GpuGraphicsPipeline
     VkDeviceSize                           vertexBindingOffsets[MAX_VERTEX_ATTRIBUTES];
     VkPipelineVertexInputStateCreateInfo   vertexInputState;
     VkPipelineInputAssemblyStateCreateInfo inputAssemblyState;
-    VkPipeline                             pipeline;
+    int                                    specializationEntryCount;
+    VkSpecializationMapEntry               specializationEntries[MAX_SPECIALIZATION_CONSTANTS];
+    uint32_t                               specializationData[MAX_SPECIALIZATION_CONSTANTS];
+    VkSpecializationInfo                   specializationInfo;
+    VkPipeline                             pipeline = VK_NULL_HANDLE; // null until compiled
+    // Pipeline libraries this pipeline is linked from, referenced for as long as it lives so other
+    // combinations of the parts only need a link, see GpuContext::EnablePipelineLibraries().
+    VkPipeline                             libraries[GPU_PIPELINE_LIBRARY_PARTS] = {};
+    // 'pipeline' is fast-linked and not in the registry, 'optimizedPipeline' replaces it. Read by
+    // Resolve() while the worker links the optimized pipeline.
+    std::atomic<bool>                      fastLinked{ false };
+    VkPipeline                             optimizedPipeline = VK_NULL_HANDLE;
 };
 } // namespace lxd
@@ -7,12 +7,15 @@ namespace lxd
 
 static int const MAX_PROGRAM_PARMS = 16;
 
+// Use as the binding of a push constant to let GpuProgramParmLayout choose its offset.
+static int const GPU_PROGRAM_PARM_BINDING_AUTO = -1;
+
 enum GpuProgramStageFlags
 {
-    GPU_PROGRAM_STAGE_FLAG_VERTEX   = 0b0,
-    GPU_PROGRAM_STAGE_FLAG_FRAGMENT = 0b1,
-    GPU_PROGRAM_STAGE_FLAG_COMPUTE  = 0b10,
-    GPU_PROGRAM_STAGE_MAX           = 0b11
+    GPU_PROGRAM_STAGE_FLAG_VERTEX   = 0b1,
+    GPU_PROGRAM_STAGE_FLAG_FRAGMENT = 0b10,
+    GPU_PROGRAM_STAGE_FLAG_COMPUTE  = 0b100,
+    GPU_PROGRAM_STAGE_MAX           = 3
 };
 
 enum GpuProgramParmType
@@ -53,7 +56,7 @@ struct GpuProgramParm
     int                  stageFlags; // vertex, fragment and/or compute
     GpuProgramParmType   type;       // texture, buffer or push constant
     GpuProgramParmAccess access;     // read and/or write
-    int                  index;      // index into ksGpuProgramParmState::parms
+    int                  index;      // index into GpuProgramParmState::parms
     const char*          name;       // GLSL name
     int                  binding;    // OpenGL shader bind points:
                                      // - texture image unit
@@ -61,6 +64,7 @@ struct GpuProgramParm
                                      // - uniform buffer
                                      // - storage buffer
                                      // - uniform
+                                     // - push constant offset or GPU_PROGRAM_PARM_BINDING_AUTO
     // Note that each bind point uses its own range of binding indices with each range starting at zero.
     // However, each range is unique across all stages of a pipeline.
     // Note that even though multiple targets can be bound to the same texture image unit,
@@ -70,10 +74,40 @@ struct GpuProgramParm
     static VkDescriptorType   GetDescriptorType( const GpuProgramParmType type );
     static bool               IsOpaqueBinding( const GpuProgramParmType type );
     static int                GetPushConstantSize( const GpuProgramParmType type );
+    static int                GetPushConstantAlignment( const GpuProgramParmType type );
+    // Matrix push constants only, 0 for other types.
+    static int                GetMatrixColumns( const GpuProgramParmType type );
+    // Distance between the columns of a matrix in a std430 or std140 block, where they are
+    // aligned like vectors, 0 for other types.
+    static int                GetColumnStride( const GpuProgramParmType type, const bool std140 );
+    // Size of a push constant in a std430 or std140 block.
+    static int                GetBlockSize( const GpuProgramParmType type, const bool std140 );
     static const char*        GetPushConstantGlslType( const GpuProgramParmType type );
 };
 
+// Places the push constants of a program. Parms with an explicit binding keep that offset.
+// Parms with GPU_PROGRAM_PARM_BINDING_AUTO are packed after them by decreasing alignment, and
+// the ones that no longer fit in 'maxPushConstantsSize' spill to a uniform block that is
+// filled from the per-frame uniform ring of the command buffer. The spill block is bound as a
+// dynamic uniform buffer right after the descriptor bindings of the program.
+// Shaders should declare their push constants with GetGlsl() so the declared offsets always
+// match, whether a parm ends up in the push constant block or in the spill block.
+struct GpuPushConstantPacking
+{
+    int  offsets[MAX_PROGRAM_PARMS]; // per parm, offset into the push constant or spill block
+    bool spilled[MAX_PROGRAM_PARMS]; // per parm, true if the parm lives in the spill block
+    int  columnStrides[MAX_PROGRAM_PARMS]; // per matrix parm, see GetColumnStride()
+    int  pushConstantsSize;
+    int  spillSize;
+    int  spillBinding;
+
+    void Pack( const GpuProgramParm* parms, const int numParms, const int maxPushConstantsSize );
+    int  GetGlsl( const GpuProgramParm* parms, const int numParms, char* glsl,
+                  const int maxLength ) const;
+};
+
 class GpuContext;
+struct GpuLayout;
 class GpuProgramParmLayout
 {
   public:
@@ -84,38 +118,88 @@ class GpuProgramParmLayout
     GpuContext&           context;
     int                   numParms            = 0;
     const GpuProgramParm* parms               = 0;
-    VkDescriptorSetLayout descriptorSetLayout = nullptr;
-    VkPipelineLayout      pipelineLayout      = nullptr;
-    int                   offsetForIndex[MAX_PROGRAM_PARMS] =
-        {}; // push constant offsets into ksGpuProgramParmState::data based on ksGpuProgramParm::index
+    GpuLayout*            layout              = nullptr; // shared by structure, see GpuLayoutCache
+    VkDescriptorSetLayout descriptorSetLayout = nullptr; // of the shared layout
+    VkPipelineLayout      pipelineLayout      = nullptr; // of the shared layout
+    // Push constant offsets into GpuProgramParmState::data by GpuProgramParm::index, and the
+    // column stride of matrices there.
+    int                   offsetForIndex[MAX_PROGRAM_PARMS]       = {};
+    int                   columnStrideForIndex[MAX_PROGRAM_PARMS] = {};
     const GpuProgramParm* bindings[MAX_PROGRAM_PARMS]      = {}; // descriptor bindings
     const GpuProgramParm* pushConstants[MAX_PROGRAM_PARMS] = {}; // push constants
     int                   numBindings                      = 0;
     int                   numPushConstants                 = 0;
-    unsigned int          hash                             = 0;
+    // GpuProgramParmState::data holds the push constant block as is, followed by the
+    // spill block at 'spillDataOffset'.
+    GpuPushConstantPacking packing                = {};
+    VkShaderStageFlags     pushConstantStageFlags = 0;
+    VkShaderStageFlags     spillStageFlags        = 0;
+    int                    spillDataOffset        = 0;
 };
 
 static const int MAX_SAVED_PUSH_CONSTANT_BYTES = 512;
+static const int MAX_PUSH_CONSTANT_RANGES      = 8;
+static const int MAX_PUSH_CONSTANT_RANGE_GAP   = 16; // unchanged bytes uploaded to merge ranges
 class GpuProgramParmState
 {
   public:
-    void          SetParm( const GpuProgramParmLayout* parmLayout, const int index,
-                           const GpuProgramParmType parmType, const void* pointer );
-    const void*   NewPushConstantData( const GpuProgramParmLayout* newLayout,
-                                       const int                   newPushConstantIndex,
-                                       const GpuProgramParmState*  newParmState,
-                                       const GpuProgramParmLayout* oldLayout,
-                                       const int                   oldPushConstantIndex,
-                                       const GpuProgramParmState* oldParmState, const bool force );
-    bool          DescriptorsMatch( const GpuProgramParmLayout* layout1,
-                                    const GpuProgramParmState*  parmState1,
-                                    const GpuProgramParmLayout* layout2,
-                                    const GpuProgramParmState*  parmState2 );
-    const void*   parms[MAX_PROGRAM_PARMS];
-    unsigned char data[MAX_SAVED_PUSH_CONSTANT_BYTES];
+    void               SetParm( const GpuProgramParmLayout* parmLayout, const int index,
+                                const GpuProgramParmType parmType, const void* pointer );
+    static int         NewPushConstantRanges( const GpuProgramParmLayout* newLayout,
+                                              const GpuProgramParmState*  newParmState,
+                                              const GpuProgramParmLayout* oldLayout,
+                                              const GpuProgramParmState*  oldParmState,
+                                              VkPushConstantRange*        ranges );
+    static bool        SpillDataMatch( const GpuProgramParmLayout* layout1,
+                                       const GpuProgramParmState*  parmState1,
+                                       const GpuProgramParmLayout* layout2,
+                                       const GpuProgramParmState*  parmState2 );
+    static bool        DescriptorsMatch( const GpuProgramParmLayout* layout1,
+                                         const GpuProgramParmState*  parmState1,
+                                         const GpuProgramParmLayout* layout2,
+                                         const GpuProgramParmState*  parmState2 );
+    const void*        parms[MAX_PROGRAM_PARMS];
+    unsigned char      data[MAX_SAVED_PUSH_CONSTANT_BYTES];
+};
+
+static int const MAX_SPECIALIZATION_CONSTANTS = 16;
+static_assert( MAX_SPECIALIZATION_CONSTANTS <= 32, "GpuSpecializationValues::setMask is 32 bits" );
+
+enum GpuSpecializationConstantType
+{
+    GPU_SPECIALIZATION_CONSTANT_TYPE_BOOL,  // (GLSL: layout( constant_id = N ) const bool)
+    GPU_SPECIALIZATION_CONSTANT_TYPE_INT,   // (GLSL: layout( constant_id = N ) const int)
+    GPU_SPECIALIZATION_CONSTANT_TYPE_UINT,  // (GLSL: layout( constant_id = N ) const uint)
+    GPU_SPECIALIZATION_CONSTANT_TYPE_FLOAT, // (GLSL: layout( constant_id = N ) const float)
+};
+
+// Specialization constants are declared on a program and get their values per pipeline, so
+// one shader yields pipeline variants that are compiled with the value folded in, instead of
+// branching on a push constant or shipping a SPIR-V file per permutation.
+struct GpuSpecializationConstant
+{
+    GpuSpecializationConstantType type;       // bools are passed as VK_TRUE or VK_FALSE
+    int                           index;      // index into GpuSpecializationValues::values
+    int                           constantId; // GLSL: layout( constant_id = ... )
+    const char*                   name;       // GLSL name, see FindSpecializationConstant()
+};
+
+// The values of a pipeline. Constants that are not set keep the default of the shader.
+struct GpuSpecializationValues
+{
+    uint32_t values[MAX_SPECIALIZATION_CONSTANTS] = {};
+    uint32_t setMask                              = 0; // bit per index
+
+    void SetBool( const int index, const bool value );
+    void SetInt( const int index, const int value );
+    void SetUint( const int index, const uint32_t value );
+    void SetFloat( const int index, const float value );
 };
 
 struct GpuVertexAttribute;
+struct GpuShader;
+struct GpuShaderBlob;
+struct GpuProgramReflection;
 class GpuGraphicsProgram
 {
   public:
@@ -123,15 +207,45 @@ class GpuGraphicsProgram
                         const size_t vertexSourceSize, const void* fragmentSourceData,
                         const size_t fragmentSourceSize, const GpuProgramParm* parms,
                         const int numParms, const GpuVertexAttribute* vertexLayout,
-                        const int vertexAttribsFlags );
+                        const int                        vertexAttribsFlags,
+                        const GpuSpecializationConstant* specializationConstants    = nullptr,
+                        const int                        numSpecializationConstants = 0 );
+    GpuGraphicsProgram( GpuContext* context, const GpuShaderBlob* vertexShader,
+                        const GpuShaderBlob* fragmentShader, const GpuProgramParm* parms,
+                        const int numParms, const GpuVertexAttribute* vertexLayout,
+                        const int                        vertexAttribsFlags,
+                        const GpuSpecializationConstant* specializationConstants    = nullptr,
+                        const int                        numSpecializationConstants = 0 );
+    // The parms are reflected from the SPIR-V, see GpuProgramReflection. Their indices are found
+    // with reflection->FindParm().
+    GpuGraphicsProgram( GpuContext* context, const GpuShaderBlob* vertexShader,
+                        const GpuShaderBlob* fragmentShader, const GpuVertexAttribute* vertexLayout,
+                        const int                        vertexAttribsFlags,
+                        const GpuSpecializationConstant* specializationConstants    = nullptr,
+                        const int                        numSpecializationConstants = 0 );
     ~GpuGraphicsProgram();
 
+    // The pipeline stages reference shaders by identifier when the device supports it. For a
+    // pipeline that is not in the pipeline cache, this fills in stages with the modules instead.
+    void GetModuleStages( VkPipelineShaderStageCreateInfo stages[2] ) const;
+    // Returns the index into GpuSpecializationValues::values of a constant by GLSL name, or -1.
+    int  FindSpecializationConstant( const char* name ) const;
+
+  private:
+    void InitSpecializationConstants( const GpuSpecializationConstant* constants,
+                                      const int                        numConstants );
+    void InitStages();
+
   public:
-    GpuContext&                     context;
-    VkShaderModule                  vertexShaderModule;
-    VkShaderModule                  fragmentShaderModule;
-    VkPipelineShaderStageCreateInfo pipelineStages[2];
-    GpuProgramParmLayout            parmLayout;
-    int                             vertexAttribsFlags;
+    GpuContext&                                        context;
+    GpuShader*                                         vertexShader;   // from the shader cache
+    GpuShader*                                         fragmentShader; // of the device
+    VkPipelineShaderStageCreateInfo                    pipelineStages[2];
+    VkPipelineShaderStageModuleIdentifierCreateInfoEXT stageIdentifiers[2];
+    GpuProgramReflection*                              reflection = nullptr; // owns the parms
+    GpuProgramParmLayout                               parmLayout;
+    int                                                vertexAttribsFlags;
+    const GpuSpecializationConstant*                   specializationConstants;
+    int                                                numSpecializationConstants;
 };
 } // namespace lxd
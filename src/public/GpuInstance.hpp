@@ -60,6 +60,8 @@ class GpuInstance
     PFN_vkGetPhysicalDeviceSurfaceFormatsKHR      vkGetPhysicalDeviceSurfaceFormatsKHR = nullptr;
     PFN_vkGetPhysicalDeviceSurfacePresentModesKHR vkGetPhysicalDeviceSurfacePresentModesKHR =
         nullptr;
+    PFN_vkGetPhysicalDeviceFeatures2KHR   vkGetPhysicalDeviceFeatures2KHR   = nullptr; // optional
+    PFN_vkGetPhysicalDeviceProperties2KHR vkGetPhysicalDeviceProperties2KHR = nullptr; // optional
 
 #if defined( OS_NEUTRAL_DISPLAY_SURFACE )
     PFN_vkGetPhysicalDeviceDisplayPropertiesKHR vkGetPhysicalDeviceDisplayPropertiesKHR = nullptr;
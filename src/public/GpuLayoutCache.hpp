@@ -0,0 +1,69 @@
+#pragma once
+
+#include "Gfx.hpp"
+#include "GpuGraphicsProgram.hpp"
+#include "threading.h"
+
+namespace lxd
+{
+
+class GpuDevice;
+
+static const int GPU_LAYOUT_CACHE_BUCKETS = 64;
+
+// What Vulkan sees of a GpuProgramParmLayout: the descriptor type and stages of every binding of
+// set 0, including the buffer for spilled push constants, the push constant range, and the
+// bindless set that follows. Names, parm indices and the order of the push constants do not
+// matter. Unused bytes are zero, so keys are hashed and compared as memory.
+struct GpuLayoutKey
+{
+    VkDescriptorSetLayout bindlessSetLayout; // VK_NULL_HANDLE without bindless
+    int                   numBindings;
+    VkDescriptorType      descriptorTypes[MAX_PROGRAM_PARMS + 1];
+    VkShaderStageFlags    stageFlags[MAX_PROGRAM_PARMS + 1];
+    VkShaderStageFlags    pushConstantStageFlags;
+    uint32_t              pushConstantsSize;
+
+    unsigned int Hash() const;
+    bool         Equals( const GpuLayoutKey* other ) const;
+};
+
+struct GpuLayout
+{
+    GpuLayoutKey          key;
+    unsigned int          hash;
+    VkDescriptorSetLayout descriptorSetLayout;
+    VkPipelineLayout      pipelineLayout;
+    int                   refCount;
+    GpuLayout*            next;
+};
+
+// Descriptor set layouts and pipeline layouts shared by structure. Programs with the same layout
+// get the same VkPipelineLayout, so they are compatible in the Vulkan sense: switching between
+// their pipelines keeps the descriptor set and the push constants bound, and their descriptor
+// sets and pipelines are shared by GpuDescriptorSetCache and GpuPipelineRegistry.
+// Owned by the device, so this holds across contexts. Thread safe.
+class GpuLayoutCache
+{
+  public:
+    GpuLayoutCache( GpuDevice* device );
+    // All layouts must have been released.
+    ~GpuLayoutCache();
+
+    // Returns the shared layout with a new reference, creating it on a miss.
+    GpuLayout* Acquire( const GpuLayoutKey* key );
+    void       Release( GpuLayout* layout );
+
+  private:
+    void CreateLayout( GpuLayout* layout );
+
+  public:
+    GpuDevice& device;
+    GpuLayout* buckets[GPU_LAYOUT_CACHE_BUCKETS] = {};
+    int        numLayouts                         = 0;
+    int        numHits                            = 0;
+    int        numMisses                          = 0;
+    ksMutex    mutex;
+};
+
+} // namespace lxd
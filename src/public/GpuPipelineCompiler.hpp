@@ -0,0 +1,66 @@
+#pragma once
+
+#include "Gfx.hpp"
+#include "threading.h"
+
+namespace lxd
+{
+
+class GpuContext;
+class GpuGraphicsPipeline;
+
+typedef void ( *GpuPipelineCompiledFunc )( GpuGraphicsPipeline* pipeline, void* userData );
+
+// Compiles graphics pipelines on the threading.h worker pool, so loading many material
+// permutations does not block the thread that creates them. A pipeline created with a compiler
+// returns right away and is pending until a worker compiled it. Draws with a pending pipeline use
+// its fallback pipeline if that is ready, or are skipped, so recording never waits for the
+// compiler. All workers share the pipeline cache of the context.
+// Update() is called once a frame on the thread that records, it runs the completion callbacks
+// and invalidates the command bundles that recorded a fallback.
+class GpuPipelineCompiler
+{
+  public:
+    GpuPipelineCompiler( GpuContext* context, const int numWorkers );
+    // The pipelines that were queued on the compiler refer to it until they are destroyed, so
+    // they all have to be destroyed first.
+    ~GpuPipelineCompiler();
+
+    // Called by the pipeline itself.
+    void Compile( GpuGraphicsPipeline* pipeline );
+    // Called by the destructor of a pipeline that was queued. Removes the pipeline if it did not
+    // start compiling yet, or waits until it is compiled.
+    void Cancel( GpuGraphicsPipeline* pipeline );
+
+    void Update();
+    int  NumPending();
+
+  private:
+    struct Worker
+    {
+        GpuPipelineCompiler* compiler;
+        int                  index;
+        bool                 busy; // guarded by the mutex
+    };
+
+    static void WorkerFunction( void* data );
+
+  public:
+    GpuContext&           context;
+    ksThreadPool          pool;
+    Worker                workers[MAX_WORKERS] = {};
+    ksMutex               mutex;
+    // Compiled in the order they were queued.
+    GpuGraphicsPipeline** queued       = nullptr;
+    int                   numQueued    = 0;
+    int                   maxQueued    = 0;
+    int                   numCompiling = 0;
+    // Compiled but Update() did not see them yet.
+    GpuGraphicsPipeline** compiled     = nullptr;
+    int                   numCompiled  = 0;
+    int                   maxCompiled  = 0;
+    // Pipelines that were queued and not destroyed yet.
+    int                   numPipelines = 0;
+};
+
+} // namespace lxd
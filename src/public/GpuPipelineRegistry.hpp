@@ -0,0 +1,113 @@
+#pragma once
+
+#include "Gfx.hpp"
+#include "GpuGraphicsProgram.hpp"
+#include "threading.h"
+
+namespace lxd
+{
+
+class GpuContext;
+class GpuGraphicsPipeline;
+struct GpuShader;
+
+static const int GPU_PIPELINE_REGISTRY_BUCKETS = 256;
+
+// A complete graphics pipeline, or one of the VK_EXT_graphics_pipeline_library parts it is linked
+// from, see GpuContext::EnablePipelineLibraries().
+typedef enum
+{
+    GPU_PIPELINE_PART_COMPLETE,
+    GPU_PIPELINE_PART_VERTEX_INPUT,
+    GPU_PIPELINE_PART_PRE_RASTERIZATION,
+    GPU_PIPELINE_PART_FRAGMENT_SHADER,
+    GPU_PIPELINE_PART_FRAGMENT_OUTPUT
+} GpuPipelinePart;
+
+static const int GPU_PIPELINE_LIBRARY_PARTS = 4;
+
+// Everything vkCreateGraphicsPipelines sees for a GpuGraphicsPipeline: the render pass, the
+// shaders and pipeline layout of the program, the raster operations, the specialization constants
+// and the vertex input derived from the geometry. Unused bytes are zero, so keys are hashed and
+// compared as memory.
+struct GpuGraphicsPipelineKey
+{
+    int                               part; // GpuPipelinePart
+    VkRenderPass                      renderPass;
+    VkPipelineLayout                  pipelineLayout;
+    const GpuShader*                  shaders[2]; // shared by content, see GpuShaderCache
+    int                               sampleCount;
+    int                               depthStencil;
+    // GpuRasterOperations, copied by member to keep the padding zero.
+    int                               blendEnable;
+    int                               colorWriteMask;
+    int                               depthTestEnable;
+    int                               depthWriteEnable;
+    int                               frontFace;
+    int                               cullMode;
+    int                               depthCompare;
+    float                             blendColor[4];
+    int                               blendOpColor;
+    int                               blendSrcColor;
+    int                               blendDstColor;
+    int                               blendOpAlpha;
+    int                               blendSrcAlpha;
+    int                               blendDstAlpha;
+    int                               specializationEntryCount;
+    uint32_t                          specializationIds[MAX_SPECIALIZATION_CONSTANTS];
+    uint32_t                          specializationData[MAX_SPECIALIZATION_CONSTANTS];
+    int                               vertexAttributeCount;
+    int                               vertexBindingCount;
+    VkVertexInputAttributeDescription vertexAttributes[MAX_VERTEX_ATTRIBUTES];
+    VkVertexInputBindingDescription   vertexBindings[MAX_VERTEX_ATTRIBUTES];
+
+    void         Set( const GpuGraphicsPipeline* pipeline );
+    // Keeps only the state of the complete pipeline 'key' that goes into library 'part', so
+    // pipelines that only differ in other parts share the library.
+    void         SetPart( const GpuGraphicsPipelineKey* key, const GpuPipelinePart part );
+    unsigned int Hash() const;
+    bool         Equals( const GpuGraphicsPipelineKey* other ) const;
+};
+
+// Shares one VkPipeline between all graphics pipelines with the same key, e.g. the same material
+// on many meshes with the same vertex layout. Every GpuGraphicsPipeline still has its own
+// geometry and vertex binding offsets, only the VkPipeline is reference counted. The last
+// release hands the VkPipeline to the deletion queue. Pipeline libraries are shared the same way,
+// keyed by part.
+// Thread safe, so pipelines can be looked up from the workers of GpuPipelineCompiler.
+class GpuPipelineRegistry
+{
+  public:
+    GpuPipelineRegistry( GpuContext* context );
+    // All pipelines must have been released.
+    ~GpuPipelineRegistry();
+
+    // Returns the shared VkPipeline with a new reference, or VK_NULL_HANDLE on a miss.
+    VkPipeline Acquire( const GpuGraphicsPipelineKey* key );
+    // Adds a pipeline that was created after a miss. If another thread added the same key in the
+    // meantime, the new pipeline is destroyed and the existing one is returned instead.
+    VkPipeline Insert( const GpuGraphicsPipelineKey* key, const VkPipeline pipeline );
+    void       Release( const VkPipeline pipeline );
+
+  private:
+    struct Entry
+    {
+        GpuGraphicsPipelineKey key;
+        unsigned int           hash;
+        int                    refCount;
+        VkPipeline             pipeline;
+        Entry*                 next;
+    };
+
+    Entry* Find( const GpuGraphicsPipelineKey* key, const unsigned int hash );
+
+  public:
+    GpuContext& context;
+    Entry*      buckets[GPU_PIPELINE_REGISTRY_BUCKETS] = {};
+    int         numPipelines                            = 0; // distinct VkPipelines
+    int         numHits                                 = 0;
+    int         numMisses                               = 0;
+    ksMutex     mutex;
+};
+
+} // namespace lxd
@@ -0,0 +1,173 @@
+#pragma once
+
+#include "Gfx.hpp"
+#include "GpuContext.hpp"
+
+namespace lxd
+{
+
+static const int GPU_RENDER_GRAPH_MAX_PASSES          = 64;
+static const int GPU_RENDER_GRAPH_MAX_RESOURCES       = 64;
+static const int GPU_RENDER_GRAPH_MAX_PASS_ACCESSES   = 16;
+static const int GPU_RENDER_GRAPH_INVALID_ALIAS_GROUP = -1;
+
+class GpuTexture;
+class GpuBuffer;
+class GpuCommandBuffer;
+class GpuRenderGraph;
+struct GpuSplitBarrier;
+
+// How a pass uses a resource. Each access implies the pipeline stages, memory accesses and
+// image layout the resource has to be in while the pass executes.
+enum GpuRenderGraphAccess
+{
+    GPU_RENDER_GRAPH_ACCESS_NONE,
+    GPU_RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT,      // color attachment, read and written
+    GPU_RENDER_GRAPH_ACCESS_DEPTH_ATTACHMENT,      // depth attachment, tested and written
+    GPU_RENDER_GRAPH_ACCESS_SAMPLED_FRAGMENT,      // sampled texture in a fragment shader
+    GPU_RENDER_GRAPH_ACCESS_SAMPLED_COMPUTE,       // sampled texture in a compute shader
+    GPU_RENDER_GRAPH_ACCESS_STORAGE_READ_COMPUTE,  // storage image or buffer read by compute
+    GPU_RENDER_GRAPH_ACCESS_STORAGE_WRITE_COMPUTE, // storage image or buffer written by compute
+    GPU_RENDER_GRAPH_ACCESS_UNIFORM_READ,          // uniform buffer in a vertex or fragment shader
+    GPU_RENDER_GRAPH_ACCESS_VERTEX_READ,           // vertex or index buffer
+    GPU_RENDER_GRAPH_ACCESS_INDIRECT_READ,         // indirect draw or dispatch arguments
+    GPU_RENDER_GRAPH_ACCESS_TRANSFER_SRC,
+    GPU_RENDER_GRAPH_ACCESS_TRANSFER_DST,
+    GPU_RENDER_GRAPH_ACCESS_PRESENT,
+    GPU_RENDER_GRAPH_ACCESS_MAX
+};
+
+struct GpuRenderGraphState
+{
+    VkPipelineStageFlags stageMask;
+    VkAccessFlags        accessMask;
+    VkImageLayout        layout;
+
+    static GpuRenderGraphState ForAccess( const GpuRenderGraphAccess access );
+    bool                       IsWrite() const;
+};
+
+struct GpuRenderGraphTextureDesc
+{
+    VkFormat       format;
+    int            width;
+    int            height;
+    int            layerCount;
+    GpuSampleCount sampleCount;
+};
+
+struct GpuRenderGraphBarrier
+{
+    int                 resource;
+    GpuRenderGraphState src;
+    GpuRenderGraphState dst;
+    int                 srcPass; // last pass that accessed the resource, -1 before the graph
+    bool                split;   // waits on the event signaled after 'srcPass'
+};
+
+typedef void ( *GpuRenderGraphExecuteFunc )( GpuCommandBuffer* commandBuffer,
+                                             const GpuRenderGraph* graph, void* userData );
+
+struct GpuRenderGraphResource
+{
+    const char*               name;
+    GpuTexture*               texture; // imported texture or realized transient texture
+    GpuBuffer*                buffer;  // imported buffer
+    bool                      image;   // has an image layout, also for textures imported as null
+    bool                      transient;
+    GpuRenderGraphTextureDesc desc; // transient textures only
+    GpuRenderGraphState       initialState;
+    GpuRenderGraphState       finalState; // state after the last pass that uses the resource
+    bool                      output;
+    GpuRenderGraphAccess      outputAccess;
+    VkImageUsageFlags         imageUsage; // union of all accesses, transient textures only
+    int                       firstPass;
+    int                       lastPass;
+    int                       aliasGroup;
+};
+
+struct GpuRenderGraphPass
+{
+    const char*               name;
+    GpuRenderGraphExecuteFunc execute;
+    void*                     userData;
+    int                       resources[GPU_RENDER_GRAPH_MAX_PASS_ACCESSES];
+    GpuRenderGraphAccess      accesses[GPU_RENDER_GRAPH_MAX_PASS_ACCESSES];
+    int                       numAccesses;
+    bool                      culled;
+    GpuRenderGraphBarrier     barriers[GPU_RENDER_GRAPH_MAX_PASS_ACCESSES];
+    int                       numBarriers;
+    VkPipelineStageFlags      signalStages; // non-zero if a later pass waits with a split barrier
+};
+
+struct GpuRenderGraphAliasGroup
+{
+    bool   depth;        // depth and color images never share memory
+    size_t sizeEstimate; // largest member, in samples
+};
+
+// A frame is described as a list of passes that declare the resources they access. Compile()
+// culls the passes whose results are never used, computes the barriers and layout transitions
+// between passes, and lets transient textures with disjoint lifetimes share memory.
+// Compile() does not call into Vulkan, so a graph can be built and compiled without a device
+// (with a null context) to verify the culling, barriers and aliasing on the CPU.
+// Execute() creates the transient textures and records the passes with one batched barrier in
+// front of each pass. The transient textures are kept across frames for as long as the graph
+// compiles to the same set of transient resources.
+// A barrier whose source pass is not the pass right before it becomes a split barrier: an event
+// is signaled after the source pass and waited on in front of the pass, so the independent
+// passes in between overlap with the source pass.
+class GpuRenderGraph
+{
+  public:
+    GpuRenderGraph( GpuContext* context );
+    ~GpuRenderGraph();
+
+    // Building the graph, typically every frame. Textures and buffers may be imported as null
+    // to compile the graph on the CPU; Execute() records no barriers for them.
+    void Reset();
+    int  ImportTexture( const char* name, GpuTexture* texture,
+                        const GpuRenderGraphAccess initialAccess );
+    int  ImportBuffer( const char* name, GpuBuffer* buffer,
+                       const GpuRenderGraphAccess initialAccess );
+    int  CreateTransientTexture( const char* name, const GpuRenderGraphTextureDesc* desc );
+    int  AddPass( const char* name, GpuRenderGraphExecuteFunc execute, void* userData );
+    void AddAccess( const int pass, const int resource, const GpuRenderGraphAccess access );
+    // The resource is used after the graph and is left in the state of 'finalAccess'.
+    void MarkOutput( const int resource, const GpuRenderGraphAccess finalAccess );
+
+    void Compile();
+    void Execute( GpuCommandBuffer* commandBuffer );
+
+    GpuTexture* GetTexture( const int resource ) const;
+    GpuBuffer*  GetBuffer( const int resource ) const;
+
+  private:
+    void CullPasses();
+    void ComputeLifetimes();
+    void AssignAliasGroups();
+    void ComputeBarriers();
+    void RealizeTransients();
+    void ReleaseTransients();
+    void RecordBarriers( GpuCommandBuffer* commandBuffer, const GpuRenderGraphBarrier* barriers,
+                         const int numBarriers, const GpuSplitBarrier* passSignals );
+
+  public:
+    GpuContext*              context                                       = nullptr;
+    GpuRenderGraphResource   resources[GPU_RENDER_GRAPH_MAX_RESOURCES]     = {};
+    int                      numResources                                  = 0;
+    GpuRenderGraphPass       passes[GPU_RENDER_GRAPH_MAX_PASSES]           = {};
+    int                      numPasses                                     = 0;
+    GpuRenderGraphBarrier    finalBarriers[GPU_RENDER_GRAPH_MAX_RESOURCES] = {};
+    int                      numFinalBarriers                              = 0;
+    GpuRenderGraphAliasGroup aliasGroups[GPU_RENDER_GRAPH_MAX_RESOURCES]   = {};
+    int                      numAliasGroups                                = 0;
+    bool                     compiled                                      = false;
+    // Transient textures realized by a previous Execute(), reused while the signature matches.
+    unsigned int             realizedSignature                                = 0;
+    GpuTexture*              realizedTextures[GPU_RENDER_GRAPH_MAX_RESOURCES] = {};
+    VkDeviceMemory           realizedMemory[GPU_RENDER_GRAPH_MAX_RESOURCES]   = {};
+    int                      numRealizedMemory                                = 0;
+};
+
+} // namespace lxd
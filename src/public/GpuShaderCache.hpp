@@ -0,0 +1,75 @@
+#pragma once
+
+#include "Gfx.hpp"
+#include "threading.h"
+
+namespace lxd
+{
+
+class GpuDevice;
+
+static const int GPU_SHADER_CACHE_BUCKETS = 256;
+
+struct GpuShader
+{
+    VkShaderStageFlagBits stage;
+    // VK_NULL_HANDLE while the shader has an identifier and no pipeline needed the module yet.
+    VkShaderModule        module;
+    // Zero without VK_EXT_shader_module_identifier, and for GLSL fed to the driver.
+    uint32_t              identifierSize;
+    uint8_t               identifier[VK_MAX_SHADER_MODULE_IDENTIFIER_SIZE_EXT];
+
+    unsigned int hash;
+    size_t       codeSize;
+    void*        code; // kept to compare and to create the module later
+    int          refCount;
+    GpuShader*   next;
+};
+
+// SPIR-V compiled at build time and embedded by lxd_embed_shader() in CMakeLists.txt, with the
+// hash of GpuShaderCache precomputed, so a program does not touch the code until the module is
+// created.
+struct GpuShaderBlob
+{
+    VkShaderStageFlagBits stage;
+    const uint32_t*       code;
+    size_t                codeSize; // in bytes
+    unsigned int          hash;
+};
+
+// Shader modules shared by content, so programs that use the same vertex or fragment shader
+// share one VkShaderModule. Owned by the device, so this holds across contexts.
+// With VK_EXT_shader_module_identifier, SPIR-V shaders are referenced by identifier and the
+// module is only created when a pipeline is not found in the pipeline cache. With a pipeline
+// cache loaded from disk, programs and pipelines are created without any module at all.
+// Thread safe.
+class GpuShaderCache
+{
+  public:
+    GpuShaderCache( GpuDevice* device );
+    // All shaders must have been released.
+    ~GpuShaderCache();
+
+    GpuShader*     Acquire( const VkShaderStageFlagBits stage, const void* code,
+                            const size_t codeSize );
+    GpuShader*     Acquire( const GpuShaderBlob* blob );
+    void           Release( GpuShader* shader );
+    // Creates the module of a shader that only had an identifier so far.
+    VkShaderModule GetModule( GpuShader* shader );
+
+  private:
+    static unsigned int Hash( const VkShaderStageFlagBits stage, const void* code,
+                              const size_t codeSize );
+    GpuShader*          Acquire( const VkShaderStageFlagBits stage, const void* code,
+                                 const size_t codeSize, const unsigned int hash );
+    void                CreateModule( GpuShader* shader );
+
+  public:
+    GpuDevice& device;
+    GpuShader* buckets[GPU_SHADER_CACHE_BUCKETS] = {};
+    int        numShaders                         = 0;
+    int        numModules                         = 0;
+    ksMutex    mutex;
+};
+
+} // namespace lxd
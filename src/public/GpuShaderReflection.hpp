@@ -0,0 +1,33 @@
+#pragma once
+
+#include "Gfx.hpp"
+#include "GpuGraphicsProgram.hpp"
+
+namespace lxd
+{
+
+static const int MAX_REFLECTED_NAME_LENGTH = 32;
+
+// The parms of a program as declared by its SPIR-V: the bindings of descriptor set 0, the
+// members of the push constant block and the vertex inputs. The parms are in a canonical order,
+// the descriptors by binding followed by the push constants by offset, and the index of a parm is
+// its position, so programs that declare the same interface end up with identical parms.
+// Descriptor arrays and sets other than 0, e.g. the bindless table, are not reflected.
+// The parms point at the names, so this is not copied once used by a GpuProgramParmLayout.
+struct GpuProgramReflection
+{
+    GpuProgramReflection() {}
+    GpuProgramReflection( const GpuShaderBlob* shader0, const GpuShaderBlob* shader1 = nullptr );
+
+    // Adds the interface of one stage. Parms used by several stages are merged.
+    void Reflect( const GpuShaderBlob* shader );
+    // Returns the index of the parm with a GLSL name, or -1. Buffers are named by their block.
+    int  FindParm( const char* name ) const;
+
+    GpuProgramParm parms[MAX_PROGRAM_PARMS];
+    char           names[MAX_PROGRAM_PARMS][MAX_REFLECTED_NAME_LENGTH];
+    int            numParms        = 0;
+    uint32_t       vertexInputMask = 0; // bit per location read by the vertex shader
+};
+
+} // namespace lxd
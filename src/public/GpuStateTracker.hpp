@@ -0,0 +1,168 @@
+#pragma once
+
+#include "Gfx.hpp"
+
+namespace lxd
+{
+
+class GpuContext;
+class GpuBuffer;
+class GpuTexture;
+
+static const VkAccessFlags GPU_WRITE_ACCESS_MASK =
+    VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT |
+    VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+// Synchronization state of one image subresource or buffer range: the current layout, the
+// stages and accesses of the last write, and the stages and accesses that already read the
+// result of that write.
+struct GpuSubresourceState
+{
+    VkImageLayout        layout;
+    VkPipelineStageFlags writeStages;
+    VkAccessFlags        writeAccess;
+    VkPipelineStageFlags readStages;
+    VkAccessFlags        readAccess;
+    const void*          pendingTracker; // tracker with an unflushed barrier for this state
+    int                  pendingFlush;
+    // Recording that accessed the state last, by the serial of its GpuTimeline and its ticket.
+    uint32_t             timelineSerial;
+    uint64_t             recordingTicket;
+
+    // State of a resource that was never accessed, or whose contents are undefined.
+    static GpuSubresourceState Undefined();
+    // State of a resource in 'layout' that may have been written by any earlier command.
+    static GpuSubresourceState Unknown( const VkImageLayout layout );
+
+    // Moves to the new access and returns true if a barrier is needed, in which case the source
+    // stages and accesses of the barrier are returned. Reads after reads in the same layout, and
+    // reads in stages that already waited for the last write, do not need a barrier.
+    bool Access( const VkPipelineStageFlags stageMask, const VkAccessFlags accessMask,
+                 const VkImageLayout newLayout, VkPipelineStageFlags* srcStages,
+                 VkAccessFlags* srcAccess );
+};
+
+struct GpuBufferRangeState
+{
+    VkDeviceSize        offset;
+    VkDeviceSize        size;
+    GpuSubresourceState state;
+};
+
+// Collects the barriers needed to move image subresources and buffer ranges to the state of
+// the next command, and records them with a single vkCmdPipelineBarrier() right before that
+// command. With VK_KHR_synchronization2 every barrier keeps its own stage masks.
+// The per-subresource state lives with the texture or buffer and is updated while commands are
+// recorded, so different trackers see the same state. That state is only correct if command
+// buffers are submitted in the order in which they access a resource: once a command buffer
+// accessed a resource, it has to be submitted before another command buffer of the same context
+// records an access to it. This is asserted. Command buffers of other queues hand resources
+// over with ReleaseTexture() and AcquireTexture() and wait for each other with semaphores.
+class GpuStateTracker
+{
+  public:
+    GpuStateTracker( GpuContext* context );
+    ~GpuStateTracker();
+
+    // Barriers are recorded into 'cmdBuffer' until the next Begin(). 'recordingTicket' is the
+    // ticket of the recording on the timeline of the context, see GpuTimeline::BeginRecording().
+    void Begin( VkCommandBuffer cmdBuffer, const uint64_t recordingTicket );
+
+    // The subresource ranges use the same conventions as VkImageSubresourceRange, including
+    // VK_REMAINING_MIP_LEVELS and VK_REMAINING_ARRAY_LAYERS.
+    void TextureAccess( GpuTexture* texture, const VkImageSubresourceRange* range,
+                        const VkPipelineStageFlags stageMask, const VkAccessFlags accessMask,
+                        const VkImageLayout layout );
+    void TextureAccess( GpuTexture* texture, const VkPipelineStageFlags stageMask,
+                        const VkAccessFlags accessMask, const VkImageLayout layout );
+    // For images that are not owned by a GpuTexture. 'states' holds mipCount * layerCount
+    // states, with the layers of a mip level next to each other.
+    void ImageAccess( const VkImage image, GpuSubresourceState* states, const int mipCount,
+                      const int layerCount, const VkImageSubresourceRange* range,
+                      const VkPipelineStageFlags stageMask, const VkAccessFlags accessMask,
+                      const VkImageLayout layout );
+    void BufferAccess( GpuBuffer* buffer, const VkDeviceSize offset, const VkDeviceSize size,
+                       const VkPipelineStageFlags stageMask, const VkAccessFlags accessMask );
+
+    // Queue family ownership transfer of a whole texture or buffer. The release is recorded on
+    // the queue that accessed the resource last, after all its accesses, and the acquire on the
+    // queue of 'dstQueueFamily' before its first access. The submit with the acquire has to wait
+    // for the submit with the release. Within the same queue family these are regular accesses.
+    void ReleaseTexture( GpuTexture* texture, const uint32_t dstQueueFamily,
+                         const VkImageLayout layout );
+    void AcquireTexture( GpuTexture* texture, const uint32_t srcQueueFamily,
+                         const VkPipelineStageFlags stageMask, const VkAccessFlags accessMask,
+                         const VkImageLayout layout );
+    void ReleaseBuffer( GpuBuffer* buffer, const uint32_t dstQueueFamily );
+    void AcquireBuffer( GpuBuffer* buffer, const uint32_t srcQueueFamily,
+                        const VkPipelineStageFlags stageMask, const VkAccessFlags accessMask );
+
+    bool HasPendingBarriers() const { return this->numPending > 0; }
+    // Records all pending barriers with one pipeline barrier.
+    void Flush();
+
+  private:
+    struct PendingBarrier
+    {
+        VkImage                 image;
+        VkBuffer                buffer;
+        VkImageSubresourceRange range;
+        VkDeviceSize            offset;
+        VkDeviceSize            size;
+        VkPipelineStageFlags    srcStages;
+        VkAccessFlags           srcAccess;
+        VkPipelineStageFlags    dstStages;
+        VkAccessFlags           dstAccess;
+        VkImageLayout           oldLayout;
+        VkImageLayout           newLayout;
+        uint32_t                srcQueueFamily;
+        uint32_t                dstQueueFamily;
+    };
+
+    // Half of a queue family ownership transfer, see ReleaseTexture().
+    struct OwnershipTransfer
+    {
+        uint32_t srcQueueFamily;
+        uint32_t dstQueueFamily;
+        bool     release;
+    };
+
+    bool            AccessState( GpuSubresourceState* state, const VkPipelineStageFlags stageMask,
+                                 const VkAccessFlags accessMask, const VkImageLayout layout,
+                                 const OwnershipTransfer* transfer, PendingBarrier* barrier );
+    void            ImageAccessInternal( const VkImage image, GpuSubresourceState* states,
+                                         const int mipCount, const int layerCount,
+                                         const VkImageSubresourceRange* range,
+                                         const VkPipelineStageFlags stageMask,
+                                         const VkAccessFlags accessMask, const VkImageLayout layout,
+                                         const OwnershipTransfer* transfer );
+    void            BufferAccessInternal( GpuBuffer* buffer, const VkDeviceSize offset,
+                                          const VkDeviceSize size,
+                                          const VkPipelineStageFlags stageMask,
+                                          const VkAccessFlags        accessMask,
+                                          const OwnershipTransfer*   transfer );
+    void            TextureAccessInternal( GpuTexture*                    texture,
+                                           const VkImageSubresourceRange* range,
+                                           const VkPipelineStageFlags     stageMask,
+                                           const VkAccessFlags accessMask,
+                                           const VkImageLayout layout,
+                                           const OwnershipTransfer* transfer );
+    PendingBarrier* AddPending();
+    static bool     MergePending( PendingBarrier* a, const PendingBarrier* b );
+
+  public:
+    GpuContext&          context;
+    // Stages the queue of the context supports, e.g. no graphics stages on an async compute queue.
+    VkPipelineStageFlags supportedStages = 0;
+    VkCommandBuffer      cmdBuffer       = VK_NULL_HANDLE;
+    uint64_t             recordingTicket = 0;
+    PendingBarrier*      pending         = nullptr;
+    int                  numPending      = 0;
+    int                  maxPending      = 0;
+    int                  flushCount      = 0;
+    void*                imageBarriers   = nullptr; // scratch space for Flush()
+    void*                bufferBarriers  = nullptr;
+};
+
+} // namespace lxd
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "Gfx.hpp"
+
+namespace lxd
+{
+
+class GpuContext;
+
+// Collects the submits to the queue of a context between Begin() and End(), and hands them to
+// the queue with a single vkQueueSubmit, e.g. the setup command buffer, the command buffers of
+// several passes and the primary command buffer of a frame. Every vkQueueSubmit goes through the
+// kernel driver, so one per queue per frame is the cheapest.
+// The submits execute in the order they were added. A submit without waits is merged into the
+// previous one when that one signals nothing, otherwise it starts a new VkSubmitInfo. All submits
+// of a batch share one timeline value, which Submit() already returns while the batch is open.
+// Outside a batch, or with the submit queue of the context, Submit() goes straight through.
+// The binary semaphores are only signaled once the batch is flushed, so flush before presenting
+// a swapchain image that a batched submit renders to. Like the timeline, a batch must only be
+// used from one thread.
+class GpuSubmitBatch
+{
+  public:
+    GpuSubmitBatch( GpuContext* context );
+    // Flushes the submits that are still collected.
+    ~GpuSubmitBatch();
+
+    // Begin() and End() nest, only the outermost End() flushes.
+    void     Begin();
+    uint64_t End();
+    // The submit info must not have a pNext chain. Returns the timeline value of the submit.
+    uint64_t Submit( const VkSubmitInfo* submitInfo );
+    // Submits everything collected so far, and returns the timeline value of the last submit.
+    uint64_t Flush();
+
+  private:
+    // Offsets into the arrays below, which may be reallocated while the batch is collected.
+    struct Entry
+    {
+        int firstCommandBuffer;
+        int numCommandBuffers;
+        int firstWait;
+        int numWaits;
+        int firstSignal;
+        int numSignals;
+    };
+
+  public:
+    GpuContext&           context;
+    int                   depth             = 0;
+    Entry*                entries           = nullptr;
+    int                   numEntries        = 0;
+    int                   maxEntries        = 0;
+    VkCommandBuffer*      commandBuffers    = nullptr;
+    int                   numCommandBuffers = 0;
+    int                   maxCommandBuffers = 0;
+    VkSemaphore*          waitSemaphores    = nullptr;
+    VkPipelineStageFlags* waitStages        = nullptr;
+    int                   numWaits          = 0;
+    int                   maxWaits          = 0;
+    VkSemaphore*          signalSemaphores  = nullptr;
+    int                   numSignals        = 0;
+    int                   maxSignals        = 0;
+};
+
+} // namespace lxd
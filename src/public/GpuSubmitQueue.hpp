@@ -0,0 +1,77 @@
+#pragma once
+
+#include "Gfx.hpp"
+#include "threading.h"
+
+#include <atomic>
+
+namespace lxd
+{
+
+class GpuContext;
+
+static const int GPU_SUBMIT_QUEUE_SIZE            = 64; // power of two
+static const int GPU_SUBMIT_MAX_COMMAND_BUFFERS   = 8;
+static const int GPU_SUBMIT_MAX_BINARY_SEMAPHORES = 4;
+
+// Lets any number of threads submit to the queue of a context. A VkQueue must be externally
+// synchronized, so a dedicated thread does all vkQueueSubmit calls, fed by a bounded ring of
+// submit descriptors that producers claim with a single atomic increment. The position in the
+// ring decides the order of the submits, so the timeline value of a submit is known as soon as
+// it is claimed, and Submit() returns it without taking a lock or waiting for the thread. The
+// thread only sleeps when the ring is empty, and producers only sleep when it is full. Waking
+// either side is the one case that takes a lock.
+// While the queue exists, every submit of the context goes through it, see GpuSubmitBatch, and
+// GpuTimeline::AddWait() is not available. Needs timeline semaphores, so GpuTimeline::Wait()
+// may be called for values that the thread did not submit yet.
+// PendingValue() is only a snapshot while other threads submit, so values are taken from what
+// Submit() returns, see GpuTimeline::EndRecording().
+class GpuSubmitQueue
+{
+  public:
+    GpuSubmitQueue( GpuContext* context );
+    // Submits everything that is still queued and stops the thread.
+    ~GpuSubmitQueue();
+
+    // The submit info must not have a pNext chain. The contents are copied, so the arrays may be
+    // released on return. Blocks only while the ring is full.
+    uint64_t Submit( const VkSubmitInfo* submitInfo );
+    // Value of the next submit that is claimed.
+    uint64_t PendingValue() const;
+
+  private:
+    struct Cell
+    {
+        // pos + 1 once the descriptor for 'pos' is written, pos + GPU_SUBMIT_QUEUE_SIZE once it
+        // is submitted and the cell can be claimed again.
+        std::atomic<uint64_t> sequence;
+        uint32_t              numCommandBuffers;
+        uint32_t              numWaits;
+        uint32_t              numSignals;
+        VkCommandBuffer       commandBuffers[GPU_SUBMIT_MAX_COMMAND_BUFFERS];
+        VkSemaphore           waitSemaphores[GPU_SUBMIT_MAX_BINARY_SEMAPHORES];
+        VkPipelineStageFlags  waitStages[GPU_SUBMIT_MAX_BINARY_SEMAPHORES];
+        VkSemaphore           signalSemaphores[GPU_SUBMIT_MAX_BINARY_SEMAPHORES];
+    };
+
+    static void ThreadFunction( void* data );
+    void        SubmitCell( Cell* cell );
+    void        WakeUp();
+
+  public:
+    GpuContext& context;
+    uint64_t    baseValue = 0; // timeline value before the first submit
+    Cell        cells[GPU_SUBMIT_QUEUE_SIZE];
+    // Written by the producers and the thread respectively, kept on separate cache lines.
+    alignas( 64 ) std::atomic<uint64_t> enqueuePos{ 0 };
+    alignas( 64 ) uint64_t dequeuePos = 0;
+    std::atomic<bool> sleeping{ false };
+    std::atomic<bool> terminate{ false };
+    ksSignal          wakeUpSignal;
+    // Producers that sleep until the thread frees a cell of the full ring.
+    std::atomic<int>  numWaitingForSpace{ 0 };
+    ksSignal          spaceSignal;
+    ksThread          thread;
+};
+
+} // namespace lxd
@@ -1,6 +1,7 @@
 #pragma once
 #include "Gfx.hpp"
 #include "GpuContext.hpp"
+#include "GpuBindless.hpp"
 namespace lxd
 {
 // Note that the channel listed first in the name shall occupy the least significant bit.
@@ -246,7 +247,14 @@ typedef enum
     GPU_TEXTURE_DEFAULT_CIRCLES // 32x32 block pattern with circles (KS_GPU_TEXTURE_FORMAT_R8G8B8A8_UNORM)
 } GpuTextureDefault;
 
+// Image layout, memory access and pipeline stages of a texture usage.
+VkImageLayout        LayoutForTextureUsage( const GpuTextureUsage usage );
+VkAccessFlags        AccessForTextureUsage( const GpuTextureUsage usage );
+VkPipelineStageFlags PipelineStagesForTextureUsage( const GpuTextureUsage usage, const bool from );
+GpuTextureUsage      TextureUsageForLayout( const VkImageLayout layout );
+
 class GpuWindow;
+struct GpuSubresourceState;
 class GpuTexture
 {
   public:
@@ -295,5 +303,10 @@ class GpuTexture
 	VkDeviceMemory memory{};
 	VkImageView    view{};
 	VkSampler      sampler{};
+	// See GpuDevice::resourceSerial, changes whenever the view or the sampler does.
+	uint64_t       resourceId{};
+	uint32_t       bindlessIndex = GPU_BINDLESS_INVALID_INDEX;
+	// Per mip level and layer, allocated by the first GpuStateTracker that uses the texture.
+	GpuSubresourceState* subresourceStates = nullptr;
 };
 } // namespace lxd
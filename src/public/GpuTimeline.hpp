@@ -0,0 +1,110 @@
+#pragma once
+
+#include "Gfx.hpp"
+#include "threading.h"
+
+#include <atomic>
+
+namespace lxd
+{
+
+class GpuContext;
+
+static const int GPU_TIMELINE_MAX_SIGNAL_SEMAPHORES = 4;  // including the timeline semaphore
+static const int GPU_TIMELINE_MAX_WAIT_SEMAPHORES   = 8;  // including the waits of AddWait()
+static const int GPU_TIMELINE_MAX_SUBMITS           = 16; // submit infos per vkQueueSubmit
+
+// Monotonically increasing submit values for the queue of a context. Every submit signals the
+// next value, and the work of a submit is complete once the completed value reached the value
+// returned by the submit, so frame pacing, deferred destruction and staging reclamation come
+// down to comparing two integers.
+// Uses a timeline semaphore when the device supports it, otherwise one fence per submit that
+// is still in flight. Like the queue itself, Submit() and AddWait() must only be called from one
+// thread, the thread of the submit queue if there is one. The values may be read and waited on
+// from any thread.
+// Command buffers are not necessarily submitted in the order they begin, e.g. the setup command
+// buffer is flushed while a frame is recorded, so the value of a command is only known once its
+// command buffer is submitted. Recordings are therefore tracked with tickets, and an object that
+// is released is safe to destroy once every recording that was open at that point is submitted
+// and complete, see GpuDeletionQueue.
+class GpuTimeline
+{
+  public:
+    GpuTimeline( GpuContext* context );
+    ~GpuTimeline();
+
+    // Submits to the queue of the context and returns the value that is reached once the GPU
+    // finished executing the submits, which all share the one value. Binary semaphores in the
+    // submit infos are left as is.
+    uint64_t Submit( const VkSubmitInfo* submitInfos, const int numSubmits = 1 );
+    // Also counts the submits that wait in the submit queue of the context.
+    uint64_t PendingValue() const;
+    // Makes the next submit wait in 'dstStages' until the GPU reached 'value' on the timeline of
+    // another queue, e.g. the submit of an async compute context that produced the input of this
+    // one. Both timelines need timeline semaphores. Only the queue that waits is blocked, the CPU
+    // never waits.
+    void     AddWait( const GpuTimeline* other, const uint64_t value,
+                      const VkPipelineStageFlags dstStages );
+    uint64_t GetCompletedValue();
+    bool     IsCompleted( const uint64_t value );
+    void     Wait( const uint64_t value );
+
+    // A command buffer that is submitted with this timeline begins a recording before its first
+    // command, and ends it with the value returned by its submit, or 0 if it is never submitted.
+    // Thread safe.
+    uint64_t BeginRecording();
+    void     EndRecording( const uint64_t ticket, const uint64_t value );
+    // Ticket of the next recording, recordings that already began have a smaller one.
+    uint64_t NextTicket();
+    // Returns false while a recording with a ticket below 'ticket' is open. Otherwise sets 'value'
+    // to a value that is only reached once all of those recordings are complete.
+    bool     ResolveRecordings( const uint64_t ticket, uint64_t* value );
+    // True until the recording of 'ticket' ended.
+    bool     IsRecording( const uint64_t ticket );
+
+  private:
+    struct InFlightFence
+    {
+        VkFence  fence;
+        uint64_t value;
+        int      waiters; // threads in Wait() on the fence, which is not reset while they wait
+    };
+
+    VkFence AcquireFence();
+    void    RetireFences();
+
+  public:
+    GpuContext&           context;
+    VkSemaphore           semaphore = VK_NULL_HANDLE; // null without timeline semaphores
+    std::atomic<uint64_t> submittedValue{ 0 };
+    std::atomic<uint64_t> completedValue{ 0 }; // last value seen as completed
+    // Fence fallback: the submits in flight in submission order, and fences ready for reuse.
+    // Any thread that looks at the completed value retires fences, so these are guarded. The
+    // mutex is not held while waiting on a fence.
+    ksMutex        fenceMutex;
+    InFlightFence* inFlight      = nullptr;
+    int            numInFlight   = 0;
+    int            maxInFlight   = 0;
+    VkFence*       freeFences    = nullptr;
+    int            numFreeFences = 0;
+    int            maxFreeFences = 0;
+    // Recordings that are open in no particular order, and the largest value a recording ended
+    // with, guarded by the recording mutex.
+    ksMutex        recordingMutex;
+    uint64_t       nextTicket     = 1; // 0 is never a ticket
+    uint64_t*      openTickets    = nullptr;
+    int            numOpenTickets = 0;
+    int            maxOpenTickets = 0;
+    uint64_t       recordedValue  = 0;
+    // Slot in GpuDevice::timelines, and the serial that tells this timeline apart from later
+    // timelines in the same slot.
+    int            deviceSlot = -1;
+    uint32_t       serial     = 0;
+    // Cross-queue waits added for the next submit.
+    VkSemaphore          waitSemaphores[GPU_TIMELINE_MAX_WAIT_SEMAPHORES] = {};
+    uint64_t             waitValues[GPU_TIMELINE_MAX_WAIT_SEMAPHORES]     = {};
+    VkPipelineStageFlags waitStages[GPU_TIMELINE_MAX_WAIT_SEMAPHORES]     = {};
+    int                  numWaits                                         = 0;
+};
+
+} // namespace lxd
@@ -5,17 +5,19 @@
 
 namespace lxd
 {
+// Results are read back this many uses later, which should not be less than the frames in flight.
 static const int GPU_TIMER_FRAMES_DELAYED = 2;
 
 class GpuTimer
 {
   public:
-    GpuTimer( GpuContext* context );
+    GpuTimer( GpuContext* context, const int framesDelayed = GPU_TIMER_FRAMES_DELAYED );
     ~GpuTimer();
     ksNanoseconds GetNanoseconds() const;
 
     GpuContext&   context;
     VkBool32      supported{ 0 };
+    int           framesDelayed{ GPU_TIMER_FRAMES_DELAYED };
     ksNanoseconds period{ 0 };
     VkQueryPool   pool{ nullptr };
     uint32_t      init{ 0 };
@@ -933,8 +933,9 @@ static void PoolStartThread( void * data )
 {
 	UNUSED_PARM( data );
 
+	// Workers run background work such as pipeline compiles, so they keep the default priority
+	// instead of preempting the threads that record and submit frames.
 	ksThread_SetAffinity( THREAD_AFFINITY_BIG_CORES );
-	ksThread_SetRealTimePriority( 1 );
 }
 
 static void ksThreadPool_Create( ksThreadPool * pool, const int numWorkers )
@@ -0,0 +1,354 @@
+#include "GpuCulling.hpp"
+#include "GpuTestUtils.hpp"
+
+#include <algorithm>
+
+using namespace lxd;
+
+// Checks GpuCullingPass::CullReference() against spheres whose visibility is known, then runs the
+// culling compute shader and checks that it keeps the instances that the reference keeps, with and
+// without a Hi-Z pyramid, for spheres and for boxes. Instances right at a boundary may differ.
+
+static const int   INSTANCE_COUNT  = 1000;
+static const int   HIZ_SIZE        = 64;
+static const int   HIZ_MIP_COUNT   = 7;
+static const float OCCLUDER_DEPTH  = 0.95f; // about 17 units in front of the camera
+static const float BOUNDARY_MARGIN = 0.01f; // world units, far above the rounding differences
+
+// Spheres in front of, around and behind the camera, from a fixed seed.
+static void CreateBounds( float* bounds )
+{
+    unsigned int seed = 12345;
+    auto random = [&seed]( const float min, const float max ) {
+        seed = seed * 1664525 + 1013904223;
+        return min + ( max - min ) * ( ( seed >> 8 ) / (float)( 1 << 24 ) );
+    };
+    for ( int i = 0; i < INSTANCE_COUNT; i++ )
+    {
+        bounds[i * 4 + 0] = random( -40.0f, 40.0f );
+        bounds[i * 4 + 1] = random( -40.0f, 40.0f );
+        bounds[i * 4 + 2] = random( -40.0f, 5.0f );
+        bounds[i * 4 + 3] = random( 0.1f, 3.0f );
+    }
+}
+
+// The left half of the screen is covered by an occluder, the right half is empty. Each level
+// keeps the farthest depth of the 2x2 texels below it.
+static void CreateHiZ( float* levels[HIZ_MIP_COUNT] )
+{
+    for ( int y = 0; y < HIZ_SIZE; y++ )
+    {
+        for ( int x = 0; x < HIZ_SIZE; x++ )
+        {
+            levels[0][y * HIZ_SIZE + x] = ( x < HIZ_SIZE / 2 ) ? OCCLUDER_DEPTH : 1.0f;
+        }
+    }
+    for ( int level = 1; level < HIZ_MIP_COUNT; level++ )
+    {
+        const int    size  = HIZ_SIZE >> level;
+        const float* below = levels[level - 1];
+        for ( int y = 0; y < size; y++ )
+        {
+            for ( int x = 0; x < size; x++ )
+            {
+                const int b = ( y * 2 ) * ( size * 2 ) + x * 2;
+                levels[level][y * size + x] =
+                    std::max( std::max( below[b], below[b + 1] ),
+                              std::max( below[b + size * 2], below[b + size * 2 + 1] ) );
+            }
+        }
+    }
+}
+
+// The boxes around the spheres, in the GPU_CULLING_BOUNDS_AABB layout.
+static void SpheresToBoxes( const float* spheres, const int count, float* boxes )
+{
+    for ( int i = 0; i < count; i++ )
+    {
+        for ( int c = 0; c < 3; c++ )
+        {
+            boxes[i * 8 + 0 + c] = spheres[i * 4 + c] - spheres[i * 4 + 3];
+            boxes[i * 8 + 4 + c] = spheres[i * 4 + c] + spheres[i * 4 + 3];
+        }
+        boxes[i * 8 + 3] = 0.0f;
+        boxes[i * 8 + 7] = 0.0f;
+    }
+}
+
+static bool Contains( const uint32_t* visible, const int count, const uint32_t instance )
+{
+    return std::find( visible, visible + count, instance ) != visible + count;
+}
+
+static bool SameVisible( const uint32_t* a, const int aCount, const uint32_t* b,
+                         const int bCount )
+{
+    return aCount == bCount && std::equal( a, a + aCount, b );
+}
+
+static void TestCullReference()
+{
+    // xyz = center, w = radius, with the camera at the origin, near 1 and far 100.
+    static const float bounds[][4] = {
+        { 0.0f, 0.0f, -10.0f, 1.0f },    // 0: in front of the camera
+        { 0.0f, 0.0f, 10.0f, 1.0f },     // 1: behind the camera
+        { 0.0f, 0.0f, -200.0f, 1.0f },   // 2: beyond the far plane
+        { 30.0f, 0.0f, -10.0f, 1.0f },   // 3: right of the frustum
+        { 10.5f, 0.0f, -10.0f, 1.0f },   // 4: crosses the right plane
+        { 0.0f, 0.0f, -100.5f, 1.0f },   // 5: crosses the far plane
+        { -10.0f, 0.0f, -40.0f, 1.0f },  // 6: behind the occluder
+        { 10.0f, 0.0f, -40.0f, 1.0f },   // 7: as far, where there is no occluder
+        { -5.0f, 0.0f, -5.0f, 1.0f } };  // 8: in front of the occluder
+    const int instanceCount = (int)( sizeof( bounds ) / sizeof( bounds[0] ) );
+
+    GpuCullingParms parms;
+    memset( &parms, 0, sizeof( parms ) );
+    float viewProjection[16];
+    PerspectiveMatrix( viewProjection, 1.0f, 100.0f );
+    parms.SetViewProjection( viewProjection );
+
+    uint32_t  visible[sizeof( bounds ) / sizeof( bounds[0] )];
+    const int frustumCount =
+        GpuCullingPass::CullReference( &parms, &bounds[0][0], instanceCount, nullptr, visible );
+    CHECK( frustumCount == 6 );
+    CHECK( Contains( visible, frustumCount, 0 ) );
+    CHECK( !Contains( visible, frustumCount, 1 ) );
+    CHECK( !Contains( visible, frustumCount, 2 ) );
+    CHECK( !Contains( visible, frustumCount, 3 ) );
+    CHECK( Contains( visible, frustumCount, 4 ) );
+    CHECK( Contains( visible, frustumCount, 5 ) );
+    CHECK( std::is_sorted( visible, visible + frustumCount ) );
+
+    float  hiZData[HIZ_SIZE * HIZ_SIZE * 2];
+    float* levels[HIZ_MIP_COUNT];
+    for ( int level = 0, offset = 0; level < HIZ_MIP_COUNT; level++ )
+    {
+        levels[level] = hiZData + offset;
+        offset += ( HIZ_SIZE >> level ) * ( HIZ_SIZE >> level );
+    }
+    CreateHiZ( levels );
+
+    GpuCullingHiZ hiZ;
+    hiZ.levels   = levels;
+    hiZ.width    = HIZ_SIZE;
+    hiZ.height   = HIZ_SIZE;
+    hiZ.mipCount = HIZ_MIP_COUNT;
+
+    const int occlusionCount =
+        GpuCullingPass::CullReference( &parms, &bounds[0][0], instanceCount, &hiZ, visible );
+    CHECK( occlusionCount == 5 );
+    CHECK( !Contains( visible, occlusionCount, 6 ) );
+    CHECK( Contains( visible, occlusionCount, 7 ) );
+    CHECK( Contains( visible, occlusionCount, 8 ) );
+
+    // The boxes around these spheres cross the same planes and cover the same texels.
+    float boxes[sizeof( bounds ) / sizeof( bounds[0] ) * 8];
+    SpheresToBoxes( &bounds[0][0], instanceCount, boxes );
+    uint32_t boxVisible[sizeof( bounds ) / sizeof( bounds[0] )];
+    CHECK( SameVisible( boxVisible,
+                        GpuCullingPass::CullReference( &parms, boxes, instanceCount, &hiZ,
+                                                       boxVisible, GPU_CULLING_BOUNDS_AABB ),
+                        visible, occlusionCount ) );
+    const int sphereFrustumCount =
+        GpuCullingPass::CullReference( &parms, &bounds[0][0], instanceCount, nullptr, visible );
+    CHECK( SameVisible( boxVisible,
+                        GpuCullingPass::CullReference( &parms, boxes, instanceCount, nullptr,
+                                                       boxVisible, GPU_CULLING_BOUNDS_AABB ),
+                        visible, sphereFrustumCount ) );
+
+    // A pyramid without a mip count is sampled at level 0, like the shader does.
+    const float   farDepth     = 1.0f;
+    const float*  farLevels[1] = { &farDepth };
+    GpuCullingHiZ farHiZ;
+    farHiZ.levels   = farLevels;
+    farHiZ.width    = 1;
+    farHiZ.height   = 1;
+    farHiZ.mipCount = 0;
+    CHECK( GpuCullingPass::CullReference( &parms, &bounds[0][0], instanceCount, &farHiZ,
+                                          visible ) == frustumCount );
+}
+
+// Returns the number of visible instances, or -1 if the results cannot be read back.
+static int CullOnGpu( TestGpu* gpu, GpuCullingPass* pass, GpuBuffer* boundsBuffer,
+                      const GpuCullingBounds boundsType, const GpuGeometry* geometry,
+                      const GpuTexture* hiZ, uint32_t* visibleInstances )
+{
+    GpuCommandBuffer commandBuffer( &gpu->context, GPU_COMMAND_BUFFER_TYPE_PRIMARY, 1 );
+    commandBuffer.BeginPrimary();
+    pass->Cull( &commandBuffer, boundsBuffer, INSTANCE_COUNT, geometry, hiZ, boundsType );
+    MakeHostReadable( &commandBuffer, &pass->indirectBuffer );
+    MakeHostReadable( &commandBuffer, &pass->visibleInstanceBuffer );
+    SubmitAndWait( &commandBuffer );
+
+    VkDrawIndexedIndirectCommand indirectCommand;
+    if ( !ReadBuffer( &gpu->context, &pass->indirectBuffer, &indirectCommand,
+                      sizeof( indirectCommand ) ) ||
+         !ReadBuffer( &gpu->context, &pass->visibleInstanceBuffer, visibleInstances,
+                      INSTANCE_COUNT * sizeof( uint32_t ) ) )
+    {
+        return -1;
+    }
+    CHECK( indirectCommand.indexCount == (uint32_t)geometry->indexCount );
+    CHECK( indirectCommand.instanceCount <= (uint32_t)INSTANCE_COUNT );
+
+    // The shader appends the instances in any order.
+    const int visibleCount = std::min( (int)indirectCommand.instanceCount, INSTANCE_COUNT );
+    std::sort( visibleInstances, visibleInstances + visibleCount );
+    return visibleCount;
+}
+
+// Grows or shrinks every sphere or box by 'margin' in all directions.
+static void ResizeBounds( const float* bounds, const GpuCullingBounds boundsType,
+                          const float margin, float* resized )
+{
+    for ( int i = 0; i < INSTANCE_COUNT; i++ )
+    {
+        if ( boundsType == GPU_CULLING_BOUNDS_AABB )
+        {
+            for ( int c = 0; c < 3; c++ )
+            {
+                resized[i * 8 + 0 + c] = bounds[i * 8 + 0 + c] - margin;
+                resized[i * 8 + 4 + c] = bounds[i * 8 + 4 + c] + margin;
+            }
+            resized[i * 8 + 3] = 0.0f;
+            resized[i * 8 + 7] = 0.0f;
+        }
+        else
+        {
+            memcpy( &resized[i * 4], &bounds[i * 4], 3 * sizeof( float ) );
+            resized[i * 4 + 3] = bounds[i * 4 + 3] + margin;
+        }
+    }
+}
+
+// The shader and the reference round differently, so an instance that touches a frustum plane
+// or a Hi-Z texel edge may go either way. Visibility only grows with the bounds, so instances
+// that the reference keeps when shrunk by BOUNDARY_MARGIN must be visible on the GPU, and
+// instances that it culls when grown by BOUNDARY_MARGIN must be culled. Only the few in between
+// may differ.
+static void CompareVisible( const GpuCullingParms* parms, const float* bounds,
+                            const GpuCullingBounds boundsType, const GpuCullingHiZ* hiZ,
+                            const uint32_t* gpuVisible, const int gpuCount )
+{
+    float*    resized = (float*)malloc( INSTANCE_COUNT * 8 * sizeof( float ) );
+    uint32_t  certainVisible[INSTANCE_COUNT];
+    uint32_t  possibleVisible[INSTANCE_COUNT];
+    ResizeBounds( bounds, boundsType, -BOUNDARY_MARGIN, resized );
+    const int certainCount = GpuCullingPass::CullReference( parms, resized, INSTANCE_COUNT, hiZ,
+                                                            certainVisible, boundsType );
+    ResizeBounds( bounds, boundsType, BOUNDARY_MARGIN, resized );
+    const int possibleCount = GpuCullingPass::CullReference( parms, resized, INSTANCE_COUNT, hiZ,
+                                                             possibleVisible, boundsType );
+    free( resized );
+
+    for ( int i = 0; i < certainCount; i++ )
+    {
+        if ( !std::binary_search( gpuVisible, gpuVisible + gpuCount, certainVisible[i] ) )
+        {
+            printf( "instance %u is visible but was culled on the GPU\n", certainVisible[i] );
+            CHECK( false );
+            break;
+        }
+    }
+    for ( int i = 0; i < gpuCount; i++ )
+    {
+        if ( !std::binary_search( possibleVisible, possibleVisible + possibleCount,
+                                  gpuVisible[i] ) )
+        {
+            printf( "instance %u is culled but was kept on the GPU\n", gpuVisible[i] );
+            CHECK( false );
+            break;
+        }
+    }
+    // The comparison says little if many instances are that close to a boundary.
+    CHECK( possibleCount - certainCount <= INSTANCE_COUNT / 50 );
+}
+
+static void TestCulling()
+{
+    TestGpu gpu;
+
+    float bounds[INSTANCE_COUNT * 4];
+    CreateBounds( bounds );
+    GpuBuffer boundsBuffer( &gpu.context, GPU_BUFFER_TYPE_STORAGE, sizeof( bounds ), bounds,
+                            false );
+    float     boxes[INSTANCE_COUNT * 8];
+    SpheresToBoxes( bounds, INSTANCE_COUNT, boxes );
+    GpuBuffer boxBuffer( &gpu.context, GPU_BUFFER_TYPE_STORAGE, sizeof( boxes ), boxes, false );
+
+    TestTriangle triangle( &gpu.context );
+
+    float* levels[HIZ_MIP_COUNT];
+    size_t hiZSize = 0;
+    for ( int level = 0; level < HIZ_MIP_COUNT; level++ )
+    {
+        hiZSize += ( HIZ_SIZE >> level ) * ( HIZ_SIZE >> level );
+    }
+    float* hiZData = (float*)malloc( hiZSize * sizeof( float ) );
+    for ( int level = 0, offset = 0; level < HIZ_MIP_COUNT; level++ )
+    {
+        levels[level] = hiZData + offset;
+        offset += ( HIZ_SIZE >> level ) * ( HIZ_SIZE >> level );
+    }
+    CreateHiZ( levels );
+
+    GpuTexture hiZ( &gpu.context );
+    hiZ.Create2D( GPU_TEXTURE_FORMAT_R32_SFLOAT, GPU_SAMPLE_COUNT_1, HIZ_SIZE, HIZ_SIZE,
+                  HIZ_MIP_COUNT, GPU_TEXTURE_USAGE_SAMPLED, hiZData, hiZSize * sizeof( float ) );
+
+    GpuCullingHiZ referenceHiZ;
+    referenceHiZ.levels   = levels;
+    referenceHiZ.width    = HIZ_SIZE;
+    referenceHiZ.height   = HIZ_SIZE;
+    referenceHiZ.mipCount = HIZ_MIP_COUNT;
+
+    GpuCullingPass pass( &gpu.context, INSTANCE_COUNT );
+    float          viewProjection[16];
+    PerspectiveMatrix( viewProjection, 1.0f, 100.0f );
+    pass.parms.SetViewProjection( viewProjection );
+
+    uint32_t gpuVisible[INSTANCE_COUNT];
+    uint32_t referenceVisible[INSTANCE_COUNT];
+
+    const int frustumCount = CullOnGpu( &gpu, &pass, &boundsBuffer, GPU_CULLING_BOUNDS_SPHERE,
+                                        &triangle.geometry, nullptr, gpuVisible );
+    if ( frustumCount < 0 )
+    {
+        printf( "SKIP: the device local memory of this driver is not host visible\n" );
+        free( hiZData );
+        return;
+    }
+    CompareVisible( &pass.parms, bounds, GPU_CULLING_BOUNDS_SPHERE, nullptr, gpuVisible,
+                    frustumCount );
+    const int referenceFrustumCount = GpuCullingPass::CullReference(
+        &pass.parms, bounds, INSTANCE_COUNT, nullptr, referenceVisible );
+    // The scene is only a useful test if the frustum removes some instances but not all.
+    CHECK( referenceFrustumCount > 0 && referenceFrustumCount < INSTANCE_COUNT );
+
+    const int occlusionCount = CullOnGpu( &gpu, &pass, &boundsBuffer, GPU_CULLING_BOUNDS_SPHERE,
+                                          &triangle.geometry, &hiZ, gpuVisible );
+    CompareVisible( &pass.parms, bounds, GPU_CULLING_BOUNDS_SPHERE, &referenceHiZ, gpuVisible,
+                    occlusionCount );
+    const int referenceOcclusionCount = GpuCullingPass::CullReference(
+        &pass.parms, bounds, INSTANCE_COUNT, &referenceHiZ, referenceVisible );
+    CHECK( referenceOcclusionCount > 0 && referenceOcclusionCount < referenceFrustumCount );
+
+    const int boxFrustumCount = CullOnGpu( &gpu, &pass, &boxBuffer, GPU_CULLING_BOUNDS_AABB,
+                                           &triangle.geometry, nullptr, gpuVisible );
+    CompareVisible( &pass.parms, boxes, GPU_CULLING_BOUNDS_AABB, nullptr, gpuVisible,
+                    boxFrustumCount );
+
+    const int boxOcclusionCount = CullOnGpu( &gpu, &pass, &boxBuffer, GPU_CULLING_BOUNDS_AABB,
+                                             &triangle.geometry, &hiZ, gpuVisible );
+    CompareVisible( &pass.parms, boxes, GPU_CULLING_BOUNDS_AABB, &referenceHiZ, gpuVisible,
+                    boxOcclusionCount );
+
+    free( hiZData );
+}
+
+int main( int argc, char* argv[] )
+{
+    RUN_TEST( TestCullReference );
+    RUN_TEST( TestCulling );
+    return ( testFailures == 0 ) ? 0 : 1;
+}
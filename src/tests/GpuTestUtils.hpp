@@ -0,0 +1,149 @@
+#pragma once
+
+#include "GpuBuffer.hpp"
+#include "GpuCommandBuffer.hpp"
+#include "GpuContext.hpp"
+#include "GpuDevice.hpp"
+#include "GpuGeometry.hpp"
+#include "GpuInstance.hpp"
+#include "GpuStateTracker.hpp"
+#include "GpuSubmitBatch.hpp"
+#include "GpuTimeline.hpp"
+#include "TestUtils.hpp"
+
+#include <stddef.h>
+#include <string.h>
+
+static lxd::GpuQueueInfo TestQueueInfo( const int computeQueueCount )
+{
+    lxd::GpuQueueInfo queueInfo;
+    memset( &queueInfo, 0, sizeof( queueInfo ) );
+    queueInfo.queueCount         = 1;
+    queueInfo.queueProperties    = lxd::GpuQueueProperty( lxd::GPU_QUEUE_PROPERTY_GRAPHICS |
+                                                       lxd::GPU_QUEUE_PROPERTY_COMPUTE );
+    queueInfo.queuePriorities[0] = lxd::GPU_QUEUE_PRIORITY_MEDIUM;
+    queueInfo.computeQueueCount  = computeQueueCount;
+    return queueInfo;
+}
+
+// A device without a surface and a graphics context on its first queue. The tests use whichever
+// driver the loader finds, set VK_ICD_FILENAMES to the manifest of lavapipe to run them on the
+// CPU.
+class TestGpu
+{
+  public:
+    TestGpu( const int computeQueueCount = 0 )
+        : queueInfo( TestQueueInfo( computeQueueCount ) ),
+          device( &instance, &queueInfo, VK_NULL_HANDLE ),
+          context( &device, 0 )
+    {
+    }
+
+  public:
+    lxd::GpuInstance  instance;
+    lxd::GpuQueueInfo queueInfo;
+    lxd::GpuDevice    device;
+    lxd::GpuContext   context;
+};
+
+// Ends and submits the recording, waits until the GPU executed it and returns its timeline value.
+static uint64_t SubmitAndWait( lxd::GpuCommandBuffer* commandBuffer )
+{
+    lxd::GpuContext* context = commandBuffer->context;
+
+    commandBuffer->EndPrimary();
+    const uint64_t value = commandBuffer->SubmitPrimary();
+    context->submitBatch->Flush();
+    context->timeline->Wait( value );
+    return value;
+}
+
+// Makes the writes of the commands recorded so far visible to ReadBuffer() once they complete.
+static void MakeHostReadable( lxd::GpuCommandBuffer* commandBuffer, lxd::GpuBuffer* buffer )
+{
+    commandBuffer->stateTracker->BufferAccess( buffer, 0, buffer->size,
+                                               VK_PIPELINE_STAGE_HOST_BIT,
+                                               VK_ACCESS_HOST_READ_BIT );
+}
+
+// Device local buffers have no transfer source usage, so they are read by mapping their memory,
+// which works with drivers that make all memory host visible, like lavapipe and most integrated
+// GPUs. Returns false if the memory of the buffer cannot be mapped.
+static bool ReadBuffer( lxd::GpuContext* context, const lxd::GpuBuffer* buffer, void* data,
+                        const size_t size )
+{
+    lxd::GpuDevice* device = context->device;
+
+    VkMemoryRequirements memoryRequirements;
+    VC( device->vkGetBufferMemoryRequirements( device->device, buffer->buffer,
+                                               &memoryRequirements ) );
+    const uint32_t memoryType =
+        device->GetMemoryTypeIndex( memoryRequirements.memoryTypeBits, buffer->flags );
+    if ( ( device->physicalDeviceMemoryProperties.memoryTypes[memoryType].propertyFlags &
+           VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT ) == 0 )
+    {
+        return false;
+    }
+
+    void* mapped;
+    VK( device->vkMapMemory( device->device, buffer->memory, 0, VK_WHOLE_SIZE, 0, &mapped ) );
+
+    VkMappedMemoryRange mappedMemoryRange;
+    mappedMemoryRange.sType  = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    mappedMemoryRange.pNext  = nullptr;
+    mappedMemoryRange.memory = buffer->memory;
+    mappedMemoryRange.offset = 0;
+    mappedMemoryRange.size   = VK_WHOLE_SIZE;
+    VK( device->vkInvalidateMappedMemoryRanges( device->device, 1, &mappedMemoryRange ) );
+
+    memcpy( data, mapped, size );
+    VC( device->vkUnmapMemory( device->device, buffer->memory ) );
+    return true;
+}
+
+// Right handed perspective with a 90 degree field of view, looking down -Z, with clip space
+// depth in [0, 1], column-major.
+static void PerspectiveMatrix( float* m, const float nearZ, const float farZ )
+{
+    memset( m, 0, 16 * sizeof( float ) );
+    m[0]  = 1.0f;
+    m[5]  = 1.0f;
+    m[10] = farZ / ( nearZ - farZ );
+    m[11] = -1.0f;
+    m[14] = nearZ * farZ / ( nearZ - farZ );
+}
+
+struct TestTriangleAttributeArrays
+{
+    TestTriangleAttributeArrays( const lxd::GpuVertexAttribute* layout ) : base( layout, 3, 1 )
+    {
+        memset( this->base.data, 0, this->base.dataSize );
+    }
+
+    lxd::GpuVertexAttributeArrays base;
+    float ( *position )[3];
+};
+
+static const lxd::GpuVertexAttribute testTriangleLayout[] = {
+    { 1, offsetof( TestTriangleAttributeArrays, position ), sizeof( float[3] ),
+      lxd::GPU_ATTRIBUTE_FORMAT_R32G32B32_SFLOAT, 1, "vertexPosition" },
+    { 0, 0, 0, lxd::GPU_ATTRIBUTE_FORMAT_NONE, 0, nullptr } };
+
+static const unsigned short testTriangleIndices[3] = { 0, 1, 2 };
+
+// A degenerate triangle, for the passes that only need the index count of a geometry.
+class TestTriangle
+{
+  public:
+    TestTriangle( lxd::GpuContext* context )
+        : attribs( testTriangleLayout ),
+          indices( 3, testTriangleIndices ),
+          geometry( context, &attribs.base, &indices )
+    {
+    }
+
+  public:
+    TestTriangleAttributeArrays attribs;
+    lxd::GpuTriangleIndexArray  indices;
+    lxd::GpuGeometry            geometry;
+};
@@ -0,0 +1,111 @@
+#include "GpuLayoutCache.hpp"
+#include "GpuTestUtils.hpp"
+
+using namespace lxd;
+
+// Acquires layouts from a GpuLayoutCache of its own: equal keys share a layout, a key that differs
+// in the stages of a binding, the push constant range or the bindless set gets a layout of its
+// own, and a layout is destroyed when its last reference is released.
+
+// A uniform buffer for the vertex shader, a texture for the fragment shader and 64 bytes of push
+// constants for both.
+static GpuLayoutKey TestLayoutKey()
+{
+    GpuLayoutKey key;
+    memset( &key, 0, sizeof( key ) );
+    key.numBindings            = 2;
+    key.descriptorTypes[0]     = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    key.descriptorTypes[1]     = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    key.stageFlags[0]          = VK_SHADER_STAGE_VERTEX_BIT;
+    key.stageFlags[1]          = VK_SHADER_STAGE_FRAGMENT_BIT;
+    key.pushConstantStageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    key.pushConstantsSize      = 64;
+    return key;
+}
+
+// Stands in for the table of GpuBindlessTable, the cache only compares the handle.
+static VkDescriptorSetLayout CreateEmptySetLayout( GpuDevice* device )
+{
+    VkDescriptorSetLayoutCreateInfo createInfo;
+    createInfo.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    createInfo.pNext        = nullptr;
+    createInfo.flags        = 0;
+    createInfo.bindingCount = 0;
+    createInfo.pBindings    = nullptr;
+
+    VkDescriptorSetLayout setLayout;
+    VK( device->vkCreateDescriptorSetLayout( device->device, &createInfo, VK_ALLOCATOR,
+                                             &setLayout ) );
+    return setLayout;
+}
+
+static void TestSharedLayouts()
+{
+    TestGpu        gpu;
+    GpuLayoutCache cache( &gpu.device );
+
+    const GpuLayoutKey key   = TestLayoutKey();
+    GpuLayout*         first = cache.Acquire( &key );
+    CHECK( first->descriptorSetLayout != VK_NULL_HANDLE );
+    CHECK( first->pipelineLayout != VK_NULL_HANDLE );
+    CHECK( first->refCount == 1 );
+    CHECK( cache.numLayouts == 1 );
+    CHECK( cache.numMisses == 1 );
+
+    // A key built separately with the same contents is a hit.
+    const GpuLayoutKey equalKey = TestLayoutKey();
+    GpuLayout*         second   = cache.Acquire( &equalKey );
+    CHECK( second == first );
+    CHECK( first->refCount == 2 );
+    CHECK( cache.numLayouts == 1 );
+    CHECK( cache.numHits == 1 );
+
+    GpuLayoutKey stageKey = TestLayoutKey();
+    stageKey.stageFlags[1] |= VK_SHADER_STAGE_VERTEX_BIT;
+    GpuLayout* stageLayout = cache.Acquire( &stageKey );
+
+    GpuLayoutKey pushKey      = TestLayoutKey();
+    pushKey.pushConstantsSize = 128;
+    GpuLayout* pushLayout     = cache.Acquire( &pushKey );
+
+    GpuLayoutKey bindlessKey      = TestLayoutKey();
+    bindlessKey.bindlessSetLayout = CreateEmptySetLayout( &gpu.device );
+    GpuLayout* bindlessLayout     = cache.Acquire( &bindlessKey );
+
+    CHECK( cache.numLayouts == 4 );
+    CHECK( cache.numMisses == 4 );
+    CHECK( stageLayout != first && pushLayout != first && bindlessLayout != first );
+    CHECK( stageLayout != pushLayout && stageLayout != bindlessLayout );
+    CHECK( pushLayout != bindlessLayout );
+    CHECK( stageLayout->pipelineLayout != first->pipelineLayout );
+    CHECK( pushLayout->pipelineLayout != first->pipelineLayout );
+    CHECK( bindlessLayout->pipelineLayout != first->pipelineLayout );
+
+    // The layout stays while a reference is left.
+    cache.Release( second );
+    CHECK( first->refCount == 1 );
+    CHECK( cache.numLayouts == 4 );
+
+    // Releasing the last reference destroys it, so the key misses again.
+    cache.Release( first );
+    CHECK( cache.numLayouts == 3 );
+    GpuLayout* recreated = cache.Acquire( &key );
+    CHECK( recreated->refCount == 1 );
+    CHECK( cache.numLayouts == 4 );
+    CHECK( cache.numMisses == 5 );
+
+    cache.Release( recreated );
+    cache.Release( stageLayout );
+    cache.Release( pushLayout );
+    cache.Release( bindlessLayout );
+    CHECK( cache.numLayouts == 0 );
+
+    VC( gpu.device.vkDestroyDescriptorSetLayout( gpu.device.device, bindlessKey.bindlessSetLayout,
+                                                 VK_ALLOCATOR ) );
+}
+
+int main( int argc, char* argv[] )
+{
+    RUN_TEST( TestSharedLayouts );
+    return ( testFailures == 0 ) ? 0 : 1;
+}
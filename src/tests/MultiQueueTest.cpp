@@ -0,0 +1,122 @@
+#include "GpuCulling.hpp"
+#include "GpuTestUtils.hpp"
+
+#include <algorithm>
+
+using namespace lxd;
+
+// Culls on an async compute context and reads the results on the graphics context, with the
+// buffers handed back and forth through queue family ownership transfers and the submits
+// ordered with GpuTimeline::AddWait(). Every frame uses a different view, so results that did
+// not make it across the queues show up as a mismatch with GpuCullingPass::CullReference().
+
+static const int INSTANCE_COUNT = 256;
+static const int FRAME_COUNT    = 3;
+
+static void CreateBounds( float* bounds )
+{
+    for ( int i = 0; i < INSTANCE_COUNT; i++ )
+    {
+        bounds[i * 4 + 0] = ( ( i % 16 ) - 7.5f ) * 4.0f;
+        bounds[i * 4 + 1] = ( ( ( i / 16 ) % 16 ) - 7.5f ) * 4.0f;
+        bounds[i * 4 + 2] = -5.0f - ( i % 7 ) * 8.0f;
+        bounds[i * 4 + 3] = 0.5f;
+    }
+}
+
+static void TestAsyncComputeOwnership()
+{
+    TestGpu gpu( 1 );
+    if ( gpu.device.computeQueueFamilyIndex == -1 || !gpu.device.supportsTimelineSemaphores )
+    {
+        printf( "SKIP: the driver has no compute-only queue family or no timeline semaphores\n" );
+        return;
+    }
+
+    GpuContext  compute( &gpu.device, 0, GPU_QUEUE_PROPERTY_COMPUTE );
+    GpuContext* graphics = &gpu.context;
+
+    float bounds[INSTANCE_COUNT * 4];
+    CreateBounds( bounds );
+    GpuBuffer boundsBuffer( &compute, GPU_BUFFER_TYPE_STORAGE, sizeof( bounds ), bounds, false );
+
+    TestTriangle     triangle( graphics );
+    GpuCullingPass   pass( &compute, INSTANCE_COUNT );
+    GpuCommandBuffer computeCommandBuffer( &compute, GPU_COMMAND_BUFFER_TYPE_PRIMARY, 1 );
+    GpuCommandBuffer graphicsCommandBuffer( graphics, GPU_COMMAND_BUFFER_TYPE_PRIMARY, 1 );
+
+    // The graphics queue reads the compacted instances and their count, like a draw would.
+    const VkPipelineStageFlags graphicsStages =
+        GpuBuffer::GetBufferStages( GPU_BUFFER_TYPE_INDIRECT ) |
+        GpuBuffer::GetBufferStages( GPU_BUFFER_TYPE_STORAGE );
+
+    uint64_t graphicsValue = 0;
+    int      previousCount = INSTANCE_COUNT + 1;
+    for ( int frame = 0; frame < FRAME_COUNT; frame++ )
+    {
+        float viewProjection[16];
+        PerspectiveMatrix( viewProjection, 1.0f, 60.0f - frame * 20.0f );
+        pass.parms.SetViewProjection( viewProjection );
+
+        computeCommandBuffer.BeginPrimary();
+        if ( frame > 0 )
+        {
+            // Takes the buffers back from the graphics queue of the previous frame.
+            compute.timeline->AddWait( graphics->timeline, graphicsValue,
+                                       VK_PIPELINE_STAGE_TRANSFER_BIT |
+                                           VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT );
+            computeCommandBuffer.AcquireBuffer( &pass.indirectBuffer, graphics );
+            computeCommandBuffer.AcquireBuffer( &pass.visibleInstanceBuffer, graphics );
+        }
+        pass.Cull( &computeCommandBuffer, &boundsBuffer, INSTANCE_COUNT, &triangle.geometry,
+                   nullptr );
+        computeCommandBuffer.ReleaseBuffer( &pass.indirectBuffer, graphics );
+        computeCommandBuffer.ReleaseBuffer( &pass.visibleInstanceBuffer, graphics );
+        computeCommandBuffer.EndPrimary();
+        const uint64_t computeValue = computeCommandBuffer.SubmitPrimary();
+        compute.submitBatch->Flush();
+
+        graphics->timeline->AddWait( compute.timeline, computeValue, graphicsStages );
+        graphicsCommandBuffer.BeginPrimary();
+        graphicsCommandBuffer.AcquireBuffer( &pass.indirectBuffer, &compute );
+        graphicsCommandBuffer.AcquireBuffer( &pass.visibleInstanceBuffer, &compute );
+        MakeHostReadable( &graphicsCommandBuffer, &pass.indirectBuffer );
+        MakeHostReadable( &graphicsCommandBuffer, &pass.visibleInstanceBuffer );
+        graphicsCommandBuffer.ReleaseBuffer( &pass.indirectBuffer, &compute );
+        graphicsCommandBuffer.ReleaseBuffer( &pass.visibleInstanceBuffer, &compute );
+        graphicsValue = SubmitAndWait( &graphicsCommandBuffer );
+
+        VkDrawIndexedIndirectCommand indirectCommand;
+        uint32_t                     gpuVisible[INSTANCE_COUNT];
+        if ( !ReadBuffer( graphics, &pass.indirectBuffer, &indirectCommand,
+                          sizeof( indirectCommand ) ) ||
+             !ReadBuffer( graphics, &pass.visibleInstanceBuffer, gpuVisible,
+                          sizeof( gpuVisible ) ) )
+        {
+            printf( "SKIP: the device local memory of this driver is not host visible\n" );
+            return;
+        }
+
+        uint32_t  referenceVisible[INSTANCE_COUNT];
+        const int referenceCount = GpuCullingPass::CullReference(
+            &pass.parms, bounds, INSTANCE_COUNT, nullptr, referenceVisible );
+
+        const int gpuCount = std::min( (int)indirectCommand.instanceCount, INSTANCE_COUNT );
+        std::sort( gpuVisible, gpuVisible + gpuCount );
+        CHECK( (int)indirectCommand.instanceCount == referenceCount );
+        CHECK( std::equal( gpuVisible, gpuVisible + std::min( gpuCount, referenceCount ),
+                           referenceVisible ) );
+
+        // The far plane moves closer every frame.
+        CHECK( referenceCount > 0 && referenceCount < previousCount );
+        previousCount = referenceCount;
+    }
+
+    compute.WaitIdle();
+}
+
+int main( int argc, char* argv[] )
+{
+    RUN_TEST( TestAsyncComputeOwnership );
+    return ( testFailures == 0 ) ? 0 : 1;
+}
@@ -0,0 +1,128 @@
+#include "GpuGraphicsPipeline.hpp"
+#include "GpuGraphicsProgram.hpp"
+#include "GpuPipelineCompiler.hpp"
+#include "GpuRenderPass.hpp"
+#include "GpuShaderCache.hpp"
+#include "GpuTestUtils.hpp"
+#include "Triangle.frag.h"
+#include "Triangle.vert.h"
+
+using namespace lxd;
+
+// Compiles pipelines on a GpuPipelineCompiler with pipeline libraries enabled. A pipeline whose
+// parts are new is compiled by the worker, a pipeline that combines cached parts is fast-linked
+// right away and replaced by the optimized link, and a pipeline that is in the registry is ready
+// right away. Lavapipe supports VK_EXT_graphics_pipeline_library, other drivers may skip.
+
+static const GpuShaderBlob triangleVertexShader = {
+    VK_SHADER_STAGE_VERTEX_BIT, triangleVertexSpirv, sizeof( triangleVertexSpirv ),
+    triangleVertexSpirvHash };
+static const GpuShaderBlob triangleFragmentShader = {
+    VK_SHADER_STAGE_FRAGMENT_BIT, triangleFragmentSpirv, sizeof( triangleFragmentSpirv ),
+    triangleFragmentSpirvHash };
+
+// Waits for the workers, then lets Update() replace the fast-linked pipelines.
+static void WaitForCompiler( GpuPipelineCompiler* compiler )
+{
+    while ( compiler->NumPending() > 0 )
+    {
+    }
+    compiler->Update();
+}
+
+static bool HasAllLibraries( const GpuGraphicsPipeline* pipeline )
+{
+    for ( int i = 0; i < GPU_PIPELINE_LIBRARY_PARTS; i++ )
+    {
+        if ( pipeline->libraries[i] == VK_NULL_HANDLE )
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void TestPipelineLibraries()
+{
+    TestGpu gpu;
+    if ( !gpu.context.EnablePipelineLibraries() )
+    {
+        printf( "SKIP: the device does not support graphics pipeline libraries\n" );
+        return;
+    }
+
+    GpuRenderPass      renderPass( &gpu.context, GPU_SURFACE_COLOR_FORMAT_R8G8B8A8,
+                                   GPU_SURFACE_DEPTH_FORMAT_NONE, GPU_SAMPLE_COUNT_1,
+                                   GPU_RENDERPASS_TYPE_INLINE,
+                                   GPU_RENDERPASS_FLAG_CLEAR_COLOR_BUFFER );
+    TestTriangle       triangle( &gpu.context );
+    GpuGraphicsProgram program( &gpu.context, &triangleVertexShader, &triangleFragmentShader,
+                                testTriangleLayout, 1 );
+    // Destroyed after the pipelines that were queued on it.
+    GpuPipelineCompiler compiler( &gpu.context, 1 );
+
+    GpuGraphicsPipelineParms parms;
+    parms.renderPass = &renderPass;
+    parms.program    = &program;
+    parms.geometry   = &triangle.geometry;
+
+    // Nothing is cached, so all the parts and the pipeline are compiled by the worker.
+    GpuGraphicsPipeline first( &gpu.context, &parms, &compiler );
+    CHECK( !first.fastLinked );
+    WaitForCompiler( &compiler );
+    CHECK( first.ready );
+    CHECK( first.pipeline != VK_NULL_HANDLE );
+    CHECK( HasAllLibraries( &first ) );
+    CHECK( first.Resolve() == &first );
+
+    // The cull mode is in the pre-rasterization part and the blending in the fragment output
+    // part, the vertex input and the fragment shader are shared with the first pipeline.
+    GpuGraphicsPipelineParms otherParms = parms;
+    otherParms.rop.cullMode             = GPU_CULL_MODE_FRONT;
+    otherParms.rop.blendEnable          = true;
+    GpuGraphicsPipeline other( &gpu.context, &otherParms, &compiler );
+    CHECK( !other.fastLinked );
+    WaitForCompiler( &compiler );
+    CHECK( other.ready );
+    CHECK( HasAllLibraries( &other ) );
+    CHECK( other.pipeline != first.pipeline );
+    CHECK( other.libraries[0] == first.libraries[0] );
+    CHECK( other.libraries[1] != first.libraries[1] );
+    CHECK( other.libraries[2] == first.libraries[2] );
+    CHECK( other.libraries[3] != first.libraries[3] );
+
+    // The culling of the first pipeline with the blending of the other one: every part is
+    // cached, so it is fast-linked and can be drawn with before the worker ran.
+    GpuGraphicsPipelineParms combinedParms = parms;
+    combinedParms.rop.blendEnable          = true;
+    GpuGraphicsPipeline combined( &gpu.context, &combinedParms, &compiler );
+    CHECK( combined.fastLinked );
+    CHECK( combined.pipeline != VK_NULL_HANDLE );
+    CHECK( combined.Resolve() == &combined );
+    CHECK( combined.libraries[0] == first.libraries[0] );
+    CHECK( combined.libraries[1] == first.libraries[1] );
+    CHECK( combined.libraries[2] == first.libraries[2] );
+    CHECK( combined.libraries[3] == other.libraries[3] );
+
+    // Update() swaps in the optimized link.
+    WaitForCompiler( &compiler );
+    CHECK( combined.ready );
+    CHECK( !combined.fastLinked );
+    CHECK( combined.pipeline != VK_NULL_HANDLE );
+    CHECK( combined.optimizedPipeline == VK_NULL_HANDLE );
+
+    // The same state as the first pipeline is a registry hit, which is not queued at all.
+    GpuGraphicsPipeline again( &gpu.context, &parms, &compiler );
+    CHECK( again.ready );
+    CHECK( !again.fastLinked );
+    CHECK( again.compiler == nullptr );
+    CHECK( again.pipeline == first.pipeline );
+    CHECK( HasAllLibraries( &again ) );
+    CHECK( compiler.NumPending() == 0 );
+}
+
+int main( int argc, char* argv[] )
+{
+    RUN_TEST( TestPipelineLibraries );
+    return ( testFailures == 0 ) ? 0 : 1;
+}
@@ -0,0 +1,251 @@
+#include "GpuRenderGraph.hpp"
+#include "TestUtils.hpp"
+
+using namespace lxd;
+
+// The graphs are compiled without a context and with null imports, so only the culling, the
+// barriers and the aliasing are tested.
+
+static GpuRenderGraphTextureDesc TextureDesc( const VkFormat format )
+{
+    GpuRenderGraphTextureDesc desc;
+    desc.format      = format;
+    desc.width       = 1024;
+    desc.height      = 1024;
+    desc.layerCount  = 1;
+    desc.sampleCount = GPU_SAMPLE_COUNT_1;
+    return desc;
+}
+
+static const GpuRenderGraphBarrier* FindBarrier( const GpuRenderGraph* graph, const int pass,
+                                                 const int resource )
+{
+    const GpuRenderGraphPass* p = &graph->passes[pass];
+    for ( int b = 0; b < p->numBarriers; b++ )
+    {
+        if ( p->barriers[b].resource == resource )
+        {
+            return &p->barriers[b];
+        }
+    }
+    return nullptr;
+}
+
+// A depth pass that is sampled by the scene pass, with an unused pass in between.
+static void TestShadowPass()
+{
+    static GpuRenderGraph graph( nullptr );
+    graph.Reset();
+
+    const GpuRenderGraphTextureDesc shadowDesc = TextureDesc( VK_FORMAT_D32_SFLOAT );
+    const GpuRenderGraphTextureDesc debugDesc  = TextureDesc( VK_FORMAT_R8G8B8A8_UNORM );
+
+    const int color  = graph.ImportTexture( "color", nullptr, GPU_RENDER_GRAPH_ACCESS_NONE );
+    const int shadow = graph.CreateTransientTexture( "shadow", &shadowDesc );
+    const int debug  = graph.CreateTransientTexture( "debug", &debugDesc );
+
+    const int shadowPass = graph.AddPass( "shadow", nullptr, nullptr );
+    graph.AddAccess( shadowPass, shadow, GPU_RENDER_GRAPH_ACCESS_DEPTH_ATTACHMENT );
+    const int debugPass = graph.AddPass( "debug", nullptr, nullptr );
+    graph.AddAccess( debugPass, shadow, GPU_RENDER_GRAPH_ACCESS_SAMPLED_FRAGMENT );
+    graph.AddAccess( debugPass, debug, GPU_RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT );
+    const int scenePass = graph.AddPass( "scene", nullptr, nullptr );
+    graph.AddAccess( scenePass, color, GPU_RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT );
+    graph.AddAccess( scenePass, shadow, GPU_RENDER_GRAPH_ACCESS_SAMPLED_FRAGMENT );
+    graph.MarkOutput( color, GPU_RENDER_GRAPH_ACCESS_PRESENT );
+    graph.Compile();
+
+    CHECK( !graph.passes[shadowPass].culled );
+    CHECK( graph.passes[debugPass].culled );
+    CHECK( !graph.passes[scenePass].culled );
+    CHECK( graph.passes[debugPass].numBarriers == 0 );
+    CHECK( graph.resources[debug].firstPass == -1 );
+    CHECK( graph.resources[debug].aliasGroup == GPU_RENDER_GRAPH_INVALID_ALIAS_GROUP );
+
+    // The first use of the shadow map discards its contents.
+    CHECK( graph.passes[shadowPass].numBarriers == 1 );
+    const GpuRenderGraphBarrier* clear = FindBarrier( &graph, shadowPass, shadow );
+    CHECK( clear != nullptr );
+    if ( clear != nullptr )
+    {
+        CHECK( clear->src.layout == VK_IMAGE_LAYOUT_UNDEFINED );
+        CHECK( clear->src.stageMask == 0 );
+        CHECK( clear->dst.layout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL );
+        CHECK( clear->srcPass == -1 );
+        CHECK( !clear->split );
+    }
+
+    // The culled pass does not separate the scene pass from the shadow pass, so the barrier is
+    // not split.
+    CHECK( graph.passes[scenePass].numBarriers == 2 );
+    const GpuRenderGraphBarrier* sample = FindBarrier( &graph, scenePass, shadow );
+    CHECK( sample != nullptr );
+    if ( sample != nullptr )
+    {
+        CHECK( sample->src.layout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL );
+        CHECK( sample->src.stageMask == ( VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                                          VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT ) );
+        CHECK( sample->src.accessMask == VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT );
+        CHECK( sample->dst.layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL );
+        CHECK( sample->dst.stageMask == VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT );
+        CHECK( sample->dst.accessMask == VK_ACCESS_SHADER_READ_BIT );
+        CHECK( sample->srcPass == shadowPass );
+        CHECK( !sample->split );
+    }
+    CHECK( graph.passes[shadowPass].signalStages == 0 );
+
+    // The output is transitioned for presentation after the graph.
+    CHECK( graph.numFinalBarriers == 1 );
+    if ( graph.numFinalBarriers == 1 )
+    {
+        const GpuRenderGraphBarrier* present = &graph.finalBarriers[0];
+        CHECK( present->resource == color );
+        CHECK( present->src.layout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL );
+        CHECK( present->src.stageMask == VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT );
+        CHECK( present->src.accessMask == VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT );
+        CHECK( present->dst.layout == VK_IMAGE_LAYOUT_PRESENT_SRC_KHR );
+    }
+    CHECK( graph.resources[color].finalState.layout == VK_IMAGE_LAYOUT_PRESENT_SRC_KHR );
+}
+
+// A buffer written by compute and read as vertices two passes later, with an independent pass
+// in between that can overlap with the compute pass.
+static void TestSplitBarrier()
+{
+    static GpuRenderGraph graph( nullptr );
+    graph.Reset();
+
+    const int particles = graph.ImportBuffer( "particles", nullptr, GPU_RENDER_GRAPH_ACCESS_NONE );
+    const int sky       = graph.ImportTexture( "sky", nullptr, GPU_RENDER_GRAPH_ACCESS_NONE );
+    const int color     = graph.ImportTexture( "color", nullptr, GPU_RENDER_GRAPH_ACCESS_NONE );
+
+    const int simulatePass = graph.AddPass( "simulate", nullptr, nullptr );
+    graph.AddAccess( simulatePass, particles, GPU_RENDER_GRAPH_ACCESS_STORAGE_WRITE_COMPUTE );
+    const int skyPass = graph.AddPass( "sky", nullptr, nullptr );
+    graph.AddAccess( skyPass, sky, GPU_RENDER_GRAPH_ACCESS_STORAGE_WRITE_COMPUTE );
+    const int drawPass = graph.AddPass( "draw", nullptr, nullptr );
+    graph.AddAccess( drawPass, particles, GPU_RENDER_GRAPH_ACCESS_VERTEX_READ );
+    graph.AddAccess( drawPass, color, GPU_RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT );
+    graph.MarkOutput( sky, GPU_RENDER_GRAPH_ACCESS_SAMPLED_FRAGMENT );
+    graph.MarkOutput( color, GPU_RENDER_GRAPH_ACCESS_NONE );
+    graph.Compile();
+
+    CHECK( !graph.passes[simulatePass].culled );
+    CHECK( !graph.passes[skyPass].culled );
+    CHECK( !graph.passes[drawPass].culled );
+
+    const GpuRenderGraphBarrier* vertices = FindBarrier( &graph, drawPass, particles );
+    CHECK( vertices != nullptr );
+    if ( vertices != nullptr )
+    {
+        // Buffers have no layout.
+        CHECK( vertices->src.layout == VK_IMAGE_LAYOUT_UNDEFINED );
+        CHECK( vertices->dst.layout == VK_IMAGE_LAYOUT_UNDEFINED );
+        CHECK( vertices->src.stageMask == VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT );
+        CHECK( vertices->src.accessMask == VK_ACCESS_SHADER_WRITE_BIT );
+        CHECK( vertices->dst.stageMask == VK_PIPELINE_STAGE_VERTEX_INPUT_BIT );
+        CHECK( vertices->srcPass == simulatePass );
+        CHECK( vertices->split );
+    }
+    CHECK( graph.passes[simulatePass].signalStages == VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT );
+    CHECK( graph.passes[skyPass].signalStages == 0 );
+    CHECK( graph.passes[drawPass].signalStages == 0 );
+
+    // Only the sky has an output access, the color buffer is left as the draw pass leaves it.
+    CHECK( graph.numFinalBarriers == 1 );
+    if ( graph.numFinalBarriers == 1 )
+    {
+        CHECK( graph.finalBarriers[0].resource == sky );
+        CHECK( graph.finalBarriers[0].src.layout == VK_IMAGE_LAYOUT_GENERAL );
+        CHECK( graph.finalBarriers[0].dst.layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL );
+    }
+    CHECK( graph.resources[color].finalState.layout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL );
+}
+
+// Reads that follow reads in the same layout need no barrier, also in other stages.
+static void TestReadAfterRead()
+{
+    static GpuRenderGraph graph( nullptr );
+    graph.Reset();
+
+    const int lut =
+        graph.ImportTexture( "lut", nullptr, GPU_RENDER_GRAPH_ACCESS_SAMPLED_FRAGMENT );
+    const int color = graph.ImportTexture( "color", nullptr, GPU_RENDER_GRAPH_ACCESS_NONE );
+    const int bloom = graph.ImportTexture( "bloom", nullptr, GPU_RENDER_GRAPH_ACCESS_NONE );
+
+    const int bloomPass = graph.AddPass( "bloom", nullptr, nullptr );
+    graph.AddAccess( bloomPass, lut, GPU_RENDER_GRAPH_ACCESS_SAMPLED_COMPUTE );
+    graph.AddAccess( bloomPass, bloom, GPU_RENDER_GRAPH_ACCESS_STORAGE_WRITE_COMPUTE );
+    const int tonemapPass = graph.AddPass( "tonemap", nullptr, nullptr );
+    graph.AddAccess( tonemapPass, lut, GPU_RENDER_GRAPH_ACCESS_SAMPLED_FRAGMENT );
+    graph.AddAccess( tonemapPass, bloom, GPU_RENDER_GRAPH_ACCESS_SAMPLED_FRAGMENT );
+    graph.AddAccess( tonemapPass, color, GPU_RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT );
+    graph.MarkOutput( color, GPU_RENDER_GRAPH_ACCESS_PRESENT );
+    graph.MarkOutput( bloom, GPU_RENDER_GRAPH_ACCESS_NONE );
+    graph.Compile();
+
+    CHECK( FindBarrier( &graph, bloomPass, lut ) == nullptr );
+    CHECK( FindBarrier( &graph, tonemapPass, lut ) == nullptr );
+    CHECK( FindBarrier( &graph, tonemapPass, bloom ) != nullptr );
+    CHECK( graph.resources[lut].finalState.layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL );
+}
+
+// Transient textures with disjoint lifetimes share memory, and the first user of the shared
+// memory waits for the last user of the previous texture.
+static void TestAliasing()
+{
+    static GpuRenderGraph graph( nullptr );
+    graph.Reset();
+
+    const GpuRenderGraphTextureDesc colorDesc = TextureDesc( VK_FORMAT_R16G16B16A16_SFLOAT );
+    const GpuRenderGraphTextureDesc depthDesc = TextureDesc( VK_FORMAT_D32_SFLOAT );
+
+    const int output = graph.ImportTexture( "output", nullptr, GPU_RENDER_GRAPH_ACCESS_NONE );
+    const int a      = graph.CreateTransientTexture( "a", &colorDesc );
+    const int b      = graph.CreateTransientTexture( "b", &colorDesc );
+    const int c      = graph.CreateTransientTexture( "c", &colorDesc );
+    const int depth  = graph.CreateTransientTexture( "depth", &depthDesc );
+
+    const int pass0 = graph.AddPass( "pass0", nullptr, nullptr );
+    graph.AddAccess( pass0, a, GPU_RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT );
+    const int pass1 = graph.AddPass( "pass1", nullptr, nullptr );
+    graph.AddAccess( pass1, a, GPU_RENDER_GRAPH_ACCESS_SAMPLED_FRAGMENT );
+    graph.AddAccess( pass1, b, GPU_RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT );
+    const int pass2 = graph.AddPass( "pass2", nullptr, nullptr );
+    graph.AddAccess( pass2, b, GPU_RENDER_GRAPH_ACCESS_SAMPLED_FRAGMENT );
+    graph.AddAccess( pass2, c, GPU_RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT );
+    graph.AddAccess( pass2, depth, GPU_RENDER_GRAPH_ACCESS_DEPTH_ATTACHMENT );
+    const int pass3 = graph.AddPass( "pass3", nullptr, nullptr );
+    graph.AddAccess( pass3, c, GPU_RENDER_GRAPH_ACCESS_SAMPLED_FRAGMENT );
+    graph.AddAccess( pass3, output, GPU_RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT );
+    graph.MarkOutput( output, GPU_RENDER_GRAPH_ACCESS_PRESENT );
+    graph.Compile();
+
+    CHECK( graph.numAliasGroups == 3 );
+    CHECK( graph.resources[a].aliasGroup == graph.resources[c].aliasGroup );
+    CHECK( graph.resources[a].aliasGroup != graph.resources[b].aliasGroup );
+    CHECK( graph.resources[depth].aliasGroup != graph.resources[a].aliasGroup );
+    CHECK( graph.resources[depth].aliasGroup != graph.resources[b].aliasGroup );
+
+    // 'c' takes over the memory of 'a' after pass1 sampled it, which is a write after read.
+    const GpuRenderGraphBarrier* alias = FindBarrier( &graph, pass2, c );
+    CHECK( alias != nullptr );
+    if ( alias != nullptr )
+    {
+        CHECK( alias->src.layout == VK_IMAGE_LAYOUT_UNDEFINED );
+        CHECK( alias->src.stageMask == VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT );
+        CHECK( alias->src.accessMask == 0 );
+        CHECK( alias->dst.layout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL );
+        CHECK( alias->srcPass == pass1 );
+        CHECK( !alias->split );
+    }
+}
+
+int main( int argc, char* argv[] )
+{
+    RUN_TEST( TestShadowPass );
+    RUN_TEST( TestSplitBarrier );
+    RUN_TEST( TestReadAfterRead );
+    RUN_TEST( TestAliasing );
+    return ( testFailures == 0 ) ? 0 : 1;
+}
@@ -0,0 +1,130 @@
+#include "GpuShaderCache.hpp"
+#include "GpuShaderReflection.hpp"
+#include "Reflection.frag.h"
+#include "Reflection.vert.h"
+#include "TestUtils.hpp"
+
+#include <string.h>
+
+using namespace lxd;
+
+// Reflects the embedded SPIR-V of a vertex and a fragment shader that declare every kind of parm
+// and checks the descriptors, the push constants and the vertex inputs. Runs on the CPU only.
+
+static const GpuShaderBlob reflectionVertexShader = {
+    VK_SHADER_STAGE_VERTEX_BIT, reflectionVertexSpirv, sizeof( reflectionVertexSpirv ),
+    reflectionVertexSpirvHash };
+static const GpuShaderBlob reflectionFragmentShader = {
+    VK_SHADER_STAGE_FRAGMENT_BIT, reflectionFragmentSpirv, sizeof( reflectionFragmentSpirv ),
+    reflectionFragmentSpirvHash };
+
+static const int VERTEX_AND_FRAGMENT =
+    GPU_PROGRAM_STAGE_FLAG_VERTEX | GPU_PROGRAM_STAGE_FLAG_FRAGMENT;
+
+// Release builds strip OpName from the embedded shaders, the parms are then unnamed.
+static bool HasNames( const GpuShaderBlob* shader )
+{
+    const uint32_t numWords = (uint32_t)( shader->codeSize / sizeof( uint32_t ) );
+    for ( uint32_t offset = 5; offset < numWords; offset += shader->code[offset] >> 16 )
+    {
+        if ( ( shader->code[offset] & 0xFFFF ) == 5 ) // OpName
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void CheckParm( const GpuProgramReflection* reflection, const int index,
+                       const GpuProgramParmType type, const int binding, const int stageFlags,
+                       const GpuProgramParmAccess access, const char* name )
+{
+    const GpuProgramParm* parm = &reflection->parms[index];
+    CHECK( parm->type == type );
+    CHECK( parm->binding == binding );
+    CHECK( parm->stageFlags == stageFlags );
+    CHECK( parm->access == access );
+    CHECK( parm->index == index );
+    CHECK( parm->name == reflection->names[index] );
+    if ( HasNames( &reflectionVertexShader ) )
+    {
+        CHECK( strcmp( parm->name, name ) == 0 );
+        CHECK( reflection->FindParm( name ) == index );
+    }
+}
+
+static void TestReflectProgram()
+{
+    const GpuProgramReflection reflection( &reflectionVertexShader, &reflectionFragmentShader );
+
+    // Descriptors by binding, then push constants by offset.
+    CHECK( reflection.numParms == 9 );
+    CheckParm( &reflection, 0, GPU_PROGRAM_PARM_TYPE_BUFFER_UNIFORM, 0,
+               GPU_PROGRAM_STAGE_FLAG_VERTEX, GPU_PROGRAM_PARM_ACCESS_READ_ONLY, "SceneMatrices" );
+    CheckParm( &reflection, 1, GPU_PROGRAM_PARM_TYPE_TEXTURE_SAMPLED, 1,
+               GPU_PROGRAM_STAGE_FLAG_FRAGMENT, GPU_PROGRAM_PARM_ACCESS_READ_ONLY,
+               "albedoTexture" );
+    // An image with Sampled 2 in its OpTypeImage, written only.
+    CheckParm( &reflection, 2, GPU_PROGRAM_PARM_TYPE_TEXTURE_STORAGE, 2,
+               GPU_PROGRAM_STAGE_FLAG_FRAGMENT, GPU_PROGRAM_PARM_ACCESS_WRITE_ONLY,
+               "coverageImage" );
+    CheckParm( &reflection, 3, GPU_PROGRAM_PARM_TYPE_BUFFER_STORAGE, 3,
+               GPU_PROGRAM_STAGE_FLAG_FRAGMENT, GPU_PROGRAM_PARM_ACCESS_READ_ONLY,
+               "MaterialColors" );
+
+    // The fragment shader declares only some members of the block, at the same offsets.
+    CheckParm( &reflection, 4, GPU_PROGRAM_PARM_TYPE_PUSH_CONSTANT_FLOAT_MATRIX4X4, 0,
+               GPU_PROGRAM_STAGE_FLAG_VERTEX, GPU_PROGRAM_PARM_ACCESS_READ_ONLY, "modelMatrix" );
+    CheckParm( &reflection, 5, GPU_PROGRAM_PARM_TYPE_PUSH_CONSTANT_FLOAT_MATRIX2X3, 64,
+               GPU_PROGRAM_STAGE_FLAG_VERTEX, GPU_PROGRAM_PARM_ACCESS_READ_ONLY, "uvTransform" );
+    CheckParm( &reflection, 6, GPU_PROGRAM_PARM_TYPE_PUSH_CONSTANT_FLOAT_VECTOR4, 96,
+               VERTEX_AND_FRAGMENT, GPU_PROGRAM_PARM_ACCESS_READ_ONLY, "tint" );
+    CheckParm( &reflection, 7, GPU_PROGRAM_PARM_TYPE_PUSH_CONSTANT_FLOAT, 112,
+               GPU_PROGRAM_STAGE_FLAG_VERTEX, GPU_PROGRAM_PARM_ACCESS_READ_ONLY, "scale" );
+    CheckParm( &reflection, 8, GPU_PROGRAM_PARM_TYPE_PUSH_CONSTANT_INT, 116,
+               VERTEX_AND_FRAGMENT, GPU_PROGRAM_PARM_ACCESS_READ_ONLY, "layer" );
+
+    // Matrices are typed by columns, then rows: mat2x3 has two columns of three floats, which
+    // std430 pads to four.
+    CHECK( GpuProgramParm::GetMatrixColumns( reflection.parms[4].type ) == 4 );
+    CHECK( GpuProgramParm::GetMatrixColumns( reflection.parms[5].type ) == 2 );
+    CHECK( GpuProgramParm::GetBlockSize( reflection.parms[5].type, false ) == 32 );
+    CHECK( GpuProgramParm::GetPushConstantSize( reflection.parms[4].type ) == 64 );
+    CHECK( GpuProgramParm::GetPushConstantSize( reflection.parms[6].type ) == 16 );
+    CHECK( GpuProgramParm::GetPushConstantSize( reflection.parms[7].type ) == 4 );
+    CHECK( GpuProgramParm::GetPushConstantSize( reflection.parms[8].type ) == 4 );
+
+    // vertexPosition at location 0 and the three columns of vertexTransform.
+    CHECK( reflection.vertexInputMask == 0b1111 );
+
+    CHECK( reflection.FindParm( "unknown" ) == -1 );
+}
+
+static void TestReflectionOrder()
+{
+    // The parms do not depend on the order in which the stages are reflected.
+    const GpuProgramReflection forward( &reflectionVertexShader, &reflectionFragmentShader );
+    const GpuProgramReflection backward( &reflectionFragmentShader, &reflectionVertexShader );
+    CHECK( forward.numParms == backward.numParms );
+    CHECK( forward.vertexInputMask == backward.vertexInputMask );
+    for ( int i = 0; i < forward.numParms && i < backward.numParms; i++ )
+    {
+        CHECK( forward.parms[i].type == backward.parms[i].type );
+        CHECK( forward.parms[i].binding == backward.parms[i].binding );
+        CHECK( forward.parms[i].stageFlags == backward.parms[i].stageFlags );
+        CHECK( forward.parms[i].access == backward.parms[i].access );
+        CHECK( strcmp( forward.names[i], backward.names[i] ) == 0 );
+    }
+
+    // A fragment shader alone has no vertex inputs.
+    const GpuProgramReflection fragment( &reflectionFragmentShader );
+    CHECK( fragment.numParms == 5 );
+    CHECK( fragment.vertexInputMask == 0 );
+}
+
+int main( int argc, char* argv[] )
+{
+    RUN_TEST( TestReflectProgram );
+    RUN_TEST( TestReflectionOrder );
+    return ( testFailures == 0 ) ? 0 : 1;
+}
@@ -0,0 +1,143 @@
+#include "GpuSubmitQueue.hpp"
+#include "GpuTestUtils.hpp"
+#include "nanoseconds.h"
+#include "threading.h"
+
+#include <algorithm>
+#include <atomic>
+
+using namespace lxd;
+
+// Measures how long Submit() blocks the calling thread when several threads submit to the same
+// queue: with the submits serialized by a mutex around GpuTimeline::Submit(), and through the
+// GpuSubmitQueue of the context. The submits have no command buffers, so only the submission
+// itself is measured. Throughput is the number of submits per second until the GPU reached the
+// last value.
+
+static const int MAX_THREADS        = 8;
+static const int SUBMITS_PER_THREAD = 2000;
+
+enum SubmitMode
+{
+    SUBMIT_MODE_MUTEX,
+    SUBMIT_MODE_QUEUE
+};
+
+struct Producer
+{
+    GpuContext*        context;
+    SubmitMode         mode;
+    ksMutex*           mutex;
+    std::atomic<bool>* start;
+    ksNanoseconds      latencies[SUBMITS_PER_THREAD];
+    uint64_t           lastValue;
+};
+
+static void ProducerFunction( void* data )
+{
+    Producer* producer = static_cast<Producer*>( data );
+
+    VkSubmitInfo submitInfo;
+    memset( &submitInfo, 0, sizeof( submitInfo ) );
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+
+    while ( !producer->start->load( std::memory_order_acquire ) )
+    {
+    }
+
+    for ( int i = 0; i < SUBMITS_PER_THREAD; i++ )
+    {
+        const ksNanoseconds begin = GetTimeNanoseconds();
+        if ( producer->mode == SUBMIT_MODE_MUTEX )
+        {
+            ksMutex_Lock( producer->mutex, true );
+            producer->lastValue = producer->context->timeline->Submit( &submitInfo );
+            ksMutex_Unlock( producer->mutex );
+        }
+        else
+        {
+            producer->lastValue = producer->context->submitQueue->Submit( &submitInfo );
+        }
+        producer->latencies[i] = GetTimeNanoseconds() - begin;
+    }
+}
+
+static void Measure( GpuContext* context, const SubmitMode mode, const int numThreads )
+{
+    static Producer   producers[MAX_THREADS];
+    ksThread          threads[MAX_THREADS];
+    ksMutex           mutex;
+    std::atomic<bool> start{ false };
+
+    ksMutex_Create( &mutex );
+    for ( int t = 0; t < numThreads; t++ )
+    {
+        producers[t].context   = context;
+        producers[t].mode      = mode;
+        producers[t].mutex     = &mutex;
+        producers[t].start     = &start;
+        producers[t].lastValue = 0;
+        ksThread_Create( &threads[t], "SubmitProducer", ProducerFunction, &producers[t] );
+        ksThread_Signal( &threads[t] );
+    }
+
+    const ksNanoseconds begin = GetTimeNanoseconds();
+    start.store( true, std::memory_order_release );
+
+    uint64_t lastValue = 0;
+    for ( int t = 0; t < numThreads; t++ )
+    {
+        ksThread_Join( &threads[t] );
+        ksThread_Destroy( &threads[t] );
+        lastValue = std::max( lastValue, producers[t].lastValue );
+    }
+    context->timeline->Wait( lastValue );
+    const ksNanoseconds elapsed = GetTimeNanoseconds() - begin;
+    ksMutex_Destroy( &mutex );
+
+    const int      numSubmits = numThreads * SUBMITS_PER_THREAD;
+    ksNanoseconds* latencies  = (ksNanoseconds*)malloc( numSubmits * sizeof( ksNanoseconds ) );
+    ksNanoseconds  total      = 0;
+    for ( int t = 0; t < numThreads; t++ )
+    {
+        for ( int i = 0; i < SUBMITS_PER_THREAD; i++ )
+        {
+            latencies[t * SUBMITS_PER_THREAD + i] = producers[t].latencies[i];
+            total += producers[t].latencies[i];
+        }
+    }
+    std::sort( latencies, latencies + numSubmits );
+
+    printf( "%-6s %d thread%s: mean %7.2f us, p50 %7.2f us, p99 %7.2f us, max %8.2f us, "
+            "%8.0f submits/s\n",
+            ( mode == SUBMIT_MODE_MUTEX ) ? "mutex" : "queue", numThreads,
+            ( numThreads == 1 ) ? " " : "s", total * 1e-3 / numSubmits,
+            latencies[numSubmits / 2] * 1e-3, latencies[numSubmits * 99 / 100] * 1e-3,
+            latencies[numSubmits - 1] * 1e-3, numSubmits * 1e9 / elapsed );
+
+    free( latencies );
+}
+
+int main( int argc, char* argv[] )
+{
+    TestGpu gpu;
+
+    static const int threadCounts[] = { 1, 2, 4, 8 };
+
+    for ( const int numThreads : threadCounts )
+    {
+        Measure( &gpu.context, SUBMIT_MODE_MUTEX, numThreads );
+    }
+
+    // The submit queue cannot be disabled again, so it is measured last.
+    if ( !gpu.context.EnableSubmitQueue() )
+    {
+        printf( "The device does not support timeline semaphores, no submit queue.\n" );
+        return 0;
+    }
+    for ( const int numThreads : threadCounts )
+    {
+        Measure( &gpu.context, SUBMIT_MODE_QUEUE, numThreads );
+    }
+    return 0;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdio.h>
+
+// The tests print to stdout so the failures show up in the ctest log. Failed checks are counted
+// and main() returns non-zero if there were any.
+static int testFailures = 0;
+
+#define CHECK( condition )                                                                         \
+    do                                                                                             \
+    {                                                                                              \
+        if ( !( condition ) )                                                                      \
+        {                                                                                          \
+            printf( "%s(%d): check failed: %s\n", __FILE__, __LINE__, #condition );                \
+            testFailures++;                                                                        \
+        }                                                                                          \
+    } while ( 0 )
+
+#define RUN_TEST( test )                                                                           \
+    do                                                                                             \
+    {                                                                                              \
+        const int failuresBefore = testFailures;                                                   \
+        test();                                                                                    \
+        printf( "%s %s\n", ( testFailures == failuresBefore ) ? "PASS" : "FAIL", #test );          \
+    } while ( 0 )
@@ -0,0 +1,26 @@
+#version 450
+
+layout( location = 0 ) in vec3 fragmentUv;
+layout( location = 1 ) in vec4 fragmentTint;
+
+layout( binding = 1 ) uniform sampler2D albedoTexture;
+layout( binding = 2, rgba8 ) uniform writeonly image2D coverageImage;
+layout( std430, binding = 3 ) readonly buffer MaterialColors
+{
+	vec4 colors[];
+} materials;
+
+layout( push_constant ) uniform PushConstants
+{
+	layout( offset = 96 ) vec4 tint;
+	layout( offset = 116 ) int layer;
+} pc;
+
+layout( location = 0 ) out vec4 outColor;
+
+void main()
+{
+	const vec4 color = texture( albedoTexture, fragmentUv.xy ) * materials.colors[pc.layer];
+	imageStore( coverageImage, ivec2( gl_FragCoord.xy ), vec4( 1.0 ) );
+	outColor = color * pc.tint * fragmentTint;
+}
@@ -0,0 +1,30 @@
+#version 450
+
+layout( location = 0 ) in vec3 vertexPosition;
+layout( location = 1 ) in mat3 vertexTransform;
+
+layout( std140, binding = 0 ) uniform SceneMatrices
+{
+	mat4 viewMatrix;
+	mat4 projectionMatrix;
+} scene;
+
+layout( push_constant ) uniform PushConstants
+{
+	layout( offset = 0 ) mat4 modelMatrix;
+	layout( offset = 64 ) mat2x3 uvTransform;
+	layout( offset = 96 ) vec4 tint;
+	layout( offset = 112 ) float scale;
+	layout( offset = 116 ) int layer;
+} pc;
+
+layout( location = 0 ) out vec3 fragmentUv;
+layout( location = 1 ) out vec4 fragmentTint;
+
+void main()
+{
+	const vec3 position = vertexTransform * vertexPosition * pc.scale;
+	gl_Position = scene.projectionMatrix * scene.viewMatrix * pc.modelMatrix * vec4( position, 1.0 );
+	fragmentUv = pc.uvTransform * vertexPosition.xy;
+	fragmentTint = pc.tint * float( pc.layer );
+}
@@ -0,0 +1,8 @@
+#version 450
+
+layout( location = 0 ) in vec3 vertexPosition;
+
+void main()
+{
+	gl_Position = vec4( vertexPosition, 1.0 );
+}